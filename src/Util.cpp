@@ -25,7 +25,10 @@
 #include <QTextStream>
 #include <QRegExp>
 
+#include <cstring>
+
 #include "Pie.h"
+#include "WZMBinary.h"
 #include "wmit.h"
 
 bool isValidWzName(const std::string name)
@@ -73,6 +76,7 @@ std::string makeWzTCMaskName(const std::string& name)
 }
 
 inline QString getWZMTextureName(const QString& filePath);
+inline QString getWZMBTextureName(const QString& filePath);
 inline QString getPIETextureName(const QString& filePath);
 //inline QString getOBJTextureName(const QString& filePath); // OBJ uses material files which contain the texture info
 QString getTextureName(const QString& filePath)
@@ -86,6 +90,10 @@ QString getTextureName(const QString& filePath)
 	{
 		return getWZMTextureName(modelFileNfo.absoluteFilePath());
 	}
+	else if (modelFileNfo.completeSuffix().compare(QString("wzmb"), Qt::CaseInsensitive) == 0)
+	{
+		return getWZMBTextureName(modelFileNfo.absoluteFilePath());
+	}
 	else if(modelFileNfo.completeSuffix().compare(QString("pie"), Qt::CaseInsensitive) == 0)
 	{
 		return getPIETextureName(modelFileNfo.absoluteFilePath());
@@ -134,6 +142,66 @@ inline QString getWZMTextureName(const QString& filePath)
 	return qstr;
 }
 
+// The diffuse texture's name block, straight from the header unless deflated
+inline QString getWZMBTextureName(const QString& filePath)
+{
+	QFile f(filePath);
+	if (!f.open(QFile::ReadOnly))
+	{
+		return QString();
+	}
+
+	QByteArray data = f.read(sizeof(WZMBHeader));
+	const bool deflated = isDeflatedWZMB(data.constData(), data.size());
+	if (deflated)
+	{
+		data += f.readAll();
+		data = inflateWZMB(data.constData(), data.size());
+	}
+
+	WZMBHeader header;
+	if (!isWZMB(data.constData(), data.size()) || static_cast<size_t>(data.size()) < sizeof(header))
+	{
+		return QString();
+	}
+	std::memcpy(&header, data.constData(), sizeof(header));
+
+	const WZMBBlock& name = header.textures[WZM_TEX_DIFFUSE];
+	if (name.size > 255)
+	{
+		return QString();
+	}
+	if (deflated)
+	{
+		if (name.offset + name.size > static_cast<uint64_t>(data.size()))
+			return QString();
+		return QString::fromLatin1(data.constData() + name.offset, static_cast<int>(name.size));
+	}
+	if (!f.seek(name.offset))
+	{
+		return QString();
+	}
+	return QString::fromLatin1(f.read(name.size));
+}
+
+QByteArray deflateWZMB(const std::string& wzmb)
+{
+	return QByteArray(WZMB_DEFLATED_SIGNATURE)
+		+ qCompress(reinterpret_cast<const uchar*>(wzmb.data()), static_cast<int>(wzmb.size()));
+}
+
+bool isDeflatedWZMB(const char* data, size_t size)
+{
+	return size >= 4 && std::memcmp(data, WZMB_DEFLATED_SIGNATURE, 4) == 0;
+}
+
+QByteArray inflateWZMB(const char* data, size_t size)
+{
+	if (!isDeflatedWZMB(data, size))
+		return QByteArray();
+	return qUncompress(reinterpret_cast<const uchar*>(data + 4), static_cast<int>(size - 4));
+}
+
 inline QString getPIETextureName(const QString& filePath)
 {
 	QFile f(filePath);
@@ -21,11 +21,17 @@
 #define UTIL_HPP
 #include <string>
 #include <QString>
+#include <QByteArray>
 
 bool isValidWzName(const std::string name);
 std::string makeWzTCMaskName(const std::string& name);
 
 QString getTextureName(const QString& filePath);
 
+// Whole .wzmb files deflated with qCompress, behind WZMB_DEFLATED_SIGNATURE
+QByteArray deflateWZMB(const std::string& wzmb);
+bool isDeflatedWZMB(const char* data, size_t size);
+QByteArray inflateWZMB(const char* data, size_t size); // empty if corrupt
+
 
 #endif // UTIL_HPP
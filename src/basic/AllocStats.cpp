@@ -0,0 +1,109 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "AllocStats.h"
+
+#ifdef WMIT_ALLOC_STATS
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+	std::atomic<size_t> g_allocations(0), g_frees(0), g_bytes(0);
+
+	void* countedAlloc(size_t size)
+	{
+		void* ptr = std::malloc(size ? size : 1);
+		if (ptr)
+		{
+			g_allocations.fetch_add(1, std::memory_order_relaxed);
+			g_bytes.fetch_add(size, std::memory_order_relaxed);
+		}
+		return ptr;
+	}
+
+	void countedFree(void* ptr)
+	{
+		if (ptr)
+		{
+			g_frees.fetch_add(1, std::memory_order_relaxed);
+			std::free(ptr);
+		}
+	}
+
+	void* throwingAlloc(size_t size)
+	{
+		void* ptr;
+		while (!(ptr = countedAlloc(size)))
+		{
+			std::new_handler handler = std::get_new_handler();
+			if (!handler)
+				throw std::bad_alloc();
+			handler();
+		}
+		return ptr;
+	}
+}
+
+void* operator new(size_t size) {return throwingAlloc(size);}
+void* operator new[](size_t size) {return throwingAlloc(size);}
+void* operator new(size_t size, const std::nothrow_t&) noexcept {return countedAlloc(size);}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {return countedAlloc(size);}
+void operator delete(void* ptr) noexcept {countedFree(ptr);}
+void operator delete[](void* ptr) noexcept {countedFree(ptr);}
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {countedFree(ptr);}
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {countedFree(ptr);}
+
+AllocStats allocStats()
+{
+	AllocStats stats;
+	stats.allocations = g_allocations.load(std::memory_order_relaxed);
+	stats.frees = g_frees.load(std::memory_order_relaxed);
+	stats.bytes = g_bytes.load(std::memory_order_relaxed);
+	return stats;
+}
+
+bool allocStatsEnabled()
+{
+	return true;
+}
+
+#else
+
+AllocStats allocStats()
+{
+	return AllocStats();
+}
+
+bool allocStatsEnabled()
+{
+	return false;
+}
+
+#endif // WMIT_ALLOC_STATS
+
+AllocStats AllocStats::operator - (const AllocStats& rhs) const
+{
+	AllocStats diff;
+	diff.allocations = allocations - rhs.allocations;
+	diff.frees = frees - rhs.frees;
+	diff.bytes = bytes - rhs.bytes;
+	return diff;
+}
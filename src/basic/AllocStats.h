@@ -0,0 +1,45 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef ALLOCSTATS_HPP
+#define ALLOCSTATS_HPP
+
+#include <cstddef>
+
+/*
+  Heap use counted by the global operator new, for checking that a step
+  doesn't copy whole models. Counting is compiled in with WMIT_ALLOC_STATS
+  only, otherwise all counts stay 0.
+  */
+struct AllocStats
+{
+	AllocStats(): allocations(0), frees(0), bytes(0) {}
+
+	size_t allocations;
+	size_t frees;
+	size_t bytes; // requested by all allocations, frees don't subtract
+
+	AllocStats operator - (const AllocStats& rhs) const;
+};
+
+/// Totals since program start
+AllocStats allocStats();
+/// False when the counting operator new wasn't compiled in
+bool allocStatsEnabled();
+
+#endif // ALLOCSTATS_HPP
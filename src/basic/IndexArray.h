@@ -0,0 +1,196 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef INDEXARRAY_HPP
+#define INDEXARRAY_HPP
+
+#include <cstring>
+#include <vector>
+#include <limits>
+
+#include <GL/glew.h>
+
+#include "Polygon.h"
+
+/*
+  Triangle index storage, kept as 16-bit indices while they all fit
+  and widened to 32-bit ones once a larger index shows up.
+  */
+class IndexArray
+{
+public:
+	IndexArray(): m_wide(false) {}
+
+	/// Number of triangles
+	size_t size() const
+	{
+		return (m_wide ? m_long.size() : m_short.size()) / 3;
+	}
+	bool empty() const
+	{
+		return size() == 0;
+	}
+
+	void clear()
+	{
+		m_short.clear();
+		m_long.clear();
+		m_wide = false;
+	}
+
+	void reserve(size_t tris)
+	{
+		if (m_wide)
+			m_long.reserve(tris * 3);
+		else
+			m_short.reserve(tris * 3);
+	}
+
+	void push_back(const IndexedTri& tri)
+	{
+		if (!m_wide && !fitsShort(tri))
+			widen();
+
+		if (m_wide)
+		{
+			m_long.push_back(tri.a());
+			m_long.push_back(tri.b());
+			m_long.push_back(tri.c());
+		}
+		else
+		{
+			m_short.push_back(static_cast<GLushort>(tri.a()));
+			m_short.push_back(static_cast<GLushort>(tri.b()));
+			m_short.push_back(static_cast<GLushort>(tri.c()));
+		}
+	}
+
+	IndexedTri operator [](size_t n) const
+	{
+		IndexedTri tri;
+		if (m_wide)
+		{
+			tri.a() = m_long[n * 3];
+			tri.b() = m_long[n * 3 + 1];
+			tri.c() = m_long[n * 3 + 2];
+		}
+		else
+		{
+			tri.a() = m_short[n * 3];
+			tri.b() = m_short[n * 3 + 1];
+			tri.c() = m_short[n * 3 + 2];
+		}
+		return tri;
+	}
+
+	void set(size_t n, const IndexedTri& tri)
+	{
+		if (!m_wide && !fitsShort(tri))
+			widen();
+
+		if (m_wide)
+		{
+			m_long[n * 3] = tri.a();
+			m_long[n * 3 + 1] = tri.b();
+			m_long[n * 3 + 2] = tri.c();
+		}
+		else
+		{
+			m_short[n * 3] = static_cast<GLushort>(tri.a());
+			m_short[n * 3 + 1] = static_cast<GLushort>(tri.b());
+			m_short[n * 3 + 2] = static_cast<GLushort>(tri.c());
+		}
+	}
+
+	/// Flat copy of all indices
+	std::vector<GLuint> toVector() const
+	{
+		if (m_wide)
+			return m_long;
+		return std::vector<GLuint>(m_short.begin(), m_short.end());
+	}
+
+	void assign(const std::vector<GLuint>& indices)
+	{
+		IndexedTri tri;
+
+		clear();
+		reserve(indices.size() / 3);
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			tri.a() = indices[i];
+			tri.b() = indices[i + 1];
+			tri.c() = indices[i + 2];
+			push_back(tri);
+		}
+	}
+
+	/// Copies tris triangles of 16-bit or, if wide, 32-bit indices as they are
+	void assign(const void* indices, size_t tris, bool wide)
+	{
+		clear();
+		m_wide = wide;
+		if (wide)
+		{
+			m_long.resize(tris * 3);
+			std::memcpy(m_long.data(), indices, tris * 3 * sizeof(GLuint));
+		}
+		else
+		{
+			m_short.resize(tris * 3);
+			std::memcpy(m_short.data(), indices, tris * 3 * sizeof(GLushort));
+		}
+	}
+
+	bool isWide() const
+	{
+		return m_wide;
+	}
+
+	/// Index type and data for glDrawElements
+	GLenum glType() const
+	{
+		return m_wide ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+	}
+	const void* data() const
+	{
+		return m_wide ? static_cast<const void*>(m_long.data()) : static_cast<const void*>(m_short.data());
+	}
+
+private:
+	static bool fitsShort(const IndexedTri& tri)
+	{
+		const GLuint maxShort = std::numeric_limits<GLushort>::max();
+		return tri.a() <= maxShort && tri.b() <= maxShort && tri.c() <= maxShort;
+	}
+
+	void widen()
+	{
+		m_long.reserve(m_short.capacity());
+		m_long.assign(m_short.begin(), m_short.end());
+		m_short.clear();
+		m_short.shrink_to_fit();
+		m_wide = true;
+	}
+
+	std::vector<GLushort> m_short;
+	std::vector<GLuint> m_long;
+	bool m_wide;
+};
+
+#endif // INDEXARRAY_HPP
@@ -0,0 +1,399 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Json.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "TextScanner.h"
+#include "TextWriter.h"
+
+// Nesting deeper than this is no glTF, and would only eat the stack
+static const unsigned JSON_MAX_DEPTH = 64;
+
+class JsonParser
+{
+public:
+	JsonParser(const char* data, size_t size): m_pos(data), m_end(data + size) {}
+
+	bool document(JsonValue& value)
+	{
+		if (!parse(value, 0))
+			return false;
+		skipSpace();
+		return m_pos == m_end;
+	}
+
+private:
+	const char* m_pos;
+	const char* m_end;
+
+	void skipSpace()
+	{
+		while (m_pos != m_end && (*m_pos == ' ' || *m_pos == '\t' || *m_pos == '\n' || *m_pos == '\r'))
+			++m_pos;
+	}
+
+	bool skip(char c)
+	{
+		skipSpace();
+		if (m_pos == m_end || *m_pos != c)
+			return false;
+		++m_pos;
+		return true;
+	}
+
+	bool literal(const char* text)
+	{
+		const size_t size = std::strlen(text);
+		if (static_cast<size_t>(m_end - m_pos) < size || std::memcmp(m_pos, text, size) != 0)
+			return false;
+		m_pos += size;
+		return true;
+	}
+
+	bool parse(JsonValue& value, unsigned depth)
+	{
+		skipSpace();
+		if (m_pos == m_end || depth > JSON_MAX_DEPTH)
+			return false;
+
+		switch (*m_pos)
+		{
+		case '{':
+			++m_pos;
+			value.m_type = JsonValue::JSON_OBJECT;
+			if (skip('}'))
+				return true;
+			do
+			{
+				std::string key;
+				skipSpace();
+				if (!string(key) || !skip(':'))
+					return false;
+				value.m_keys.push_back(key);
+				value.m_items.push_back(JsonValue());
+				if (!parse(value.m_items.back(), depth + 1))
+					return false;
+			} while (skip(','));
+			return skip('}');
+		case '[':
+			++m_pos;
+			value.m_type = JsonValue::JSON_ARRAY;
+			if (skip(']'))
+				return true;
+			do
+			{
+				value.m_items.push_back(JsonValue());
+				if (!parse(value.m_items.back(), depth + 1))
+					return false;
+			} while (skip(','));
+			return skip(']');
+		case '"':
+			value.m_type = JsonValue::JSON_STRING;
+			return string(value.m_string);
+		case 't':
+			value = JsonValue::fromBool(true);
+			return literal("true");
+		case 'f':
+			value = JsonValue::fromBool(false);
+			return literal("false");
+		case 'n':
+			return literal("null");
+		default:
+			return number(value);
+		}
+	}
+
+	// Integers exactly, byte offsets may not fit a float
+	bool number(JsonValue& value)
+	{
+		const char* begin = m_pos;
+		bool integral = true;
+
+		while (m_pos != m_end && *m_pos && std::strchr("+-0123456789.eE", *m_pos))
+		{
+			if (*m_pos == '.' || *m_pos == 'e' || *m_pos == 'E')
+				integral = false;
+			++m_pos;
+		}
+
+		TextScanner in(begin, m_pos);
+		value.m_type = JsonValue::JSON_NUMBER;
+		if (integral)
+		{
+			long long integer;
+			if (!in.read(integer))
+				return false;
+			value.m_number = static_cast<double>(integer);
+		}
+		else
+		{
+			float real;
+			if (!in.read(real))
+				return false;
+			value.m_number = real;
+		}
+		return in.position() == m_pos && m_pos != begin;
+	}
+
+	static void appendUtf8(std::string& str, unsigned long code)
+	{
+		if (code < 0x80)
+			str += static_cast<char>(code);
+		else if (code < 0x800)
+		{
+			str += static_cast<char>(0xc0 | (code >> 6));
+			str += static_cast<char>(0x80 | (code & 0x3f));
+		}
+		else if (code < 0x10000)
+		{
+			str += static_cast<char>(0xe0 | (code >> 12));
+			str += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+			str += static_cast<char>(0x80 | (code & 0x3f));
+		}
+		else
+		{
+			str += static_cast<char>(0xf0 | (code >> 18));
+			str += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+			str += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+			str += static_cast<char>(0x80 | (code & 0x3f));
+		}
+	}
+
+	bool hex4(unsigned long& code)
+	{
+		if (m_end - m_pos < 4)
+			return false;
+
+		code = 0;
+		for (const char* end = m_pos + 4; m_pos != end; ++m_pos)
+		{
+			const char c = *m_pos;
+			const int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10
+					: c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+			if (digit < 0)
+				return false;
+			code = code * 16 + static_cast<unsigned long>(digit);
+		}
+		return true;
+	}
+
+	bool string(std::string& str)
+	{
+		if (m_pos == m_end || *m_pos != '"')
+			return false;
+		++m_pos;
+
+		for (;;)
+		{
+			// plain runs in one go
+			const char* run = m_pos;
+			while (m_pos != m_end && *m_pos != '"' && *m_pos != '\\')
+				++m_pos;
+			str.append(run, m_pos);
+
+			if (m_pos == m_end)
+				return false;
+			if (*m_pos++ == '"')
+				return true;
+			if (m_pos == m_end)
+				return false;
+
+			const char escape = *m_pos++;
+			switch (escape)
+			{
+			case '"': case '\\': case '/':
+				str += escape;
+				break;
+			case 'b': str += '\b'; break;
+			case 'f': str += '\f'; break;
+			case 'n': str += '\n'; break;
+			case 'r': str += '\r'; break;
+			case 't': str += '\t'; break;
+			case 'u':
+			{
+				unsigned long code, low;
+				if (!hex4(code))
+					return false;
+				// surrogate pairs make one code point
+				if (code >= 0xd800 && code < 0xdc00 && literal("\\u"))
+				{
+					if (!hex4(low) || low < 0xdc00 || low >= 0xe000)
+						return false;
+					code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+				}
+				appendUtf8(str, code);
+				break;
+			}
+			default:
+				return false;
+			}
+		}
+	}
+};
+
+JsonValue JsonValue::fromBool(bool value)
+{
+	JsonValue result;
+	result.m_type = JSON_BOOL;
+	result.m_number = value ? 1. : 0.;
+	return result;
+}
+
+JsonValue JsonValue::array()
+{
+	JsonValue result;
+	result.m_type = JSON_ARRAY;
+	return result;
+}
+
+JsonValue JsonValue::object()
+{
+	JsonValue result;
+	result.m_type = JSON_OBJECT;
+	return result;
+}
+
+const JsonValue& JsonValue::nullValue()
+{
+	static const JsonValue null;
+	return null;
+}
+
+const JsonValue& JsonValue::operator [](size_t index) const
+{
+	return index < m_items.size() ? m_items[index] : nullValue();
+}
+
+const JsonValue& JsonValue::operator [](const std::string& key) const
+{
+	for (size_t i = 0; i < m_keys.size(); ++i)
+	{
+		if (m_keys[i] == key)
+			return m_items[i];
+	}
+	return nullValue();
+}
+
+JsonValue& JsonValue::append(const JsonValue& value)
+{
+	m_type = JSON_ARRAY;
+	m_items.push_back(value);
+	return m_items.back();
+}
+
+JsonValue& JsonValue::set(const std::string& key, const JsonValue& value)
+{
+	JsonValue& result = member(key);
+	result = value;
+	return result;
+}
+
+JsonValue& JsonValue::member(const std::string& key, const JsonValue& value)
+{
+	m_type = JSON_OBJECT;
+	for (size_t i = 0; i < m_keys.size(); ++i)
+	{
+		if (m_keys[i] == key)
+			return m_items[i];
+	}
+	m_keys.push_back(key);
+	m_items.push_back(value);
+	return m_items.back();
+}
+
+bool JsonValue::parse(const char* data, size_t size)
+{
+	*this = JsonValue();
+	if (!JsonParser(data, size).document(*this))
+	{
+		*this = JsonValue();
+		return false;
+	}
+	return true;
+}
+
+void JsonValue::writeString(TextWriter& out, const std::string& str)
+{
+	out << '"';
+	for (char c: str)
+	{
+		if (c == '"' || c == '\\')
+			out << '\\' << c;
+		else if (static_cast<unsigned char>(c) < 0x20)
+		{
+			out << "\\u00";
+			if (static_cast<unsigned char>(c) < 0x10)
+				out << '0';
+			out.writeHex(static_cast<unsigned char>(c));
+		}
+		else
+			out << c;
+	}
+	out << '"';
+}
+
+void JsonValue::write(TextWriter& out) const
+{
+	switch (m_type)
+	{
+	case JSON_NULL:
+		out << "null";
+		break;
+	case JSON_BOOL:
+		out << (m_number != 0. ? "true" : "false");
+		break;
+	case JSON_NUMBER:
+		// JSON has no infinities or NaN
+		if (!std::isfinite(m_number))
+			out << "null";
+		else if (m_number == std::floor(m_number) && std::fabs(m_number) < 9e15)
+			out << static_cast<long long>(m_number);
+		else
+			out << static_cast<float>(m_number);
+		break;
+	case JSON_STRING:
+		writeString(out, m_string);
+		break;
+	case JSON_ARRAY:
+		out << '[';
+		for (size_t i = 0; i < m_items.size(); ++i)
+		{
+			if (i)
+				out << ',';
+			m_items[i].write(out);
+		}
+		out << ']';
+		break;
+	case JSON_OBJECT:
+		out << '{';
+		for (size_t i = 0; i < m_items.size(); ++i)
+		{
+			if (i)
+				out << ',';
+			writeString(out, m_keys[i]);
+			out << ':';
+			m_items[i].write(out);
+		}
+		out << '}';
+		break;
+	}
+}
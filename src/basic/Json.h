@@ -0,0 +1,99 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef JSON_HPP
+#define JSON_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class TextWriter;
+
+/*
+  Just enough JSON for glTF: a value tree that parses a document in memory
+  and writes one out. Objects keep their members in order and look keys
+  up linearly, they hold a handful each.
+
+  Numbers are doubles. Integral ones are written as integers, others with
+  the shortest digits of their float, which is all glTF stores.
+  */
+class JsonValue
+{
+public:
+	enum Type {JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT};
+
+	JsonValue(): m_type(JSON_NULL), m_number(0.) {}
+	JsonValue(double number): m_type(JSON_NUMBER), m_number(number) {}
+	JsonValue(int number): m_type(JSON_NUMBER), m_number(number) {}
+	JsonValue(unsigned number): m_type(JSON_NUMBER), m_number(number) {}
+	JsonValue(size_t number): m_type(JSON_NUMBER), m_number(static_cast<double>(number)) {}
+	JsonValue(const std::string& str): m_type(JSON_STRING), m_number(0.), m_string(str) {}
+	JsonValue(const char* str): m_type(JSON_STRING), m_number(0.), m_string(str) {}
+
+	static JsonValue fromBool(bool value);
+	static JsonValue array();
+	static JsonValue object();
+
+	Type type() const {return m_type;}
+	bool isNull() const {return m_type == JSON_NULL;}
+	bool isNumber() const {return m_type == JSON_NUMBER;}
+	bool isString() const {return m_type == JSON_STRING;}
+	bool isArray() const {return m_type == JSON_ARRAY;}
+	bool isObject() const {return m_type == JSON_OBJECT;}
+
+	/// The value, or fallback for other types
+	double number(double fallback = 0.) const {return m_type == JSON_NUMBER ? m_number : fallback;}
+	bool boolean(bool fallback) const {return m_type == JSON_BOOL ? m_number != 0. : fallback;}
+	const std::string& string() const {return m_string;} // empty unless a string
+
+	/// Array elements or object members
+	size_t size() const {return m_items.size();}
+	/// Element or member value by position, a null value past the end
+	const JsonValue& operator [](size_t index) const;
+	/// Member by key, a null value if missing or not an object
+	const JsonValue& operator [](const std::string& key) const;
+	bool has(const std::string& key) const {return !(*this)[key].isNull();}
+	/// Object member keys in order
+	const std::string& key(size_t index) const {return m_keys[index];}
+
+	/// Appends to an array and returns the new element
+	JsonValue& append(const JsonValue& value);
+	/// Sets an object member, appended if new, and returns it
+	JsonValue& set(const std::string& key, const JsonValue& value);
+	/// Existing member, or a new one of value
+	JsonValue& member(const std::string& key, const JsonValue& value = JsonValue());
+
+	/// Parses a whole document, which may have surrounding whitespace only
+	bool parse(const char* data, size_t size);
+	void write(TextWriter& out) const;
+
+private:
+	Type m_type;
+	double m_number; // also the bool
+	std::string m_string;
+	std::vector<JsonValue> m_items;
+	std::vector<std::string> m_keys; // objects only, one per item
+
+	static const JsonValue& nullValue();
+	static void writeString(TextWriter& out, const std::string& str);
+
+	friend class JsonParser;
+};
+
+#endif // JSON_HPP
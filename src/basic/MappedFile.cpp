@@ -0,0 +1,134 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MappedFile.h"
+
+#include <fstream>
+#include <iterator>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(): m_data(nullptr), m_size(0), m_open(false), m_mapped(false)
+#ifdef _WIN32
+	, m_mapping(nullptr)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const char* path)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+				  FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+	{
+		m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_mapping)
+		{
+			m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+			if (m_data)
+			{
+				m_size = static_cast<size_t>(size.QuadPart);
+				m_mapped = true;
+			}
+			else
+			{
+				CloseHandle(m_mapping);
+				m_mapping = nullptr;
+			}
+		}
+	}
+	CloseHandle(file);
+#else
+	const int file = ::open(path, O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(file, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+	{
+		void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+		if (view != MAP_FAILED)
+		{
+			m_data = static_cast<const char*>(view);
+			m_size = static_cast<size_t>(info.st_size);
+			m_mapped = true;
+		}
+	}
+	::close(file);
+#endif
+
+	// empty files and whatever can't be mapped
+	if (!m_mapped && !readWhole(path))
+		return false;
+
+	m_open = true;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_mapped)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(m_data);
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+#else
+		munmap(const_cast<char*>(m_data), m_size);
+#endif
+	}
+
+	m_buffer.clear();
+	m_buffer.shrink_to_fit();
+	m_data = nullptr;
+	m_size = 0;
+	m_open = false;
+	m_mapped = false;
+}
+
+bool MappedFile::readWhole(const char* path)
+{
+	std::ifstream in(path, std::ios::in | std::ios::binary);
+	if (!in.is_open())
+		return false;
+
+	m_buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	m_data = m_buffer.data();
+	m_size = m_buffer.size();
+	return true;
+}
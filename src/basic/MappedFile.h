@@ -0,0 +1,59 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <cstddef>
+#include <vector>
+
+/*
+  Read-only view of a whole file, memory mapped where the system allows
+  and read into memory otherwise.
+  */
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const char* path);
+	void close();
+
+	bool isOpen() const {return m_open;}
+	const char* data() const {return m_data;}
+	size_t size() const {return m_size;}
+	const char* end() const {return m_data + m_size;}
+
+private:
+	bool readWhole(const char* path);
+
+	const char* m_data;
+	size_t m_size;
+	bool m_open;
+	bool m_mapped;
+#ifdef _WIN32
+	void* m_mapping;
+#endif
+	std::vector<char> m_buffer;
+};
+
+#endif // MAPPEDFILE_HPP
@@ -0,0 +1,180 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef MATRIX_HPP
+#define MATRIX_HPP
+
+#include <cmath>
+#include <cstddef>
+
+#include "VectorTypes.h"
+
+/*
+  Affine 4x4 matrix acting on column vectors, m[row][col].
+  The bottom row stays 0 0 0 1, so a * b applies b first.
+  */
+template <typename T>
+struct Matrix4
+{
+	T m[4][4];
+
+	Matrix4()
+	{
+		for (size_t row = 0; row < 4; ++row)
+			for (size_t col = 0; col < 4; ++col)
+				m[row][col] = row == col ? 1 : 0;
+	}
+
+	static Matrix4 scaling(T x, T y, T z)
+	{
+		Matrix4 result;
+		result.m[0][0] = x;
+		result.m[1][1] = y;
+		result.m[2][2] = z;
+		return result;
+	}
+
+	static Matrix4 translation(const Vertex<T>& by)
+	{
+		Matrix4 result;
+		for (size_t row = 0; row < 3; ++row)
+			result.m[row][3] = by[row];
+		return result;
+	}
+
+	/// Reflection through the plane crossing point, normal to axis x == 0, y == 1, z == 2
+	static Matrix4 mirroring(const Vertex<T>& point, int axis)
+	{
+		const size_t mirrored = axis == 0 || axis == 1 ? axis : 2;
+		Matrix4 result;
+		result.m[mirrored][mirrored] = -1;
+		result.m[mirrored][3] = 2 * point[mirrored];
+		return result;
+	}
+
+	Matrix4 operator * (const Matrix4& rhs) const
+	{
+		Matrix4 result;
+		for (size_t row = 0; row < 3; ++row)
+		{
+			for (size_t col = 0; col < 4; ++col)
+			{
+				result.m[row][col] = m[row][0] * rhs.m[0][col] + m[row][1] * rhs.m[1][col] + m[row][2] * rhs.m[2][col]
+					+ (col == 3 ? m[row][3] : 0);
+			}
+		}
+		return result;
+	}
+
+	Vertex<T> transformPoint(const Vertex<T>& p) const
+	{
+		return Vertex<T>(rowTimes(0, p, m[0][3]), rowTimes(1, p, m[1][3]), rowTimes(2, p, m[2][3]));
+	}
+
+	/// Upper 3x3 only, no translation
+	Vertex<T> transformDirection(const Vertex<T>& d) const
+	{
+		return Vertex<T>(rowTimes(0, d, 0), rowTimes(1, d, 0), rowTimes(2, d, 0));
+	}
+
+	T determinant() const
+	{
+		return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+			- m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+			+ m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+	}
+
+	/// True when only the translation differs from identity
+	bool isTranslation() const
+	{
+		for (size_t row = 0; row < 3; ++row)
+			for (size_t col = 0; col < 3; ++col)
+				if (m[row][col] != (row == col ? 1 : 0))
+					return false;
+		return true;
+	}
+
+	bool isIdentity() const
+	{
+		return isTranslation() && m[0][3] == 0 && m[1][3] == 0 && m[2][3] == 0;
+	}
+
+	/// Inverse transpose of the upper 3x3 for transforming normals, identity if singular
+	Matrix4 normalMatrix() const
+	{
+		Matrix4 result;
+		const T det = determinant();
+
+		if (det == 0)
+			return result;
+
+		// cofactors are the transposed adjugate
+		for (size_t row = 0; row < 3; ++row)
+		{
+			const size_t r1 = (row + 1) % 3, r2 = (row + 2) % 3;
+			for (size_t col = 0; col < 3; ++col)
+			{
+				const size_t c1 = (col + 1) % 3, c2 = (col + 2) % 3;
+				result.m[row][col] = (m[r1][c1] * m[r2][c2] - m[r1][c2] * m[r2][c1]) / det;
+			}
+		}
+		return result;
+	}
+
+	/*
+	  Scale s when the upper 3x3 is s times a rotation or reflection, 0 otherwise.
+	  Such maps keep angles, so unit directions stay unit length after dividing by s.
+	  */
+	T conformalScale() const
+	{
+		T lengthSq[3];
+
+		for (size_t col = 0; col < 3; ++col)
+		{
+			const size_t next = (col + 1) % 3;
+			if (m[0][col] * m[0][next] + m[1][col] * m[1][next] + m[2][col] * m[2][next] != 0)
+				return 0;
+			lengthSq[col] = m[0][col] * m[0][col] + m[1][col] * m[1][col] + m[2][col] * m[2][col];
+		}
+
+		if (lengthSq[0] != lengthSq[1] || lengthSq[0] != lengthSq[2] || lengthSq[0] == 0)
+			return 0;
+
+		// exact for axis aligned scales and mirrors
+		for (size_t row = 0; row < 3; ++row)
+			if (std::abs(m[row][0]) * std::abs(m[row][0]) == lengthSq[0])
+				return std::abs(m[row][0]);
+		return std::sqrt(lengthSq[0]);
+	}
+
+private:
+	// Zero entries are skipped and -0 is the start value, so scales and mirrors
+	// give exactly what multiplying the components would, signed zeros included
+	T rowTimes(size_t row, const Vertex<T>& v, T add) const
+	{
+		T result = -T(0);
+		for (size_t col = 0; col < 3; ++col)
+			if (m[row][col] != 0)
+				result += m[row][col] * v[col];
+		if (add != 0)
+			result += add;
+		return result;
+	}
+};
+
+#endif // MATRIX_HPP
@@ -0,0 +1,204 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Worker threads parallelFor spreads over, at least 1
+inline unsigned parallelThreads()
+{
+	const unsigned hardware = std::thread::hardware_concurrency();
+	return hardware ? hardware : 1;
+}
+
+/// True on threads running a parallel loop, loops nested in it run inline
+inline bool& insideParallelLoop()
+{
+	static thread_local bool inside = false;
+	return inside;
+}
+
+// Marks this thread as running a parallel loop while in scope
+struct ParallelLoopScope
+{
+	ParallelLoopScope(): m_outer(insideParallelLoop()) {insideParallelLoop() = true;}
+	~ParallelLoopScope() {insideParallelLoop() = m_outer;}
+
+private:
+	bool m_outer;
+};
+
+/*
+  Threads of one parallel loop, all joined when it goes out of scope, so
+  a thread failing to start doesn't leave the started ones running on
+  the loop's state. run() catches what the work throws, on the workers
+  and on the calling thread alike, and join() rethrows the first of it.
+  */
+class ParallelWorkers
+{
+public:
+	explicit ParallelWorkers(size_t threads): m_failed(false) {m_threads.reserve(threads);}
+	~ParallelWorkers() {joinAll();}
+
+	ParallelWorkers(const ParallelWorkers&) = delete;
+	ParallelWorkers& operator=(const ParallelWorkers&) = delete;
+
+	template <typename Work>
+	void start(Work work)
+	{
+		m_threads.push_back(std::thread([this, work]()
+		{
+			run(work);
+		}));
+	}
+
+	template <typename Work>
+	void run(Work work)
+	{
+		try
+		{
+			ParallelLoopScope scope;
+			work();
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_error)
+				m_error = std::current_exception();
+			m_failed = true;
+		}
+	}
+
+	bool failed() const {return m_failed;} // work left may be skipped then
+
+	void join()
+	{
+		joinAll();
+		if (m_error)
+			std::rethrow_exception(m_error);
+	}
+
+private:
+	void joinAll()
+	{
+		for (std::thread& thread: m_threads)
+		{
+			if (thread.joinable())
+				thread.join();
+		}
+		m_threads.clear();
+	}
+
+	std::vector<std::thread> m_threads;
+	std::mutex m_mutex;
+	std::exception_ptr m_error;
+	std::atomic<bool> m_failed;
+};
+
+/*
+  Calls func(chunkBegin, chunkEnd) on contiguous chunks of [begin, end),
+  one per thread, and returns once all are done. Ranges below minChunk
+  items per thread use fewer threads, down to running inline. Loops
+  nested in a parallel one run inline too.
+
+  Chunks must not write to shared state, results then don't depend
+  on the thread count. If chunks throw, the first exception is rethrown
+  once all threads are done.
+  */
+template <typename Func>
+void parallelFor(size_t begin, size_t end, size_t minChunk, Func func)
+{
+	if (end <= begin)
+		return;
+
+	const size_t count = end - begin;
+	const size_t chunks = std::min<size_t>(parallelThreads(), std::max<size_t>(1, count / std::max<size_t>(1, minChunk)));
+
+	if (chunks == 1 || insideParallelLoop())
+	{
+		func(begin, end);
+		return;
+	}
+
+	const size_t chunkSize = (count + chunks - 1) / chunks;
+	ParallelWorkers workers(chunks - 1);
+
+	for (size_t chunkBegin = begin + chunkSize; chunkBegin < end; chunkBegin += chunkSize)
+	{
+		const size_t chunkEnd = std::min(end, chunkBegin + chunkSize);
+		workers.start([&func, chunkBegin, chunkEnd]()
+		{
+			func(chunkBegin, chunkEnd);
+		});
+	}
+
+	// the first chunk on this thread
+	workers.run([&func, begin, end, chunkSize]()
+	{
+		func(begin, std::min(end, begin + chunkSize));
+	});
+
+	workers.join();
+}
+
+/*
+  Calls func(i) for each i in [begin, end), threads take the next
+  item as they finish one. For items of very different cost, which
+  parallelFor would spread unevenly. A single item runs inline and
+  may use parallel loops itself. Once an item throws, no new ones are
+  taken and the first exception is rethrown when all threads are done.
+  */
+template <typename Func>
+void parallelForEach(size_t begin, size_t end, Func func)
+{
+	if (end <= begin)
+		return;
+
+	const size_t threads = std::min<size_t>(parallelThreads(), end - begin);
+
+	if (threads == 1 || insideParallelLoop())
+	{
+		for (size_t i = begin; i < end; ++i)
+			func(i);
+		return;
+	}
+
+	std::atomic<size_t> next(begin);
+	ParallelWorkers workers(threads - 1);
+	auto work = [&func, &next, &workers, end]()
+	{
+		for (size_t i = next++; i < end && !workers.failed(); i = next++)
+			func(i);
+	};
+
+	for (size_t i = 1; i < threads; ++i)
+		workers.start(work);
+
+	workers.run(work);
+	workers.join();
+}
+
+#endif // PARALLEL_HPP
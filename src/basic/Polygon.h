@@ -24,11 +24,13 @@
 #include <GL/glew.h>
 
 #include "Vector.h"
+#include "TextScanner.h"
+#include "TextWriter.h"
 
 
-struct IndexedTri : public Vector<GLushort,3>
+struct IndexedTri : public Vector<GLuint,3>
 {
-	typedef GLushort indexType;
+	typedef GLuint indexType;
 	indexType& a() {
 		return component[0];
 	}
@@ -59,12 +61,13 @@ template<typename U, typename S, size_t MAX>
 class PiePolygon
 {
 	friend class Mesh;
+	friend class MeshTransformView;
 public:
 	PiePolygon();
 	virtual ~PiePolygon(){}
 
-	bool read(std::istream& in);
-	void write(std::ostream& out) const;
+	bool read(TextScanner& in);
+	void write(TextWriter& out) const;
 
 	unsigned getFrames() const;
 	unsigned getIndex(unsigned n) const;
@@ -75,7 +78,7 @@ protected:
 	void clear();
 	static const size_t MAX_VERTICES = MAX;
 	unsigned short m_vertices;
-	short m_indices[MAX];
+	unsigned m_indices[MAX];
 	U m_texCoords[MAX];
 	unsigned long m_flags;
 
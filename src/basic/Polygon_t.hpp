@@ -41,13 +41,13 @@ PiePolygon<U, S, MAX>::PiePolygon():
 }
 
 template<typename U, typename S, size_t MAX>
-bool PiePolygon<U, S, MAX>::read(std::istream& in)
+bool PiePolygon<U, S, MAX>::read(TextScanner& in)
 {
 	unsigned i;
+	bool ok = true;
 	clear();
 
-	in >> std::hex >> m_flags >> std::dec >> m_vertices;
-	if (in.fail() || m_vertices > MAX)
+	if (!in.readHex(m_flags) || !in.read(m_vertices) || m_vertices > MAX)
 	{
 		clear();
 		return false;
@@ -55,12 +55,12 @@ bool PiePolygon<U, S, MAX>::read(std::istream& in)
 
 	for (i = 0; i < m_vertices; ++i)
 	{
-		in >> m_indices[i];
+		ok = ok && in.read(m_indices[i]);
 	}
 
 	if (m_flags & 0x4000)
 	{
-		in >> m_frames >> m_playbackRate >>	m_width >> m_height;
+		ok = ok && in.read(m_frames) && in.read(m_playbackRate) && in.read(m_width) && in.read(m_height);
 	}
 	else
 	{
@@ -69,9 +69,11 @@ bool PiePolygon<U, S, MAX>::read(std::istream& in)
 
 	for (i = 0; i < m_vertices; ++i)
 	{
-		in >> m_texCoords[i].u() >> m_texCoords[i].v();
+		ok = ok && in.read(m_texCoords[i]);
 	}
-	if (in.fail() && !in.eof())
+
+	// a cut off last polygon passes, as with streams
+	if (!ok && !in.atEnd())
 	{
 		clear();
 		return false;
@@ -80,11 +82,11 @@ bool PiePolygon<U, S, MAX>::read(std::istream& in)
 }
 
 template<typename U, typename S, size_t MAX>
-void PiePolygon<U, S, MAX>::write(std::ostream& out) const
+void PiePolygon<U, S, MAX>::write(TextWriter& out) const
 {
 	unsigned i;
 
-	out << std::hex << m_flags << std::dec << ' ';
+	out.writeHex(m_flags) << ' ';
 	out << m_vertices << ' ';
 
 	for (i = 0; i < m_vertices; ++i)
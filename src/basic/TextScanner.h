@@ -0,0 +1,303 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TEXTSCANNER_HPP
+#define TEXTSCANNER_HPP
+
+#include <algorithm>
+#include <clocale>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+
+#include "Vector.h"
+
+/*
+  Reads whitespace separated words and numbers from a buffer in memory,
+  such as a MappedFile, the way std::istream's operator>> would but without
+  allocating or seeking. Copies are cheap, copy to look ahead.
+
+  Like a stream it fails for good once a read fails.
+  */
+class TextScanner
+{
+public:
+	TextScanner(const char* begin, const char* end): m_pos(begin), m_end(end), m_fail(false) {}
+
+	const char* position() const {return m_pos;}
+	const char* end() const {return m_end;}
+	bool fail() const {return m_fail;}
+
+	/// Skips whitespace, true if nothing else is left
+	bool atEnd()
+	{
+		skipSpace();
+		return m_pos == m_end;
+	}
+
+	/// Next word, pointing into the buffer
+	bool word(const char*& begin, size_t& size)
+	{
+		skipSpace();
+		begin = m_pos;
+		while (m_pos != m_end && !isSpace(*m_pos))
+			++m_pos;
+		size = static_cast<size_t>(m_pos - begin);
+		return size ? true : setFail();
+	}
+
+	/// Consumes the next word if it equals expected, does not fail otherwise
+	bool skipWord(const char* expected)
+	{
+		if (m_fail)
+			return false;
+
+		skipSpace();
+		const size_t size = std::strlen(expected);
+		if (static_cast<size_t>(m_end - m_pos) < size || std::memcmp(m_pos, expected, size) != 0
+			|| (m_pos + size != m_end && !isSpace(m_pos[size])))
+		{
+			return false;
+		}
+		m_pos += size;
+		return true;
+	}
+
+	bool read(std::string& str)
+	{
+		const char* begin;
+		size_t size;
+
+		if (m_fail || !word(begin, size))
+			return false;
+		str.assign(begin, size);
+		return true;
+	}
+
+	template <typename T>
+	typename std::enable_if<std::is_integral<T>::value, bool>::type read(T& value)
+	{
+		return readInteger(value, 10);
+	}
+
+	/// Integer in hex, with or without 0x
+	template <typename T>
+	bool readHex(T& value)
+	{
+		return readInteger(value, 16);
+	}
+
+	/// Rounds like strtof, fast for up to 7 significant digits and small exponents
+	bool read(float& value)
+	{
+		if (m_fail)
+			return false;
+
+		skipSpace();
+		const char* start = m_pos;
+		const bool negative = m_pos != m_end && *m_pos == '-';
+		if (m_pos != m_end && (*m_pos == '-' || *m_pos == '+'))
+			++m_pos;
+
+		// one compare per digit, more than 19 digits may overflow and take the slow path
+		unsigned long long mantissa = 0;
+		const char* digits = m_pos;
+		m_pos = accumulateDigits(m_pos, mantissa);
+		size_t digitCount = static_cast<size_t>(m_pos - digits);
+		int exponent = 0;
+
+		if (m_pos != m_end && *m_pos == '.')
+		{
+			const char* fraction = ++m_pos;
+			m_pos = accumulateDigits(m_pos, mantissa);
+			exponent = -static_cast<int>(std::min<size_t>(m_pos - fraction, 1000));
+			digitCount += static_cast<size_t>(m_pos - fraction);
+		}
+
+		if (!digitCount)
+			return setFail();
+		bool exact = digitCount <= 19;
+
+		if (m_pos != m_end && (*m_pos == 'e' || *m_pos == 'E'))
+		{
+			int explicitExponent;
+			++m_pos;
+			if (!readInteger(explicitExponent, 10, false))
+				return false;
+			if (explicitExponent > 1000 || explicitExponent < -1000)
+				exact = false;
+			else
+				exponent += explicitExponent;
+		}
+
+		// strip trailing zeros so more values fit the fast path
+		while (exact && mantissa > (1u << 24) && mantissa % 10 == 0)
+		{
+			mantissa /= 10;
+			++exponent;
+		}
+
+		if (exact && mantissa == 0)
+		{
+			value = negative ? -0.f : 0.f;
+			return true;
+		}
+
+		// both operands exact in a float, so one rounding gives the correctly rounded value
+		if (exact && mantissa <= (1u << 24) && exponent >= -10 && exponent <= 10)
+		{
+			static const float pow10[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+			const float m = static_cast<float>(mantissa);
+			value = exponent < 0 ? m / pow10[-exponent] : m * pow10[exponent];
+			if (negative)
+				value = -value;
+			return true;
+		}
+
+		return slowFloat(start, value);
+	}
+
+	template <typename T, size_t COMPONENTS>
+	bool read(Vector<T, COMPONENTS>& vector)
+	{
+		for (size_t i = 0; i < COMPONENTS; ++i)
+		{
+			if (!read(vector[i]))
+				return false;
+		}
+		return true;
+	}
+
+	static bool isSpace(char c)
+	{
+		return c == ' ' || (c >= '\t' && c <= '\r');
+	}
+
+private:
+	const char* m_pos;
+	const char* m_end;
+	bool m_fail;
+
+	bool setFail()
+	{
+		m_fail = true;
+		return false;
+	}
+
+	void skipSpace()
+	{
+		while (m_pos != m_end && isSpace(*m_pos))
+			++m_pos;
+	}
+
+	const char* accumulateDigits(const char* pos, unsigned long long& mantissa) const
+	{
+		unsigned digit;
+		while (pos != m_end && (digit = static_cast<unsigned char>(*pos) - '0') < 10)
+		{
+			mantissa = mantissa * 10 + digit;
+			++pos;
+		}
+		return pos;
+	}
+
+	static int digitValue(char c)
+	{
+		if (c >= '0' && c <= '9')
+			return c - '0';
+		if (c >= 'a' && c <= 'f')
+			return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F')
+			return c - 'A' + 10;
+		return 16;
+	}
+
+	// Out of range values fail, unsigned types take a minus sign modulo their range like streams do
+	template <typename T>
+	bool readInteger(T& value, int base, bool skipLeadingSpace = true)
+	{
+		if (m_fail)
+			return false;
+
+		if (skipLeadingSpace)
+			skipSpace();
+
+		const bool negative = m_pos != m_end && *m_pos == '-';
+		if (m_pos != m_end && (*m_pos == '-' || *m_pos == '+'))
+			++m_pos;
+
+		if (base == 16 && m_end - m_pos > 1 && m_pos[0] == '0' && (m_pos[1] == 'x' || m_pos[1] == 'X'))
+			m_pos += 2;
+
+		typedef typename std::make_unsigned<T>::type U;
+		const U limit = std::is_signed<T>::value ?
+				static_cast<U>(std::numeric_limits<T>::max()) + (negative ? 1 : 0) : std::numeric_limits<U>::max();
+		U magnitude = 0;
+		const char* digits = m_pos;
+
+		for (int digit; m_pos != m_end && (digit = digitValue(*m_pos)) < base; ++m_pos)
+		{
+			if (magnitude > (limit - static_cast<U>(digit)) / static_cast<U>(base))
+				return setFail();
+			magnitude = static_cast<U>(magnitude * base + digit);
+		}
+
+		if (m_pos == digits)
+			return setFail();
+
+		value = static_cast<T>(negative ? static_cast<U>(0 - magnitude) : magnitude);
+		return true;
+	}
+
+	// Long or out of range values, through strtof on a copy in the C library's decimal format
+	bool slowFloat(const char* start, float& value)
+	{
+		char buffer[128];
+		std::string longNumber;
+		const size_t size = static_cast<size_t>(m_pos - start);
+		char* number = buffer;
+
+		if (size >= sizeof(buffer))
+		{
+			longNumber.resize(size);
+			number = &longNumber[0];
+		}
+		else
+			buffer[size] = '\0';
+		std::memcpy(number, start, size);
+
+		const char point = *std::localeconv()->decimal_point;
+		if (point != '.')
+		{
+			char* dot = static_cast<char*>(std::memchr(number, '.', size));
+			if (dot)
+				*dot = point;
+		}
+
+		value = std::strtof(number, nullptr);
+		if (std::isinf(value))
+			return setFail();
+		return true;
+	}
+};
+
+#endif // TEXTSCANNER_HPP
@@ -0,0 +1,344 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TextWriter.h"
+
+#include <cstdint>
+
+/*
+  Shortest digits after Ulf Adams' Ryu (PLDI 2018): the interval of reals
+  rounding to the float is scaled by a power of ten, 64 bit approximations
+  of which are tabled, and digits are removed while both ends agree.
+  */
+namespace
+{
+
+const int FLOAT_MANTISSA_BITS = 23;
+const int FLOAT_BIAS = 127;
+const int FLOAT_POW5_INV_BITCOUNT = 59;
+const int FLOAT_POW5_BITCOUNT = 61;
+
+// floor(2^(bits(5^i) - 1 + 59) / 5^i) + 1
+const uint64_t FLOAT_POW5_INV_SPLIT[31] = {
+	576460752303423489u, 461168601842738791u, 368934881474191033u,
+	295147905179352826u, 472236648286964522u, 377789318629571618u,
+	302231454903657294u, 483570327845851670u, 386856262276681336u,
+	309485009821345069u, 495176015714152110u, 396140812571321688u,
+	316912650057057351u, 507060240091291761u, 405648192073033409u,
+	324518553658426727u, 519229685853482763u, 415383748682786211u,
+	332306998946228969u, 531691198313966350u, 425352958651173080u,
+	340282366920938464u, 544451787073501542u, 435561429658801234u,
+	348449143727040987u, 557518629963265579u, 446014903970612463u,
+	356811923176489971u, 570899077082383953u, 456719261665907162u,
+	365375409332725730u
+};
+
+// The top 61 bits of 5^i
+const uint64_t FLOAT_POW5_SPLIT[48] = {
+	1152921504606846976u, 1441151880758558720u, 1801439850948198400u,
+	2251799813685248000u, 1407374883553280000u, 1759218604441600000u,
+	2199023255552000000u, 1374389534720000000u, 1717986918400000000u,
+	2147483648000000000u, 1342177280000000000u, 1677721600000000000u,
+	2097152000000000000u, 1310720000000000000u, 1638400000000000000u,
+	2048000000000000000u, 1280000000000000000u, 1600000000000000000u,
+	2000000000000000000u, 1250000000000000000u, 1562500000000000000u,
+	1953125000000000000u, 1220703125000000000u, 1525878906250000000u,
+	1907348632812500000u, 1192092895507812500u, 1490116119384765625u,
+	1862645149230957031u, 1164153218269348144u, 1455191522836685180u,
+	1818989403545856475u, 2273736754432320594u, 1421085471520200371u,
+	1776356839400250464u, 2220446049250313080u, 1387778780781445675u,
+	1734723475976807094u, 2168404344971008868u, 1355252715606880542u,
+	1694065894508600678u, 2117582368135750847u, 1323488980084844279u,
+	1654361225106055349u, 2067951531382569187u, 1292469707114105741u,
+	1615587133892632177u, 2019483917365790221u, 1262177448353618888u
+};
+
+// ceil(log2(5^e)), 1 for e == 0
+inline int pow5bits(int e)
+{
+	return static_cast<int>((static_cast<uint32_t>(e) * 1217359) >> 19) + 1;
+}
+
+// floor(log10(2^e))
+inline int log10Pow2(int e)
+{
+	return static_cast<int>((static_cast<uint32_t>(e) * 78913) >> 18);
+}
+
+// floor(log10(5^e))
+inline int log10Pow5(int e)
+{
+	return static_cast<int>((static_cast<uint32_t>(e) * 732923) >> 20);
+}
+
+inline bool multipleOfPowerOf5(uint32_t value, int p)
+{
+	int count = 0;
+	while (value % 5 == 0 && count < p)
+	{
+		value /= 5;
+		++count;
+	}
+	return count >= p;
+}
+
+inline bool multipleOfPowerOf2(uint32_t value, int p)
+{
+	return (value & ((1u << p) - 1)) == 0;
+}
+
+// (m * factor) >> shift, shift is above 32
+inline uint32_t mulShift(uint32_t m, uint64_t factor, int shift)
+{
+	const uint64_t low = static_cast<uint64_t>(m) * static_cast<uint32_t>(factor);
+	const uint64_t high = static_cast<uint64_t>(m) * static_cast<uint32_t>(factor >> 32);
+	return static_cast<uint32_t>(((low >> 32) + high) >> (shift - 32));
+}
+
+inline uint32_t mulPow5InvDivPow2(uint32_t m, int q, int j)
+{
+	return mulShift(m, FLOAT_POW5_INV_SPLIT[q], j);
+}
+
+inline uint32_t mulPow5DivPow2(uint32_t m, int i, int j)
+{
+	return mulShift(m, FLOAT_POW5_SPLIT[i], j);
+}
+
+// Shortest digits * 10^exponent of a finite non-zero float, the closest when there are several
+void shortestDigits(uint32_t ieeeMantissa, int ieeeExponent, uint32_t& digits, int& exponent)
+{
+	int e2;
+	uint32_t m2;
+
+	if (ieeeExponent == 0)
+	{
+		e2 = 1 - FLOAT_BIAS - FLOAT_MANTISSA_BITS - 2;
+		m2 = ieeeMantissa;
+	}
+	else
+	{
+		e2 = ieeeExponent - FLOAT_BIAS - FLOAT_MANTISSA_BITS - 2;
+		m2 = (1u << FLOAT_MANTISSA_BITS) | ieeeMantissa;
+	}
+
+	// ties go to the even mantissa, whose interval includes its ends
+	const bool acceptBounds = (m2 & 1) == 0;
+
+	// the value and the interval ends, times 4
+	const uint32_t mv = 4 * m2;
+	const uint32_t mp = 4 * m2 + 2;
+	const uint32_t mmShift = ieeeMantissa != 0 || ieeeExponent <= 1;
+	const uint32_t mm = 4 * m2 - 1 - mmShift;
+
+	uint32_t vr, vp, vm;
+	int e10;
+	bool vmIsTrailingZeros = false, vrIsTrailingZeros = false;
+	uint32_t lastRemovedDigit = 0;
+
+	if (e2 >= 0)
+	{
+		const int q = log10Pow2(e2);
+		const int k = FLOAT_POW5_INV_BITCOUNT + pow5bits(q) - 1;
+		const int i = -e2 + q + k;
+
+		e10 = q;
+		vr = mulPow5InvDivPow2(mv, q, i);
+		vp = mulPow5InvDivPow2(mp, q, i);
+		vm = mulPow5InvDivPow2(mm, q, i);
+		if (q != 0 && (vp - 1) / 10 <= vm / 10)
+		{
+			// one digit more is removed below, it decides the rounding
+			const int l = FLOAT_POW5_INV_BITCOUNT + pow5bits(q - 1) - 1;
+			lastRemovedDigit = mulPow5InvDivPow2(mv, q - 1, -e2 + q - 1 + l) % 10;
+		}
+		if (q <= 9)
+		{
+			// only one of mp, mv and mm can be a multiple of 5
+			if (mv % 5 == 0)
+				vrIsTrailingZeros = multipleOfPowerOf5(mv, q);
+			else if (acceptBounds)
+				vmIsTrailingZeros = multipleOfPowerOf5(mm, q);
+			else
+				vp -= multipleOfPowerOf5(mp, q);
+		}
+	}
+	else
+	{
+		const int q = log10Pow5(-e2);
+		const int i = -e2 - q;
+		const int k = pow5bits(i) - FLOAT_POW5_BITCOUNT;
+		const int j = q - k;
+
+		e10 = q + e2;
+		vr = mulPow5DivPow2(mv, i, j);
+		vp = mulPow5DivPow2(mp, i, j);
+		vm = mulPow5DivPow2(mm, i, j);
+		if (q != 0 && (vp - 1) / 10 <= vm / 10)
+		{
+			const int l = q - 1 - (pow5bits(i + 1) - FLOAT_POW5_BITCOUNT);
+			lastRemovedDigit = mulPow5DivPow2(mv, i + 1, l) % 10;
+		}
+		if (q <= 1)
+		{
+			// mv has at least q trailing zero bits, mm has them if mmShift is 1
+			vrIsTrailingZeros = true;
+			if (acceptBounds)
+				vmIsTrailingZeros = mmShift == 1;
+			else
+				--vp;
+		}
+		else if (q < 31)
+		{
+			vrIsTrailingZeros = multipleOfPowerOf2(mv, q - 1);
+		}
+	}
+
+	int removed = 0;
+
+	if (vmIsTrailingZeros || vrIsTrailingZeros)
+	{
+		// the rare general case
+		while (vp / 10 > vm / 10)
+		{
+			vmIsTrailingZeros &= vm % 10 == 0;
+			vrIsTrailingZeros &= lastRemovedDigit == 0;
+			lastRemovedDigit = vr % 10;
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+			++removed;
+		}
+		if (vmIsTrailingZeros)
+		{
+			while (vm % 10 == 0)
+			{
+				vrIsTrailingZeros &= lastRemovedDigit == 0;
+				lastRemovedDigit = vr % 10;
+				vr /= 10;
+				vp /= 10;
+				vm /= 10;
+				++removed;
+			}
+		}
+		// exactly halfway rounds to even
+		if (vrIsTrailingZeros && lastRemovedDigit == 5 && vr % 2 == 0)
+			lastRemovedDigit = 4;
+		digits = vr + ((vr == vm && (!acceptBounds || !vmIsTrailingZeros)) || lastRemovedDigit >= 5);
+	}
+	else
+	{
+		while (vp / 10 > vm / 10)
+		{
+			lastRemovedDigit = vr % 10;
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+			++removed;
+		}
+		digits = vr + (vr == vm || lastRemovedDigit >= 5);
+	}
+	exponent = e10 + removed;
+}
+
+inline char* copyText(const char* text, char* buffer)
+{
+	while (*text)
+		*buffer++ = *text++;
+	return buffer;
+}
+
+} // namespace
+
+char* formatFloat(float value, char* buffer, bool fixedNotation)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	const uint32_t ieeeMantissa = bits & ((1u << FLOAT_MANTISSA_BITS) - 1);
+	const int ieeeExponent = static_cast<int>((bits >> FLOAT_MANTISSA_BITS) & 0xff);
+
+	if (bits >> 31)
+		*buffer++ = '-';
+
+	if (ieeeExponent == 0xff)
+		return copyText(ieeeMantissa ? "nan" : "inf", buffer);
+
+	if (ieeeExponent == 0 && ieeeMantissa == 0)
+	{
+		*buffer++ = '0';
+		return buffer;
+	}
+
+	uint32_t digits;
+	int exponent;
+	shortestDigits(ieeeMantissa, ieeeExponent, digits, exponent);
+
+	char text[10];
+	int length = 0;
+	for (uint32_t rest = digits; rest; rest /= 10)
+		++length;
+	for (int i = length - 1; i >= 0; --i, digits /= 10)
+		text[i] = static_cast<char>('0' + digits % 10);
+
+	// exponent of the first digit
+	const int leading = exponent + length - 1;
+
+	if (!fixedNotation && (leading < -4 || leading >= 9))
+	{
+		*buffer++ = text[0];
+		if (length > 1)
+		{
+			*buffer++ = '.';
+			for (int i = 1; i < length; ++i)
+				*buffer++ = text[i];
+		}
+		*buffer++ = 'e';
+		*buffer++ = leading < 0 ? '-' : '+';
+
+		const int magnitude = leading < 0 ? -leading : leading;
+		if (magnitude >= 10)
+			*buffer++ = static_cast<char>('0' + magnitude / 10);
+		else
+			*buffer++ = '0';
+		*buffer++ = static_cast<char>('0' + magnitude % 10);
+		return buffer;
+	}
+
+	if (leading < 0)
+	{
+		*buffer++ = '0';
+		*buffer++ = '.';
+		for (int i = -1; i > leading; --i)
+			*buffer++ = '0';
+		for (int i = 0; i < length; ++i)
+			*buffer++ = text[i];
+		return buffer;
+	}
+
+	for (int i = 0; i <= leading; ++i)
+		*buffer++ = i < length ? text[i] : '0';
+	if (length > leading + 1)
+	{
+		*buffer++ = '.';
+		for (int i = leading + 1; i < length; ++i)
+			*buffer++ = text[i];
+	}
+	return buffer;
+}
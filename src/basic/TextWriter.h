@@ -0,0 +1,171 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TEXTWRITER_HPP
+#define TEXTWRITER_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/// Longest text formatFloat writes, fixed notation of the smallest denormal
+const size_t TEXT_FLOAT_MAX = 64;
+
+/*
+  Writes the fewest digits that read back to the same float, in the shape
+  of printf's %.9g, or always without exponent in fixed notation.
+  Returns the end of the text, which isn't terminated.
+  */
+char* formatFloat(float value, char* buffer, bool fixedNotation = false);
+
+/*
+  Formats text into a reusable buffer and hands it to the stream in big
+  writes, at the latest when destroyed. Numbers don't go through the
+  stream's flags or locale, so the bytes are the same everywhere:
+  integers in decimal and floats as formatFloat writes them.
+  */
+class TextWriter
+{
+public:
+	explicit TextWriter(std::ostream& out, size_t capacity = 1 << 20):
+		m_out(out), m_buffer(std::max<size_t>(capacity, TEXT_FLOAT_MAX)), m_pos(0), m_fixedNotation(false) {}
+	~TextWriter() {flush();}
+
+	TextWriter(const TextWriter&) = delete;
+	TextWriter& operator=(const TextWriter&) = delete;
+
+	TextWriter& operator<< (char c)
+	{
+		*reserve(1) = c;
+		++m_pos;
+		return *this;
+	}
+
+	TextWriter& operator<< (const char* str)
+	{
+		write(str, std::strlen(str));
+		return *this;
+	}
+
+	TextWriter& operator<< (const std::string& str)
+	{
+		write(str.data(), str.size());
+		return *this;
+	}
+
+	TextWriter& operator<< (int value) {return writeSigned(value);}
+	TextWriter& operator<< (long value) {return writeSigned(value);}
+	TextWriter& operator<< (long long value) {return writeSigned(value);}
+	TextWriter& operator<< (unsigned value) {return writeUnsigned(value);}
+	TextWriter& operator<< (unsigned long value) {return writeUnsigned(value);}
+	TextWriter& operator<< (unsigned long long value) {return writeUnsigned(value);}
+
+	TextWriter& operator<< (float value)
+	{
+		char* begin = reserve(TEXT_FLOAT_MAX);
+		m_pos += formatFloat(value, begin, m_fixedNotation) - begin;
+		return *this;
+	}
+
+	/// Lower case hex digits, as std::hex writes them
+	TextWriter& writeHex(unsigned long long value)
+	{
+		static const char digits[] = "0123456789abcdef";
+		char text[16];
+		char* pos = text + sizeof(text);
+
+		do
+		{
+			*--pos = digits[value & 0xf];
+			value >>= 4;
+		} while (value);
+		write(pos, text + sizeof(text) - pos);
+		return *this;
+	}
+
+	void write(const char* data, size_t size)
+	{
+		if (size > m_buffer.size() - m_pos)
+		{
+			flush();
+			if (size > m_buffer.size())
+			{
+				m_out.write(data, size);
+				return;
+			}
+		}
+		std::memcpy(&m_buffer[m_pos], data, size);
+		m_pos += size;
+	}
+
+	/// Floats without exponent, like std::fixed but with the shortest digits
+	void setFixedNotation(bool fixed) {m_fixedNotation = fixed;}
+
+	void flush()
+	{
+		if (m_pos)
+			m_out.write(m_buffer.data(), m_pos);
+		m_pos = 0;
+	}
+
+private:
+	// Room for size more bytes, flushing if needed
+	char* reserve(size_t size)
+	{
+		if (size > m_buffer.size() - m_pos)
+			flush();
+		return &m_buffer[m_pos];
+	}
+
+	template <typename T>
+	TextWriter& writeUnsigned(T value)
+	{
+		char text[24];
+		char* pos = text + sizeof(text);
+
+		do
+		{
+			*--pos = static_cast<char>('0' + value % 10);
+			value /= 10;
+		} while (value);
+		write(pos, text + sizeof(text) - pos);
+		return *this;
+	}
+
+	template <typename T>
+	TextWriter& writeSigned(T value)
+	{
+		if (value < 0)
+		{
+			*this << '-';
+			// through unsigned, so the lowest value doesn't overflow
+			return writeUnsigned(0ull - static_cast<unsigned long long>(value));
+		}
+		return writeUnsigned(static_cast<unsigned long long>(value));
+	}
+
+	std::ostream& m_out;
+	std::vector<char> m_buffer;
+	size_t m_pos;
+	bool m_fixedNotation;
+};
+
+#endif // TEXTWRITER_HPP
@@ -26,21 +26,8 @@
 template <typename T, size_t COMPONENTS>
 struct Vector
 {
+	// copies stay implicit so vectors are trivially copyable and arrays of them copy as memcpy
 	Vector() {}
-	Vector(const Vector& rhs)
-	{
-		*this = rhs;
-	}
-
-	Vector& operator = (const Vector& rhs)
-	{
-		unsigned i;
-		for (i = 0; i < COMPONENTS; ++i)
-		{
-			component[i] = rhs.component[i];
-		}
-		return *this;
-	}
 
 	inline T  operator [](size_t i) const {
 		return component[i];
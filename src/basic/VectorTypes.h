@@ -28,15 +28,7 @@ struct UV : public Vector<T, COMPONENTS>
 	UV() {u() = 0, v() =0;}
 
 	UV(T u, T v) {
-		u() = u; v() = v;
-	}
-
-	UV(const UV& rhs): Vector<T, COMPONENTS>(rhs) {}
-
-	UV& operator = (const UV& rhs)
-	{
-		Vector<T, COMPONENTS>::operator=(rhs);
-		return *this;
+		this->u() = u; this->v() = v;
 	}
 
 	UV(const Vector<T, COMPONENTS>& rhs): Vector<T, COMPONENTS>(rhs) {}
@@ -71,14 +63,6 @@ struct Vertex : public Vector<T, COMPONENTS>
 		this->z() = z;
 	}
 
-	Vertex(const Vertex& rhs): Vector<T, COMPONENTS>(rhs) {}
-
-	Vertex& operator = (const Vertex& rhs)
-	{
-		Vector<T, COMPONENTS>::operator=(rhs);
-		return *this;
-	}
-
 	Vertex(const Vector<T, COMPONENTS>& rhs): Vector<T, COMPONENTS>(rhs) {}
 
 	inline T& x() {
@@ -198,7 +182,6 @@ struct Vertex4 : public Vector<T, COMPONENTS>
 		this->w() = w;
 	}
 
-	Vertex4(const Vertex4& rhs): Vector<T, COMPONENTS>(rhs) {}
 	Vertex4(const Vertex<T>& rhs, const T wval = 0): Vector<T, COMPONENTS>()
 	{
 		x() = rhs.x();
@@ -207,12 +190,6 @@ struct Vertex4 : public Vector<T, COMPONENTS>
 		w() = wval;
 	}
 
-	Vertex4& operator = (const Vertex4& rhs)
-	{
-		Vector<T, COMPONENTS>::operator=(rhs);
-		return *this;
-	}
-
 	inline T& x() {
 		return this->operator [](0);
 	}
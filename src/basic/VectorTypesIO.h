@@ -0,0 +1,34 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VECTORTYPESIO_HPP
+#define VECTORTYPESIO_HPP
+
+// TextWriter output of the vector types, for the writers only
+
+#include "TextWriter.h"
+#include "VectorTypes.h"
+
+template <typename T>
+TextWriter& operator<< (TextWriter& out, const Vertex<T>& ver)
+{
+    out << ver.x() << ' ' << ver.y() << ' ' << ver.z() << ' ';
+    return out;
+}
+
+#endif // VECTORTYPESIO_HPP
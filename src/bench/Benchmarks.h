@@ -0,0 +1,139 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BENCHMARKS_HPP
+#define BENCHMARKS_HPP
+
+// Timings behind the --benchmark-* modes of the command line, not used by the formats themselves
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "VertexCodec.h"
+
+/// Best time of the runs in milliseconds
+template <typename F>
+double bestMilliseconds(unsigned runs, F run)
+{
+	double best = std::numeric_limits<double>::max();
+
+	for (unsigned i = 0; i < std::max(1u, runs); ++i)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		run();
+		const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		best = std::min(best, elapsed.count());
+	}
+	return best;
+}
+
+struct KernelTiming
+{
+	std::string kernel, instructionSet;
+	double milliseconds; // best of the runs
+	bool identical; // the same bits as the scalar kernel
+};
+
+/// Times every kernel with every available instruction set on random vertices
+std::vector<KernelTiming> benchmarkKernels(size_t vertexCount, unsigned runs = 5);
+
+struct PieReadTiming
+{
+	int version; // -1 if the file is no pie
+	bool identical; // both readers gave the same caps and data
+	double copyMilliseconds; // best of the runs, std::ifstream copied into memory and scanned
+	double mappedMilliseconds; // best of the runs, the same scanner on the memory mapped file
+};
+
+/// Times reading a pie file through std::ifstream and memory mapped. Both share one scanner,
+/// so they differ by the copy only
+PieReadTiming benchmarkPieRead(const char* file, unsigned runs = 5);
+
+struct WZMReadTiming
+{
+	bool read; // false if the file is no readable wzm
+	bool identical; // all readers gave the same model
+	double megabytes; // file size
+	double binaryMegabytes; // the model as .wzmb
+	double copyMilliseconds; // best of the runs, std::ifstream copied into memory and scanned
+	double mappedMilliseconds; // best of the runs, the same scanner on the memory mapped file
+	double binaryMilliseconds; // best of the runs, from memory
+};
+
+/// Times reading a wzm file through std::ifstream, memory mapped and as .wzmb. The first two share one
+/// scanner, so they differ by the copy only
+WZMReadTiming benchmarkWZMRead(const char* file, unsigned runs = 5);
+
+struct WZMPackTiming
+{
+	bool read; // false if the file is no readable wzm
+	bool trianglesIdentical; // packing keeps them as they are
+	double positionError; // largest, in model units
+	double megabytes, binaryMegabytes, packedMegabytes; // text file, .wzmb and .wzmb with packed meshes
+	double mappedMilliseconds, binaryMilliseconds, packedMilliseconds; // best of the runs, .wzmb from memory
+	std::string packed; // the packed .wzmb, for timing compression on top
+};
+
+/// Sizes and read times of a wzm file as text, as .wzmb and as .wzmb with packed meshes
+WZMPackTiming benchmarkWZMPacking(const char* file, unsigned runs = 5);
+
+struct WZMWeldTiming
+{
+	bool read; // false if the file is no readable wzm
+	size_t corners; // triangle corners welded, mesh by mesh
+	size_t setPoints, hashPoints; // points left by each welder
+	double setMilliseconds, hashMilliseconds; // best of the runs
+};
+
+/// Times welding the triangle corners of a wzm file with the old epsilon std::set and with VertexWelder
+WZMWeldTiming benchmarkWeld(const char* file, unsigned runs = 3);
+
+struct WZMStreamTiming
+{
+	bool read; // false if the file is no readable wzm
+	bool identical; // both layouts fetched the same values
+	size_t vertices, triangles;
+	double buildMilliseconds; // interleaving the separate arrays into the stream
+	double splitUploadMilliseconds, streamUploadMilliseconds; // copying the vertices into one buffer
+	double splitDrawMilliseconds, streamDrawMilliseconds; // fetching every attribute of every index
+	double splitShuffledMilliseconds, streamShuffledMilliseconds; // the same with the vertices in random order
+};
+
+/// Times separate vertex arrays against the interleaved stream of a wzm file for uploading and drawing
+WZMStreamTiming benchmarkVertexStream(const char* file, unsigned runs = 5);
+
+struct CompactRoundTrip
+{
+	bool read; // false if the compact model didn't read back
+	bool versionChecked; // the compact model labelled version 3 is refused
+	size_t vertices;
+	double megabytes, compactMegabytes; // the model as version 3 and as compact version 4
+	CompactErrorStats errors; // the vertices read back against the random ones
+	double readMilliseconds, compactReadMilliseconds; // best of the runs, from memory
+};
+
+/// Writes random positions, normals, tangents and uvs as a compact wzm, reads it back
+/// and compares the vertices to the ones written
+CompactRoundTrip benchmarkCompactRoundTrip(size_t vertexCount, unsigned runs = 5);
+
+#endif // BENCHMARKS_HPP
@@ -0,0 +1,753 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "GLTF.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+#include "TextWriter.h"
+
+static const GLfloat DEGREES = 57.29577951308232f;
+
+bool gltfIndex(const JsonValue& value, size_t& out, size_t limit)
+{
+	const double number = value.number(-1.);
+
+	if (number < 0. || number != std::floor(number) || number >= 9007199254740992. || number >= static_cast<double>(limit))
+		return false;
+	out = static_cast<size_t>(number);
+	return true;
+}
+
+// Same for the optional ones, which default to 0
+static bool optionalIndex(const JsonValue& value, size_t& out)
+{
+	out = 0;
+	return value.isNull() || gltfIndex(value, out);
+}
+
+static size_t componentSize(unsigned componentType)
+{
+	switch (componentType)
+	{
+	case GLTF_BYTE:
+	case GLTF_UNSIGNED_BYTE:
+		return 1;
+	case GLTF_SHORT:
+	case GLTF_UNSIGNED_SHORT:
+		return 2;
+	case GLTF_UNSIGNED_INT:
+	case GLTF_FLOAT:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+static unsigned typeComponents(const std::string& type)
+{
+	if (type == "SCALAR")
+		return 1;
+	if (type == "VEC2")
+		return 2;
+	if (type == "VEC3")
+		return 3;
+	if (type == "VEC4")
+		return 4;
+	return 0;
+}
+
+bool GLBFile::read(const char* data, size_t size)
+{
+	uint32_t header[3], chunk[2];
+	bool hasJson = false;
+
+	m_json = JsonValue();
+	m_bin = nullptr;
+	m_binSize = 0;
+
+	if (!wzmbHostSupported())
+	{
+		std::cerr << "GLBFile::read - GLB files are little endian only";
+		return false;
+	}
+
+	if (size < sizeof(header))
+	{
+		std::cerr << "GLBFile::read - Missing header";
+		return false;
+	}
+
+	std::memcpy(header, data, sizeof(header));
+	if (header[0] != GLB_MAGIC || header[1] != GLB_VERSION)
+	{
+		std::cerr << "GLBFile::read - Unsupported glTF binary version " << header[1];
+		return false;
+	}
+	if (header[2] < sizeof(header))
+	{
+		std::cerr << "GLBFile::read - Missing header";
+		return false;
+	}
+	if (header[2] > size)
+	{
+		std::cerr << "GLBFile::read - File is truncated";
+		return false;
+	}
+	size = header[2];
+
+	// the JSON chunk comes first, unknown chunks are skipped
+	for (size_t pos = sizeof(header); pos <= size && size - pos >= sizeof(chunk); pos += chunk[0])
+	{
+		std::memcpy(chunk, data + pos, sizeof(chunk));
+		pos += sizeof(chunk);
+		if (chunk[0] > size - pos)
+		{
+			std::cerr << "GLBFile::read - Chunk is truncated";
+			return false;
+		}
+
+		if (!hasJson)
+		{
+			size_t length = chunk[0];
+			while (length && data[pos + length - 1] == '\0')
+				--length;
+			if (chunk[1] != GLB_CHUNK_JSON || !m_json.parse(data + pos, length) || !m_json.isObject())
+			{
+				std::cerr << "GLBFile::read - Error reading JSON chunk";
+				return false;
+			}
+			hasJson = true;
+		}
+		else if (chunk[1] == GLB_CHUNK_BIN && !m_bin)
+		{
+			m_bin = data + pos;
+			m_binSize = chunk[0];
+		}
+	}
+
+	if (!hasJson)
+	{
+		std::cerr << "GLBFile::read - Missing JSON chunk";
+		return false;
+	}
+	if (m_json["asset"]["version"].string().compare(0, 2, "2.") != 0)
+	{
+		std::cerr << "GLBFile::read - Unsupported glTF version " << m_json["asset"]["version"].string();
+		return false;
+	}
+	return true;
+}
+
+bool GLBFile::accessor(const JsonValue& index, GLTFAccessor& out) const
+{
+	const JsonValue& accessors = m_json["accessors"];
+	const JsonValue& views = m_json["bufferViews"];
+	const JsonValue& buffer = m_json["buffers"][0];
+	size_t accessorIndex, viewIndex, bufferIndex, bufferLength = 0, count = 0, offset, viewOffset, viewLength = 0, stride;
+
+	// sparse accessors and those without a view would need zeros made up
+	if (!gltfIndex(index, accessorIndex, accessors.size()))
+		return false;
+	const JsonValue& accessor = accessors[accessorIndex];
+	if (!gltfIndex(accessor["bufferView"], viewIndex, views.size()) || accessor.has("sparse"))
+		return false;
+	const JsonValue& view = views[viewIndex];
+
+	// the binary chunk is buffer 0, files next to the model aren't read
+	if (!optionalIndex(view["buffer"], bufferIndex) || bufferIndex != 0 || buffer.has("uri")
+		|| !gltfIndex(buffer["byteLength"], bufferLength) || bufferLength > m_binSize)
+	{
+		return false;
+	}
+
+	out.componentType = static_cast<unsigned>(accessor["componentType"].number());
+	out.components = typeComponents(accessor["type"].string());
+	out.normalized = accessor["normalized"].boolean(false);
+	const size_t elementSize = componentSize(out.componentType) * out.components;
+
+	if (!elementSize || !gltfIndex(accessor["count"], count) || !count || !optionalIndex(accessor["byteOffset"], offset)
+		|| !optionalIndex(view["byteOffset"], viewOffset) || !gltfIndex(view["byteLength"], viewLength)
+		|| !optionalIndex(view["byteStride"], stride))
+	{
+		return false;
+	}
+	if (!stride)
+		stride = elementSize;
+
+	// all elements inside the view, the view inside the buffer
+	if (stride < elementSize || viewLength > bufferLength || viewOffset > bufferLength - viewLength
+		|| offset > viewLength || elementSize > viewLength - offset
+		|| count - 1 > (viewLength - offset - elementSize) / stride)
+	{
+		return false;
+	}
+
+	out.data = m_bin + viewOffset + offset;
+	out.count = count;
+	out.stride = stride;
+	return true;
+}
+
+template <typename T>
+static void readNormalized(const GLTFAccessor& accessor, GLfloat* to, GLfloat max)
+{
+	for (size_t i = 0; i < accessor.count; ++i)
+	{
+		for (unsigned k = 0; k < accessor.components; ++k)
+		{
+			T value;
+			std::memcpy(&value, accessor.data + i * accessor.stride + k * sizeof(T), sizeof(T));
+			to[i * accessor.components + k] = std::max(value / max, -1.f);
+		}
+	}
+}
+
+bool readGLTFFloats(const GLTFAccessor& accessor, unsigned components, GLfloat* to)
+{
+	const size_t elementSize = components * sizeof(GLfloat);
+
+	if (accessor.components != components)
+		return false;
+
+	switch (accessor.componentType)
+	{
+	case GLTF_FLOAT:
+		if (accessor.stride == elementSize)
+			std::memcpy(to, accessor.data, accessor.count * elementSize);
+		else
+		{
+			for (size_t i = 0; i < accessor.count; ++i)
+				std::memcpy(to + i * components, accessor.data + i * accessor.stride, elementSize);
+		}
+		return true;
+	case GLTF_UNSIGNED_BYTE:
+		readNormalized<uint8_t>(accessor, to, 255.f);
+		return accessor.normalized;
+	case GLTF_BYTE:
+		readNormalized<int8_t>(accessor, to, 127.f);
+		return accessor.normalized;
+	case GLTF_UNSIGNED_SHORT:
+		readNormalized<uint16_t>(accessor, to, 65535.f);
+		return accessor.normalized;
+	case GLTF_SHORT:
+		readNormalized<int16_t>(accessor, to, 32767.f);
+		return accessor.normalized;
+	default:
+		return false;
+	}
+}
+
+template <typename T>
+static void readIndices(const GLTFAccessor& accessor, IndexArray& to)
+{
+	IndexedTri tri;
+
+	to.clear();
+	to.reserve(accessor.count / 3);
+	for (size_t i = 0; i + 2 < accessor.count; i += 3)
+	{
+		for (size_t k = 0; k < 3; ++k)
+		{
+			T index;
+			std::memcpy(&index, accessor.data + (i + k) * accessor.stride, sizeof(T));
+			tri[k] = index;
+		}
+		to.push_back(tri);
+	}
+}
+
+bool readGLTFIndices(const GLTFAccessor& accessor, size_t vertices, IndexArray& to)
+{
+	if (accessor.components != 1 || accessor.count % 3)
+		return false;
+
+	if (accessor.componentType == GLTF_UNSIGNED_SHORT && accessor.stride == sizeof(GLushort))
+		to.assign(accessor.data, accessor.count / 3, false);
+	else if (accessor.componentType == GLTF_UNSIGNED_INT && accessor.stride == sizeof(GLuint))
+		to.assign(accessor.data, accessor.count / 3, true);
+	else if (accessor.componentType == GLTF_UNSIGNED_BYTE)
+		readIndices<uint8_t>(accessor, to);
+	else if (accessor.componentType == GLTF_UNSIGNED_SHORT)
+		readIndices<uint16_t>(accessor, to);
+	else if (accessor.componentType == GLTF_UNSIGNED_INT)
+		readIndices<uint32_t>(accessor, to);
+	else
+		return false;
+
+	for (size_t i = 0; i < to.size(); ++i)
+	{
+		const IndexedTri tri = to[i];
+		if (tri.a() >= vertices || tri.b() >= vertices || tri.c() >= vertices)
+			return false;
+	}
+	return true;
+}
+
+static WZMMatrix4 trsMatrix(const GLfloat translation[3], const GLfloat rotation[4], const GLfloat scale[3])
+{
+	WZMMatrix4 result;
+	const GLfloat length = std::sqrt(rotation[0] * rotation[0] + rotation[1] * rotation[1]
+					 + rotation[2] * rotation[2] + rotation[3] * rotation[3]);
+
+	if (length > 0.f)
+	{
+		const GLfloat x = rotation[0] / length, y = rotation[1] / length, z = rotation[2] / length,
+			w = rotation[3] / length;
+
+		result.m[0][0] = 1 - 2 * (y * y + z * z);
+		result.m[0][1] = 2 * (x * y - z * w);
+		result.m[0][2] = 2 * (x * z + y * w);
+		result.m[1][0] = 2 * (x * y + z * w);
+		result.m[1][1] = 1 - 2 * (x * x + z * z);
+		result.m[1][2] = 2 * (y * z - x * w);
+		result.m[2][0] = 2 * (x * z - y * w);
+		result.m[2][1] = 2 * (y * z + x * w);
+		result.m[2][2] = 1 - 2 * (x * x + y * y);
+	}
+
+	for (size_t row = 0; row < 3; ++row)
+	{
+		for (size_t col = 0; col < 3; ++col)
+			result.m[row][col] *= scale[col];
+		result.m[row][3] = translation[row];
+	}
+	return result;
+}
+
+// Components of a node property, or the defaults if it isn't there
+static void nodeVector(const JsonValue& value, GLfloat* to, size_t size)
+{
+	if (value.size() != size)
+		return;
+	for (size_t i = 0; i < size; ++i)
+		to[i] = static_cast<GLfloat>(value[i].number(to[i]));
+}
+
+static void nodeTRS(const JsonValue& node, GLfloat translation[3], GLfloat rotation[4], GLfloat scale[3])
+{
+	const JsonValue& matrix = node["matrix"];
+
+	if (matrix.size() == 16)
+	{
+		gltfDecompose(gltfNodeMatrix(node), translation, rotation, scale);
+		return;
+	}
+
+	std::fill(translation, translation + 3, 0.f);
+	std::fill(rotation, rotation + 3, 0.f);
+	rotation[3] = 1.f;
+	std::fill(scale, scale + 3, 1.f);
+	nodeVector(node["translation"], translation, 3);
+	nodeVector(node["rotation"], rotation, 4);
+	nodeVector(node["scale"], scale, 3);
+}
+
+WZMMatrix4 gltfNodeMatrix(const JsonValue& node)
+{
+	const JsonValue& matrix = node["matrix"];
+
+	// column major
+	if (matrix.size() == 16)
+	{
+		WZMMatrix4 result;
+		for (size_t row = 0; row < 3; ++row)
+			for (size_t col = 0; col < 4; ++col)
+				result.m[row][col] = static_cast<GLfloat>(matrix[col * 4 + row].number(row == col ? 1. : 0.));
+		return result;
+	}
+
+	GLfloat translation[3], rotation[4], scale[3];
+	nodeTRS(node, translation, rotation, scale);
+	return trsMatrix(translation, rotation, scale);
+}
+
+// Column lengths are the scale, a reflection goes to x
+static void decomposeScale(const WZMMatrix4& transform, GLfloat scale[3], GLfloat rotation[3][3])
+{
+	for (size_t col = 0; col < 3; ++col)
+	{
+		scale[col] = std::sqrt(transform.m[0][col] * transform.m[0][col] + transform.m[1][col] * transform.m[1][col]
+				       + transform.m[2][col] * transform.m[2][col]);
+	}
+	if (transform.determinant() < 0)
+		scale[0] = -scale[0];
+
+	for (size_t row = 0; row < 3; ++row)
+		for (size_t col = 0; col < 3; ++col)
+			rotation[row][col] = row == col ? 1.f : 0.f;
+
+	if (scale[0] == 0.f || scale[1] == 0.f || scale[2] == 0.f)
+		return;
+	for (size_t row = 0; row < 3; ++row)
+		for (size_t col = 0; col < 3; ++col)
+			rotation[row][col] = transform.m[row][col] / scale[col];
+}
+
+void gltfDecompose(const WZMMatrix4& transform, GLfloat translation[3], GLfloat rotation[4], GLfloat scale[3])
+{
+	GLfloat r[3][3];
+	GLfloat& x = rotation[0];
+	GLfloat& y = rotation[1];
+	GLfloat& z = rotation[2];
+	GLfloat& w = rotation[3];
+
+	for (size_t row = 0; row < 3; ++row)
+		translation[row] = transform.m[row][3];
+	decomposeScale(transform, scale, r);
+
+	// from the largest of the diagonal terms, for precision
+	const GLfloat trace = r[0][0] + r[1][1] + r[2][2];
+	if (trace > 0.f)
+	{
+		const GLfloat s = std::sqrt(trace + 1.f) * 2.f;
+		w = s / 4.f;
+		x = (r[2][1] - r[1][2]) / s;
+		y = (r[0][2] - r[2][0]) / s;
+		z = (r[1][0] - r[0][1]) / s;
+	}
+	else if (r[0][0] > r[1][1] && r[0][0] > r[2][2])
+	{
+		const GLfloat s = std::sqrt(1.f + r[0][0] - r[1][1] - r[2][2]) * 2.f;
+		w = (r[2][1] - r[1][2]) / s;
+		x = s / 4.f;
+		y = (r[0][1] + r[1][0]) / s;
+		z = (r[0][2] + r[2][0]) / s;
+	}
+	else if (r[1][1] > r[2][2])
+	{
+		const GLfloat s = std::sqrt(1.f + r[1][1] - r[0][0] - r[2][2]) * 2.f;
+		w = (r[0][2] - r[2][0]) / s;
+		x = (r[0][1] + r[1][0]) / s;
+		y = s / 4.f;
+		z = (r[1][2] + r[2][1]) / s;
+	}
+	else
+	{
+		const GLfloat s = std::sqrt(1.f + r[2][2] - r[0][0] - r[1][1]) * 2.f;
+		w = (r[1][0] - r[0][1]) / s;
+		x = (r[0][2] + r[2][0]) / s;
+		y = (r[1][2] + r[2][1]) / s;
+		z = s / 4.f;
+	}
+}
+
+static WZMMatrix4 axisRotation(size_t axis, GLfloat degrees)
+{
+	WZMMatrix4 result;
+	const size_t a = (axis + 1) % 3, b = (axis + 2) % 3;
+	const GLfloat c = std::cos(degrees / DEGREES), s = std::sin(degrees / DEGREES);
+
+	result.m[a][a] = c;
+	result.m[a][b] = -s;
+	result.m[b][a] = s;
+	result.m[b][b] = c;
+	return result;
+}
+
+WZMMatrix4 frameMatrix(const Frame& frame)
+{
+	return WZMMatrix4::translation(frame.trans) * axisRotation(0, frame.rot.x()) * axisRotation(1, frame.rot.y())
+		* axisRotation(2, frame.rot.z()) * WZMMatrix4::scaling(frame.scale.x(), frame.scale.y(), frame.scale.z());
+}
+
+Frame matrixFrame(const WZMMatrix4& transform)
+{
+	Frame frame;
+	GLfloat r[3][3], scale[3], x, y, z;
+
+	decomposeScale(transform, scale, r);
+
+	// R = Rx Ry Rz has sin y at the top right, x and z follow unless cos y is 0
+	const GLfloat sinY = std::max(-1.f, std::min(1.f, r[0][2]));
+	y = std::asin(sinY);
+	if (std::abs(sinY) < 0.99999f)
+	{
+		x = std::atan2(-r[1][2], r[2][2]);
+		z = std::atan2(-r[0][1], r[0][0]);
+	}
+	else
+	{
+		x = std::atan2(r[2][1], r[1][1]);
+		z = 0.f;
+	}
+
+	// + 0 turns the -0 of unrotated axes into 0
+	frame.trans = WZMVertex(transform.m[0][3], transform.m[1][3], transform.m[2][3]);
+	frame.rot = WZMVertex(x * DEGREES + 0.f, y * DEGREES + 0.f, z * DEGREES + 0.f);
+	frame.scale = WZMVertex(scale[0], scale[1], scale[2]);
+	return frame;
+}
+
+WZMMatrix4 affineInverse(const WZMMatrix4& transform)
+{
+	const WZMMatrix4 inverseTranspose = transform.normalMatrix();
+	WZMMatrix4 result;
+
+	for (size_t row = 0; row < 3; ++row)
+		for (size_t col = 0; col < 3; ++col)
+			result.m[row][col] = inverseTranspose.m[col][row];
+
+	const WZMVertex translation = result.transformDirection(WZMVertex(transform.m[0][3], transform.m[1][3], transform.m[2][3]));
+	for (size_t row = 0; row < 3; ++row)
+		result.m[row][3] = -translation[row];
+	return result;
+}
+
+namespace
+{
+	enum GLTFPath {GLTF_TRANSLATION = 0, GLTF_ROTATION, GLTF_SCALE};
+
+	struct GLTFChannel
+	{
+		GLTFPath path;
+		std::vector<GLfloat> times, values;
+		bool step, cubic; // cubic splines keep each value between its tangents
+	};
+
+	void slerp(const GLfloat* a, const GLfloat* b, GLfloat f, GLfloat* to)
+	{
+		GLfloat dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+		const GLfloat sign = dot < 0.f ? -1.f : 1.f;
+		GLfloat weightA = 1.f - f, weightB = f * sign;
+
+		dot = std::abs(dot);
+		if (dot < 0.9995f)
+		{
+			const GLfloat angle = std::acos(dot), sine = std::sin(angle);
+			weightA = std::sin((1.f - f) * angle) / sine;
+			weightB = sign * std::sin(f * angle) / sine;
+		}
+		for (size_t k = 0; k < 4; ++k)
+			to[k] = a[k] * weightA + b[k] * weightB;
+	}
+
+	void sample(const GLTFChannel& channel, GLfloat time, GLfloat* to)
+	{
+		const size_t components = channel.path == GLTF_ROTATION ? 4 : 3;
+		const size_t next = std::upper_bound(channel.times.begin(), channel.times.end(), time) - channel.times.begin();
+		auto value = [&](size_t key) {return &channel.values[(channel.cubic ? key * 3 + 1 : key) * components];};
+
+		if (next == 0 || next == channel.times.size() || channel.step)
+		{
+			const GLfloat* from = value(next ? next - 1 : 0);
+			std::copy(from, from + components, to);
+			return;
+		}
+
+		const GLfloat begin = channel.times[next - 1], end = channel.times[next];
+		const GLfloat f = end > begin ? (time - begin) / (end - begin) : 0.f;
+		const GLfloat* a = value(next - 1);
+		const GLfloat* b = value(next);
+
+		if (channel.path == GLTF_ROTATION)
+			slerp(a, b, f, to);
+		else
+		{
+			for (size_t k = 0; k < components; ++k)
+				to[k] = a[k] + (b[k] - a[k]) * f;
+		}
+	}
+}
+
+bool GLBFile::nodeAnimation(size_t node, GLTFNodeAnimation& out) const
+{
+	const JsonValue& animations = m_json["animations"];
+	std::vector<GLTFChannel> channels;
+
+	out.frames.clear();
+	out.frameTime = 0;
+
+	// WZM meshes have a single animation
+	for (size_t a = 0; a < animations.size() && channels.empty(); ++a)
+	{
+		const JsonValue& animation = animations[a];
+		const JsonValue& animationChannels = animation["channels"];
+
+		for (size_t c = 0; c < animationChannels.size(); ++c)
+		{
+			const JsonValue& channel = animationChannels[c];
+			const std::string& path = channel["target"]["path"].string();
+			size_t target, samplerIndex;
+			GLTFAccessor input, output;
+			GLTFChannel sampled;
+
+			if (!gltfIndex(channel["target"]["node"], target) || target != node)
+				continue;
+			if (path == "translation")
+				sampled.path = GLTF_TRANSLATION;
+			else if (path == "rotation")
+				sampled.path = GLTF_ROTATION;
+			else if (path == "scale")
+				sampled.path = GLTF_SCALE;
+			else
+				continue; // morph target weights
+
+			const unsigned components = sampled.path == GLTF_ROTATION ? 4 : 3;
+			if (!gltfIndex(channel["sampler"], samplerIndex))
+				samplerIndex = animation["samplers"].size(); // a null sampler, which fails below
+			const JsonValue& sampler = animation["samplers"][samplerIndex];
+			const std::string& interpolation = sampler["interpolation"].string();
+
+			sampled.step = interpolation == "STEP";
+			sampled.cubic = interpolation == "CUBICSPLINE";
+			if (!accessor(sampler["input"], input) || !accessor(sampler["output"], output)
+				|| output.count != input.count * (sampled.cubic ? 3 : 1))
+			{
+				std::cerr << "GLBFile::nodeAnimation - Error reading animation sampler";
+				return false;
+			}
+
+			sampled.times.resize(input.count);
+			sampled.values.resize(output.count * components);
+			if (!readGLTFFloats(input, 1, sampled.times.data()) || !readGLTFFloats(output, components, sampled.values.data())
+				|| !std::is_sorted(sampled.times.begin(), sampled.times.end()))
+			{
+				std::cerr << "GLBFile::nodeAnimation - Error reading animation keys";
+				return false;
+			}
+			channels.push_back(std::move(sampled));
+		}
+	}
+
+	if (channels.empty())
+		return false;
+
+	// frames as far apart as the closest keys, to the millisecond
+	GLfloat start = channels[0].times.front(), end = start, step = 0.f;
+	for (const GLTFChannel& channel: channels)
+	{
+		start = std::min(start, channel.times.front());
+		end = std::max(end, channel.times.back());
+		for (size_t i = 1; i < channel.times.size(); ++i)
+		{
+			const GLfloat gap = channel.times[i] - channel.times[i - 1];
+			if (gap >= 0.0005f && (step == 0.f || gap < step))
+				step = gap;
+		}
+	}
+
+	size_t frames = 1;
+	out.frameTime = 100;
+	if (step > 0.f)
+	{
+		const double span = (static_cast<double>(end) - start) * 1000.;
+
+		out.frameTime = std::max(1, static_cast<int>(std::lround(step * 1000.)));
+		if (span / out.frameTime >= GLTF_MAX_FRAMES)
+			out.frameTime = static_cast<int>(std::ceil(span / (GLTF_MAX_FRAMES - 1)));
+		frames = static_cast<size_t>(std::lround(span / out.frameTime)) + 1;
+	}
+
+	GLfloat rest[3][4];
+	nodeTRS(m_json["nodes"][node], rest[GLTF_TRANSLATION], rest[GLTF_ROTATION], rest[GLTF_SCALE]);
+
+	out.frames.reserve(frames);
+	for (size_t i = 0; i < frames; ++i)
+	{
+		const GLfloat time = start + static_cast<GLfloat>(i * out.frameTime / 1000.);
+		GLfloat trs[3][4];
+
+		std::copy(&rest[0][0], &rest[0][0] + 12, &trs[0][0]);
+		for (const GLTFChannel& channel: channels)
+			sample(channel, time, trs[channel.path]);
+		out.frames.push_back(trsMatrix(trs[GLTF_TRANSLATION], trs[GLTF_ROTATION], trs[GLTF_SCALE]));
+	}
+	return true;
+}
+
+GLBWriter::GLBWriter()
+{
+	JsonValue& asset = m_json.member("asset", JsonValue::object());
+	asset.set("version", "2.0");
+	asset.set("generator", "WMIT");
+}
+
+size_t GLBWriter::addAccessor(const void* data, size_t count, unsigned componentType, const char* type,
+			      unsigned target, const JsonValue& min, const JsonValue& max)
+{
+	const size_t size = count * componentSize(componentType) * typeComponents(type);
+	JsonValue view = JsonValue::object();
+	JsonValue accessor = JsonValue::object();
+
+	// views start 4 byte aligned, as floats have to
+	m_bin.resize((m_bin.size() + 3) / 4 * 4);
+
+	view.set("buffer", 0);
+	view.set("byteOffset", m_bin.size());
+	view.set("byteLength", size);
+	if (target)
+		view.set("target", target);
+	m_bin.insert(m_bin.end(), static_cast<const char*>(data), static_cast<const char*>(data) + size);
+
+	accessor.set("bufferView", m_json["bufferViews"].size());
+	accessor.set("componentType", componentType);
+	accessor.set("count", count);
+	accessor.set("type", type);
+	if (!min.isNull())
+		accessor.set("min", min);
+	if (!max.isNull())
+		accessor.set("max", max);
+
+	// one at a time, adding members moves the others
+	m_json.member("bufferViews", JsonValue::array()).append(view);
+	JsonValue& accessors = m_json.member("accessors", JsonValue::array());
+	accessors.append(accessor);
+	return accessors.size() - 1;
+}
+
+void GLBWriter::write(std::ostream& out)
+{
+	std::ostringstream text;
+	std::string json;
+
+	m_bin.resize((m_bin.size() + 3) / 4 * 4);
+	if (!m_bin.empty())
+	{
+		JsonValue buffer = JsonValue::object();
+		buffer.set("byteLength", m_bin.size());
+		m_json.set("buffers", JsonValue::array()).append(buffer);
+	}
+
+	{
+		TextWriter writer(text);
+		m_json.write(writer);
+	}
+	json = text.str();
+	json.resize((json.size() + 3) / 4 * 4, ' ');
+
+	const uint32_t jsonChunk[2] = {static_cast<uint32_t>(json.size()), GLB_CHUNK_JSON};
+	const uint32_t binChunk[2] = {static_cast<uint32_t>(m_bin.size()), GLB_CHUNK_BIN};
+	const uint32_t header[3] = {GLB_MAGIC, GLB_VERSION, static_cast<uint32_t>(sizeof(header) + sizeof(jsonChunk) + json.size()
+		+ (m_bin.empty() ? 0 : sizeof(binChunk) + m_bin.size()))};
+
+	out.write(reinterpret_cast<const char*>(header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(jsonChunk), sizeof(jsonChunk));
+	out.write(json.data(), json.size());
+	if (!m_bin.empty())
+	{
+		out.write(reinterpret_cast<const char*>(binChunk), sizeof(binChunk));
+		out.write(m_bin.data(), m_bin.size());
+	}
+}
@@ -0,0 +1,134 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef GLTF_HPP
+#define GLTF_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include <GL/glew.h>
+#include "Json.h"
+#include "Mesh.h"
+
+/*
+ * glTF 2.0 binary (.glb): a JSON chunk describing the scene and a binary
+ * chunk the accessors point into, so vertex data is copied out as it is.
+ * Only the binary chunk is read, buffers in other files are not.
+ *
+ * glTF is right handed with y up, WZM the mirror image of it on x,
+ * as for OBJ. Texture coordinates share their origin with WZM.
+ */
+
+#define GLB_MAGIC 0x46546C67u // "glTF"
+#define GLB_VERSION 2
+#define GLB_CHUNK_JSON 0x4E4F534Au
+#define GLB_CHUNK_BIN 0x004E4942u
+
+#define GLTF_BYTE 5120
+#define GLTF_UNSIGNED_BYTE 5121
+#define GLTF_SHORT 5122
+#define GLTF_UNSIGNED_SHORT 5123
+#define GLTF_UNSIGNED_INT 5125
+#define GLTF_FLOAT 5126
+
+#define GLTF_ARRAY_BUFFER 34962
+#define GLTF_ELEMENT_ARRAY_BUFFER 34963
+#define GLTF_TRIANGLES 4
+
+#define GLTF_MAX_FRAMES 10000 // sampled animation frames per node
+
+/// Where an accessor's elements are in the binary chunk
+struct GLTFAccessor
+{
+	const char* data; // first element
+	size_t count, stride; // elements, bytes from one to the next
+	unsigned componentType, components;
+	bool normalized;
+};
+
+/// A node's animated transform, sampled every frameTime milliseconds
+struct GLTFNodeAnimation
+{
+	std::vector<WZMMatrix4> frames;
+	int frameTime;
+};
+
+// Reads a .glb held in memory, pointing into it
+class GLBFile
+{
+public:
+	GLBFile(): m_bin(nullptr), m_binSize(0) {}
+
+	bool read(const char* data, size_t size);
+
+	const JsonValue& json() const {return m_json;}
+
+	/// Checks the accessor at index lies within the binary chunk
+	bool accessor(const JsonValue& index, GLTFAccessor& out) const;
+
+	/// Samples the channels of the first animation targeting node, false if there are none
+	bool nodeAnimation(size_t node, GLTFNodeAnimation& out) const;
+
+private:
+	JsonValue m_json;
+	const char* m_bin;
+	size_t m_binSize;
+};
+
+/// Non-negative integer below limit, as glTF indices, counts and offsets are
+bool gltfIndex(const JsonValue& value, size_t& out, size_t limit = SIZE_MAX);
+
+/// Whole elements as floats, normalized integers mapped to [0, 1] or [-1, 1]
+bool readGLTFFloats(const GLTFAccessor& accessor, unsigned components, GLfloat* to);
+/// Triangles of indices below vertices, copied as they are when 16 or 32-bit
+bool readGLTFIndices(const GLTFAccessor& accessor, size_t vertices, IndexArray& to);
+
+// Builds a .glb, the binary chunk growing by one buffer view per accessor
+class GLBWriter
+{
+public:
+	GLBWriter();
+
+	JsonValue& json() {return m_json;}
+
+	/// Copies count elements of type ("SCALAR", "VEC3"...) and returns the accessor index
+	size_t addAccessor(const void* data, size_t count, unsigned componentType, const char* type,
+			   unsigned target = 0, const JsonValue& min = JsonValue(), const JsonValue& max = JsonValue());
+
+	void write(std::ostream& out);
+
+private:
+	JsonValue m_json;
+	std::vector<char> m_bin;
+};
+
+/// Local transform of a node, from its matrix or its translation, rotation and scale
+WZMMatrix4 gltfNodeMatrix(const JsonValue& node);
+/// Translation, unit quaternion (x y z w) and scale of a map without shear
+void gltfDecompose(const WZMMatrix4& transform, GLfloat translation[3], GLfloat rotation[4], GLfloat scale[3]);
+
+// WZM frames apply translation, rotation about x, y and z in degrees, then scale
+WZMMatrix4 frameMatrix(const Frame& frame);
+Frame matrixFrame(const WZMMatrix4& transform); // maps without shear only
+
+WZMMatrix4 affineInverse(const WZMMatrix4& transform); // identity if singular
+
+#endif // GLTF_HPP
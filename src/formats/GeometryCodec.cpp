@@ -0,0 +1,378 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "GeometryCodec.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+	inline uint64_t zigzag(int64_t value)
+	{
+		return value < 0 ? (static_cast<uint64_t>(-(value + 1)) << 1) | 1 : static_cast<uint64_t>(value) << 1;
+	}
+
+	inline int64_t unzigzag(uint64_t value)
+	{
+		return value & 1 ? -static_cast<int64_t>(value >> 1) - 1 : static_cast<int64_t>(value >> 1);
+	}
+
+	void putVarint(std::vector<char>& out, uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			out.push_back(static_cast<char>(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back(static_cast<char>(value));
+	}
+
+	// Reads up to maxBytes of varint, false past end or when longer
+	inline bool getVarint(const unsigned char*& in, const unsigned char* end, unsigned maxBytes, uint64_t& value)
+	{
+		value = 0;
+		for (unsigned i = 0; i < maxBytes && in != end; ++i)
+		{
+			const unsigned char byte = *in++;
+			value |= static_cast<uint64_t>(byte & 0x7f) << (7 * i);
+			if (!(byte & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+	// 16-bit components, deltas wrap around so each fits 3 varint bytes
+	void packStream(const uint16_t* plane, size_t count, std::vector<char>& out)
+	{
+		uint16_t previous = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			putVarint(out, zigzag(static_cast<int16_t>(static_cast<uint16_t>(plane[i] - previous))));
+			previous = plane[i];
+		}
+	}
+
+	// Into every stride'th uint16_t from out
+	bool unpackStream(const unsigned char* in, size_t size, size_t count, char* out, size_t stride)
+	{
+		const unsigned char* end = in + size;
+		uint16_t previous = 0;
+		uint64_t value;
+
+		for (size_t i = 0; i < count; ++i, out += stride)
+		{
+			// mostly single bytes
+			if (in != end && *in < 0x80)
+				value = *in++;
+			else if (!getVarint(in, end, 3, value) || value > 0xffff)
+				return false;
+			previous = static_cast<uint16_t>(previous + unzigzag(value));
+			std::memcpy(out, &previous, sizeof(previous));
+		}
+		return in == end;
+	}
+
+	struct Edge
+	{
+		GLuint from, to;
+	};
+
+	// The edges of the last PACKED_EDGE_FIFO / 3 triangles, newest at position 0
+	class EdgeFifo
+	{
+	public:
+		EdgeFifo(): m_pushed(0) {}
+
+		void push(const IndexedTri& tri)
+		{
+			for (size_t i = 0; i < 3; ++i)
+			{
+				m_edges[m_pushed % PACKED_EDGE_FIFO] = {tri[i], tri[(i + 1) % 3]};
+				++m_pushed;
+			}
+		}
+
+		size_t size() const {return std::min<size_t>(m_pushed, PACKED_EDGE_FIFO);}
+		const Edge& operator [](size_t position) const
+		{
+			return m_edges[(m_pushed - 1 - position) % PACKED_EDGE_FIFO];
+		}
+
+	private:
+		Edge m_edges[PACKED_EDGE_FIFO];
+		size_t m_pushed;
+	};
+
+	/*
+	 * Control bytes: 0x80 | position << 3 | rotation << 1 | third is next
+	 * for a triangle whose rotation starts with a fifo edge reversed,
+	 * otherwise a bit per index that is next. Next is one past the
+	 * highest index so far, what vertex ordered meshes use for new ones.
+	 */
+	const unsigned char EDGE_HIT = 0x80;
+}
+
+bool packVertices(const CompactVertexArray& vertices, std::vector<char>& out)
+{
+	const size_t count = vertices.size();
+	PackedVertexHeader header;
+	std::vector<uint16_t> planes(count * PACKED_STREAMS);
+
+	std::memset(&header, 0, sizeof(header));
+	header.uvEncoding = vertices.uvEncoding();
+
+	for (size_t k = 0; k < 3 && count; ++k)
+	{
+		GLfloat low = vertices.vertices()[0].pos[k], high = low;
+		for (const WZMCompactVertex& vert: vertices.vertices())
+		{
+			if (!std::isfinite(vert.pos[k]))
+				return false;
+			low = std::min(low, vert.pos[k]);
+			high = std::max(high, vert.pos[k]);
+		}
+
+		header.origin[k] = low;
+		header.step[k] = (high - low) / PACKED_POSITION_STEPS;
+		if (!std::isfinite(header.step[k]))
+			return false;
+	}
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const WZMCompactVertex& vert = vertices.vertices()[i];
+
+		for (size_t k = 0; k < 3; ++k)
+		{
+			const float steps = header.step[k] > 0.f ? std::round((vert.pos[k] - header.origin[k]) / header.step[k]) : 0.f;
+			planes[k * count + i] = static_cast<uint16_t>(std::min<float>(std::max(steps, 0.f), PACKED_POSITION_STEPS));
+		}
+		planes[3 * count + i] = vert.uv[0];
+		planes[4 * count + i] = vert.uv[1];
+		planes[5 * count + i] = static_cast<uint16_t>(vert.normal[0]);
+		planes[6 * count + i] = static_cast<uint16_t>(vert.normal[1]);
+		planes[7 * count + i] = static_cast<uint16_t>(vert.tangent[0]);
+		planes[8 * count + i] = static_cast<uint16_t>(vert.tangent[1]);
+	}
+
+	const size_t start = out.size();
+	out.resize(start + sizeof(header));
+	for (size_t s = 0; s < PACKED_STREAMS; ++s)
+	{
+		const size_t streamStart = out.size();
+		packStream(planes.data() + s * count, count, out);
+		header.streamSizes[s] = static_cast<uint32_t>(out.size() - streamStart);
+	}
+	std::memcpy(out.data() + start, &header, sizeof(header));
+	return true;
+}
+
+bool unpackVertices(const char* data, size_t size, size_t count, CompactVertexArray& vertices)
+{
+	PackedVertexHeader header;
+
+	// every component takes a byte at least
+	if (size < sizeof(header) || count > (size - sizeof(header)) / PACKED_STREAMS)
+		return false;
+	std::memcpy(&header, data, sizeof(header));
+	if (header.uvEncoding != WZM_UV_UNORM16 && header.uvEncoding != WZM_UV_HALF)
+		return false;
+
+	// quantised positions go to the start of pos first, the others right where they belong
+	std::vector<WZMCompactVertex> compact(count);
+	char* const first = reinterpret_cast<char*>(compact.data());
+	const size_t fields[PACKED_STREAMS] = {offsetof(WZMCompactVertex, pos), offsetof(WZMCompactVertex, pos) + 2,
+		offsetof(WZMCompactVertex, pos) + 4, offsetof(WZMCompactVertex, uv), offsetof(WZMCompactVertex, uv) + 2,
+		offsetof(WZMCompactVertex, normal), offsetof(WZMCompactVertex, normal) + 2,
+		offsetof(WZMCompactVertex, tangent), offsetof(WZMCompactVertex, tangent) + 2};
+	uint64_t offset = sizeof(header);
+
+	for (size_t s = 0; s < PACKED_STREAMS; ++s)
+	{
+		if (header.streamSizes[s] > size - offset
+			|| !unpackStream(reinterpret_cast<const unsigned char*>(data + offset), header.streamSizes[s], count,
+					 first + fields[s], sizeof(WZMCompactVertex)))
+		{
+			return false;
+		}
+		offset += header.streamSizes[s];
+	}
+	if (offset != size)
+		return false;
+
+	for (WZMCompactVertex& vert: compact)
+	{
+		uint16_t steps[3];
+		std::memcpy(steps, vert.pos, sizeof(steps));
+		for (size_t k = 0; k < 3; ++k)
+			vert.pos[k] = header.origin[k] + header.step[k] * steps[k];
+	}
+
+	vertices.assign(std::move(compact), static_cast<WZMUVEncoding>(header.uvEncoding));
+	return true;
+}
+
+void packTriangles(const IndexArray& indices, std::vector<char>& out)
+{
+	const size_t triangles = indices.size();
+	std::vector<char> data;
+	EdgeFifo fifo;
+	uint64_t next = 0;
+
+	const size_t start = out.size();
+	out.resize(start + triangles);
+
+	// The varint of an index, unless it's next
+	auto code = [&next, &data](GLuint index) -> bool
+	{
+		const bool isNext = index == next;
+		if (!isNext)
+			putVarint(data, zigzag(static_cast<int64_t>(next) - static_cast<int64_t>(index)));
+		next = std::max<uint64_t>(next, static_cast<uint64_t>(index) + 1);
+		return isNext;
+	};
+
+	for (size_t t = 0; t < triangles; ++t)
+	{
+		const IndexedTri tri = indices[t];
+		size_t bestPosition = PACKED_EDGE_FIFO, bestRotation = 0;
+
+		for (size_t rotation = 0; rotation < 3; ++rotation)
+		{
+			const GLuint from = tri[rotation], to = tri[(rotation + 1) % 3];
+			for (size_t position = 0; position < std::min(bestPosition, fifo.size()); ++position)
+			{
+				if (fifo[position].from == to && fifo[position].to == from)
+				{
+					bestPosition = position;
+					bestRotation = rotation;
+					break;
+				}
+			}
+		}
+
+		unsigned char control;
+		if (bestPosition < PACKED_EDGE_FIFO)
+		{
+			control = static_cast<unsigned char>(EDGE_HIT | bestPosition << 3 | bestRotation << 1);
+			if (code(tri[(bestRotation + 2) % 3]))
+				control |= 1;
+		}
+		else
+		{
+			control = 0;
+			for (size_t i = 0; i < 3; ++i)
+			{
+				if (code(tri[i]))
+					control |= static_cast<unsigned char>(1 << i);
+			}
+		}
+
+		out[start + t] = static_cast<char>(control);
+		fifo.push(tri);
+	}
+	out.insert(out.end(), data.begin(), data.end());
+}
+
+bool unpackTriangles(const char* data, size_t size, size_t triangles, size_t vertices, bool wide,
+		     IndexArray& indices)
+{
+	if (size < triangles)
+		return false;
+
+	const unsigned char* control = reinterpret_cast<const unsigned char*>(data);
+	const unsigned char* in = control + triangles;
+	const unsigned char* end = control + size;
+	const uint64_t limit = wide ? vertices : std::min<uint64_t>(vertices, 0x10000);
+	std::vector<GLuint> flat(triangles * 3);
+	EdgeFifo fifo;
+	uint64_t next = 0;
+	bool valid = true;
+
+	auto decode = [&](bool isNext) -> GLuint
+	{
+		uint64_t value;
+		int64_t index = static_cast<int64_t>(next);
+
+		if (!isNext)
+		{
+			if (!getVarint(in, end, 10, value))
+			{
+				valid = false;
+				return 0;
+			}
+			index -= unzigzag(value);
+		}
+		if (index < 0 || static_cast<uint64_t>(index) >= limit)
+		{
+			valid = false;
+			return 0;
+		}
+		next = std::max<uint64_t>(next, static_cast<uint64_t>(index) + 1);
+		return static_cast<GLuint>(index);
+	};
+
+	for (size_t t = 0; t < triangles && valid; ++t)
+	{
+		IndexedTri tri;
+
+		if (control[t] & EDGE_HIT)
+		{
+			const size_t position = (control[t] >> 3) & (PACKED_EDGE_FIFO - 1);
+			const size_t rotation = (control[t] >> 1) & 3;
+
+			if (position >= fifo.size() || rotation > 2)
+				return false;
+
+			tri[rotation] = fifo[position].to;
+			tri[(rotation + 1) % 3] = fifo[position].from;
+			tri[(rotation + 2) % 3] = decode(control[t] & 1);
+		}
+		else
+		{
+			if (control[t] >> 3)
+				return false;
+			for (size_t i = 0; i < 3; ++i)
+				tri[i] = decode(control[t] & (1 << i));
+		}
+
+		flat[t * 3] = tri[0];
+		flat[t * 3 + 1] = tri[1];
+		flat[t * 3 + 2] = tri[2];
+		fifo.push(tri);
+	}
+
+	if (!valid || in != end)
+		return false;
+
+	if (wide)
+	{
+		indices.assign(flat.data(), triangles, true);
+	}
+	else
+	{
+		const std::vector<GLushort> narrow(flat.begin(), flat.end());
+		indices.assign(narrow.data(), triangles, false);
+	}
+	return true;
+}
@@ -0,0 +1,65 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef GEOMETRYCODEC_HPP
+#define GEOMETRYCODEC_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <GL/glew.h>
+#include "VertexCodec.h"
+#include "IndexArray.h"
+
+/*
+ * Packed meshes, small on disk and a single pass to decode.
+ *
+ * Vertices start from the compact encoding, positions then get quantised
+ * to 16 bits over their bounds. Each of the 9 attribute components is
+ * delta coded against the previous vertex as its own stream of zigzag
+ * varints, so general purpose compressors find the runs.
+ *
+ * Triangles are coded against the edges of the recent ones, a triangle
+ * sharing one of them costs one control byte plus its third index.
+ * Index order, winding included, is kept as it is.
+ */
+
+#define PACKED_POSITION_STEPS 65535 // 16 bits over the bounds per axis
+#define PACKED_STREAMS 9 // position xyz, uv, normal and tangent xy
+#define PACKED_EDGE_FIFO 16
+
+struct PackedVertexHeader
+{
+	GLfloat origin[3], step[3]; // position = origin + step * quantised
+	uint32_t uvEncoding; // WZMUVEncoding
+	uint32_t streamSizes[PACKED_STREAMS]; // bytes, the streams follow in order
+};
+static_assert(sizeof(PackedVertexHeader) == 64, "PackedVertexHeader layout changed.");
+
+/// Fails on positions that aren't finite
+bool packVertices(const CompactVertexArray& vertices, std::vector<char>& out);
+bool unpackVertices(const char* data, size_t size, size_t count, CompactVertexArray& vertices);
+
+/// One control byte per triangle, then the varints of the indices not found in edges
+void packTriangles(const IndexArray& indices, std::vector<char>& out);
+/// Fails unless there are exactly triangles, all indexing below vertices
+bool unpackTriangles(const char* data, size_t size, size_t triangles, size_t vertices, bool wide,
+		     IndexArray& indices);
+
+#endif // GEOMETRYCODEC_HPP
@@ -20,11 +20,12 @@
 #include "Mesh.h"
 
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <functional>
 #include <iterator>
 #include <map>
 #include <set>
-#include <tuple>
 
 #include <sstream>
 
@@ -33,50 +34,21 @@
 #include "Pie.h"
 #include "Vector.h"
 #include "Mesh.h"
-
-typedef std::tuple<WZMVertex, WZMUV, WZMVertex> WZMPoint;
+#include "VertexWelder.h"
+#include "MeshSimplifier.h"
+#include "MeshKernels.h"
+#include "GeometryCodec.h"
+#include "GLTF.h"
+#include "Parallel.h"
+#include "TextScanner.h"
 
 // Scale animation numbers from int to float
 #define INT_SCALE       1000
 static const float FROM_INT_SCALE = 0.001f;
 
-struct compareWZMPoint_less_wEps: public std::binary_function<WZMPoint&, WZMPoint&, bool>
-{
-	const WZMVertex::less_wEps vertLess;
-	const WZMUV::less_wEps uvLess;
-	const WZMVertex::equal_wEps vertEq;
-	const WZMUV::equal_wEps uvEq;
-
-public:
-	compareWZMPoint_less_wEps(float vertEps = 0.0001f, float uvEps = 0.0001f):
-		vertLess(vertEps), uvLess(uvEps), vertEq(vertEps), uvEq(uvEps) {}
-
-	bool operator() (const WZMPoint& lhs, const WZMPoint& rhs) const
-	{
-		if (vertLess(std::get<0>(lhs), std::get<0>(rhs)))
-		{
-			return true;
-		}
-		else
-		{
-			if (vertEq(std::get<0>(lhs), std::get<0>(rhs)))
-			{
-				if (uvLess(std::get<1>(lhs), std::get<1>(rhs)))
-				{
-					return true;
-				}
-				else
-				{
-					if (uvEq(std::get<1>(lhs), std::get<1>(rhs)))
-					{
-						return vertLess(std::get<2>(lhs), std::get<2>(rhs));
-					}
-				}
-			}
-		}
-		return false;
-	}
-};
+// Fewer triangles or vertices per thread aren't worth starting it
+static const size_t TB_MIN_CHUNK = 4096;
+static const size_t TRANSFORM_MIN_CHUNK = 16384;
 
 WZMConnector::WZMConnector(GLfloat x, GLfloat y, GLfloat z):
 	m_pos(x, y, z)
@@ -103,16 +75,12 @@ Mesh::Mesh()
 	defaultConstructor();
 }
 
-Mesh::Mesh(const Pie3Level& p3)
+Mesh::Mesh(const Pie3Level& p3, const WeldTolerances& tolerances)
 {
 	std::vector<Pie3Polygon>::const_iterator itL;
 
-	typedef std::set<WZMPoint, compareWZMPoint_less_wEps> t_tupleSet;
-	t_tupleSet tupleSet;
-	std::pair<t_tupleSet::iterator, bool> inResult;
-
-	std::vector<int> mapping;
-	std::vector<int>::iterator itMap;
+	VertexWelder welder(tolerances);
+	bool inserted;
 
 	IndexedTri iTri;
 	WZMVertex tmpNrm;
@@ -123,6 +91,11 @@ Mesh::Mesh(const Pie3Level& p3)
 
 	defaultConstructor();
 
+	// welding rarely adds many vertices past the pie's points
+	reservePoints(p3.points());
+	reserveIndices(p3.polygons());
+	welder.reserve(p3.points());
+
 	/*
 	 *	Try to prevent duplicate vertices
 	 *	(remember, different UV's, or animations,
@@ -164,23 +137,13 @@ Mesh::Mesh(const Pie3Level& p3)
 			if (p3.normals() != 0)
 				tmpNrm = *nrmIt++;
 
-			inResult = tupleSet.insert(WZMPoint(v[i], itL->getUV(i, 0), tmpNrm));
+			const WZMUV uv = itL->getUV(i, 0);
 
-			t_tupleSet::difference_type dist = std::distance(tupleSet.begin(), inResult.first);
-
-			if (!inResult.second)
-			{
-				iTri[i] = static_cast<GLushort>(mapping[static_cast<size_t>(dist)]);
-			}
-			else
+			// welder indices follow our own, since every new point is added right away
+			iTri[i] = welder.weld(v[i], uv, tmpNrm, inserted);
+			if (inserted)
 			{
-				itMap = mapping.begin();
-				std::advance(itMap, dist);
-				mapping.insert(itMap, static_cast<int>(vertices()));
-				iTri[i] = static_cast<GLushort>(vertices());
-
-				const WZMPoint& curPoint(*inResult.first);
-				addPoint(std::get<0>(curPoint), std::get<1>(curPoint), std::get<2>(curPoint));
+				addPoint(v[i], uv, tmpNrm);
 			}
 		}
 		addIndices(iTri);
@@ -215,12 +178,14 @@ Pie3Level Mesh::backConvert(const Mesh& wzmMesh)
 
 Mesh::operator Pie3Level() const
 {
-	Pie3Level p3;
-
-	std::vector<Pie3Vertex>::iterator itPV;
+	return MeshTransformView(*this);
+}
 
-	std::vector<IndexedTri>::const_iterator itTri;
+MeshTransformView::operator Pie3Level() const
+{
+	Pie3Level p3;
 
+	size_t triIdx;
 	unsigned i;
 
 	/* Note:
@@ -232,38 +197,44 @@ Mesh::operator Pie3Level() const
 	Pie3Polygon p3Poly;
 	Pie3UV	p3UV;
 	WZMVertex fixedVert;
-	typedef Pie3Vertex::equal_wEps equals;
+	const Pie3Vertex::equal_wEps equals(0.0001f);
+	PointHash pointHash(0.0001f);
+	unsigned pointIdx = 0;
 
 	p3Poly.m_flags = 0x200;
 
-	for (itTri = m_indexArray.begin(); itTri != m_indexArray.end(); ++itTri)
+	pointHash.reserve(vertices());
+	p3.m_points.reserve(vertices());
+	p3.m_normals.reserve(triangles() * 3);
+	p3.m_polygons.reserve(triangles());
+
+	for (triIdx = 0; triIdx < triangles(); ++triIdx)
 	{
-		tri = *itTri;
+		tri = triangle(triIdx);
 		for (i = 0; i < 3; ++i)
 		{
-			auto curIndex = tri[i];
-			fixedVert = m_vertexArray[curIndex];
-			mybinder1st<equals> compare(fixedVert, equals(0.0001f));
-
-			itPV = std::find_if(p3.m_points.begin(), p3.m_points.end(), compare);
+			const unsigned idx = tri[i];
+			fixedVert = position(idx);
 
-			if (itPV == p3.m_points.end())
+			// first point within tolerance, as a linear search would find
+			if (!pointHash.find(fixedVert, [&](unsigned candidate)
+				{
+					return equals(p3.m_points[candidate], fixedVert);
+				}, pointIdx))
 			{
 				// add it now
-				p3Poly.m_indices[i] = p3.m_points.size();
+				pointIdx = static_cast<unsigned>(p3.m_points.size());
+				pointHash.insert(fixedVert, pointIdx);
 				p3.m_points.push_back(fixedVert);
 			}
-			else
-			{
-				p3Poly.m_indices[i] = std::distance(p3.m_points.begin(), itPV);
-			}
+			p3Poly.m_indices[i] = pointIdx;
 
 			// TODO: deal with UV animation
-			p3UV.u() = m_textureArray[curIndex].u();
-			p3UV.v() = m_textureArray[curIndex].v();
+			p3UV.u() = uv(idx).u();
+			p3UV.v() = uv(idx).v();
 			p3Poly.m_texCoords[i] = p3UV;
 
-			p3.m_normals.push_back(m_normalArray[curIndex]);
+			p3.m_normals.push_back(normal(idx));
 		}
 		p3.m_polygons.push_back(p3Poly);
 	}
@@ -271,31 +242,34 @@ Mesh::operator Pie3Level() const
 	std::list<WZMConnector>::const_iterator itC;
 
 	// For each WZM connector
-	for (itC = m_connectors.begin(); itC != m_connectors.end(); ++itC)
+	for (itC = m_mesh.m_connectors.begin(); itC != m_mesh.m_connectors.end(); ++itC)
 	{
+		const WZMVertex pos = m_transform.transformPoint(itC->getPos());
 		Pie3Connector conn;
-		conn.pos[0] = itC->getPos()[0];
-		conn.pos[1] = itC->getPos()[2];
-		conn.pos[2] = itC->getPos()[1];
+		conn.pos[0] = pos[0];
+		conn.pos[1] = pos[2];
+		conn.pos[2] = pos[1];
 		p3.m_connectors.push_back(conn);
 	}
 
 	// shaders
-	p3.m_shader_frag = m_shader_frag;
-	p3.m_shader_vert = m_shader_vert;
+	p3.m_shader_frag = m_mesh.m_shader_frag;
+	p3.m_shader_vert = m_mesh.m_shader_vert;
 
 	// Anim object
-	p3.m_animobj.time = m_frame_time;
-	p3.m_animobj.cycles = m_frame_cycles;
-	p3.m_animobj.numframes = static_cast<int>(m_frameArray.size());
+	p3.m_animobj.time = m_mesh.m_frame_time;
+	p3.m_animobj.cycles = m_mesh.m_frame_cycles;
+	p3.m_animobj.numframes = static_cast<int>(m_mesh.m_frameArray.size());
 	ApieAnimFrame p3Frame;
 	int cur_num = 0;
-	for (const auto& curFrame: m_frameArray)
+	for (const auto& curFrame: m_mesh.m_frameArray)
 	{
+		const WZMVertex trans = m_transform.transformDirection(curFrame.trans);
+
 		p3Frame.num = cur_num++;
-		p3Frame.pos = Vertex<int>(static_cast<int>(curFrame.trans.x() * INT_SCALE),
-					  static_cast<int>(curFrame.trans.z() * INT_SCALE),
-					  static_cast<int>(curFrame.trans.y() * INT_SCALE));
+		p3Frame.pos = Vertex<int>(static_cast<int>(trans.x() * INT_SCALE),
+					  static_cast<int>(trans.z() * INT_SCALE),
+					  static_cast<int>(trans.y() * INT_SCALE));
 		p3Frame.rot = Vertex<int>(static_cast<int>(-curFrame.rot.x() * INT_SCALE),
 					  static_cast<int>(-curFrame.rot.z() * INT_SCALE),
 					  static_cast<int>(-curFrame.rot.y() * INT_SCALE));
@@ -306,15 +280,15 @@ Mesh::operator Pie3Level() const
 	return p3;
 }
 
-bool Mesh::read(std::istream& in)
+bool Mesh::read(TextScanner& in, bool compactVertices)
 {
 	std::string str;
-	unsigned i,vertices,indices;
+	unsigned i, vertices, indices;
+	int teamColours;
 
 	clear();
 
-	in >> str >> m_name;
-	if (in.fail() || str.compare(WZM_MESH_SIGNATURE) != 0)
+	if (!in.read(str) || str.compare(WZM_MESH_SIGNATURE) != 0 || !in.read(m_name))
 	{
 		std::cerr << "Mesh::read - Expected " << WZM_MESH_SIGNATURE << " directive found " << str;
 		return false;
@@ -326,115 +300,126 @@ bool Mesh::read(std::istream& in)
 		m_name = std::string();
 	}
 
-	in >> str >> m_teamColours;
-	if (in.fail() || str.compare(WZM_MESH_DIRECTIVE_TEAMCOLOURS) != 0)
+	// a bool reads as 0 or 1 only, like with streams
+	if (!in.read(str) || str.compare(WZM_MESH_DIRECTIVE_TEAMCOLOURS) != 0 || !in.read(teamColours)
+		|| (teamColours != 0 && teamColours != 1))
 	{
 		std::cerr << "Mesh::read - Expected " << WZM_MESH_DIRECTIVE_TEAMCOLOURS << " directive found " << str;
 		return false;
 	}
+	m_teamColours = teamColours != 0;
 
-	in >> str;
-	if (in.fail() || str.compare(WZM_MESH_DIRECTIVE_MINMAXTSCEN) != 0)
+	if (!in.read(str) || str.compare(WZM_MESH_DIRECTIVE_MINMAXTSCEN) != 0)
 	{
 		std::cerr << "Mesh::read - Expected " << WZM_MESH_DIRECTIVE_MINMAXTSCEN << " directive found " << str;
 		return false;
 	}
-	else
+	else if (!in.read(m_mesh_aabb_min) || !in.read(m_mesh_aabb_max) || !in.read(m_mesh_tspcenter))
 	{
-		// ignore those, they will be recalculated later (support for manual editing for example)
-		float f;
-		in >> f >> f >> f >> f >> f >> f >> f >> f >> f;
-		if (in.fail())
-		{
-			std::cerr << "Mesh::read - Error reading minmaxtspcen values";
-			return false;
-		}
+		std::cerr << "Mesh::read - Error reading minmaxtspcen values";
+		return false;
 	}
 
-	in >> str >> vertices;
-	if (in.fail() || str.compare(WZM_MESH_DIRECTIVE_VERTICES) != 0)
+	if (!in.read(str) || str.compare(WZM_MESH_DIRECTIVE_VERTICES) != 0 || !in.read(vertices))
 	{
 		std::cerr << "Mesh::read - Expected " << WZM_MESH_DIRECTIVE_VERTICES << " directive found " << str;
 		return false;
 	}
 
-	in >> str >> indices;
-	if (in.fail() || str.compare(WZM_MESH_DIRECTIVE_INDICES) != 0)
+	if (!in.read(str) || str.compare(WZM_MESH_DIRECTIVE_INDICES) != 0 || !in.read(indices))
 	{
 		std::cerr << "Mesh::read - Expected " << WZM_MESH_DIRECTIVE_INDICES << " directive found " << str;
 		return false;
 	}
 
-	in >> str;
-	if (in.fail() || str.compare(WZM_MESH_DIRECTIVE_VERTEXARRAY) != 0)
+	// a vertex takes at least 24 characters (18 compact) and a triangle 6, so counts
+	// the file can't hold fail here instead of allocating for them
+	const size_t left = static_cast<size_t>(in.end() - in.position());
+
+	in.read(str);
+	if (compactVertices && !in.fail() && str.compare(WZM_MESH_DIRECTIVE_COMPACTVERTEXARRAY) == 0)
+	{
+		if (vertices > left / 18)
+		{
+			std::cerr << "Mesh::read - Error reading compact vertex";
+			return false;
+		}
+		if (!readCompactVertices(in, vertices))
+			return false;
+	}
+	else if (in.fail() || str.compare(WZM_MESH_DIRECTIVE_VERTEXARRAY) != 0)
 	{
 		std::cerr << "Mesh::read - Expected " << WZM_MESH_DIRECTIVE_VERTEXARRAY << " directive found " << str;
 		return false;
 	}
+	else if (vertices > left / 24)
+	{
+		std::cerr << "Mesh::read - Error reading vertex";
+		return false;
+	}
+	else
+	{
+		m_vertexArray.resize(vertices);
+		m_textureArray.resize(vertices);
+		m_normalArray.resize(vertices);
+		m_tangentArray.resize(vertices);
 
-	reservePoints(vertices);
-
-	WZMVertex vert, normal;
-	WZMVertex4 tangent;
-	WZMUV uv;
+		WZMVertex* vert = m_vertexArray.data();
+		WZMUV* uv = m_textureArray.data();
+		WZMVertex* normal = m_normalArray.data();
+		WZMVertex4* tangent = m_tangentArray.data();
 
-	for (; vertices > 0; --vertices)
-	{
-		in >> vert.x() >> vert.y() >> vert.z();
-		if (in.fail())
+		for (size_t k = 0; k < vertices; ++k)
 		{
-			std::cerr << "Mesh::read - Error reading vertex";
-			return false;
-		}
-		m_vertexArray.push_back(vert);
+			if (!in.read(vert[k]))
+			{
+				std::cerr << "Mesh::read - Error reading vertex";
+				return false;
+			}
 
-		in >> uv.u() >> uv.v();
-		if (in.fail())
-		{
-			std::cerr << "Mesh::read - Error reading uv coords.";
-			return false;
-		}
-		else if (uv.u() > 1 || uv.v() > 1)
-		{
-			std::cerr << "Mesh::read - Error uv coords out of range";
-			return false;
-		}
-		m_textureArray.push_back(uv);
+			if (!in.read(uv[k]))
+			{
+				std::cerr << "Mesh::read - Error reading uv coords.";
+				return false;
+			}
+			else if (uv[k].u() > 1 || uv[k].v() > 1)
+			{
+				std::cerr << "Mesh::read - Error uv coords out of range";
+				return false;
+			}
 
-		in >> normal.x() >> normal.y() >> normal.z();
-		if (in.fail())
-		{
-			std::cerr << "Mesh::read - Error reading normal";
-			return false;
-		}
-		m_normalArray.push_back(normal);
+			if (!in.read(normal[k]))
+			{
+				std::cerr << "Mesh::read - Error reading normal";
+				return false;
+			}
 
-		in >> tangent.x() >> tangent.y() >> tangent.z() >> tangent.w();
-		if (in.fail())
-		{
-			std::cerr << "Mesh::read - Error reading t";
-			return false;
+			if (!in.read(tangent[k]))
+			{
+				std::cerr << "Mesh::read - Error reading t";
+				return false;
+			}
 		}
-		m_tangentArray.push_back(tangent);
-
-		m_bitangentArray.push_back(normal.crossProduct(tangent.xyz()) * tangent.w());
 	}
 
-	in >> str;
-	if (str.compare(WZM_MESH_DIRECTIVE_INDEXARRAY) != 0)
+	if (!in.read(str) || str.compare(WZM_MESH_DIRECTIVE_INDEXARRAY) != 0)
 	{
 		std::cerr << "Mesh::read - Expected " << WZM_MESH_DIRECTIVE_INDEXARRAY << " directive found " << str;
 		return false;
 	}
 
+	if (indices > static_cast<size_t>(in.end() - in.position()) / 6)
+	{
+		std::cerr << "Mesh::read - Error reading indices";
+		return false;
+	}
+
 	reserveIndices(indices);
-	for(; indices > 0; --indices)
+	for (; indices > 0; --indices)
 	{
 		IndexedTri tri;
 
-		in >> tri.a() >> tri.b() >> tri.c();
-
-		if (in.fail())
+		if (!in.read(tri))
 		{
 			std::cerr << "Mesh::read - Error reading indices";
 			return false;
@@ -442,22 +427,17 @@ bool Mesh::read(std::istream& in)
 		m_indexArray.push_back(tri);
 	}
 
-	in >> str >> i;
-	if (in.fail() || str.compare(WZM_MESH_DIRECTIVE_CONNECTORS) != 0)
+	if (!in.read(str) || str.compare(WZM_MESH_DIRECTIVE_CONNECTORS) != 0 || !in.read(i))
 	{
 		std::cerr << "Mesh::read - Expected " << WZM_MESH_DIRECTIVE_CONNECTORS << " directive found " << str;
 		return false;
 	}
 
-	if (i > 0)
+	for (; i > 0; --i)
 	{
 		WZMVertex con;
 
-		for(; i > 0; --i)
-		{
-			in >> con.x() >> con.y() >> con.z();
-		}
-		if (in.fail())
+		if (!in.read(con))
 		{
 			std::cerr << "Mesh::read - Error reading connectors";
 			return false;
@@ -465,18 +445,73 @@ bool Mesh::read(std::istream& in)
 		m_connectors.push_back(con);
 	}
 
-	recalculateBoundData();
-
+	useStoredBounds();
 	return true;
 }
 
-void Mesh::write(std::ostream &out) const
+bool Mesh::readCompactVertices(TextScanner& in, unsigned vertices)
+{
+	std::string str;
+	WZMUVEncoding uvEncoding;
+
+	in.read(str);
+	if (str.compare(WZM_MESH_COMPACT_UV_UNORM16) == 0)
+	{
+		uvEncoding = WZM_UV_UNORM16;
+	}
+	else if (str.compare(WZM_MESH_COMPACT_UV_HALF) == 0)
+	{
+		uvEncoding = WZM_UV_HALF;
+	}
+	else
+	{
+		std::cerr << "Mesh::read - Unknown compact uv encoding " << str;
+		return false;
+	}
+
+	std::vector<WZMCompactVertex> compact(vertices);
+	for (auto& vert: compact)
+	{
+		if (!in.read(vert.pos[0]) || !in.read(vert.pos[1]) || !in.read(vert.pos[2])
+			|| !in.read(vert.uv[0]) || !in.read(vert.uv[1])
+			|| !in.read(vert.normal[0]) || !in.read(vert.normal[1])
+			|| !in.read(vert.tangent[0]) || !in.read(vert.tangent[1]))
+		{
+			std::cerr << "Mesh::read - Error reading compact vertex";
+			return false;
+		}
+	}
+
+	CompactVertexArray compactArray;
+	compactArray.assign(compact, uvEncoding);
+
+	m_vertexArray.resize(vertices);
+	m_textureArray.resize(vertices);
+	m_normalArray.resize(vertices);
+	m_tangentArray.resize(vertices);
+	return setCompactVertices(compactArray);
+}
+
+// Stored bounds that make sense are used until an edit needs exact ones,
+// others get recalculated (support for manual editing for example)
+void Mesh::useStoredBounds()
+{
+	bool storedBounds = !m_vertexArray.empty();
+	for (size_t k = 0; k < 3; ++k)
+	{
+		storedBounds = storedBounds && std::isfinite(m_mesh_aabb_min[k]) && std::isfinite(m_mesh_aabb_max[k])
+			&& std::isfinite(m_mesh_tspcenter[k]) && m_mesh_aabb_min[k] <= m_mesh_aabb_max[k];
+	}
+	m_boundDataState = storedBounds ? BOUNDS_STORED : BOUNDS_DIRTY;
+}
+
+void Mesh::write(TextWriter &out, bool compactVertices) const
 {
 	out << WZM_MESH_SIGNATURE << ' ' << (m_name.empty() ? "_noname_" : m_name ) << '\n';
 
-	// noboolalpha should be default...
-	out << WZM_MESH_DIRECTIVE_TEAMCOLOURS << " " << std::noboolalpha << teamColours() << '\n';
+	out << WZM_MESH_DIRECTIVE_TEAMCOLOURS << " " << teamColours() << '\n';
 
+	ensureBoundData();
 	out << WZM_MESH_DIRECTIVE_MINMAXTSCEN << " "
 	    << m_mesh_aabb_min.x() << ' ' << m_mesh_aabb_min.y() << ' ' << m_mesh_aabb_min.z() << ' '
 	    << m_mesh_aabb_max.x() << ' ' << m_mesh_aabb_max.y() << ' ' << m_mesh_aabb_max.z() << ' '
@@ -486,23 +521,41 @@ void Mesh::write(std::ostream &out) const
 	out << WZM_MESH_DIRECTIVE_VERTICES << " " << vertices() << '\n';
 	out << WZM_MESH_DIRECTIVE_INDICES << " " << indices() << '\n';
 
-	out << WZM_MESH_DIRECTIVE_VERTEXARRAY << '\n';
-	for (unsigned int i = 0; i < vertices(); ++i)
+	if (compactVertices)
 	{
-		out << '\t';
-		out << m_vertexArray[i].x() << ' ' << m_vertexArray[i].y() << ' ' << m_vertexArray[i].z() << ' ';
-		out << m_textureArray[i].u() << ' ' << m_textureArray[i].v() << ' ';
-		out << m_normalArray[i].x() << ' ' << m_normalArray[i].y() << ' ' << m_normalArray[i].z() << ' ';
-		out << m_tangentArray[i].x() << ' ' << m_tangentArray[i].y() << ' ' << m_tangentArray[i].z() << ' '
-		    << m_tangentArray[i].w() << '\n';
+		const CompactVertexArray compact = this->compactVertices();
+
+		out << WZM_MESH_DIRECTIVE_COMPACTVERTEXARRAY << ' '
+		    << (compact.uvEncoding() == WZM_UV_UNORM16 ? WZM_MESH_COMPACT_UV_UNORM16 : WZM_MESH_COMPACT_UV_HALF) << '\n';
+		for (const WZMCompactVertex& vert: compact.vertices())
+		{
+			out << '\t';
+			out << vert.pos[0] << ' ' << vert.pos[1] << ' ' << vert.pos[2] << ' ';
+			out << vert.uv[0] << ' ' << vert.uv[1] << ' ';
+			out << vert.normal[0] << ' ' << vert.normal[1] << ' ';
+			out << vert.tangent[0] << ' ' << vert.tangent[1] << '\n';
+		}
+	}
+	else
+	{
+		out << WZM_MESH_DIRECTIVE_VERTEXARRAY << '\n';
+		for (const WZMPackedVertex& vert: vertexStream())
+		{
+			out << '\t';
+			out << vert.pos[0] << ' ' << vert.pos[1] << ' ' << vert.pos[2] << ' ';
+			out << vert.uv[0] << ' ' << vert.uv[1] << ' ';
+			out << vert.normal[0] << ' ' << vert.normal[1] << ' ' << vert.normal[2] << ' ';
+			out << vert.tangent[0] << ' ' << vert.tangent[1] << ' ' << vert.tangent[2] << ' '
+			    << vert.tangent[3] << '\n';
+		}
 	}
 
 	out << WZM_MESH_DIRECTIVE_INDEXARRAY << '\n';
-	std::vector<IndexedTri>::const_iterator indIt;
-	for (indIt = m_indexArray.begin(); indIt < m_indexArray.end(); ++indIt)
+	for (size_t i = 0; i < m_indexArray.size(); ++i)
 	{
+		const IndexedTri tri = m_indexArray[i];
 		out << '\t';
-		out << indIt->a() << ' ' << indIt->b() << ' ' << indIt->c() << '\n';
+		out << tri.a() << ' ' << tri.b() << ' ' << tri.c() << '\n';
 	}
 
 	out << WZM_MESH_DIRECTIVE_CONNECTORS << " " << m_connectors.size() << "\n";
@@ -517,20 +570,283 @@ void Mesh::write(std::ostream &out) const
 	}
 }
 
+// Blocks are copied straight into the arrays, so their elements must match the file
+static_assert(sizeof(WZMVertex) == sizeof(GLfloat) * 3, "WZMVertex doesn't match the binary layout.");
+static_assert(sizeof(WZMUV) == sizeof(GLfloat) * 2, "WZMUV doesn't match the binary layout.");
+static_assert(sizeof(WZMVertex4) == sizeof(GLfloat) * 4, "WZMVertex4 doesn't match the binary layout.");
+static_assert(sizeof(Frame) == sizeof(GLfloat) * 9 && std::is_trivially_copyable<Frame>::value,
+	      "Frame doesn't match the binary layout.");
+
+template <typename T>
+static void copyBlock(std::vector<T>& to, const char* from, size_t count)
+{
+	to.resize(count);
+	if (count)
+		std::memcpy(to.data(), from, count * sizeof(T));
+}
+
+bool Mesh::readBinary(const WZMBReader& file, const WZMBMesh& entry)
+{
+	const uint64_t vertices = entry.vertices;
+	const char* name = file.block(entry.name);
+
+	clear();
+
+	if (!name)
+	{
+		std::cerr << "Mesh::readBinary - Error reading name";
+		return false;
+	}
+
+	m_name.assign(name, entry.name.size);
+	if (!isValidWzName(m_name))
+	{
+		std::cerr << "Mesh::readBinary - Invalid mesh name: " << m_name;
+		m_name = std::string();
+	}
+
+	if (entry.teamColours > 1)
+	{
+		std::cerr << "Mesh::readBinary - Error reading team colours";
+		return false;
+	}
+	m_teamColours = entry.teamColours != 0;
+
+	for (size_t k = 0; k < 3; ++k)
+	{
+		m_mesh_aabb_min[k] = entry.aabbMin[k];
+		m_mesh_aabb_max[k] = entry.aabbMax[k];
+		m_mesh_tspcenter[k] = entry.tspCenter[k];
+	}
+
+	if (entry.vertexLayout == WZMB_VERTICES_ARRAYS)
+	{
+		const char* positions = file.block(entry.positions, vertices * sizeof(WZMVertex));
+		const char* uvs = file.block(entry.uvs, vertices * sizeof(WZMUV));
+		const char* normals = file.block(entry.normals, vertices * sizeof(WZMVertex));
+		const char* tangents = file.block(entry.tangents, vertices * sizeof(WZMVertex4));
+
+		if (!positions || !uvs || !normals || !tangents)
+		{
+			std::cerr << "Mesh::readBinary - Error reading vertices";
+			return false;
+		}
+
+		copyBlock(m_vertexArray, positions, vertices);
+		copyBlock(m_textureArray, uvs, vertices);
+		copyBlock(m_normalArray, normals, vertices);
+		copyBlock(m_tangentArray, tangents, vertices);
+
+		for (const WZMUV& uv: m_textureArray)
+		{
+			if (uv.u() > 1 || uv.v() > 1)
+			{
+				std::cerr << "Mesh::readBinary - Error uv coords out of range";
+				return false;
+			}
+		}
+	}
+	else if (entry.vertexLayout == WZMB_VERTICES_COMPACT_UNORM16 || entry.vertexLayout == WZMB_VERTICES_COMPACT_HALF)
+	{
+		const char* compact = file.block(entry.compact, vertices * sizeof(WZMCompactVertex));
+		std::vector<WZMCompactVertex> compactVertices;
+		CompactVertexArray compactArray;
+
+		if (!compact)
+		{
+			std::cerr << "Mesh::readBinary - Error reading compact vertices";
+			return false;
+		}
+
+		copyBlock(compactVertices, compact, vertices);
+		compactArray.assign(compactVertices,
+				    entry.vertexLayout == WZMB_VERTICES_COMPACT_UNORM16 ? WZM_UV_UNORM16 : WZM_UV_HALF);
+
+		m_vertexArray.resize(vertices);
+		m_textureArray.resize(vertices);
+		m_normalArray.resize(vertices);
+		m_tangentArray.resize(vertices);
+		if (!setCompactVertices(compactArray))
+			return false;
+	}
+	else if (entry.vertexLayout == WZMB_VERTICES_PACKED)
+	{
+		const char* packed = file.block(entry.compact);
+		CompactVertexArray compactArray;
+
+		if (!packed || !unpackVertices(packed, entry.compact.size, vertices, compactArray))
+		{
+			std::cerr << "Mesh::readBinary - Error reading packed vertices";
+			return false;
+		}
+
+		m_vertexArray.resize(vertices);
+		m_textureArray.resize(vertices);
+		m_normalArray.resize(vertices);
+		m_tangentArray.resize(vertices);
+		if (!setCompactVertices(compactArray))
+			return false;
+	}
+	else
+	{
+		std::cerr << "Mesh::readBinary - Unknown vertex layout " << entry.vertexLayout;
+		return false;
+	}
+
+	if (entry.vertexLayout == WZMB_VERTICES_PACKED)
+	{
+		const char* packed = entry.indexSize == 2 || entry.indexSize == 4 ? file.block(entry.indices) : nullptr;
+
+		if (!packed || !unpackTriangles(packed, entry.indices.size, entry.triangles, vertices, entry.indexSize == 4,
+						m_indexArray))
+		{
+			std::cerr << "Mesh::readBinary - Error reading packed indices";
+			return false;
+		}
+	}
+	else
+	{
+		const char* indices = entry.indexSize == 2 || entry.indexSize == 4
+			? file.block(entry.indices, static_cast<uint64_t>(entry.triangles) * 3 * entry.indexSize) : nullptr;
+		if (!indices)
+		{
+			std::cerr << "Mesh::readBinary - Error reading indices";
+			return false;
+		}
+		m_indexArray.assign(indices, entry.triangles, entry.indexSize == 4);
+	}
+
+	const char* connectors = file.block(entry.connectorArray, static_cast<uint64_t>(entry.connectors) * sizeof(WZMVertex));
+	if (!connectors)
+	{
+		std::cerr << "Mesh::readBinary - Error reading connectors";
+		return false;
+	}
+	for (size_t i = 0; i < entry.connectors; ++i)
+	{
+		WZMVertex con;
+		std::memcpy(&con, connectors + i * sizeof(WZMVertex), sizeof(WZMVertex));
+		m_connectors.push_back(con);
+	}
+
+	const char* frames = file.block(entry.frameArray, static_cast<uint64_t>(entry.frames) * sizeof(Frame));
+	if (!frames)
+	{
+		std::cerr << "Mesh::readBinary - Error reading frames";
+		return false;
+	}
+	copyBlock(m_frameArray, frames, entry.frames);
+	m_frame_time = entry.frameTime;
+	m_frame_cycles = entry.frameCycles;
+
+	useStoredBounds();
+	return true;
+}
+
+WZMBMesh Mesh::writeBinary(WZMBWriter& out, WZMBEncoding encoding) const
+{
+	const std::string name = m_name.empty() ? "_noname_" : m_name;
+	WZMBMesh entry;
+
+	std::memset(&entry, 0, sizeof(entry));
+	entry.name = out.write(name.data(), name.size());
+	entry.vertices = static_cast<uint32_t>(vertices());
+	entry.triangles = static_cast<uint32_t>(indices());
+	entry.teamColours = teamColours();
+
+	ensureBoundData();
+	for (size_t k = 0; k < 3; ++k)
+	{
+		entry.aabbMin[k] = m_mesh_aabb_min[k];
+		entry.aabbMax[k] = m_mesh_aabb_max[k];
+		entry.tspCenter[k] = m_mesh_tspcenter[k];
+	}
+
+	std::vector<char> packed;
+	CompactVertexArray compact;
+
+	if (encoding != WZMB_ENCODING_FLOATS)
+		compact = compactVertices();
+
+	// positions that don't quantise stay compact
+	if (encoding == WZMB_ENCODING_PACKED && packVertices(compact, packed))
+	{
+		entry.vertexLayout = WZMB_VERTICES_PACKED;
+		entry.compact = out.write(packed.data(), packed.size());
+	}
+	else if (encoding != WZMB_ENCODING_FLOATS)
+	{
+		entry.vertexLayout = compact.uvEncoding() == WZM_UV_UNORM16 ? WZMB_VERTICES_COMPACT_UNORM16 : WZMB_VERTICES_COMPACT_HALF;
+		entry.compact = out.write(compact.vertices().data(), compact.size() * sizeof(WZMCompactVertex));
+	}
+	else
+	{
+		ensureTangents();
+		entry.vertexLayout = WZMB_VERTICES_ARRAYS;
+		entry.positions = out.write(m_vertexArray.data(), m_vertexArray.size() * sizeof(WZMVertex));
+		entry.uvs = out.write(m_textureArray.data(), m_textureArray.size() * sizeof(WZMUV));
+		entry.normals = out.write(m_normalArray.data(), m_normalArray.size() * sizeof(WZMVertex));
+		entry.tangents = out.write(m_tangentArray.data(), m_tangentArray.size() * sizeof(WZMVertex4));
+	}
+
+	// as the index array holds them, ready for glDrawElements, unless packed
+	entry.indexSize = m_indexArray.isWide() ? 4 : 2;
+	if (entry.vertexLayout == WZMB_VERTICES_PACKED)
+	{
+		packed.clear();
+		packTriangles(m_indexArray, packed);
+		entry.indices = out.write(packed.data(), packed.size());
+	}
+	else
+	{
+		entry.indices = out.write(m_indexArray.data(), m_indexArray.size() * 3 * entry.indexSize);
+	}
+
+	std::vector<WZMVertex> connectors;
+	connectors.reserve(m_connectors.size());
+	for (const WZMConnector& con: m_connectors)
+		connectors.push_back(con.getPos());
+	entry.connectors = static_cast<uint32_t>(connectors.size());
+	entry.connectorArray = out.write(connectors.data(), connectors.size() * sizeof(WZMVertex));
+
+	entry.frames = static_cast<uint32_t>(m_frameArray.size());
+	entry.frameArray = out.write(m_frameArray.data(), m_frameArray.size() * sizeof(Frame));
+	entry.frameTime = m_frame_time;
+	entry.frameCycles = m_frame_cycles;
+	return entry;
+}
+
+// Distinct vertices the faces use, marked in a bitmap over all of them
+static size_t usedOBJVertices(const std::vector<OBJTri>& faces, size_t vertexCount)
+{
+	std::vector<bool> used(vertexCount + 1);
+	size_t count = 0;
+
+	for (const OBJTri& face: faces)
+	{
+		for (size_t i = 0; i < 3; ++i)
+		{
+			if (face.tri[i] <= vertexCount && !used[face.tri[i]])
+			{
+				used[face.tri[i]] = true;
+				++count;
+			}
+		}
+	}
+	return count;
+}
+
 bool Mesh::importFromOBJ(const std::vector<OBJTri>&	faces,
 			 const std::vector<OBJVertex>&  verts,
 			 const std::vector<OBJUV>&	uvArray,
 			 const std::vector<OBJVertex>&  normals,
-			 bool welder)
+			 bool welder,
+			 const WeldTolerances& tolerances)
 {
-	typedef std::set<WZMPoint, compareWZMPoint_less_wEps> t_tupleSet;
-	t_tupleSet tupleSet;
+	VertexWelder pointWelder(tolerances);
+	bool inserted;
 
 	std::vector<OBJTri>::const_iterator itFaces;
-	std::pair<t_tupleSet::iterator, bool> inResult;
-
-	std::vector<unsigned> mapping;
-	std::vector<unsigned>::iterator itMap;
 
 	unsigned int i;
 
@@ -540,8 +856,13 @@ bool Mesh::importFromOBJ(const std::vector<OBJTri>&	faces,
 
 	clear();
 
-	reservePoints(verts.size());
-	reserveIndices(faces.size());
+	// Only what this group uses, verts holds those of the whole file.
+	// Welding leaves at least one point per vertex used, without it there is one per corner
+	const size_t points = welder ? usedOBJVertices(faces, verts.size()) : faces.size() * 3;
+	reservePoints(static_cast<unsigned>(points));
+	reserveIndices(static_cast<unsigned>(faces.size()));
+	if (welder)
+		pointWelder.reserve(points);
 
 	for (itFaces = faces.begin(); itFaces != faces.end(); ++itFaces)
 	{
@@ -564,21 +885,12 @@ bool Mesh::importFromOBJ(const std::vector<OBJTri>&	faces,
 
 			if (welder)
 			{
-				inResult = tupleSet.insert(WZMPoint(verts[itFaces->tri[i]-1], tmpUv, tmpNrm));
+				const WZMVertex& vert = verts[itFaces->tri[i]-1];
 
-				if (!inResult.second)
-				{
-					tmpTri[i] = mapping[std::distance(tupleSet.begin(), inResult.first)];
-				}
-				else
+				tmpTri[i] = pointWelder.weld(vert, tmpUv, tmpNrm, inserted);
+				if (inserted)
 				{
-					itMap = mapping.begin();
-					std::advance(itMap, std::distance(tupleSet.begin(), inResult.first));
-					mapping.insert(itMap, vertices());
-					tmpTri[i] = vertices();
-
-					const WZMPoint& curPoint(*inResult.first);
-					addPoint(std::get<0>(curPoint), std::get<1>(curPoint), std::get<2>(curPoint));
+					addPoint(vert, tmpUv, tmpNrm);
 				}
 			}
 			else
@@ -595,89 +907,171 @@ bool Mesh::importFromOBJ(const std::vector<OBJTri>&	faces,
 	return true;
 }
 
-std::stringstream* Mesh::exportToOBJ(const Mesh_exportToOBJ_InOutParams& params) const
+// Copies a glTF vertex attribute of count elements into to
+template <typename V>
+static bool readGLTFAttribute(const GLBFile& file, const JsonValue& index, size_t count, std::vector<V>& to)
 {
-	const bool invertV = true;
-	std::stringstream* out = new std::stringstream;
+	static_assert(sizeof(V) % sizeof(GLfloat) == 0, "Vertex is not made of floats.");
+	GLTFAccessor accessor;
 
-	std::pair<std::set<OBJVertex, OBJVertex::less_wEps>::iterator, bool> vertInResult;
-	std::pair<std::set<OBJUV, OBJUV::less_wEps>::iterator, bool> uvInResult;
-	std::pair<std::set<OBJVertex, OBJVertex::less_wEps>::iterator, bool> normInResult;
-
-	std::vector<IndexedTri>::const_iterator itF;
-	std::vector<unsigned>::iterator itMap;
-	unsigned i;
+	if (!file.accessor(index, accessor) || accessor.count != count)
+		return false;
+	to.resize(count);
+	return readGLTFFloats(accessor, sizeof(V) / sizeof(GLfloat), reinterpret_cast<GLfloat*>(to.data()));
+}
 
-	OBJUV uv;
+bool Mesh::importFromGLTF(const GLBFile& file, const JsonValue& primitive)
+{
+	const JsonValue& attributes = primitive["attributes"];
+	const bool hasNormals = attributes.has("NORMAL"), hasTangents = attributes.has("TANGENT");
+	GLTFAccessor accessor;
 
-	*out << "o " << m_name << "\n";
+	clear();
 
-	for (itF = m_indexArray.begin(); itF != m_indexArray.end(); ++itF)
+	if (!file.accessor(attributes["POSITION"], accessor)
+		|| !readGLTFAttribute(file, attributes["POSITION"], accessor.count, m_vertexArray))
 	{
-		*out << "f";
+		std::cerr << "Mesh::importFromGLTF - Error reading positions";
+		return false;
+	}
 
-		for (i = 0; i < 3; ++i)
+	const size_t count = m_vertexArray.size();
+	if ((hasNormals && !readGLTFAttribute(file, attributes["NORMAL"], count, m_normalArray))
+		|| (hasTangents && !readGLTFAttribute(file, attributes["TANGENT"], count, m_tangentArray))
+		|| (attributes.has("TEXCOORD_0") && !readGLTFAttribute(file, attributes["TEXCOORD_0"], count, m_textureArray)))
+	{
+		std::cerr << "Mesh::importFromGLTF - Error reading vertex attributes";
+		return false;
+	}
+	m_textureArray.resize(count);
+	m_tangentArray.resize(count);
+
+	if (primitive.has("indices"))
+	{
+		if (!file.accessor(primitive["indices"], accessor) || !readGLTFIndices(accessor, count, m_indexArray))
 		{
-			*out << ' ';
+			std::cerr << "Mesh::importFromGLTF - Error reading indices";
+			return false;
+		}
+	}
+	else
+	{
+		std::vector<GLuint> sequence(count - count % 3);
+		for (size_t i = 0; i < sequence.size(); ++i)
+			sequence[i] = static_cast<GLuint>(i);
+		m_indexArray.assign(sequence);
+	}
 
-			vertInResult = params.vertSet->insert(m_vertexArray[itF->operator [](i)]);
+	// glTF wants flat normals then, which takes a vertex per corner
+	if (!hasNormals)
+	{
+		std::vector<WZMVertex> positions, normals;
+		std::vector<WZMUV> uvs;
+		std::vector<WZMVertex4> tangents;
+		std::vector<GLuint> corners;
+
+		positions.reserve(m_indexArray.size() * 3);
+		normals.reserve(m_indexArray.size() * 3);
+		uvs.reserve(m_indexArray.size() * 3);
+		tangents.reserve(m_indexArray.size() * 3);
+		for (size_t i = 0; i < m_indexArray.size(); ++i)
+		{
+			const IndexedTri tri = m_indexArray[i];
+			const WZMVertex& v0 = m_vertexArray[tri.a()];
+			const WZMVertex normal = WZMVertex(m_vertexArray[tri.b()] - v0).crossProduct(m_vertexArray[tri.c()] - v0).normalize();
 
-			if (!vertInResult.second)
+			for (size_t k = 0; k < 3; ++k)
 			{
-				*out << (*params.vertMapping)[std::distance(params.vertSet->begin(), vertInResult.first)] + 1;
-			}
-			else
-			{
-				itMap = params.vertMapping->begin();
-				std::advance(itMap, std::distance(params.vertSet->begin(), vertInResult.first));
-				params.vertMapping->insert(itMap, params.vertices->size());
-				params.vertices->push_back(m_vertexArray[itF->operator [](i)]);
-				*out << params.vertices->size();
+				corners.push_back(static_cast<GLuint>(positions.size()));
+				positions.push_back(m_vertexArray[tri[k]]);
+				normals.push_back(normal);
+				uvs.push_back(m_textureArray[tri[k]]);
+				tangents.push_back(m_tangentArray[tri[k]]);
 			}
+		}
 
-			*out << '/';
+		m_vertexArray.swap(positions);
+		m_normalArray.swap(normals);
+		m_textureArray.swap(uvs);
+		m_tangentArray.swap(tangents);
+		m_indexArray.assign(corners);
+	}
 
-			uv = m_textureArray[itF->operator [](i)];
-			if (invertV)
-			{
-				uv.v() = 1 - uv.v();
-			}
-			uvInResult = params.uvSet->insert(uv);
+	if (!hasTangents && vertices())
+		markTangentsDirty(0, vertices() - 1);
+	finishImport();
+	return true;
+}
 
-			if (!uvInResult.second)
-			{
-				*out << (*params.uvMapping)[std::distance(params.uvSet->begin(), uvInResult.first)] + 1;
-			}
-			else
-			{
-				itMap = params.uvMapping->begin();
-				std::advance(itMap, std::distance(params.uvSet->begin(), uvInResult.first));
-				params.uvMapping->insert(itMap, params.uvs->size());
-				params.uvs->push_back(uv);
-				*out << params.uvs->size();
-			}
+// Corner order of the reversed winding
+static const unsigned OBJ_CORNER_ORDER[3] = {0, 2, 1};
 
-			*out << '/';
+void MeshTransformView::addToOBJPools(OBJExportPools& pools, std::vector<OBJPointRef>& refs) const
+{
+	const bool invertV = true;
+	const unsigned NO_REF = ~0u;
+	const OBJPointRef unset = {NO_REF, NO_REF, NO_REF};
+
+	size_t triIdx;
+	unsigned i;
+
+	OBJVertex norm;
+	OBJUV texCoord;
+
+	refs.assign(vertices(), unset);
 
-			normInResult = params.normSet->insert(m_normalArray[itF->operator [](i)]);
+	// Pool in the order the faces will reference them
+	for (triIdx = 0; triIdx < triangles(); ++triIdx)
+	{
+		const IndexedTri tri = triangle(triIdx);
 
-			if (!normInResult.second)
+		for (i = 0; i < 3; ++i)
+		{
+			const unsigned idx = tri[OBJ_CORNER_ORDER[i]];
+			OBJPointRef& ref = refs[idx];
+
+			if (ref.v != NO_REF)
 			{
-				*out << (*params.normMapping)[std::distance(params.normSet->begin(), normInResult.first)] + 1;
+				continue;
 			}
-			else
+
+			ref.v = pools.addVertex(position(idx).mirrorFrom(OBJVertex(), 0));
+
+			texCoord = uv(idx);
+			if (invertV)
 			{
-				itMap = params.normMapping->begin();
-				std::advance(itMap, std::distance(params.normSet->begin(), normInResult.first));
-				params.normMapping->insert(itMap, params.normals->size());
-				params.normals->push_back(m_normalArray[itF->operator [](i)]);
-				*out << params.normals->size();
+				texCoord.v() = 1 - texCoord.v();
 			}
+			ref.vt = pools.addUV(texCoord);
+
+			norm = normal(idx);
+			norm.x() = -norm.x();
+			ref.vn = pools.addNormal(norm);
 		}
-		*out << '\n';
 	}
+}
 
-	return out;
+void MeshTransformView::writeOBJFaces(TextWriter& out, const std::vector<OBJPointRef>& refs) const
+{
+	size_t triIdx;
+	unsigned i;
+
+	out << "o " << m_mesh.m_name << "\n";
+
+	for (triIdx = 0; triIdx < triangles(); ++triIdx)
+	{
+		const IndexedTri tri = triangle(triIdx);
+
+		out << "f";
+
+		for (i = 0; i < 3; ++i)
+		{
+			const OBJPointRef& ref = refs[tri[OBJ_CORNER_ORDER[i]]];
+
+			out << ' ' << ref.v + 1 << '/' << ref.vt + 1 << '/' << ref.vn + 1;
+		}
+		out << '\n';
+	}
 }
 
 std::string Mesh::getName() const
@@ -756,6 +1150,28 @@ size_t Mesh::frames() const
 	return m_frameArray.size();
 }
 
+const std::vector<Frame>& Mesh::getFrames() const
+{
+	return m_frameArray;
+}
+
+int Mesh::frameTime() const
+{
+	return m_frame_time;
+}
+
+int Mesh::frameCycles() const
+{
+	return m_frame_cycles;
+}
+
+void Mesh::setFrames(const std::vector<Frame>& frames, int frameTime, int frameCycles)
+{
+	m_frameArray = frames;
+	m_frame_time = frameTime;
+	m_frame_cycles = frameCycles;
+}
+
 size_t Mesh::indices() const
 {
 	return m_indexArray.size();
@@ -770,18 +1186,18 @@ bool Mesh::isValid() const
 	}
 
 	// Check that the values of the indices are in range
-	std::vector<IndexedTri>::const_iterator it;
-	for (it = m_indexArray.begin(); it != m_indexArray.end(); ++it)
+	for (size_t i = 0; i < m_indexArray.size(); ++i)
 	{
-		if ((*it).a() >= vertices())
+		const IndexedTri tri = m_indexArray[i];
+		if (tri.a() >= vertices())
 		{
 			return false;
 		}
-		if ((*it).b() >= vertices())
+		if (tri.b() >= vertices())
 		{
 			return false;
 		}
-		if ((*it).c() >= vertices())
+		if (tri.c() >= vertices())
 		{
 			return false;
 		}
@@ -789,10 +1205,90 @@ bool Mesh::isValid() const
 	return true;
 }
 
+const std::vector<WZMPackedVertex>& Mesh::vertexStream() const
+{
+	ensureTangents();
+	if (!m_vertexStreamDirty)
+		return m_vertexStream;
+
+	m_vertexStream.resize(vertices());
+	for (size_t i = 0; i < vertices(); ++i)
+	{
+		WZMPackedVertex& vert = m_vertexStream[i];
+
+		vert.pos[0] = m_vertexArray[i].x();
+		vert.pos[1] = m_vertexArray[i].y();
+		vert.pos[2] = m_vertexArray[i].z();
+		vert.uv[0] = m_textureArray[i].u();
+		vert.uv[1] = m_textureArray[i].v();
+		vert.normal[0] = m_normalArray[i].x();
+		vert.normal[1] = m_normalArray[i].y();
+		vert.normal[2] = m_normalArray[i].z();
+		vert.tangent[0] = m_tangentArray[i].x();
+		vert.tangent[1] = m_tangentArray[i].y();
+		vert.tangent[2] = m_tangentArray[i].z();
+		vert.tangent[3] = m_tangentArray[i].w();
+	}
+	m_vertexStreamDirty = false;
+	return m_vertexStream;
+}
+
+WZMVertex Mesh::getBitangent(size_t index) const
+{
+	ensureTangents();
+	return m_normalArray[index].crossProduct(m_tangentArray[index].xyz()) * m_tangentArray[index].w();
+}
+
+CompactVertexArray Mesh::compactVertices() const
+{
+	CompactVertexArray compact;
+	compact.encode(vertexStream());
+	return compact;
+}
+
+bool Mesh::setCompactVertices(const CompactVertexArray& compact)
+{
+	if (compact.size() != vertices())
+		return false;
+
+	std::vector<WZMPackedVertex> decoded;
+	compact.decode(decoded);
+
+	for (size_t i = 0; i < decoded.size(); ++i)
+	{
+		const WZMPackedVertex& vert = decoded[i];
+
+		m_vertexArray[i] = WZMVertex(vert.pos[0], vert.pos[1], vert.pos[2]);
+		m_textureArray[i].u() = vert.uv[0];
+		m_textureArray[i].v() = vert.uv[1];
+		m_normalArray[i] = WZMVertex(vert.normal[0], vert.normal[1], vert.normal[2]);
+		m_tangentArray[i] = WZMVertex4(vert.tangent[0], vert.tangent[1], vert.tangent[2], vert.tangent[3]);
+	}
+
+	m_vertexStream.swap(decoded);
+	m_vertexStreamDirty = false;
+	m_tangentsDirtyBegin = m_tangentsDirtyEnd = 0;
+	invalidateBoundData();
+	return true;
+}
+
+CompactErrorStats Mesh::compactErrorStats() const
+{
+	return measureCompactError(vertexStream());
+}
+
+void Mesh::invalidateVertexStream()
+{
+	m_vertexStreamDirty = true;
+}
+
 void Mesh::defaultConstructor()
 {
 	m_name.clear();
 	m_teamColours = false;
+	m_vertexStreamDirty = true;
+	m_tangentsDirtyBegin = m_tangentsDirtyEnd = 0;
+	m_boundDataState = BOUNDS_DIRTY;
 }
 
 void Mesh::clear()
@@ -805,8 +1301,10 @@ void Mesh::clear()
 	m_textureArray.clear();
 	m_normalArray.clear();
 	m_tangentArray.clear();
-	m_bitangentArray.clear();
 	m_indexArray.clear();
+	invalidateVertexStream();
+	m_tangentsDirtyBegin = m_tangentsDirtyEnd = 0;
+	m_boundDataState = BOUNDS_DIRTY;
 
 	m_connectors.clear();
 	m_teamColours = false;
@@ -818,7 +1316,6 @@ inline void Mesh::reservePoints(const unsigned size)
 	m_textureArray.reserve(size);
 	m_normalArray.reserve(size);
 	m_tangentArray.reserve(size);
-	m_bitangentArray.reserve(size);
 }
 
 inline void Mesh::reserveIndices(const unsigned size)
@@ -832,7 +1329,7 @@ void Mesh::addPoint(const WZMVertex& vertex, const WZMUV& uv, const WZMVertex &n
 	m_textureArray.push_back(uv);
 	m_normalArray.push_back(normal);
 	m_tangentArray.resize(m_tangentArray.size() + 1);
-	m_bitangentArray.resize(m_bitangentArray.size() + 1);
+	markTangentsDirty(vertices() - 1, vertices() - 1);
 }
 
 void Mesh::addIndices(const IndexedTri &trio)
@@ -845,22 +1342,19 @@ void Mesh::addIndices(const IndexedTri &trio)
 
 	m_indexArray.push_back(trio);
 
-	// TB-calculation part
-	calculateTBForIndices(trio);
+	// TB-calculation part, deferred to the first use
+	if (trio.a() < vertices() && trio.b() < vertices() && trio.c() < vertices())
+	{
+		markTangentsDirty(std::min(trio.a(), std::min(trio.b(), trio.c())),
+				  std::max(trio.a(), std::max(trio.b(), trio.c())));
+	}
 }
 
-void Mesh::calculateTBForIndices(const IndexedTri &trio)
+// Tangent and bitangent of one triangle, from its uv gradients
+static void triangleTB(const WZMVertex& v0, const WZMVertex& v1, const WZMVertex& v2,
+		       const WZMUV& uv0, const WZMUV& uv1, const WZMUV& uv2,
+		       WZMVertex& tangent, WZMVertex& bitangent)
 {
-	// Shortcuts for vertices
-	WZMVertex &v0 = m_vertexArray[trio.a()];
-	WZMVertex &v1 = m_vertexArray[trio.b()];
-	WZMVertex &v2 = m_vertexArray[trio.c()];
-
-	// Shortcuts for UVs
-	WZMUV &uv0 = m_textureArray[trio.a()];
-	WZMUV &uv1 = m_textureArray[trio.b()];
-	WZMUV &uv2 = m_textureArray[trio.c()];
-
 	// Edges of the triangle : postion delta
 	WZMVertex deltaPos1 = v1 - v0;
 	WZMVertex deltaPos2 = v2 - v0;
@@ -874,65 +1368,60 @@ void Mesh::calculateTBForIndices(const IndexedTri &trio)
 	if (r)
 		r = 1.f / r;
 
-	WZMVertex4 tangent = WZMVertex((deltaPos1 * deltaUV2.v() - deltaPos2 * deltaUV1.v()) * r);
-	WZMVertex bitangent = (deltaPos2 * deltaUV1.u() - deltaPos1 * deltaUV2.u()) * r;
-
-	m_tangentArray[trio.a()] -= tangent;
-	m_tangentArray[trio.b()] -= tangent;
-	m_tangentArray[trio.c()] -= tangent;
-
-	m_bitangentArray[trio.a()] -= bitangent;
-	m_bitangentArray[trio.b()] -= bitangent;
-	m_bitangentArray[trio.c()] -= bitangent;
+	tangent = (deltaPos1 * deltaUV2.v() - deltaPos2 * deltaUV1.v()) * r;
+	bitangent = (deltaPos2 * deltaUV1.u() - deltaPos1 * deltaUV2.u()) * r;
 }
 
-void Mesh::finishTBCalculation()
+// Final tangent from the summed up ones: Gram-Schmidt orthogonalized, w holding the handedness
+static WZMVertex4 orthogonalTangent(const WZMVertex& n, const WZMVertex& tangentSum, const WZMVertex& bitangentSum)
 {
-	for (unsigned int i = 0; i < vertices(); ++i)
-	{
-		WZMVertex n = m_normalArray[i];
-
-		// Gram-Schmidt orthogonalize
-		WZMVertex t = m_tangentArray[i].xyz();
-		t = WZMVertex(t - n * n.dotProduct(t)).normalize();
+	// Gram-Schmidt orthogonalize
+	WZMVertex t = WZMVertex(tangentSum - n * n.dotProduct(tangentSum)).normalize();
 
-		// Calculate handedness
-		if (n.crossProduct(t).dotProduct(m_bitangentArray[i]) < 0.0f)
-		{
-			m_tangentArray[i] = WZMVertex4(t, -1.f);
-		}
-		else
-		{
-			m_tangentArray[i] = WZMVertex4(t, 1.f);
-		}
+	// Calculate handedness
+	if (n.crossProduct(t).dotProduct(bitangentSum) < 0.0f)
+	{
+		return WZMVertex4(t, -1.f);
+	}
+	else
+	{
+		return WZMVertex4(t, 1.f);
 	}
 }
 
 void Mesh::finishImport()
 {
-	finishTBCalculation();
-	recalculateBoundData();
+	// tangents are already marked by addPoint and addIndices
+	invalidateBoundData();
+}
+
+// The flat float array behind vertex arrays, for the bulk kernels
+template <typename V>
+static GLfloat* components(std::vector<V>& array)
+{
+	static_assert(sizeof(V) == sizeof(GLfloat) * 3 || sizeof(V) == sizeof(GLfloat) * 4, "Vertex is not tightly packed.");
+	return array.empty() ? nullptr : &array.front()[0];
+}
+
+template <typename V>
+static const GLfloat* components(const std::vector<V>& array)
+{
+	return array.empty() ? nullptr : static_cast<const GLfloat*>(array.front());
 }
 
 void Mesh::scale(GLfloat x, GLfloat y, GLfloat z)
 {
-	std::vector<WZMVertex>::iterator vertIt;
-	for (vertIt = m_vertexArray.begin(); vertIt < m_vertexArray.end(); ++vertIt)
-	{
-		vertIt->scale(x, y, z);
-	}
+	ensureTangents();
+
+	const GLfloat scaler[3] = {x, y, z};
+	kernelMul3(components(m_vertexArray), vertices(), scaler);
 
 	if ((x < 0.f) || (y < 0.f) || (z < 0.f))
 	{
-		WZMVertex nrmScaler(x < 0.f ? -1.f: 1.f, y < 0.f ? -1.f: 1.f, z < 0.f ? -1.f: 1.f);
-		WZMVertex4 tgtScaler(nrmScaler, 1.f);
+		const GLfloat tgtScaler[4] = {x < 0.f ? -1.f: 1.f, y < 0.f ? -1.f: 1.f, z < 0.f ? -1.f: 1.f, 1.f};
 
-		for (unsigned int i = 0; i < vertices(); ++i)
-		{
-			m_normalArray[i].operator*=(nrmScaler);
-			m_tangentArray[i].operator*=(tgtScaler);
-			m_bitangentArray[i].operator*=(nrmScaler);
-		}
+		kernelMul3(components(m_normalArray), vertices(), tgtScaler);
+		kernelMul4(components(m_tangentArray), vertices(), tgtScaler);
 	}
 
 	std::list<WZMConnector>::iterator itC;
@@ -941,9 +1430,8 @@ void Mesh::scale(GLfloat x, GLfloat y, GLfloat z)
 		itC->m_pos.scale(x, y, z);
 	}
 
-	m_mesh_weightcenter.scale(x, y, z);
-	m_mesh_aabb_min.scale(x, y, z);
-	m_mesh_aabb_max.scale(x, y, z);
+	invalidateBoundData();
+	invalidateVertexStream();
 
 	// Update animation
 	for (auto& curFrame: m_frameArray)
@@ -957,35 +1445,20 @@ void Mesh::mirrorUsingLocalCenter(int axis)
 
 void Mesh::mirrorFromPoint(const WZMVertex& point, int axis)
 {
-	for (unsigned int i = 0; i < vertices(); ++i)
-	{
-		switch (axis)
-		{
-		case 0:
-			m_vertexArray[i].x() = -m_vertexArray[i].x() + 2 * point.x();
-			m_normalArray[i].x() = -m_normalArray[i].x();
-			m_tangentArray[i].x() = -m_tangentArray[i].x();
-			m_bitangentArray[i].x() = -m_bitangentArray[i].x();
-			break;
-		case 1:
-			m_vertexArray[i].y() = -m_vertexArray[i].y() + 2 * point.y();
-			m_normalArray[i].y() = -m_normalArray[i].y();
-			m_tangentArray[i].y() = -m_tangentArray[i].y();
-			m_bitangentArray[i].y() = -m_bitangentArray[i].y();
-			break;
-		default:
-			m_vertexArray[i].z() = -m_vertexArray[i].z() + 2 * point.z();
-			m_normalArray[i].z() = -m_normalArray[i].z();
-			m_tangentArray[i].z() = -m_tangentArray[i].z();
-			m_bitangentArray[i].z() = -m_bitangentArray[i].z();
-		}
+	ensureTangents();
 
-		// Recalculate handedness
-		if (m_normalArray[i].crossProduct(m_tangentArray[i].xyz()).dotProduct(m_bitangentArray[i]) < 0.0f)
-			m_tangentArray[i].w() = -1.0f;
-		else
-			m_tangentArray[i].w() = 1.0f;
-	}
+	const size_t mirrored = axis == 0 || axis == 1 ? axis : 2;
+	GLfloat mirror[4] = {1.f, 1.f, 1.f, 1.f}, offset[3] = {-0.f, -0.f, -0.f}; // -0 leaves -0 alone
+
+	mirror[mirrored] = -1.f;
+	offset[mirrored] = 2 * point[mirrored];
+
+	kernelMulAdd3(components(m_vertexArray), vertices(), mirror, offset);
+	kernelMul3(components(m_normalArray), vertices(), mirror);
+	kernelMul4(components(m_tangentArray), vertices(), mirror);
+
+	// A reflection swaps the handedness
+	kernelSwapHandedness(components(m_normalArray), components(m_tangentArray), vertices());
 
 	std::list<WZMConnector>::iterator itC;
 	for (itC = m_connectors.begin(); itC != m_connectors.end(); ++itC)
@@ -1003,7 +1476,8 @@ void Mesh::mirrorFromPoint(const WZMVertex& point, int axis)
 		}
 	}
 
-	recalculateBoundData();
+	invalidateBoundData();
+	invalidateVertexStream();
 
 	// Update animation
 	/*
@@ -1016,45 +1490,49 @@ void Mesh::mirrorFromPoint(const WZMVertex& point, int axis)
 
 void Mesh::reverseWinding()
 {
-	std::vector<IndexedTri>::iterator it;
-	for (it = m_indexArray.begin(); it != m_indexArray.end(); ++it)
+	for (size_t i = 0; i < m_indexArray.size(); ++i)
 	{
-		std::swap((*it).b(), (*it).c());
+		IndexedTri tri = m_indexArray[i];
+		std::swap(tri.b(), tri.c());
+		m_indexArray.set(i, tri);
 	}
 }
 
 void Mesh::flipNormals()
 {
-	std::vector<WZMVertex>::iterator nit;
-	for (nit = m_normalArray.begin(); nit != m_normalArray.end(); ++nit)
-	{
-		nit->scale(-1.,-1.,-1.);
-	}
+	ensureTangents();
 
-	for (unsigned int i = 0; i < vertices(); ++i)
-	{
-		// Recalculate handedness
-		if (m_normalArray[i].crossProduct(m_tangentArray[i].xyz()).dotProduct(m_bitangentArray[i]) < 0.0f)
-			m_tangentArray[i].w() = -1.0f;
-		else
-			m_tangentArray[i].w() = 1.0f;
-	}
+	const GLfloat flip[3] = {-1.f, -1.f, -1.f};
+	kernelMul3(components(m_normalArray), vertices(), flip);
+
+	// Flipped normals swap the handedness
+	kernelSwapHandedness(components(m_normalArray), components(m_tangentArray), vertices());
+	invalidateVertexStream();
 }
 
 void Mesh::move(const WZMVertex &moveby)
 {
-	for (size_t i = 0; i < vertices(); ++i)
+	const GLfloat keep[3] = {1.f, 1.f, 1.f};
+	kernelMulAdd3(components(m_vertexArray), vertices(), keep, moveby);
+	// exact bounds just move along, the stored ones are rounded already
+	if (m_boundDataState == BOUNDS_EXACT)
 	{
-		m_vertexArray[i] += moveby;
+		m_mesh_weightcenter += moveby;
+		m_mesh_aabb_min += moveby;
+		m_mesh_aabb_max += moveby;
+		m_mesh_tspcenter += moveby;
 	}
-	m_mesh_weightcenter += moveby;
-	m_mesh_aabb_min += moveby;
-	m_mesh_aabb_max += moveby;
-	m_mesh_tspcenter += moveby;
+	else
+	{
+		invalidateBoundData();
+	}
+	invalidateVertexStream();
 }
 
 void Mesh::center(int axis)
 {
+	ensureBoundData(true);
+
 	if (m_mesh_weightcenter == WZMVertex())
 		return;
 
@@ -1076,20 +1554,410 @@ void Mesh::center(int axis)
 	move(moveby);
 }
 
+AffineDirections::AffineDirections(const WZMMatrix4& transform):
+	turns(!transform.isTranslation()), renormalize(false), reflects(transform.determinant() < 0.f)
+{
+	const GLfloat det = transform.determinant();
+	const GLfloat conformal = transform.conformalScale();
+
+	// Angle keeping maps take unit directions to unit directions once the scale is divided out,
+	// others need the inverse transpose for normals and renormalizing. Singular ones keep them.
+	if (conformal > 0.f)
+	{
+		for (size_t row = 0; row < 3; ++row)
+			for (size_t col = 0; col < 3; ++col)
+				normalMatrix.m[row][col] = tangentMatrix.m[row][col] = transform.m[row][col] / conformal;
+	}
+	else if (det != 0.f)
+	{
+		normalMatrix = transform.normalMatrix();
+		tangentMatrix = transform;
+		renormalize = true;
+	}
+
+	for (size_t row = 0; row < 3; ++row)
+		normalMatrix.m[row][3] = tangentMatrix.m[row][3] = 0.f;
+}
+
+WZMVertex AffineDirections::normal(const WZMVertex& n) const
+{
+	const WZMVertex result = normalMatrix.transformDirection(n);
+	return renormalize ? result.normalize() : result;
+}
+
+WZMVertex4 AffineDirections::tangent(const WZMVertex& movedNormal, const WZMVertex4& t) const
+{
+	WZMVertex result = tangentMatrix.transformDirection(t.xyz());
+	GLfloat w = t.w();
+
+	// Sheared frames aren't orthogonal anymore, Gram-Schmidt them back
+	if (renormalize)
+		result = WZMVertex(result - movedNormal * movedNormal.dotProduct(result)).normalize();
+
+	// A reflection swaps the handedness, degenerate frames have none
+	if (reflects)
+	{
+		const WZMVertex cross = movedNormal.crossProduct(result);
+		w = cross.dotProduct(cross) == 0.f ? 1.f : -w;
+	}
+
+	return WZMVertex4(result.x(), result.y(), result.z(), w);
+}
+
+MeshTransformView::MeshTransformView(const Mesh& mesh, const WZMMatrix4& transform):
+	m_mesh(mesh), m_transform(transform), m_directions(transform),
+	m_identity(transform.isIdentity())
+{
+	m_mesh.ensureTangents();
+}
+
+WZMVertex MeshTransformView::position(size_t index) const
+{
+	return m_identity ? m_mesh.m_vertexArray[index] : m_transform.transformPoint(m_mesh.m_vertexArray[index]);
+}
+
+WZMVertex MeshTransformView::normal(size_t index) const
+{
+	return m_directions.turns ? m_directions.normal(m_mesh.m_normalArray[index]) : m_mesh.m_normalArray[index];
+}
+
+WZMVertex4 MeshTransformView::tangent(size_t index) const
+{
+	if (!m_directions.turns)
+		return m_mesh.m_tangentArray[index];
+	return m_directions.tangent(normal(index), m_mesh.m_tangentArray[index]);
+}
+
+IndexedTri MeshTransformView::triangle(size_t index) const
+{
+	IndexedTri tri = m_mesh.m_indexArray[index];
+
+	if (m_directions.reflects)
+		std::swap(tri.b(), tri.c());
+	return tri;
+}
+
+namespace
+{
+	// Same floats as the multiply kernels scale and mirror use, -0 offsets leave -0 alone
+	template <bool TURNS, bool REFLECTS>
+	void affineDiagonal(const WZMMatrix4& transform, const AffineDirections& directions,
+			    GLfloat* pos, GLfloat* nrm, GLfloat* tgt, size_t begin, size_t end)
+	{
+		GLfloat mul[3], add[3], nmul[3], tmul[3];
+
+		for (size_t k = 0; k < 3; ++k)
+		{
+			mul[k] = transform.m[k][k];
+			add[k] = transform.m[k][3] == 0.f ? -0.f : transform.m[k][3];
+			nmul[k] = directions.normalMatrix.m[k][k];
+			tmul[k] = directions.tangentMatrix.m[k][k];
+		}
+
+		for (size_t i = begin; i < end; ++i)
+		{
+			GLfloat* p = pos + i * 3;
+			p[0] = p[0] * mul[0] + add[0];
+			p[1] = p[1] * mul[1] + add[1];
+			p[2] = p[2] * mul[2] + add[2];
+
+			if (!TURNS)
+				continue;
+
+			GLfloat* n = nrm + i * 3;
+			GLfloat* t = tgt + i * 4;
+			n[0] *= nmul[0];
+			n[1] *= nmul[1];
+			n[2] *= nmul[2];
+			t[0] *= tmul[0];
+			t[1] *= tmul[1];
+			t[2] *= tmul[2];
+
+			// A reflection swaps the handedness, degenerate frames have none
+			if (REFLECTS)
+			{
+				const GLfloat cx = n[1] * t[2] - n[2] * t[1], cy = n[2] * t[0] - n[0] * t[2], cz = n[0] * t[1] - n[1] * t[0];
+				t[3] = cx * cx + cy * cy + cz * cz == 0.f ? 1.f : -t[3];
+			}
+		}
+	}
+}
+
+void Mesh::applyAffine(const WZMMatrix4& transform)
+{
+	ensureTangents();
+
+	const AffineDirections directions(transform);
+	bool diagonal = !directions.renormalize;
+
+	for (size_t row = 0; row < 3; ++row)
+		for (size_t col = 0; col < 3; ++col)
+			diagonal = diagonal && (row == col || transform.m[row][col] == 0.f);
+
+	GLfloat* positions = components(m_vertexArray);
+	GLfloat* normals = components(m_normalArray);
+	GLfloat* tangents = components(m_tangentArray);
+
+	// One sweep over positions, normals and tangents
+	parallelFor(0, vertices(), TRANSFORM_MIN_CHUNK, [&](size_t begin, size_t end)
+	{
+		if (!directions.turns)
+			affineDiagonal<false, false>(transform, directions, positions, normals, tangents, begin, end);
+		else if (diagonal && directions.reflects)
+			affineDiagonal<true, true>(transform, directions, positions, normals, tangents, begin, end);
+		else if (diagonal)
+			affineDiagonal<true, false>(transform, directions, positions, normals, tangents, begin, end);
+		else
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				m_vertexArray[i] = transform.transformPoint(m_vertexArray[i]);
+				m_normalArray[i] = directions.normal(m_normalArray[i]);
+				m_tangentArray[i] = directions.tangent(m_normalArray[i], m_tangentArray[i]);
+			}
+		}
+	});
+
+	for (auto& connector: m_connectors)
+		connector.m_pos = transform.transformPoint(connector.m_pos);
+
+	// Update animation
+	for (auto& curFrame: m_frameArray)
+		curFrame.trans = transform.transformDirection(curFrame.trans);
+
+	// exact bounds just move along with a translation
+	if (!directions.turns && m_boundDataState == BOUNDS_EXACT)
+	{
+		const WZMVertex moveby(transform.m[0][3], transform.m[1][3], transform.m[2][3]);
+
+		m_mesh_weightcenter += moveby;
+		m_mesh_aabb_min += moveby;
+		m_mesh_aabb_max += moveby;
+		m_mesh_tspcenter += moveby;
+	}
+	else
+	{
+		invalidateBoundData();
+	}
+
+	if (directions.reflects)
+		reverseWinding();
+	invalidateVertexStream();
+}
+
 void Mesh::recalculateTB()
 {
-	size_t vert_num = vertices();
+	if (vertices())
+		markTangentsDirty(0, vertices() - 1);
+	ensureTangents();
+}
+
+void Mesh::markTangentsDirty(size_t first, size_t last)
+{
+	if (m_tangentsDirtyBegin >= m_tangentsDirtyEnd)
+	{
+		m_tangentsDirtyBegin = first;
+		m_tangentsDirtyEnd = last + 1;
+	}
+	else
+	{
+		m_tangentsDirtyBegin = std::min(m_tangentsDirtyBegin, first);
+		m_tangentsDirtyEnd = std::max(m_tangentsDirtyEnd, last + 1);
+	}
+	invalidateVertexStream();
+}
+
+void Mesh::ensureTangents() const
+{
+	if (m_tangentsDirtyBegin < m_tangentsDirtyEnd)
+	{
+		recalculateTangents(m_tangentsDirtyBegin, std::min(m_tangentsDirtyEnd, vertices()));
+		m_tangentsDirtyBegin = m_tangentsDirtyEnd = 0;
+	}
+}
+
+// Tangents of the vertices in [first, last), from all the triangles around them
+void Mesh::recalculateTangents(size_t first, size_t last) const
+{
+	const size_t vert_num = vertices();
+	const size_t tri_num = m_indexArray.size();
+	const size_t count = last > first ? last - first : 0;
+	size_t i;
+
+	auto inRange = [first, last](GLuint v)
+	{
+		return v >= first && v < last;
+	};
+
+	// The triangles touching the range, in order
+	std::vector<GLuint> tris;
+	for (i = 0; i < tri_num; ++i)
+	{
+		const IndexedTri tri = m_indexArray[i];
+
+		if (tri.a() < vert_num && tri.b() < vert_num && tri.c() < vert_num
+			&& (inRange(tri.a()) || inRange(tri.b()) || inRange(tri.c())))
+		{
+			tris.push_back(static_cast<GLuint>(i));
+		}
+	}
+
+	// TB-calculation part, per triangle
+	std::vector<WZMVertex> triTangents(tris.size()), triBitangents(tris.size());
+	parallelFor(0, tris.size(), TB_MIN_CHUNK, [&](size_t begin, size_t end)
+	{
+		for (size_t t = begin; t < end; ++t)
+		{
+			const IndexedTri tri = m_indexArray[tris[t]];
+
+			triangleTB(m_vertexArray[tri.a()], m_vertexArray[tri.b()], m_vertexArray[tri.c()],
+				   m_textureArray[tri.a()], m_textureArray[tri.b()], m_textureArray[tri.c()],
+				   triTangents[t], triBitangents[t]);
+		}
+	});
+
+	// Every vertex sums up its triangles in triangle order, keeping the float sums
+	// and so the results independent of the thread count
+	if (parallelThreads() == 1 || tris.size() < TB_MIN_CHUNK)
+	{
+		// serial scatter, the corner table below only pays off when the work is shared
+		std::vector<WZMVertex> tangentSums(count), bitangentSums(count);
+
+		for (i = 0; i < tris.size(); ++i)
+		{
+			const IndexedTri tri = m_indexArray[tris[i]];
+			const GLuint corners[3] = {tri.a(), tri.b(), tri.c()};
+
+			for (GLuint v: corners)
+			{
+				if (inRange(v))
+				{
+					tangentSums[v - first] -= triTangents[i];
+					bitangentSums[v - first] -= triBitangents[i];
+				}
+			}
+		}
+
+		for (i = 0; i < count; ++i)
+			m_tangentArray[first + i] = orthogonalTangent(m_normalArray[first + i], tangentSums[i], bitangentSums[i]);
+	}
+	else
+	{
+		// vertex -> triangle corners
+		std::vector<GLuint> cornerOffsets(count + 1, 0), cornerTris;
+		for (i = 0; i < tris.size(); ++i)
+		{
+			const IndexedTri tri = m_indexArray[tris[i]];
+			const GLuint corners[3] = {tri.a(), tri.b(), tri.c()};
+
+			for (GLuint v: corners)
+			{
+				if (inRange(v))
+					++cornerOffsets[v - first + 1];
+			}
+		}
+		for (i = 0; i < count; ++i)
+			cornerOffsets[i + 1] += cornerOffsets[i];
+
+		std::vector<GLuint> fill(cornerOffsets.begin(), cornerOffsets.end() - 1);
+		cornerTris.resize(cornerOffsets.back());
+		for (i = 0; i < tris.size(); ++i)
+		{
+			const IndexedTri tri = m_indexArray[tris[i]];
+			const GLuint corners[3] = {tri.a(), tri.b(), tri.c()};
+
+			for (GLuint v: corners)
+			{
+				if (inRange(v))
+					cornerTris[fill[v - first]++] = static_cast<GLuint>(i);
+			}
+		}
+
+		parallelFor(0, count, TB_MIN_CHUNK, [&](size_t begin, size_t end)
+		{
+			for (size_t v = begin; v < end; ++v)
+			{
+				WZMVertex tangentSum, bitangentSum;
+
+				for (GLuint c = cornerOffsets[v]; c < cornerOffsets[v + 1]; ++c)
+				{
+					tangentSum -= triTangents[cornerTris[c]];
+					bitangentSum -= triBitangents[cornerTris[c]];
+				}
+
+				m_tangentArray[first + v] = orthogonalTangent(m_normalArray[first + v], tangentSum, bitangentSum);
+			}
+		});
+	}
+
+	m_vertexStreamDirty = true;
+}
+
+VertexCacheStats Mesh::vertexCacheStats() const
+{
+	return analyzeVertexCache(m_indexArray.toVector(), vertices());
+}
+
+void Mesh::optimizeVertexCache()
+{
+	m_indexArray.assign(::optimizeVertexCache(m_indexArray.toVector(), vertices()));
+}
+
+OverdrawStats Mesh::overdrawStats() const
+{
+	return analyzeOverdraw(m_indexArray.toVector(), m_vertexArray);
+}
+
+void Mesh::optimizeOverdraw(float threshold)
+{
+	m_indexArray.assign(::optimizeOverdraw(m_indexArray.toVector(), m_vertexArray, threshold));
+}
+
+void Mesh::optimizeVertexFetch()
+{
+	ensureTangents();
+
+	std::vector<GLuint> indices = m_indexArray.toVector();
+	const std::vector<GLuint> remap = vertexFetchRemap(indices, vertices());
+
+	remapVertexArray(m_vertexArray, remap);
+	remapVertexArray(m_textureArray, remap);
+	remapVertexArray(m_normalArray, remap);
+	remapVertexArray(m_tangentArray, remap);
+	invalidateVertexStream();
+
+	for (GLuint& idx: indices)
+	{
+		if (idx < remap.size())
+			idx = remap[idx];
+	}
+	m_indexArray.assign(indices);
+}
+
+Mesh Mesh::simplified(float ratio) const
+{
+	ensureTangents();
+
+	Mesh result(*this);
+	result.m_indexArray.assign(simplifyMesh(m_indexArray.toVector(), m_vertexArray, ratio));
 
-	// Zero-out arrays
-	m_tangentArray.resize(vert_num);
-	std::fill(m_tangentArray.begin(), m_tangentArray.end(), WZMVertex4());
-	m_bitangentArray.resize(vert_num);
-	std::fill(m_bitangentArray.begin(), m_bitangentArray.end(), WZMVertex());
+	// Used vertices come first after the fetch remap, so the rest can go
+	result.optimizeVertexFetch();
 
-	// TB-calculation part
-	for (auto& curTrio : m_indexArray)
-		calculateTBForIndices(curTrio);
-	finishTBCalculation();
+	GLuint used = 0;
+	for (size_t i = 0; i < result.m_indexArray.size(); ++i)
+	{
+		const IndexedTri tri = result.m_indexArray[i];
+		used = std::max(used, std::max(tri.a(), std::max(tri.b(), tri.c())) + 1);
+	}
+
+	result.m_vertexArray.resize(used);
+	result.m_textureArray.resize(used);
+	result.m_normalArray.resize(used);
+	result.m_tangentArray.resize(used);
+	result.invalidateVertexStream();
+	result.invalidateBoundData();
+	return result;
 }
 
 void Mesh::importPieAnimation(const ApieAnimObject &animobj)
@@ -1113,44 +1981,45 @@ void Mesh::importPieAnimation(const ApieAnimObject &animobj)
 	}
 }
 
-void Mesh::recalculateBoundData()
+void Mesh::ensureBoundData(bool exact) const
+{
+	if (m_boundDataState == BOUNDS_DIRTY || (exact && m_boundDataState == BOUNDS_STORED))
+		recalculateBoundData();
+}
+
+void Mesh::invalidateBoundData()
+{
+	m_boundDataState = BOUNDS_DIRTY;
+}
+
+void Mesh::recalculateBoundData() const
 {
 	WZMVertex weight, min, max, vxmin, vxmax, vymin, vymax, vzmin, vzmax;
+	BoundsResult bounds;
+
+	m_boundDataState = BOUNDS_EXACT;
 
 	if (!vertices())
 	{
 		return;
 	}
 
-	min = max = vxmax = vymax = vzmax = vxmin = vymin = vzmin = m_vertexArray.at(0);
+	const GLfloat* positions = components(m_vertexArray);
+	kernelBounds3(positions, vertices(), bounds);
 
-	std::vector<WZMVertex>::const_iterator vertIt;
-	for (vertIt = m_vertexArray.begin(); vertIt < m_vertexArray.end(); ++vertIt)
+	for (size_t i = 0; i < 3; ++i)
 	{
-		weight.x() += vertIt->x();
-		weight.y() += vertIt->y();
-		weight.z() += vertIt->z();
-
-		if (min.x() > vertIt->x()) min.x() = vertIt->x();
-		if (min.y() > vertIt->y()) min.y() = vertIt->y();
-		if (min.z() > vertIt->z()) min.z() = vertIt->z();
-
-		if (max.x() < vertIt->x()) max.x() = vertIt->x();
-		if (max.y() < vertIt->y()) max.y() = vertIt->y();
-		if (max.z() < vertIt->z()) max.z() = vertIt->z();
-
-		if (vxmin.x() > vertIt->x()) vxmin = *vertIt;
-		if (vymin.y() > vertIt->y()) vymin = *vertIt;
-		if (vzmin.z() > vertIt->z()) vzmin = *vertIt;
-
-		if (vxmax.x() < vertIt->x()) vxmax = *vertIt;
-		if (vymax.y() < vertIt->y()) vymax = *vertIt;
-		if (vzmax.z() < vertIt->z()) vzmax = *vertIt;
+		weight[i] = static_cast<GLfloat>(bounds.sum[i] / vertices());
+		min[i] = bounds.min[i];
+		max[i] = bounds.max[i];
 	}
 
-	weight.x() /= vertices();
-	weight.y() /= vertices();
-	weight.z() /= vertices();
+	vxmin = m_vertexArray[bounds.minIndex[0]];
+	vymin = m_vertexArray[bounds.minIndex[1]];
+	vzmin = m_vertexArray[bounds.minIndex[2]];
+	vxmax = m_vertexArray[bounds.maxIndex[0]];
+	vymax = m_vertexArray[bounds.maxIndex[1]];
+	vzmax = m_vertexArray[bounds.maxIndex[2]];
 
 	m_mesh_weightcenter = weight;
 	m_mesh_aabb_min = min;
@@ -1212,9 +2081,12 @@ void Mesh::recalculateBoundData()
 	rad_sq = dx*dx + dy*dy + dz*dz;
 	rad = sqrt((double)rad_sq);
 
-	// second pass (find tight sphere)
-	for (vertIt = m_vertexArray.begin(); vertIt < m_vertexArray.end(); ++vertIt)
+	// second pass (find tight sphere), the kernel skips the points well inside
+	for (size_t i = kernelFindOutside3(positions, 0, vertices(), cen, rad_sq); i < vertices();
+	     i = kernelFindOutside3(positions, i + 1, vertices(), cen, rad_sq))
 	{
+		const WZMVertex* vertIt = &m_vertexArray[i];
+
 		dx = vertIt->x() - cen.x();
 		dy = vertIt->y() - cen.y();
 		dz = vertIt->z() - cen.z();
@@ -1246,6 +2118,8 @@ WZMVertex Mesh::getCenterPoint() const
 {
 	WZMVertex center;
 
+	ensureBoundData(true);
+
 	center.x() = (m_mesh_aabb_max.x() + m_mesh_aabb_min.x()) / 2;
 	center.y() = (m_mesh_aabb_max.y() + m_mesh_aabb_min.y()) / 2;
 	center.z() = (m_mesh_aabb_max.z() + m_mesh_aabb_min.z()) / 2;
@@ -24,12 +24,19 @@
 #include <string>
 #include <vector>
 #include <list>
+#include <type_traits>
 
 #include <GL/glew.h>
 #include "VectorTypes.h"
+#include "Matrix.h"
 #include "Polygon.h"
+#include "IndexArray.h"
 
 #include "OBJ.h"
+#include "VertexWelder.h"
+#include "MeshOptimizer.h"
+#include "VertexCodec.h"
+#include "WZMBinary.h"
 
 #define WZM_MESH_SIGNATURE "MESH"
 #define WZM_MESH_DIRECTIVE_TEAMCOLOURS "TEAMCOLOURS"
@@ -37,14 +44,23 @@
 #define WZM_MESH_DIRECTIVE_VERTICES "VERTICES"
 #define WZM_MESH_DIRECTIVE_INDICES "INDICES"
 #define WZM_MESH_DIRECTIVE_VERTEXARRAY "VERTEXARRAY"
+#define WZM_MESH_DIRECTIVE_COMPACTVERTEXARRAY "COMPACTVERTEXARRAY"
+#define WZM_MESH_COMPACT_UV_UNORM16 "UNORM16"
+#define WZM_MESH_COMPACT_UV_HALF "HALF"
 #define WZM_MESH_DIRECTIVE_INDEXARRAY "INDEXARRAY"
 #define WZM_MESH_DIRECTIVE_CONNECTORS "CONNECTORS"
 
 
 typedef Vertex<GLfloat> WZMVertex;
 typedef Vertex4<GLfloat> WZMVertex4;
+typedef Matrix4<GLfloat> WZMMatrix4;
 typedef UV<GLclampf> WZMUV;
 
+// Vertex arrays are copied and grown with memcpy only while these hold
+static_assert(std::is_trivially_copyable<WZMVertex>::value, "WZMVertex is no longer trivially copyable.");
+static_assert(std::is_trivially_copyable<WZMVertex4>::value, "WZMVertex4 is no longer trivially copyable.");
+static_assert(std::is_trivially_copyable<WZMUV>::value, "WZMUV is no longer trivially copyable.");
+
 class Mesh;
 
 class WZMConnector
@@ -69,28 +85,45 @@ struct Frame
 
 class Pie3Level;
 class ApieAnimObject;
-struct Mesh_exportToOBJ_InOutParams;
+class TextScanner;
+class GLBFile;
+class JsonValue;
 
 class Mesh
 {
 	friend class QWZM; // For rendering
+	friend class MeshTransformView;
 public:
 	Mesh();
-	Mesh(const Pie3Level& p3);
+	Mesh(const Pie3Level& p3, const WeldTolerances& tolerances = WeldTolerances());
 	virtual ~Mesh();
 
+	Mesh(const Mesh& rhs) = default;
+	Mesh(Mesh&& rhs) = default;
+	Mesh& operator=(const Mesh& rhs) = default;
+	Mesh& operator=(Mesh&& rhs) = default;
+
 	static Pie3Level backConvert(const Mesh& wzmMesh);
 	virtual operator Pie3Level() const;
 
-	bool read(std::istream& in);
-	void write(std::ostream& out) const;
+	// Vertex rows go straight into the presized arrays, compact ones only
+	// where the file version allows them
+	bool read(TextScanner& in, bool compactVertices = false);
+	void write(TextWriter& out, bool compactVertices = false) const;
+
+	// Binary .wzmb mesh from its table entry, blocks are checked against the file
+	bool readBinary(const WZMBReader& file, const WZMBMesh& entry);
+	// Writes the blocks and returns the table entry pointing at them
+	WZMBMesh writeBinary(WZMBWriter& out, WZMBEncoding encoding = WZMB_ENCODING_FLOATS) const;
 
 	bool importFromOBJ(const std::vector<OBJTri>&	faces,
 			   const std::vector<OBJVertex>& verts,
 			   const std::vector<OBJUV>&	uvArray,
 			   const std::vector<OBJVertex>& normals,
-			   bool welder);
-	std::stringstream* exportToOBJ(const Mesh_exportToOBJ_InOutParams& params) const;
+			   bool welder,
+			   const WeldTolerances& tolerances = WeldTolerances());
+	// A glTF triangle primitive as it is stored, in glTF space
+	bool importFromGLTF(const GLBFile& file, const JsonValue& primitive);
 
 	std::string getName() const;
 	void setName(const std::string& name);
@@ -109,8 +142,25 @@ public:
 	size_t indices() const;
 	size_t frames() const;
 
+	const std::vector<Frame>& getFrames() const;
+	int frameTime() const;
+	int frameCycles() const;
+	void setFrames(const std::vector<Frame>& frames, int frameTime, int frameCycles);
+
 	bool isValid() const;
 
+	// Interleaved copy of the vertex arrays, rebuilt on first use after any change
+	const std::vector<WZMPackedVertex>& vertexStream() const;
+	const IndexArray& indexArray() const {return m_indexArray;}
+
+	// Bitangents aren't stored, they follow from normal, tangent and its w
+	WZMVertex getBitangent(size_t index) const;
+
+	// The mesh itself keeps float arrays, the compact form is for files and conversions
+	CompactVertexArray compactVertices() const;
+	bool setCompactVertices(const CompactVertexArray& compact); // same vertex count only
+	CompactErrorStats compactErrorStats() const;
+
 	void scale(GLfloat x, GLfloat y, GLfloat z);
 	void mirrorUsingLocalCenter(int axis); // x == 0, y == 1, z == 2
 	void mirrorFromPoint(const WZMVertex& point, int axis); // x == 0, y == 1, z == 2
@@ -119,7 +169,21 @@ public:
 	void move(const WZMVertex& moveby);
 	void center(int axis); // -1 == all, x == 0, y == 1, z == 2
 
+	// Any stack of the above in one pass, winding is reversed for reflections
+	void applyAffine(const WZMMatrix4& transform);
+
 	void recalculateTB();
+
+	VertexCacheStats vertexCacheStats() const;
+	void optimizeVertexCache();
+	void optimizeVertexFetch();
+
+	OverdrawStats overdrawStats() const;
+	void optimizeOverdraw(float threshold = WMIT_OVERDRAW_DEFAULT_THRESHOLD);
+
+	// Decimated copy with about ratio of the triangles, unused vertices dropped
+	Mesh simplified(float ratio) const;
+
 	void importPieAnimation(const ApieAnimObject& animobj);
 
 	WZMVertex getCenterPoint() const;
@@ -132,29 +196,99 @@ protected:
 	std::vector<WZMVertex> m_vertexArray;
 	std::vector<WZMUV> m_textureArray;
 	std::vector<WZMVertex> m_normalArray;
-	std::vector<WZMVertex4> m_tangentArray;
-	std::vector<WZMVertex> m_bitangentArray;
-	std::vector<IndexedTri> m_indexArray;
+	mutable std::vector<WZMVertex4> m_tangentArray; // the dirty range is rebuilt on first use
+	IndexArray m_indexArray;
+
+	mutable std::vector<WZMPackedVertex> m_vertexStream;
+	mutable bool m_vertexStreamDirty; // set by every change to the vertex arrays
 
 	std::list<WZMConnector> m_connectors;
 	std::string m_shader_vert;
 	std::string m_shader_frag;
 
 	bool m_teamColours;
-	WZMVertex m_mesh_weightcenter, m_mesh_aabb_min, m_mesh_aabb_max, m_mesh_tspcenter;
+
+	enum BoundDataState
+	{
+		BOUNDS_DIRTY,
+		BOUNDS_STORED, // aabb and sphere as read from a file: rounded, no weight center
+		BOUNDS_EXACT
+	};
+
+	// Derived data, recalculated on first use after a change
+	mutable size_t m_tangentsDirtyBegin, m_tangentsDirtyEnd; // vertex range, empty when begin >= end
+	mutable BoundDataState m_boundDataState;
+	mutable WZMVertex m_mesh_weightcenter, m_mesh_aabb_min, m_mesh_aabb_max, m_mesh_tspcenter;
 
 	void clear();
 	void reservePoints(const unsigned size);
 	void reserveIndices(const unsigned size);
 	void addIndices(const IndexedTri& trio);
-	void calculateTBForIndices(const IndexedTri &trio);
-	void finishTBCalculation();
 	void addPoint(const WZMVertex &vertex, const WZMUV &uv, const WZMVertex &normal);
 	void finishImport();
+	bool readCompactVertices(TextScanner& in, unsigned vertices);
+	void useStoredBounds(); // if the bounds read make sense
 
-	void recalculateBoundData();
+	void markTangentsDirty(size_t first, size_t last); // inclusive vertex range
+	void ensureTangents() const;
+	void recalculateTangents(size_t begin, size_t end) const;
+
+	void recalculateBoundData() const;
+	void ensureBoundData(bool exact = false) const; // exact: not trusting the stored values
+	void invalidateBoundData();
+	void invalidateVertexStream();
 private:
 	void defaultConstructor();
 };
 
+/*
+ * How directions follow an affine map: normals by the inverse transpose and tangents
+ * by the map itself, renormalized when it shears. Reflections swap the handedness.
+ */
+struct AffineDirections
+{
+	explicit AffineDirections(const WZMMatrix4& transform);
+
+	WZMVertex normal(const WZMVertex& n) const;
+	WZMVertex4 tangent(const WZMVertex& movedNormal, const WZMVertex4& t) const;
+
+	WZMMatrix4 normalMatrix, tangentMatrix;
+	bool turns; // anything but a translation
+	bool renormalize;
+	bool reflects;
+};
+
+/*
+ * Read-only look at a mesh through an affine transform, for the exporters.
+ * Vertices are transformed as they are read and triangles come reversed for
+ * reflections, so saving an edited model copies none of its meshes.
+ */
+class MeshTransformView
+{
+public:
+	explicit MeshTransformView(const Mesh& mesh, const WZMMatrix4& transform = WZMMatrix4());
+
+	operator Pie3Level() const;
+
+	// OBJ export is mirrored on x with reversed winding
+	void addToOBJPools(OBJExportPools& pools, std::vector<OBJPointRef>& refs) const;
+	void writeOBJFaces(TextWriter& out, const std::vector<OBJPointRef>& refs) const;
+
+	const Mesh& mesh() const {return m_mesh;}
+	size_t vertices() const {return m_mesh.vertices();}
+	size_t triangles() const {return m_mesh.indices();}
+
+	WZMVertex position(size_t index) const;
+	WZMUV uv(size_t index) const {return m_mesh.m_textureArray[index];}
+	WZMVertex normal(size_t index) const;
+	WZMVertex4 tangent(size_t index) const;
+	IndexedTri triangle(size_t index) const;
+
+private:
+	const Mesh& m_mesh;
+	WZMMatrix4 m_transform;
+	AffineDirections m_directions;
+	bool m_identity;
+};
+
 #endif // MESH_HPP
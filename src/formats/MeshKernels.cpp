@@ -0,0 +1,830 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MeshKernels.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#  define WMIT_KERNELS_X86
+#  include <immintrin.h>
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#    define WMIT_TARGET(isa)
+#  else
+#    define WMIT_TARGET(isa) __attribute__((target(isa)))
+#  endif
+#elif defined(WMIT_NEON_KERNELS) && (defined(__aarch64__) || defined(_M_ARM64))
+// Not yet run on ARM hardware, so only built on request
+#  define WMIT_KERNELS_NEON
+#  include <arm_neon.h>
+#endif
+
+namespace
+{
+	struct KernelTable
+	{
+		const char* name;
+		void (*mul3)(GLfloat*, size_t, const GLfloat*);
+		void (*mulAdd3)(GLfloat*, size_t, const GLfloat*, const GLfloat*);
+		void (*mul4)(GLfloat*, size_t, const GLfloat*);
+		void (*swapHandedness)(const GLfloat*, GLfloat*, size_t);
+		void (*bounds3)(const GLfloat*, size_t, BoundsResult&);
+		size_t (*findOutside3)(const GLfloat*, size_t, size_t, const GLfloat*, double);
+	};
+
+	// Lane j of a register run over interleaved xyz holds component j % 3 of vertex j / 3
+	void fillPattern(GLfloat* pattern, size_t lanes, const GLfloat xyz[3])
+	{
+		for (size_t j = 0; j < lanes; ++j)
+			pattern[j] = xyz[j % 3];
+	}
+
+	// Squared float distances at or above this may be outside, float rounding can't hide more than 1e-5
+	GLfloat outsideThreshold(double radiusSq)
+	{
+		if (!(radiusSq > 1e-30)) // tiny, zero or nan: everything is worth a look, nan nothing
+			return radiusSq == radiusSq ? 0.f : std::numeric_limits<GLfloat>::quiet_NaN();
+		if (radiusSq >= std::numeric_limits<GLfloat>::max())
+			return std::numeric_limits<GLfloat>::infinity();
+		return static_cast<GLfloat>(radiusSq * (1. - 1e-5));
+	}
+
+	// Scalar kernels, also doing the tails of the vector ones
+
+	void mul3Scalar(GLfloat* xyz, size_t count, const GLfloat* mul)
+	{
+		for (size_t i = 0; i < count; ++i, xyz += 3)
+		{
+			xyz[0] *= mul[0];
+			xyz[1] *= mul[1];
+			xyz[2] *= mul[2];
+		}
+	}
+
+	void mulAdd3Scalar(GLfloat* xyz, size_t count, const GLfloat* mul, const GLfloat* add)
+	{
+		for (size_t i = 0; i < count; ++i, xyz += 3)
+		{
+			xyz[0] = xyz[0] * mul[0] + add[0];
+			xyz[1] = xyz[1] * mul[1] + add[1];
+			xyz[2] = xyz[2] * mul[2] + add[2];
+		}
+	}
+
+	void mul4Scalar(GLfloat* xyzw, size_t count, const GLfloat* mul)
+	{
+		for (size_t i = 0; i < count; ++i, xyzw += 4)
+		{
+			xyzw[0] *= mul[0];
+			xyzw[1] *= mul[1];
+			xyzw[2] *= mul[2];
+			xyzw[3] *= mul[3];
+		}
+	}
+
+	void swapHandednessScalar(const GLfloat* normals, GLfloat* tangents, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i, normals += 3, tangents += 4)
+		{
+			const GLfloat* n = normals;
+			const GLfloat* t = tangents;
+			const GLfloat cx = n[1] * t[2] - n[2] * t[1], cy = n[2] * t[0] - n[0] * t[2], cz = n[0] * t[1] - n[1] * t[0];
+
+			tangents[3] = cx * cx + cy * cy + cz * cz == 0.f ? 1.f : -t[3];
+		}
+	}
+
+	// Carries on from vertex begin with what result already holds
+	void boundsTail(const GLfloat* xyz, size_t begin, size_t count, BoundsResult& result)
+	{
+		for (size_t i = begin; i < count; ++i)
+		{
+			const GLfloat* v = xyz + i * 3;
+
+			for (int c = 0; c < 3; ++c)
+			{
+				result.sum[c] += v[c];
+
+				if (result.min[c] > v[c])
+				{
+					result.min[c] = v[c];
+					result.minIndex[c] = i;
+				}
+				if (result.max[c] < v[c])
+				{
+					result.max[c] = v[c];
+					result.maxIndex[c] = i;
+				}
+			}
+		}
+	}
+
+	void boundsScalar(const GLfloat* xyz, size_t count, BoundsResult& result)
+	{
+		for (int c = 0; c < 3; ++c)
+		{
+			result.min[c] = result.max[c] = xyz[c];
+			result.minIndex[c] = result.maxIndex[c] = 0;
+			result.sum[c] = 0.;
+		}
+		boundsTail(xyz, 0, count, result);
+	}
+
+	/*
+	 * Reduces per lane extremes, lane j being component j % 3 when interleaved
+	 * or j / (lanes / 3) otherwise. Ties go to the lower vertex, like the scalar scan.
+	 * The sums come from the vector loops, added up in vertex order like boundsTail does.
+	 */
+	void combineLanes(size_t lanes, bool interleaved, const GLfloat* mins, const int32_t* minIndices,
+			  const GLfloat* maxs, const int32_t* maxIndices, const double* sums, BoundsResult& result)
+	{
+		bool seen[3] = {false, false, false};
+
+		for (size_t j = 0; j < lanes; ++j)
+		{
+			const size_t c = interleaved ? j % 3 : j / (lanes / 3);
+			const size_t minIndex = static_cast<size_t>(minIndices[j]), maxIndex = static_cast<size_t>(maxIndices[j]);
+
+			if (!seen[c])
+			{
+				seen[c] = true;
+				result.min[c] = mins[j];
+				result.max[c] = maxs[j];
+				result.minIndex[c] = minIndex;
+				result.maxIndex[c] = maxIndex;
+				result.sum[c] = sums[c];
+				continue;
+			}
+
+			if (mins[j] < result.min[c] || (mins[j] == result.min[c] && minIndex < result.minIndex[c]))
+			{
+				result.min[c] = mins[j];
+				result.minIndex[c] = minIndex;
+			}
+			if (maxs[j] > result.max[c] || (maxs[j] == result.max[c] && maxIndex < result.maxIndex[c]))
+			{
+				result.max[c] = maxs[j];
+				result.maxIndex[c] = maxIndex;
+			}
+		}
+	}
+
+	size_t findOutside3Scalar(const GLfloat* xyz, size_t begin, size_t count, const GLfloat* center, double radiusSq)
+	{
+		for (size_t i = begin; i < count; ++i)
+		{
+			const GLfloat* v = xyz + i * 3;
+			const double dx = v[0] - center[0], dy = v[1] - center[1], dz = v[2] - center[2];
+
+			if (dx * dx + dy * dy + dz * dz > radiusSq)
+				return i;
+		}
+		return count;
+	}
+
+	const KernelTable SCALAR_KERNELS = {"scalar", mul3Scalar, mulAdd3Scalar, mul4Scalar, swapHandednessScalar, boundsScalar, findOutside3Scalar};
+
+	// Vertex indices of the lanes in the index registers stay below 2^31
+	const size_t MAX_VECTOR_VERTICES = static_cast<size_t>(std::numeric_limits<int32_t>::max()) - 8;
+
+#ifdef WMIT_KERNELS_X86
+	const int32_t LANE_VERTEX_24[24] = {0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5, 5, 5, 6, 6, 6, 7, 7, 7};
+
+	inline int firstSetBit(int mask)
+	{
+		int bit = 0;
+		while (!(mask & (1 << bit)))
+			++bit;
+		return bit;
+	}
+
+	// SSE2, 4 vertices in 3 registers
+
+	WMIT_TARGET("sse2") void mul3Sse2(GLfloat* xyz, size_t count, const GLfloat* mul)
+	{
+		GLfloat pattern[12];
+		size_t i = 0;
+
+		fillPattern(pattern, 12, mul);
+		const __m128 m0 = _mm_loadu_ps(pattern), m1 = _mm_loadu_ps(pattern + 4), m2 = _mm_loadu_ps(pattern + 8);
+
+		for (; i + 4 <= count; i += 4)
+		{
+			GLfloat* p = xyz + i * 3;
+			_mm_storeu_ps(p, _mm_mul_ps(_mm_loadu_ps(p), m0));
+			_mm_storeu_ps(p + 4, _mm_mul_ps(_mm_loadu_ps(p + 4), m1));
+			_mm_storeu_ps(p + 8, _mm_mul_ps(_mm_loadu_ps(p + 8), m2));
+		}
+		mul3Scalar(xyz + i * 3, count - i, mul);
+	}
+
+	WMIT_TARGET("sse2") void mulAdd3Sse2(GLfloat* xyz, size_t count, const GLfloat* mul, const GLfloat* add)
+	{
+		GLfloat mulPattern[12], addPattern[12];
+		size_t i = 0;
+
+		fillPattern(mulPattern, 12, mul);
+		fillPattern(addPattern, 12, add);
+		const __m128 m0 = _mm_loadu_ps(mulPattern), m1 = _mm_loadu_ps(mulPattern + 4), m2 = _mm_loadu_ps(mulPattern + 8);
+		const __m128 a0 = _mm_loadu_ps(addPattern), a1 = _mm_loadu_ps(addPattern + 4), a2 = _mm_loadu_ps(addPattern + 8);
+
+		for (; i + 4 <= count; i += 4)
+		{
+			GLfloat* p = xyz + i * 3;
+			_mm_storeu_ps(p, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(p), m0), a0));
+			_mm_storeu_ps(p + 4, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(p + 4), m1), a1));
+			_mm_storeu_ps(p + 8, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(p + 8), m2), a2));
+		}
+		mulAdd3Scalar(xyz + i * 3, count - i, mul, add);
+	}
+
+	WMIT_TARGET("sse2") void mul4Sse2(GLfloat* xyzw, size_t count, const GLfloat* mul)
+	{
+		const __m128 m = _mm_loadu_ps(mul);
+
+		for (size_t i = 0; i < count; ++i)
+			_mm_storeu_ps(xyzw + i * 4, _mm_mul_ps(_mm_loadu_ps(xyzw + i * 4), m));
+	}
+
+	WMIT_TARGET("sse2") void bounds3Sse2(const GLfloat* xyz, size_t count, BoundsResult& result)
+	{
+		if (count < 4 || count > MAX_VECTOR_VERTICES)
+		{
+			boundsScalar(xyz, count, result);
+			return;
+		}
+
+		GLfloat first[12];
+		__m128 vmin[3], vmax[3];
+		double sums[3] = {0., 0., 0.};
+		__m128i imin[3], imax[3], index[3];
+		const __m128i step = _mm_set1_epi32(4);
+		size_t i = 0;
+		int r;
+
+		fillPattern(first, 12, xyz);
+		for (r = 0; r < 3; ++r)
+		{
+			vmin[r] = vmax[r] = _mm_loadu_ps(first + r * 4);
+			imin[r] = imax[r] = _mm_setzero_si128();
+			index[r] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(LANE_VERTEX_24 + r * 4));
+		}
+
+		for (; i + 4 <= count; i += 4)
+		{
+			const GLfloat* p = xyz + i * 3;
+
+			for (r = 0; r < 3; ++r)
+			{
+				const __m128 v = _mm_loadu_ps(p + r * 4);
+				const __m128 less = _mm_cmplt_ps(v, vmin[r]), greater = _mm_cmpgt_ps(v, vmax[r]);
+
+				vmin[r] = _mm_or_ps(_mm_and_ps(less, v), _mm_andnot_ps(less, vmin[r]));
+				imin[r] = _mm_or_si128(_mm_and_si128(_mm_castps_si128(less), index[r]),
+						       _mm_andnot_si128(_mm_castps_si128(less), imin[r]));
+				vmax[r] = _mm_or_ps(_mm_and_ps(greater, v), _mm_andnot_ps(greater, vmax[r]));
+				imax[r] = _mm_or_si128(_mm_and_si128(_mm_castps_si128(greater), index[r]),
+						       _mm_andnot_si128(_mm_castps_si128(greater), imax[r]));
+				index[r] = _mm_add_epi32(index[r], step);
+			}
+
+			// in double and vertex order, so the sum matches the scalar loop to the bit
+			for (int k = 0; k < 12; k += 3)
+			{
+				sums[0] += p[k];
+				sums[1] += p[k + 1];
+				sums[2] += p[k + 2];
+			}
+		}
+
+		GLfloat mins[12], maxs[12];
+		int32_t minIndices[12], maxIndices[12];
+
+		for (r = 0; r < 3; ++r)
+		{
+			_mm_storeu_ps(mins + r * 4, vmin[r]);
+			_mm_storeu_ps(maxs + r * 4, vmax[r]);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(minIndices + r * 4), imin[r]);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(maxIndices + r * 4), imax[r]);
+		}
+		combineLanes(12, true, mins, minIndices, maxs, maxIndices, sums, result);
+		boundsTail(xyz, i, count, result);
+	}
+
+	// x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3 to x, y and z registers, also per half of AVX ones
+	WMIT_TARGET("sse2") inline void deinterleave3(__m128 a, __m128 b, __m128 c, __m128& x, __m128& y, __m128& z)
+	{
+		x = _mm_shuffle_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 0, 0)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+		y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+		z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+	}
+
+	WMIT_TARGET("sse2") void swapHandednessSse2(const GLfloat* normals, GLfloat* tangents, size_t count)
+	{
+		const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f), sign = _mm_set1_ps(-0.f);
+		size_t i = 0;
+
+		for (; i + 4 <= count; i += 4)
+		{
+			const GLfloat* n = normals + i * 3;
+			GLfloat* t = tangents + i * 4;
+			__m128 nx, ny, nz;
+			__m128 tx = _mm_loadu_ps(t), ty = _mm_loadu_ps(t + 4), tz = _mm_loadu_ps(t + 8), tw = _mm_loadu_ps(t + 12);
+
+			deinterleave3(_mm_loadu_ps(n), _mm_loadu_ps(n + 4), _mm_loadu_ps(n + 8), nx, ny, nz);
+			_MM_TRANSPOSE4_PS(tx, ty, tz, tw);
+
+			const __m128 cx = _mm_sub_ps(_mm_mul_ps(ny, tz), _mm_mul_ps(nz, ty));
+			const __m128 cy = _mm_sub_ps(_mm_mul_ps(nz, tx), _mm_mul_ps(nx, tz));
+			const __m128 cz = _mm_sub_ps(_mm_mul_ps(nx, ty), _mm_mul_ps(ny, tx));
+			const __m128 degenerate = _mm_cmpeq_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy)), _mm_mul_ps(cz, cz)), zero);
+			GLfloat w[4];
+
+			_mm_storeu_ps(w, _mm_or_ps(_mm_and_ps(degenerate, one), _mm_andnot_ps(degenerate, _mm_xor_ps(tw, sign))));
+			t[3] = w[0];
+			t[7] = w[1];
+			t[11] = w[2];
+			t[15] = w[3];
+		}
+		swapHandednessScalar(normals + i * 3, tangents + i * 4, count - i);
+	}
+
+	WMIT_TARGET("sse2") size_t findOutside3Sse2(const GLfloat* xyz, size_t begin, size_t count, const GLfloat* center, double radiusSq)
+	{
+		const __m128 threshold = _mm_set1_ps(outsideThreshold(radiusSq));
+		const __m128 cx = _mm_set1_ps(center[0]), cy = _mm_set1_ps(center[1]), cz = _mm_set1_ps(center[2]);
+		size_t i = begin;
+
+		for (; i + 4 <= count; i += 4)
+		{
+			const GLfloat* p = xyz + i * 3;
+			__m128 x, y, z;
+
+			deinterleave3(_mm_loadu_ps(p), _mm_loadu_ps(p + 4), _mm_loadu_ps(p + 8), x, y, z);
+			const __m128 dx = _mm_sub_ps(x, cx), dy = _mm_sub_ps(y, cy), dz = _mm_sub_ps(z, cz);
+			const __m128 distSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			const int mask = _mm_movemask_ps(_mm_cmpge_ps(distSq, threshold));
+
+			if (mask)
+				return i + firstSetBit(mask);
+		}
+		return findOutside3Scalar(xyz, i, count, center, radiusSq);
+	}
+
+	// AVX2, 8 vertices in 3 registers
+
+	WMIT_TARGET("avx2") void mul3Avx2(GLfloat* xyz, size_t count, const GLfloat* mul)
+	{
+		GLfloat pattern[24];
+		size_t i = 0;
+
+		fillPattern(pattern, 24, mul);
+		const __m256 m0 = _mm256_loadu_ps(pattern), m1 = _mm256_loadu_ps(pattern + 8), m2 = _mm256_loadu_ps(pattern + 16);
+
+		for (; i + 8 <= count; i += 8)
+		{
+			GLfloat* p = xyz + i * 3;
+			_mm256_storeu_ps(p, _mm256_mul_ps(_mm256_loadu_ps(p), m0));
+			_mm256_storeu_ps(p + 8, _mm256_mul_ps(_mm256_loadu_ps(p + 8), m1));
+			_mm256_storeu_ps(p + 16, _mm256_mul_ps(_mm256_loadu_ps(p + 16), m2));
+		}
+		mul3Scalar(xyz + i * 3, count - i, mul);
+	}
+
+	WMIT_TARGET("avx2") void mulAdd3Avx2(GLfloat* xyz, size_t count, const GLfloat* mul, const GLfloat* add)
+	{
+		GLfloat mulPattern[24], addPattern[24];
+		size_t i = 0;
+
+		fillPattern(mulPattern, 24, mul);
+		fillPattern(addPattern, 24, add);
+		const __m256 m0 = _mm256_loadu_ps(mulPattern), m1 = _mm256_loadu_ps(mulPattern + 8), m2 = _mm256_loadu_ps(mulPattern + 16);
+		const __m256 a0 = _mm256_loadu_ps(addPattern), a1 = _mm256_loadu_ps(addPattern + 8), a2 = _mm256_loadu_ps(addPattern + 16);
+
+		for (; i + 8 <= count; i += 8)
+		{
+			GLfloat* p = xyz + i * 3;
+			_mm256_storeu_ps(p, _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(p), m0), a0));
+			_mm256_storeu_ps(p + 8, _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(p + 8), m1), a1));
+			_mm256_storeu_ps(p + 16, _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(p + 16), m2), a2));
+		}
+		mulAdd3Scalar(xyz + i * 3, count - i, mul, add);
+	}
+
+	WMIT_TARGET("avx2") void mul4Avx2(GLfloat* xyzw, size_t count, const GLfloat* mul)
+	{
+		const GLfloat pattern[8] = {mul[0], mul[1], mul[2], mul[3], mul[0], mul[1], mul[2], mul[3]};
+		const __m256 m = _mm256_loadu_ps(pattern);
+		size_t i = 0;
+
+		for (; i + 2 <= count; i += 2)
+			_mm256_storeu_ps(xyzw + i * 4, _mm256_mul_ps(_mm256_loadu_ps(xyzw + i * 4), m));
+		mul4Scalar(xyzw + i * 4, count - i, mul);
+	}
+
+	WMIT_TARGET("avx2") void bounds3Avx2(const GLfloat* xyz, size_t count, BoundsResult& result)
+	{
+		if (count < 8 || count > MAX_VECTOR_VERTICES)
+		{
+			boundsScalar(xyz, count, result);
+			return;
+		}
+
+		GLfloat first[24];
+		__m256 vmin[3], vmax[3];
+		double sums[3] = {0., 0., 0.};
+		__m256i imin[3], imax[3], index[3];
+		const __m256i step = _mm256_set1_epi32(8);
+		size_t i = 0;
+		int r;
+
+		fillPattern(first, 24, xyz);
+		for (r = 0; r < 3; ++r)
+		{
+			vmin[r] = vmax[r] = _mm256_loadu_ps(first + r * 8);
+			imin[r] = imax[r] = _mm256_setzero_si256();
+			index[r] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(LANE_VERTEX_24 + r * 8));
+		}
+
+		for (; i + 8 <= count; i += 8)
+		{
+			const GLfloat* p = xyz + i * 3;
+
+			for (r = 0; r < 3; ++r)
+			{
+				const __m256 v = _mm256_loadu_ps(p + r * 8);
+				const __m256 less = _mm256_cmp_ps(v, vmin[r], _CMP_LT_OQ), greater = _mm256_cmp_ps(v, vmax[r], _CMP_GT_OQ);
+
+				vmin[r] = _mm256_blendv_ps(vmin[r], v, less);
+				imin[r] = _mm256_blendv_epi8(imin[r], index[r], _mm256_castps_si256(less));
+				vmax[r] = _mm256_blendv_ps(vmax[r], v, greater);
+				imax[r] = _mm256_blendv_epi8(imax[r], index[r], _mm256_castps_si256(greater));
+				index[r] = _mm256_add_epi32(index[r], step);
+			}
+
+			for (int k = 0; k < 24; k += 3)
+			{
+				sums[0] += p[k];
+				sums[1] += p[k + 1];
+				sums[2] += p[k + 2];
+			}
+		}
+
+		GLfloat mins[24], maxs[24];
+		int32_t minIndices[24], maxIndices[24];
+
+		for (r = 0; r < 3; ++r)
+		{
+			_mm256_storeu_ps(mins + r * 8, vmin[r]);
+			_mm256_storeu_ps(maxs + r * 8, vmax[r]);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(minIndices + r * 8), imin[r]);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(maxIndices + r * 8), imax[r]);
+		}
+		combineLanes(24, true, mins, minIndices, maxs, maxIndices, sums, result);
+		boundsTail(xyz, i, count, result);
+	}
+
+	WMIT_TARGET("avx2") size_t findOutside3Avx2(const GLfloat* xyz, size_t begin, size_t count, const GLfloat* center, double radiusSq)
+	{
+		const __m256 threshold = _mm256_set1_ps(outsideThreshold(radiusSq));
+		const __m256 cx = _mm256_set1_ps(center[0]), cy = _mm256_set1_ps(center[1]), cz = _mm256_set1_ps(center[2]);
+		size_t i = begin;
+
+		for (; i + 8 <= count; i += 8)
+		{
+			const GLfloat* p = xyz + i * 3;
+			const __m256 l0 = _mm256_loadu_ps(p), l1 = _mm256_loadu_ps(p + 8), l2 = _mm256_loadu_ps(p + 16);
+			// vertices 0-3 in the low halves, 4-7 in the high ones
+			const __m256 a = _mm256_permute2f128_ps(l0, l1, 0x30);
+			const __m256 b = _mm256_permute2f128_ps(l0, l2, 0x21);
+			const __m256 c = _mm256_permute2f128_ps(l1, l2, 0x30);
+			// the shuffles of deinterleave3, per half
+			const __m256 x = _mm256_shuffle_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 0, 0)), _mm256_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+			const __m256 y = _mm256_shuffle_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm256_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+			const __m256 z = _mm256_shuffle_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm256_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+			const __m256 dx = _mm256_sub_ps(x, cx), dy = _mm256_sub_ps(y, cy), dz = _mm256_sub_ps(z, cz);
+			const __m256 distSq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+			const int mask = _mm256_movemask_ps(_mm256_cmp_ps(distSq, threshold, _CMP_GE_OQ));
+
+			if (mask)
+				return i + firstSetBit(mask);
+		}
+		return findOutside3Scalar(xyz, i, count, center, radiusSq);
+	}
+
+	const KernelTable SSE2_KERNELS = {"sse2", mul3Sse2, mulAdd3Sse2, mul4Sse2, swapHandednessSse2, bounds3Sse2, findOutside3Sse2};
+	const KernelTable AVX2_KERNELS = {"avx2", mul3Avx2, mulAdd3Avx2, mul4Avx2, swapHandednessSse2, bounds3Avx2, findOutside3Avx2};
+
+	bool cpuHasSse2()
+	{
+#if defined(__x86_64__) || defined(_M_X64)
+		return true;
+#elif defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		return (info[3] & (1 << 26)) != 0;
+#else
+		return __builtin_cpu_supports("sse2");
+#endif
+	}
+
+	bool cpuHasAvx2()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		// the OS has to save the ymm registers too
+		__cpuid(info, 1);
+		if (!(info[2] & (1 << 27)) || (_xgetbv(0) & 6) != 6)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif // WMIT_KERNELS_X86
+
+#ifdef WMIT_KERNELS_NEON
+	// NEON, vld3 splits 4 vertices into x, y and z registers
+
+	void mul3Neon(GLfloat* xyz, size_t count, const GLfloat* mul)
+	{
+		const float32x4_t mx = vdupq_n_f32(mul[0]), my = vdupq_n_f32(mul[1]), mz = vdupq_n_f32(mul[2]);
+		size_t i = 0;
+
+		for (; i + 4 <= count; i += 4)
+		{
+			float32x4x3_t v = vld3q_f32(xyz + i * 3);
+			v.val[0] = vmulq_f32(v.val[0], mx);
+			v.val[1] = vmulq_f32(v.val[1], my);
+			v.val[2] = vmulq_f32(v.val[2], mz);
+			vst3q_f32(xyz + i * 3, v);
+		}
+		mul3Scalar(xyz + i * 3, count - i, mul);
+	}
+
+	void mulAdd3Neon(GLfloat* xyz, size_t count, const GLfloat* mul, const GLfloat* add)
+	{
+		const float32x4_t mx = vdupq_n_f32(mul[0]), my = vdupq_n_f32(mul[1]), mz = vdupq_n_f32(mul[2]);
+		const float32x4_t ax = vdupq_n_f32(add[0]), ay = vdupq_n_f32(add[1]), az = vdupq_n_f32(add[2]);
+		size_t i = 0;
+
+		for (; i + 4 <= count; i += 4)
+		{
+			float32x4x3_t v = vld3q_f32(xyz + i * 3);
+			v.val[0] = vaddq_f32(vmulq_f32(v.val[0], mx), ax);
+			v.val[1] = vaddq_f32(vmulq_f32(v.val[1], my), ay);
+			v.val[2] = vaddq_f32(vmulq_f32(v.val[2], mz), az);
+			vst3q_f32(xyz + i * 3, v);
+		}
+		mulAdd3Scalar(xyz + i * 3, count - i, mul, add);
+	}
+
+	void mul4Neon(GLfloat* xyzw, size_t count, const GLfloat* mul)
+	{
+		const float32x4_t m = vld1q_f32(mul);
+
+		for (size_t i = 0; i < count; ++i)
+			vst1q_f32(xyzw + i * 4, vmulq_f32(vld1q_f32(xyzw + i * 4), m));
+	}
+
+	void swapHandednessNeon(const GLfloat* normals, GLfloat* tangents, size_t count)
+	{
+		const float32x4_t zero = vdupq_n_f32(0.f), one = vdupq_n_f32(1.f);
+		size_t i = 0;
+
+		for (; i + 4 <= count; i += 4)
+		{
+			const float32x4x3_t n = vld3q_f32(normals + i * 3);
+			float32x4x4_t t = vld4q_f32(tangents + i * 4);
+
+			const float32x4_t cx = vsubq_f32(vmulq_f32(n.val[1], t.val[2]), vmulq_f32(n.val[2], t.val[1]));
+			const float32x4_t cy = vsubq_f32(vmulq_f32(n.val[2], t.val[0]), vmulq_f32(n.val[0], t.val[2]));
+			const float32x4_t cz = vsubq_f32(vmulq_f32(n.val[0], t.val[1]), vmulq_f32(n.val[1], t.val[0]));
+			const float32x4_t lengthSq = vaddq_f32(vaddq_f32(vmulq_f32(cx, cx), vmulq_f32(cy, cy)), vmulq_f32(cz, cz));
+
+			t.val[3] = vbslq_f32(vceqq_f32(lengthSq, zero), one, vnegq_f32(t.val[3]));
+			vst4q_f32(tangents + i * 4, t);
+		}
+		swapHandednessScalar(normals + i * 3, tangents + i * 4, count - i);
+	}
+
+	void bounds3Neon(const GLfloat* xyz, size_t count, BoundsResult& result)
+	{
+		if (count < 4 || count > MAX_VECTOR_VERTICES)
+		{
+			boundsScalar(xyz, count, result);
+			return;
+		}
+
+		const int32_t laneVertex[4] = {0, 1, 2, 3};
+		float32x4_t vmin[3], vmax[3];
+		double sums[3] = {0., 0., 0.};
+		int32x4_t imin[3], imax[3];
+		int32x4_t index = vld1q_s32(laneVertex);
+		const int32x4_t step = vdupq_n_s32(4);
+		size_t i = 0;
+		int c;
+
+		for (c = 0; c < 3; ++c)
+		{
+			vmin[c] = vmax[c] = vdupq_n_f32(xyz[c]);
+			imin[c] = imax[c] = vdupq_n_s32(0);
+		}
+
+		for (; i + 4 <= count; i += 4)
+		{
+			const float32x4x3_t v = vld3q_f32(xyz + i * 3);
+
+			for (c = 0; c < 3; ++c)
+			{
+				const uint32x4_t less = vcltq_f32(v.val[c], vmin[c]), greater = vcgtq_f32(v.val[c], vmax[c]);
+
+				vmin[c] = vbslq_f32(less, v.val[c], vmin[c]);
+				imin[c] = vbslq_s32(less, index, imin[c]);
+				vmax[c] = vbslq_f32(greater, v.val[c], vmax[c]);
+				imax[c] = vbslq_s32(greater, index, imax[c]);
+			}
+			index = vaddq_s32(index, step);
+
+			for (int k = 0; k < 12; k += 3)
+			{
+				sums[0] += xyz[i * 3 + k];
+				sums[1] += xyz[i * 3 + k + 1];
+				sums[2] += xyz[i * 3 + k + 2];
+			}
+		}
+
+		GLfloat mins[12], maxs[12];
+		int32_t minIndices[12], maxIndices[12];
+
+		for (c = 0; c < 3; ++c)
+		{
+			vst1q_f32(mins + c * 4, vmin[c]);
+			vst1q_f32(maxs + c * 4, vmax[c]);
+			vst1q_s32(minIndices + c * 4, imin[c]);
+			vst1q_s32(maxIndices + c * 4, imax[c]);
+		}
+		combineLanes(12, false, mins, minIndices, maxs, maxIndices, sums, result);
+		boundsTail(xyz, i, count, result);
+	}
+
+	size_t findOutside3Neon(const GLfloat* xyz, size_t begin, size_t count, const GLfloat* center, double radiusSq)
+	{
+		const float32x4_t threshold = vdupq_n_f32(outsideThreshold(radiusSq));
+		const float32x4_t cx = vdupq_n_f32(center[0]), cy = vdupq_n_f32(center[1]), cz = vdupq_n_f32(center[2]);
+		size_t i = begin;
+
+		for (; i + 4 <= count; i += 4)
+		{
+			const float32x4x3_t v = vld3q_f32(xyz + i * 3);
+			const float32x4_t dx = vsubq_f32(v.val[0], cx), dy = vsubq_f32(v.val[1], cy), dz = vsubq_f32(v.val[2], cz);
+			const float32x4_t distSq = vaddq_f32(vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dy, dy)), vmulq_f32(dz, dz));
+			const uint32x4_t outside = vcgeq_f32(distSq, threshold);
+
+			if (vmaxvq_u32(outside))
+			{
+				uint32_t lanes[4];
+				vst1q_u32(lanes, outside);
+				for (size_t k = 0; k < 4; ++k)
+				{
+					if (lanes[k])
+						return i + k;
+				}
+			}
+		}
+		return findOutside3Scalar(xyz, i, count, center, radiusSq);
+	}
+
+	const KernelTable NEON_KERNELS = {"neon", mul3Neon, mulAdd3Neon, mul4Neon, swapHandednessNeon, bounds3Neon, findOutside3Neon};
+#endif // WMIT_KERNELS_NEON
+
+	// Usable tables, the best one last
+	std::vector<const KernelTable*> availableKernels()
+	{
+		std::vector<const KernelTable*> tables(1, &SCALAR_KERNELS);
+
+#ifdef WMIT_KERNELS_X86
+		if (cpuHasSse2())
+			tables.push_back(&SSE2_KERNELS);
+		if (cpuHasAvx2())
+			tables.push_back(&AVX2_KERNELS);
+#endif
+#ifdef WMIT_KERNELS_NEON
+		tables.push_back(&NEON_KERNELS);
+#endif
+		return tables;
+	}
+
+	const KernelTable* findKernels(const std::string& name)
+	{
+		const std::vector<const KernelTable*> tables = availableKernels();
+
+		for (const KernelTable* table: tables)
+		{
+			if (name == table->name)
+				return table;
+		}
+		return nullptr;
+	}
+
+	const KernelTable* defaultKernels()
+	{
+		const char* forced = std::getenv("WMIT_SIMD");
+
+		if (forced)
+		{
+			const KernelTable* table = findKernels(forced);
+			if (table)
+				return table;
+		}
+		return availableKernels().back();
+	}
+
+	const KernelTable*& currentKernels()
+	{
+		static const KernelTable* current = defaultKernels();
+		return current;
+	}
+}
+
+void kernelMul3(GLfloat* xyz, size_t count, const GLfloat mul[3])
+{
+	currentKernels()->mul3(xyz, count, mul);
+}
+
+void kernelMulAdd3(GLfloat* xyz, size_t count, const GLfloat mul[3], const GLfloat add[3])
+{
+	currentKernels()->mulAdd3(xyz, count, mul, add);
+}
+
+void kernelMul4(GLfloat* xyzw, size_t count, const GLfloat mul[4])
+{
+	currentKernels()->mul4(xyzw, count, mul);
+}
+
+void kernelSwapHandedness(const GLfloat* normals, GLfloat* tangents, size_t count)
+{
+	currentKernels()->swapHandedness(normals, tangents, count);
+}
+
+void kernelBounds3(const GLfloat* xyz, size_t count, BoundsResult& result)
+{
+	currentKernels()->bounds3(xyz, count, result);
+}
+
+size_t kernelFindOutside3(const GLfloat* xyz, size_t begin, size_t count, const GLfloat center[3], double radiusSq)
+{
+	return currentKernels()->findOutside3(xyz, begin, count, center, radiusSq);
+}
+
+const char* kernelInstructionSet()
+{
+	return currentKernels()->name;
+}
+
+bool setKernelInstructionSet(const std::string& name)
+{
+	const KernelTable* table = findKernels(name);
+
+	if (!table)
+		return false;
+
+	currentKernels() = table;
+	return true;
+}
+
+std::vector<std::string> availableKernelInstructionSets()
+{
+	std::vector<std::string> names;
+	const std::vector<const KernelTable*> tables = availableKernels();
+
+	for (const KernelTable* table: tables)
+		names.push_back(table->name);
+	return names;
+}
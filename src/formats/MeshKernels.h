@@ -0,0 +1,73 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MESHKERNELS_HPP
+#define MESHKERNELS_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+/*
+ * Bulk kernels over flat xyz (stride 3) and xyzw (stride 4) float arrays.
+ * The instruction set is picked on first use from what the CPU supports:
+ * AVX2 or SSE2 on x86, plain C++ otherwise. The NEON kernels for ARM are
+ * only built with WMIT_NEON_KERNELS until they have been tested there.
+ * WMIT_SIMD=scalar|sse2|avx2|neon in the environment overrides the choice.
+ *
+ * All kernels give the same floats as the scalar loops they replace, there is no fma,
+ * and the bounds sum is added up in vertex order whatever the instruction set.
+ */
+
+struct BoundsResult
+{
+	GLfloat min[3], max[3];
+	size_t minIndex[3], maxIndex[3]; // first vertex holding the extreme
+	double sum[3];
+};
+
+/// xyz *= mul
+void kernelMul3(GLfloat* xyz, size_t count, const GLfloat mul[3]);
+/// xyz = xyz * mul + add
+void kernelMulAdd3(GLfloat* xyz, size_t count, const GLfloat mul[3], const GLfloat add[3]);
+/// xyzw *= mul
+void kernelMul4(GLfloat* xyzw, size_t count, const GLfloat mul[4]);
+
+/// Tangent w for reflected frames: -w, or 1 where the frame is degenerate and has no handedness
+void kernelSwapHandedness(const GLfloat* normals, GLfloat* tangents, size_t count);
+
+/// Extremes and sum of a non-empty array, min/max follow strict compares from the first vertex
+void kernelBounds3(const GLfloat* xyz, size_t count, BoundsResult& result);
+
+/*
+ * First vertex from begin whose squared float distance to center may exceed radiusSq,
+ * count if none. It errs on the side of returning too early, callers recheck in double.
+ */
+size_t kernelFindOutside3(const GLfloat* xyz, size_t begin, size_t count, const GLfloat center[3], double radiusSq);
+
+/// Name of the instruction set in use
+const char* kernelInstructionSet();
+/// Switches to another instruction set, false if the CPU or build lacks it
+bool setKernelInstructionSet(const std::string& name);
+/// All instruction sets usable here, scalar first
+std::vector<std::string> availableKernelInstructionSets();
+
+#endif // MESHKERNELS_HPP
@@ -0,0 +1,594 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MeshOptimizer.h"
+
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+VertexCacheStats analyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount,
+				    unsigned cacheSize)
+{
+	VertexCacheStats stats;
+
+	// A vertex is in the FIFO while fewer than cacheSize misses happened since it got in
+	std::vector<size_t> timestamps(vertexCount, 0);
+	size_t time = cacheSize + 1;
+
+	stats.triangles = indices.size() / 3;
+
+	for (size_t i = 0; i < stats.triangles * 3; ++i)
+	{
+		const GLuint idx = indices[i];
+
+		if (idx >= vertexCount)
+			continue;
+
+		if (timestamps[idx] == 0)
+			++stats.vertices;
+
+		if (time - timestamps[idx] > cacheSize)
+		{
+			timestamps[idx] = time++;
+			++stats.transforms;
+		}
+	}
+
+	return stats;
+}
+
+/*
+ * Tom Forsyth, "Linear-Speed Vertex Cache Optimisation".
+ * Vertices score higher the more recently they were used and the fewer
+ * triangles are left to use them, the best scored triangle next to the
+ * cached vertices is emitted next.
+ */
+namespace
+{
+	const unsigned FORSYTH_CACHE_SIZE = 32;
+	const unsigned FORSYTH_MAX_VALENCE = 64;
+	const float CACHE_DECAY_POWER = 1.5f;
+	const float LAST_TRI_SCORE = 0.75f;
+	const float VALENCE_BOOST_SCALE = 2.0f;
+	const float VALENCE_BOOST_POWER = 0.5f;
+
+	const unsigned NO_TRI = ~0u;
+
+	struct ScoreTables
+	{
+		float cache[FORSYTH_CACHE_SIZE];
+		float valence[FORSYTH_MAX_VALENCE];
+
+		ScoreTables()
+		{
+			for (unsigned i = 0; i < FORSYTH_CACHE_SIZE; ++i)
+			{
+				if (i < 3)
+				{
+					// the last triangle's vertices, don't favour using them again right away
+					cache[i] = LAST_TRI_SCORE;
+				}
+				else
+				{
+					const float scaler = 1.f / (FORSYTH_CACHE_SIZE - 3);
+					cache[i] = std::pow(1.f - (i - 3) * scaler, CACHE_DECAY_POWER);
+				}
+			}
+
+			valence[0] = 0.f;
+			for (unsigned i = 1; i < FORSYTH_MAX_VALENCE; ++i)
+			{
+				valence[i] = VALENCE_BOOST_SCALE * std::pow(static_cast<float>(i), -VALENCE_BOOST_POWER);
+			}
+		}
+
+		float score(int cachePos, unsigned activeTris) const
+		{
+			if (activeTris == 0)
+				return -1.f;
+
+			float result = cachePos < 0 ? 0.f : cache[cachePos];
+
+			if (activeTris < FORSYTH_MAX_VALENCE)
+				result += valence[activeTris];
+			else
+				result += VALENCE_BOOST_SCALE * std::pow(static_cast<float>(activeTris), -VALENCE_BOOST_POWER);
+			return result;
+		}
+	};
+}
+
+std::vector<GLuint> optimizeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount)
+{
+	static const ScoreTables tables;
+
+	const size_t triCount = indices.size() / 3;
+	std::vector<GLuint> result;
+	size_t i, t;
+
+	result.reserve(triCount * 3);
+
+	// Vertex -> triangles adjacency, the active ones are kept in front
+	std::vector<unsigned> activeTris(vertexCount, 0);
+	std::vector<unsigned> adjOffsets(vertexCount + 1, 0);
+
+	for (i = 0; i < triCount * 3; ++i)
+	{
+		if (indices[i] >= vertexCount)
+			return indices; // leave broken input alone
+		++activeTris[indices[i]];
+	}
+	for (i = 0; i < vertexCount; ++i)
+	{
+		adjOffsets[i + 1] = adjOffsets[i] + activeTris[i];
+	}
+
+	std::vector<unsigned> adjacency(adjOffsets[vertexCount]);
+	std::vector<unsigned> fill(adjOffsets.begin(), adjOffsets.end() - 1);
+	for (i = 0; i < triCount * 3; ++i)
+	{
+		adjacency[fill[indices[i]]++] = static_cast<unsigned>(i / 3);
+	}
+
+	std::vector<float> vertScore(vertexCount);
+	for (i = 0; i < vertexCount; ++i)
+	{
+		vertScore[i] = tables.score(-1, activeTris[i]);
+	}
+
+	std::vector<float> triScore(triCount);
+	std::vector<bool> emitted(triCount, false);
+	unsigned bestTri = NO_TRI;
+
+	for (t = 0; t < triCount; ++t)
+	{
+		triScore[t] = vertScore[indices[t * 3]] + vertScore[indices[t * 3 + 1]] + vertScore[indices[t * 3 + 2]];
+		if (bestTri == NO_TRI || triScore[t] > triScore[bestTri])
+			bestTri = static_cast<unsigned>(t);
+	}
+
+	std::vector<GLuint> cache, newCache;
+	cache.reserve(FORSYTH_CACHE_SIZE + 3);
+	newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+	size_t cursor = 0;
+
+	for (size_t emittedCount = 0; emittedCount < triCount; ++emittedCount)
+	{
+		if (bestTri == NO_TRI)
+		{
+			// dead end, continue with the next triangle in input order
+			while (emitted[cursor])
+				++cursor;
+			bestTri = static_cast<unsigned>(cursor);
+		}
+
+		const GLuint* tri = &indices[bestTri * 3];
+		emitted[bestTri] = true;
+
+		newCache.clear();
+		for (i = 0; i < 3; ++i)
+		{
+			const GLuint v = tri[i];
+			result.push_back(v);
+
+			// drop the triangle from the vertex's active ones
+			unsigned* adj = &adjacency[adjOffsets[v]];
+			unsigned* adjEnd = adj + activeTris[v];
+			unsigned* found = std::find(adj, adjEnd, bestTri);
+			if (found != adjEnd)
+			{
+				*found = *(adjEnd - 1);
+				--activeTris[v];
+			}
+
+			if (std::find(newCache.begin(), newCache.end(), v) == newCache.end())
+				newCache.push_back(v);
+		}
+
+		// the rest of the old cache moves back behind the triangle's vertices
+		const size_t triVerts = newCache.size();
+		for (i = 0; i < cache.size(); ++i)
+		{
+			if (std::find(newCache.begin(), newCache.begin() + triVerts, cache[i]) == newCache.begin() + triVerts)
+				newCache.push_back(cache[i]);
+		}
+
+		// rescore everything that was or is in the cache
+		for (i = 0; i < newCache.size(); ++i)
+		{
+			const GLuint v = newCache[i];
+			const int pos = i < FORSYTH_CACHE_SIZE ? static_cast<int>(i) : -1;
+			const float score = tables.score(pos, activeTris[v]);
+			const float delta = score - vertScore[v];
+
+			vertScore[v] = score;
+
+			for (unsigned a = adjOffsets[v]; a < adjOffsets[v] + activeTris[v]; ++a)
+			{
+				triScore[adjacency[a]] += delta;
+			}
+		}
+
+		if (newCache.size() > FORSYTH_CACHE_SIZE)
+			newCache.resize(FORSYTH_CACHE_SIZE);
+		cache.swap(newCache);
+
+		// next one comes from the triangles using cached vertices
+		bestTri = NO_TRI;
+		for (i = 0; i < cache.size(); ++i)
+		{
+			const GLuint v = cache[i];
+
+			for (unsigned a = adjOffsets[v]; a < adjOffsets[v] + activeTris[v]; ++a)
+			{
+				const unsigned adjTri = adjacency[a];
+				if (bestTri == NO_TRI || triScore[adjTri] > triScore[bestTri])
+					bestTri = adjTri;
+			}
+		}
+	}
+
+	return result;
+}
+
+namespace
+{
+	// FIFO cache misses of one triangle, same model as analyzeVertexCache
+	unsigned cacheMisses(const GLuint* tri, std::vector<size_t>& timestamps, size_t& time)
+	{
+		unsigned misses = 0;
+
+		for (int i = 0; i < 3; ++i)
+		{
+			if (time - timestamps[tri[i]] > WMIT_VCACHE_FIFO_SIZE)
+			{
+				timestamps[tri[i]] = time++;
+				++misses;
+			}
+		}
+		return misses;
+	}
+
+	void flushCache(size_t& time)
+	{
+		time += WMIT_VCACHE_FIFO_SIZE + 1;
+	}
+
+	/*
+	 * Splits the given clusters further, at the first point where the running
+	 * ACMR is back within threshold times the cluster's.
+	 * (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw")
+	 */
+	std::vector<size_t> softBoundaries(const std::vector<GLuint>& indices, const std::vector<size_t>& clusters,
+					   float threshold, std::vector<size_t>& timestamps, size_t& time)
+	{
+		const size_t triCount = indices.size() / 3;
+		std::vector<size_t> result;
+
+		for (size_t c = 0; c < clusters.size(); ++c)
+		{
+			const size_t start = clusters[c];
+			const size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triCount;
+			size_t t, misses = 0;
+
+			flushCache(time);
+			for (t = start; t < end; ++t)
+			{
+				misses += cacheMisses(&indices[t * 3], timestamps, time);
+			}
+
+			const float clusterThreshold = threshold * static_cast<float>(misses) / (end - start);
+			size_t runMisses = 0, runTris = 0;
+
+			result.push_back(start);
+			flushCache(time);
+			for (t = start; t < end; ++t)
+			{
+				runMisses += cacheMisses(&indices[t * 3], timestamps, time);
+				++runTris;
+
+				if (static_cast<float>(runMisses) / runTris <= clusterThreshold && t + 1 < end)
+				{
+					result.push_back(t + 1);
+					flushCache(time);
+					runMisses = runTris = 0;
+				}
+			}
+		}
+		return result;
+	}
+
+	// Emits the clusters with those facing away from the mesh centroid first
+	std::vector<GLuint> sortClusters(const std::vector<GLuint>& indices, const std::vector<Vertex<GLfloat> >& positions,
+					 const std::vector<size_t>& clusters)
+	{
+		const size_t triCount = indices.size() / 3;
+		GLfloat meshCentroid[3] = {0.f, 0.f, 0.f};
+		size_t i, c, t;
+		int k;
+
+		for (i = 0; i < triCount * 3; ++i)
+		{
+			for (k = 0; k < 3; ++k)
+				meshCentroid[k] += positions[indices[i]][k];
+		}
+		for (k = 0; k < 3; ++k)
+			meshCentroid[k] /= triCount * 3;
+
+		std::vector<float> sortKeys(clusters.size());
+
+		for (c = 0; c < clusters.size(); ++c)
+		{
+			const size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triCount;
+			GLfloat centroid[3] = {0.f, 0.f, 0.f}, normal[3] = {0.f, 0.f, 0.f}, clusterArea = 0.f;
+
+			for (t = clusters[c]; t < end; ++t)
+			{
+				const Vertex<GLfloat>& p0 = positions[indices[t * 3]];
+				const Vertex<GLfloat>& p1 = positions[indices[t * 3 + 1]];
+				const Vertex<GLfloat>& p2 = positions[indices[t * 3 + 2]];
+
+				// counter-clockwise winding faces outwards
+				const Vertex<GLfloat> triNormal = Vertex<GLfloat>(p1 - p0).crossProduct(p2 - p0);
+				const GLfloat area = std::sqrt(triNormal.dotProduct(triNormal));
+
+				for (k = 0; k < 3; ++k)
+				{
+					centroid[k] += (p0[k] + p1[k] + p2[k]) * (area / 3.f);
+					normal[k] += triNormal[k];
+				}
+				clusterArea += area;
+			}
+
+			const GLfloat normalLength = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+			float key = 0.f;
+
+			for (k = 0; k < 3; ++k)
+			{
+				const GLfloat dir = normalLength > 0.f ? normal[k] / normalLength : 0.f;
+				const GLfloat pos = clusterArea > 0.f ? centroid[k] / clusterArea : 0.f;
+				key += (pos - meshCentroid[k]) * dir;
+			}
+			sortKeys[c] = key;
+		}
+
+		std::vector<size_t> order(clusters.size());
+		for (c = 0; c < order.size(); ++c)
+			order[c] = c;
+
+		std::stable_sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs)
+		{
+			return sortKeys[lhs] > sortKeys[rhs];
+		});
+
+		std::vector<GLuint> result;
+		result.reserve(triCount * 3);
+
+		for (c = 0; c < order.size(); ++c)
+		{
+			const size_t start = clusters[order[c]];
+			const size_t end = order[c] + 1 < clusters.size() ? clusters[order[c] + 1] : triCount;
+
+			result.insert(result.end(), indices.begin() + start * 3, indices.begin() + end * 3);
+		}
+		return result;
+	}
+}
+
+std::vector<GLuint> optimizeOverdraw(const std::vector<GLuint>& indices, const std::vector<Vertex<GLfloat> >& positions,
+				     float threshold)
+{
+	const size_t triCount = indices.size() / 3;
+	size_t i, t;
+
+	for (i = 0; i < triCount * 3; ++i)
+	{
+		if (indices[i] >= positions.size())
+			return indices; // leave broken input alone
+	}
+
+	if (triCount == 0)
+		return indices;
+
+	std::vector<size_t> timestamps(positions.size(), 0);
+	size_t time = 0;
+
+	// Missing all 3 vertices usually means the start of a new patch
+	std::vector<size_t> hardClusters;
+
+	flushCache(time);
+	for (t = 0; t < triCount; ++t)
+	{
+		if (cacheMisses(&indices[t * 3], timestamps, time) == 3 || t == 0)
+			hardClusters.push_back(t);
+	}
+
+	const std::vector<size_t> softClusters = softBoundaries(indices, hardClusters, threshold, timestamps, time);
+	const size_t transformLimit = static_cast<size_t>(analyzeVertexCache(indices, positions.size()).transforms * threshold);
+
+	// Fall back to coarser clusters if the finer ones cost too many transforms
+	std::vector<GLuint> result = sortClusters(indices, positions, softClusters);
+	if (analyzeVertexCache(result, positions.size()).transforms <= transformLimit)
+		return result;
+
+	result = sortClusters(indices, positions, hardClusters);
+	if (analyzeVertexCache(result, positions.size()).transforms <= transformLimit)
+		return result;
+
+	return indices;
+}
+
+OverdrawStats analyzeOverdraw(const std::vector<GLuint>& indices, const std::vector<Vertex<GLfloat> >& positions)
+{
+	const int viewport = WMIT_OVERDRAW_VIEWPORT;
+	const size_t triCount = indices.size() / 3;
+	OverdrawStats stats;
+	GLfloat minPos[3], maxPos[3], extent = 0.f;
+	size_t i, t;
+	int k;
+
+	for (i = 0; i < triCount * 3; ++i)
+	{
+		if (indices[i] >= positions.size())
+			return stats;
+	}
+
+	if (triCount == 0)
+		return stats;
+
+	for (k = 0; k < 3; ++k)
+	{
+		minPos[k] = maxPos[k] = positions[indices[0]][k];
+	}
+	for (i = 0; i < triCount * 3; ++i)
+	{
+		for (k = 0; k < 3; ++k)
+		{
+			minPos[k] = std::min(minPos[k], positions[indices[i]][k]);
+			maxPos[k] = std::max(maxPos[k], positions[indices[i]][k]);
+		}
+	}
+	for (k = 0; k < 3; ++k)
+		extent = std::max(extent, maxPos[k] - minPos[k]);
+
+	if (extent <= 0.f)
+		return stats;
+
+	const GLfloat scale = (viewport - 1) / extent;
+	const GLfloat empty = -std::numeric_limits<GLfloat>::max();
+
+	// One depth buffer per facing: an orthographic view down each axis sees
+	// the front faces of one direction and the back faces of the other
+	std::vector<GLfloat> depth[2];
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const int u = (axis + 1) % 3, v = (axis + 2) % 3;
+
+		depth[0].assign(viewport * viewport, empty);
+		depth[1].assign(viewport * viewport, empty);
+
+		for (t = 0; t < triCount; ++t)
+		{
+			GLfloat x[3], y[3], z[3];
+
+			for (k = 0; k < 3; ++k)
+			{
+				const Vertex<GLfloat>& pos = positions[indices[t * 3 + k]];
+				x[k] = (pos[u] - minPos[u]) * scale;
+				y[k] = (pos[v] - minPos[v]) * scale;
+				z[k] = (pos[axis] - minPos[axis]) * scale;
+			}
+
+			GLfloat area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+			if (area == 0.f)
+				continue;
+
+			// counter-clockwise faces the +axis viewer, closer means larger z;
+			// the rest faces the -axis viewer, for whom smaller z is closer
+			const int facing = area > 0.f ? 0 : 1;
+			if (facing == 1)
+			{
+				std::swap(x[1], x[2]);
+				std::swap(y[1], y[2]);
+				std::swap(z[1], z[2]);
+				area = -area;
+				for (k = 0; k < 3; ++k)
+					z[k] = -z[k];
+			}
+
+			const int minX = std::max(0, static_cast<int>(std::floor(std::min(x[0], std::min(x[1], x[2])))));
+			const int maxX = std::min(viewport - 1, static_cast<int>(std::ceil(std::max(x[0], std::max(x[1], x[2])))));
+			const int minY = std::max(0, static_cast<int>(std::floor(std::min(y[0], std::min(y[1], y[2])))));
+			const int maxY = std::min(viewport - 1, static_cast<int>(std::ceil(std::max(y[0], std::max(y[1], y[2])))));
+
+			for (int py = minY; py <= maxY; ++py)
+			{
+				for (int px = minX; px <= maxX; ++px)
+				{
+					const GLfloat cx = px + 0.5f, cy = py + 0.5f;
+					GLfloat w[3];
+					bool inside = true;
+
+					for (k = 0; k < 3 && inside; ++k)
+					{
+						// edge opposite of vertex k
+						const int a = (k + 1) % 3, b = (k + 2) % 3;
+						const GLfloat dx = x[b] - x[a], dy = y[b] - y[a];
+
+						w[k] = dx * (cy - y[a]) - dy * (cx - x[a]);
+
+						// a pixel centre on a shared edge belongs to one triangle only
+						inside = w[k] > 0.f || (w[k] == 0.f && (dy > 0.f || (dy == 0.f && dx < 0.f)));
+					}
+
+					if (!inside)
+						continue;
+
+					const GLfloat pz = (w[0] * z[0] + w[1] * z[1] + w[2] * z[2]) / area;
+					GLfloat& dst = depth[facing][py * viewport + px];
+
+					if (pz > dst)
+					{
+						dst = pz;
+						++stats.shaded;
+					}
+				}
+			}
+		}
+
+		for (k = 0; k < 2; ++k)
+		{
+			for (i = 0; i < depth[k].size(); ++i)
+			{
+				if (depth[k][i] != empty)
+					++stats.covered;
+			}
+		}
+	}
+
+	return stats;
+}
+
+std::vector<GLuint> vertexFetchRemap(const std::vector<GLuint>& indices, size_t vertexCount)
+{
+	const GLuint UNUSED = ~0u;
+	std::vector<GLuint> remap(vertexCount, UNUSED);
+	GLuint next = 0;
+	size_t i;
+
+	for (i = 0; i < indices.size(); ++i)
+	{
+		const GLuint idx = indices[i];
+
+		if (idx < vertexCount && remap[idx] == UNUSED)
+			remap[idx] = next++;
+	}
+
+	// keep unreferenced vertices, in their original order
+	for (i = 0; i < vertexCount; ++i)
+	{
+		if (remap[i] == UNUSED)
+			remap[i] = next++;
+	}
+
+	return remap;
+}
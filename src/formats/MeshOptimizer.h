@@ -0,0 +1,119 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MESHOPTIMIZER_HPP
+#define MESHOPTIMIZER_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include <GL/glew.h>
+#include "VectorTypes.h"
+
+// FIFO size used for cache statistics, close to what current GPUs do
+#define WMIT_VCACHE_FIFO_SIZE 16
+
+// Allowed ACMR growth of the overdraw pass, 1.05 = 5% more transforms
+#define WMIT_OVERDRAW_DEFAULT_THRESHOLD 1.05f
+
+// Resolution of the overdraw analysis views
+#define WMIT_OVERDRAW_VIEWPORT 256
+
+struct VertexCacheStats
+{
+	VertexCacheStats(): transforms(0), triangles(0), vertices(0) {}
+
+	size_t transforms; // vertex shader invocations
+	size_t triangles;
+	size_t vertices; // referenced by the indices
+
+	/// Average cache miss ratio, transforms per triangle (0.5 at best, 3 at worst)
+	double acmr() const
+	{
+		return triangles ? static_cast<double>(transforms) / triangles : 0.;
+	}
+
+	/// Average transform to vertex ratio (1 at best)
+	double atvr() const
+	{
+		return vertices ? static_cast<double>(transforms) / vertices : 0.;
+	}
+
+	VertexCacheStats& operator += (const VertexCacheStats& rhs)
+	{
+		transforms += rhs.transforms;
+		triangles += rhs.triangles;
+		vertices += rhs.vertices;
+		return *this;
+	}
+};
+
+struct OverdrawStats
+{
+	OverdrawStats(): covered(0), shaded(0) {}
+
+	size_t covered; // pixels covered in the final image
+	size_t shaded; // fragments passing the depth test, in draw order
+
+	/// Fragments shaded per covered pixel (1 at best)
+	double overdraw() const
+	{
+		return covered ? static_cast<double>(shaded) / covered : 0.;
+	}
+
+	OverdrawStats& operator += (const OverdrawStats& rhs)
+	{
+		covered += rhs.covered;
+		shaded += rhs.shaded;
+		return *this;
+	}
+};
+
+/// Simulates a FIFO post-transform cache over a triangle list
+VertexCacheStats analyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount,
+				    unsigned cacheSize = WMIT_VCACHE_FIFO_SIZE);
+
+/// Reorders triangles for vertex cache reuse (Forsyth's linear-speed optimizer)
+std::vector<GLuint> optimizeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount);
+
+/// Sorts clusters of triangles so that outward facing ones are drawn first,
+/// keeping the ACMR within threshold times the input's
+std::vector<GLuint> optimizeOverdraw(const std::vector<GLuint>& indices, const std::vector<Vertex<GLfloat> >& positions,
+				     float threshold = WMIT_OVERDRAW_DEFAULT_THRESHOLD);
+
+/// Rasterizes the triangles in order from the 6 axis directions, with a depth test
+OverdrawStats analyzeOverdraw(const std::vector<GLuint>& indices, const std::vector<Vertex<GLfloat> >& positions);
+
+/// Old to new vertex positions putting vertices in first use order, unused ones last
+std::vector<GLuint> vertexFetchRemap(const std::vector<GLuint>& indices, size_t vertexCount);
+
+/// Moves every element to its remapped position
+template <typename T>
+void remapVertexArray(std::vector<T>& vertices, const std::vector<GLuint>& remap)
+{
+	std::vector<T> result(vertices.size());
+
+	for (size_t i = 0; i < vertices.size(); ++i)
+	{
+		result[remap[i]] = vertices[i];
+	}
+	vertices.swap(result);
+}
+
+#endif // MESHOPTIMIZER_HPP
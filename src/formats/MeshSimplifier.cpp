@@ -0,0 +1,400 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MeshSimplifier.h"
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+
+#include "VertexWelder.h"
+
+namespace
+{
+	// Border planes weigh in more than surface ones, to keep silhouettes
+	const double BORDER_WEIGHT = 10.;
+
+	// Minimal cosine between a triangle's normal before and after a collapse
+	const double MIN_NORMAL_COS = 0.25;
+
+	const unsigned MAX_PASSES = 100;
+
+	enum VertexKind {VK_MANIFOLD, VK_BORDER, VK_LOCKED};
+
+	struct Quadric
+	{
+		double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+		Quadric(): a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0) {}
+
+		// plane ax + by + cz + d = 0, (a, b, c) being normalized
+		void addPlane(double a, double b, double c, double d, double weight)
+		{
+			a2 += a * a * weight; ab += a * b * weight; ac += a * c * weight; ad += a * d * weight;
+			b2 += b * b * weight; bc += b * c * weight; bd += b * d * weight;
+			c2 += c * c * weight; cd += c * d * weight;
+			d2 += d * d * weight;
+		}
+
+		Quadric& operator += (const Quadric& rhs)
+		{
+			a2 += rhs.a2; ab += rhs.ab; ac += rhs.ac; ad += rhs.ad;
+			b2 += rhs.b2; bc += rhs.bc; bd += rhs.bd;
+			c2 += rhs.c2; cd += rhs.cd;
+			d2 += rhs.d2;
+			return *this;
+		}
+
+		double error(const Vertex<GLfloat>& pos) const
+		{
+			const double x = pos.x(), y = pos.y(), z = pos.z();
+
+			return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+				+ b2 * y * y + 2 * bc * y * z + 2 * bd * y
+				+ c2 * z * z + 2 * cd * z
+				+ d2;
+		}
+	};
+
+	struct Collapse
+	{
+		GLuint from, to;
+		double cost;
+	};
+
+	inline uint64_t edgeKey(GLuint a, GLuint b)
+	{
+		if (a > b)
+			std::swap(a, b);
+		return (static_cast<uint64_t>(a) << 32) | b;
+	}
+
+	inline Vertex<GLfloat> triNormal(const Vertex<GLfloat>& p0, const Vertex<GLfloat>& p1, const Vertex<GLfloat>& p2)
+	{
+		return Vertex<GLfloat>(p1 - p0).crossProduct(p2 - p0);
+	}
+
+	/*
+	 * Everything the collapse rules need for one pass,
+	 * rebuilt from the current triangles each time.
+	 */
+	struct Topology
+	{
+		std::unordered_map<uint64_t, unsigned> edgeTris; // on position ids
+		std::vector<VertexKind> kinds; // per position id
+		std::vector<unsigned> triOffsets, adjTris; // vertex -> triangles
+
+		void build(const std::vector<GLuint>& tris, const std::vector<GLuint>& posIds, size_t posCount)
+		{
+			const size_t triCount = tris.size() / 3;
+			const size_t vertCount = posIds.size();
+			size_t i, t;
+
+			edgeTris.clear();
+			edgeTris.reserve(triCount * 2);
+			for (t = 0; t < triCount; ++t)
+			{
+				for (i = 0; i < 3; ++i)
+				{
+					++edgeTris[edgeKey(posIds[tris[t * 3 + i]], posIds[tris[t * 3 + (i + 1) % 3]])];
+				}
+			}
+
+			// several referenced vertices on one position are a seam
+			std::vector<GLuint> wedge(posCount, ~0u);
+			kinds.assign(posCount, VK_MANIFOLD);
+			for (i = 0; i < tris.size(); ++i)
+			{
+				const GLuint pos = posIds[tris[i]];
+
+				if (wedge[pos] == ~0u)
+					wedge[pos] = tris[i];
+				else if (wedge[pos] != tris[i])
+					kinds[pos] = VK_LOCKED;
+			}
+
+			std::vector<unsigned> borderEdges(posCount, 0);
+			for (const auto& edge: edgeTris)
+			{
+				const GLuint a = static_cast<GLuint>(edge.first >> 32);
+				const GLuint b = static_cast<GLuint>(edge.first & 0xFFFFFFFF);
+
+				if (edge.second > 2)
+				{
+					kinds[a] = kinds[b] = VK_LOCKED;
+				}
+				else if (edge.second == 1)
+				{
+					++borderEdges[a];
+					++borderEdges[b];
+				}
+			}
+			for (i = 0; i < posCount; ++i)
+			{
+				if (kinds[i] == VK_MANIFOLD && borderEdges[i])
+					kinds[i] = borderEdges[i] == 2 ? VK_BORDER : VK_LOCKED;
+			}
+
+			triOffsets.assign(vertCount + 1, 0);
+			for (i = 0; i < tris.size(); ++i)
+				++triOffsets[tris[i] + 1];
+			for (i = 0; i < vertCount; ++i)
+				triOffsets[i + 1] += triOffsets[i];
+
+			std::vector<unsigned> fill(triOffsets.begin(), triOffsets.end() - 1);
+			adjTris.resize(tris.size());
+			for (i = 0; i < tris.size(); ++i)
+				adjTris[fill[tris[i]]++] = static_cast<unsigned>(i / 3);
+		}
+
+		bool isBorderEdge(GLuint a, GLuint b) const
+		{
+			auto it = edgeTris.find(edgeKey(a, b));
+			return it != edgeTris.end() && it->second == 1;
+		}
+	};
+}
+
+std::vector<GLuint> simplifyMesh(const std::vector<GLuint>& indices, const std::vector<Vertex<GLfloat> >& positions,
+				 float targetRatio)
+{
+	const size_t vertCount = positions.size();
+	size_t i, t;
+
+	std::vector<GLuint> tris(indices.begin(), indices.begin() + indices.size() / 3 * 3);
+
+	for (i = 0; i < tris.size(); ++i)
+	{
+		if (tris[i] >= vertCount)
+			return indices; // leave broken input alone
+	}
+
+	const size_t targetTris = static_cast<size_t>(std::max(0.f, targetRatio) * (tris.size() / 3));
+
+	if (targetTris >= tris.size() / 3)
+		return tris;
+
+	// Vertices at the same spot share a position id, for topology and quadrics
+	std::vector<GLuint> posIds(vertCount);
+	std::vector<GLuint> posFirst;
+	{
+		PointHash hash(std::numeric_limits<GLfloat>::epsilon());
+		hash.reserve(vertCount);
+
+		for (i = 0; i < vertCount; ++i)
+		{
+			unsigned found = 0;
+
+			if (hash.find(positions[i], [&](unsigned candidate)
+				{
+					return positions[posFirst[candidate]] == positions[i];
+				}, found))
+			{
+				posIds[i] = found;
+			}
+			else
+			{
+				posIds[i] = static_cast<GLuint>(posFirst.size());
+				hash.insert(positions[i], posIds[i]);
+				posFirst.push_back(static_cast<GLuint>(i));
+			}
+		}
+	}
+	const size_t posCount = posFirst.size();
+
+	// Surface quadrics, then border ones
+	std::vector<Quadric> quadrics(posCount);
+	Topology topo;
+	topo.build(tris, posIds, posCount);
+
+	for (t = 0; t < tris.size() / 3; ++t)
+	{
+		const GLuint* tri = &tris[t * 3];
+		const Vertex<GLfloat> normal = triNormal(positions[tri[0]], positions[tri[1]], positions[tri[2]]);
+		const double length = std::sqrt(normal.dotProduct(normal));
+
+		if (length == 0.)
+			continue;
+
+		const double a = normal.x() / length, b = normal.y() / length, c = normal.z() / length;
+		const double d = -(a * positions[tri[0]].x() + b * positions[tri[0]].y() + c * positions[tri[0]].z());
+
+		for (i = 0; i < 3; ++i)
+		{
+			// area weighted
+			quadrics[posIds[tri[i]]].addPlane(a, b, c, d, length * 0.5);
+
+			const GLuint e0 = tri[i], e1 = tri[(i + 1) % 3];
+			if (!topo.isBorderEdge(posIds[e0], posIds[e1]))
+				continue;
+
+			// plane through the border edge, perpendicular to the triangle
+			const Vertex<GLfloat> edge = Vertex<GLfloat>(positions[e1] - positions[e0]);
+			const Vertex<GLfloat> side = edge.crossProduct(Vertex<GLfloat>(a, b, c));
+			const double sideLength = std::sqrt(side.dotProduct(side));
+
+			if (sideLength == 0.)
+				continue;
+
+			const double sa = side.x() / sideLength, sb = side.y() / sideLength, sc = side.z() / sideLength;
+			const double sd = -(sa * positions[e0].x() + sb * positions[e0].y() + sc * positions[e0].z());
+			const double weight = edge.dotProduct(edge) * BORDER_WEIGHT;
+
+			quadrics[posIds[e0]].addPlane(sa, sb, sc, sd, weight);
+			quadrics[posIds[e1]].addPlane(sa, sb, sc, sd, weight);
+		}
+	}
+
+	std::vector<Collapse> collapses;
+	std::vector<GLuint> collapseTo(vertCount);
+	std::vector<bool> touched(posCount);
+
+	for (unsigned pass = 0; pass < MAX_PASSES && tris.size() / 3 > targetTris; ++pass)
+	{
+		if (pass > 0)
+			topo.build(tris, posIds, posCount);
+
+		// Cheapest direction of every edge, if any
+		collapses.clear();
+		for (i = 0; i < tris.size(); ++i)
+		{
+			const GLuint a = tris[i], b = tris[i / 3 * 3 + (i + 1) % 3];
+			const GLuint pa = posIds[a], pb = posIds[b];
+			Collapse best = {0, 0, std::numeric_limits<double>::max()};
+
+			if (pa == pb)
+				continue;
+
+			for (int dir = 0; dir < 2; ++dir)
+			{
+				const GLuint from = dir ? b : a, to = dir ? a : b;
+				const GLuint pFrom = posIds[from], pTo = posIds[to];
+
+				if (topo.kinds[pFrom] == VK_LOCKED)
+					continue;
+				if (topo.kinds[pFrom] == VK_BORDER && !topo.isBorderEdge(pFrom, pTo))
+					continue;
+
+				Quadric q = quadrics[pFrom];
+				q += quadrics[pTo];
+
+				const double cost = q.error(positions[to]);
+				if (cost < best.cost)
+				{
+					best.from = from;
+					best.to = to;
+					best.cost = cost;
+				}
+			}
+
+			if (best.cost < std::numeric_limits<double>::max())
+				collapses.push_back(best);
+		}
+
+		if (collapses.empty())
+			break;
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& lhs, const Collapse& rhs)
+		{
+			return lhs.cost < rhs.cost;
+		});
+
+		for (i = 0; i < vertCount; ++i)
+			collapseTo[i] = static_cast<GLuint>(i);
+		std::fill(touched.begin(), touched.end(), false);
+
+		const size_t toRemove = tris.size() / 3 - targetTris;
+		size_t removed = 0, performed = 0;
+
+		for (const Collapse& col: collapses)
+		{
+			const GLuint pFrom = posIds[col.from], pTo = posIds[col.to];
+
+			if (removed >= toRemove)
+				break;
+			if (touched[pFrom] || touched[pTo])
+				continue;
+
+			const Vertex<GLfloat>& target = positions[col.to];
+			size_t dying = 0;
+			bool valid = true;
+
+			for (unsigned a = topo.triOffsets[col.from]; a < topo.triOffsets[col.from + 1] && valid; ++a)
+			{
+				const GLuint* tri = &tris[topo.adjTris[a] * 3];
+				Vertex<GLfloat> moved[3];
+
+				if (posIds[tri[0]] == pTo || posIds[tri[1]] == pTo || posIds[tri[2]] == pTo)
+				{
+					++dying;
+					continue;
+				}
+
+				for (int k = 0; k < 3; ++k)
+					moved[k] = tri[k] == col.from ? target : positions[tri[k]];
+
+				const Vertex<GLfloat> before = triNormal(positions[tri[0]], positions[tri[1]], positions[tri[2]]);
+				const Vertex<GLfloat> after = triNormal(moved[0], moved[1], moved[2]);
+				const double lengths = std::sqrt(before.dotProduct(before)) * std::sqrt(after.dotProduct(after));
+
+				valid = lengths > 0. && before.dotProduct(after) >= MIN_NORMAL_COS * lengths;
+			}
+
+			if (!valid)
+				continue;
+
+			collapseTo[col.from] = col.to;
+			quadrics[pTo] += quadrics[pFrom];
+			removed += dying;
+			++performed;
+
+			// keep everything around the collapse as it is until the next pass
+			for (unsigned a = topo.triOffsets[col.from]; a < topo.triOffsets[col.from + 1]; ++a)
+			{
+				const GLuint* tri = &tris[topo.adjTris[a] * 3];
+
+				for (int k = 0; k < 3; ++k)
+					touched[posIds[tri[k]]] = true;
+			}
+		}
+
+		if (performed == 0)
+			break;
+
+		// Apply and drop the triangles that degenerated
+		size_t kept = 0;
+		for (t = 0; t < tris.size() / 3; ++t)
+		{
+			const GLuint v0 = collapseTo[tris[t * 3]], v1 = collapseTo[tris[t * 3 + 1]], v2 = collapseTo[tris[t * 3 + 2]];
+
+			if (posIds[v0] == posIds[v1] || posIds[v1] == posIds[v2] || posIds[v0] == posIds[v2])
+				continue;
+
+			tris[kept * 3] = v0;
+			tris[kept * 3 + 1] = v1;
+			tris[kept * 3 + 2] = v2;
+			++kept;
+		}
+		tris.resize(kept * 3);
+	}
+
+	return tris;
+}
@@ -0,0 +1,42 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MESHSIMPLIFIER_HPP
+#define MESHSIMPLIFIER_HPP
+
+#include <vector>
+
+#include <GL/glew.h>
+#include "VectorTypes.h"
+
+/*
+ * Quadric error metric decimation (Garland & Heckbert) by half-edge collapses,
+ * vertices only ever move onto other existing vertices so their attributes stay valid.
+ *
+ * - vertices sharing a position with others (UV or normal seams) stay in place
+ * - open borders only collapse along themselves, and non-manifold spots are locked
+ * - collapses that flip a triangle or bend it by more than ~75 degrees are rejected
+ *
+ * Returns the new triangle list, which has about targetRatio of the input's triangles
+ * unless the locked vertices don't allow it.
+ */
+std::vector<GLuint> simplifyMesh(const std::vector<GLuint>& indices, const std::vector<Vertex<GLfloat> >& positions,
+				 float targetRatio);
+
+#endif // MESHSIMPLIFIER_HPP
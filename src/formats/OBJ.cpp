@@ -0,0 +1,401 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "OBJ.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "Parallel.h"
+#include "TextScanner.h"
+
+// Smaller files aren't worth splitting, this much per chunk at least
+static const size_t OBJ_PARALLEL_MIN_CHUNK = 1024 * 1024;
+
+void OBJFile::clear()
+{
+	vertices.clear();
+	normals.clear();
+	uvs.clear();
+	objects.clear();
+	lines = points = false;
+}
+
+namespace
+{
+	// Face with relative indices, bit corner * 3 + part of mask for each, part 0 v, 1 vt, 2 vn
+	struct OBJRelativeFace
+	{
+		size_t object, face;
+		unsigned mask;
+	};
+
+	/*
+	 * Records of a run of whole lines. Relative indices count from the records
+	 * of the chunk, so they may be 0 or negative until the counts of the
+	 * chunks before are added. The first object continues the previous chunk's last.
+	 */
+	struct OBJChunk
+	{
+		OBJFile obj;
+		std::vector<OBJRelativeFace> relative;
+		unsigned lines;
+		unsigned errorLine; // 1 based within the chunk, 0 if none
+
+		// where it goes in the whole file
+		size_t bases[3]; // v, vt and vn before it
+		size_t firstObject, firstFace;
+	};
+
+	/*
+	 * One part of a v/vt/vn corner. Like reading it from a stream whatever leading
+	 * number there is counts, 0 if none. Negative ones count back from the latest
+	 * of the count records read so far, -1 is the latest.
+	 */
+	bool readOBJIndex(const char* begin, const char* end, size_t count, long long& index, bool& relative)
+	{
+		TextScanner in(begin, end);
+
+		relative = false;
+		if (!in.read(index))
+			index = 0;
+		else if (index < 0)
+		{
+			relative = true;
+			index += static_cast<long long>(count) + 1;
+		}
+		return index >= std::numeric_limits<int>::min() && index <= std::numeric_limits<int>::max();
+	}
+
+	bool readOBJFace(TextScanner& in, OBJChunk& chunk)
+	{
+		OBJFile& obj = chunk.obj;
+		std::vector<OBJTri>& faces = obj.objects.back().faces;
+		const size_t counts[3] = {obj.vertices.size(), obj.uvs.size(), obj.normals.size()};
+		const char* begin;
+		size_t size;
+		OBJTri tri;
+		unsigned mask = 0;
+
+		// the f itself
+		in.word(begin, size);
+
+		for (unsigned i = 0; in.word(begin, size); ++i)
+		{
+			const unsigned pos = i <= 2 ? i : 2;
+			const char* end = begin + size;
+			const char* parts[3] = {begin, end, end};
+			const char* partEnds[3] = {end, end, end};
+			unsigned partCount = 1;
+
+			// v, vt and vn split at slashes, up to 3 are looked at
+			for (const char* c = begin; c != end; ++c)
+			{
+				if (*c != '/')
+					continue;
+				if (partCount < 3)
+				{
+					partEnds[partCount - 1] = c;
+					parts[partCount] = c + 1;
+				}
+				++partCount;
+			}
+
+			if (i > 2)
+			{
+				tri.uvs[1] = tri.uvs[2];
+				tri.tri[1] = tri.tri[2];
+				tri.nrm[1] = tri.nrm[2];
+				mask = (mask & 07) | (mask >> 3 & 070);
+			}
+
+			// -1 means not specified
+			int values[3] = {0, -1, -1};
+			const bool given[3] = {true, partCount >= 2 && parts[1] != partEnds[1], partCount == 3 && parts[2] != partEnds[2]};
+
+			for (unsigned part = 0; part < 3; ++part)
+			{
+				long long index;
+				bool relative;
+
+				if (!given[part])
+					continue;
+				if (!readOBJIndex(parts[part], partEnds[part], counts[part], index, relative))
+					return false;
+				values[part] = static_cast<int>(index);
+				if (relative)
+					mask |= 1u << (pos * 3 + part);
+			}
+
+			tri.tri[pos] = static_cast<GLuint>(values[0]);
+			tri.uvs[pos] = values[1];
+			tri.nrm[pos] = values[2];
+
+			if (i >= 2)
+			{
+				if (mask)
+				{
+					const OBJRelativeFace face = {obj.objects.size() - 1, faces.size(), mask};
+					chunk.relative.push_back(face);
+				}
+				faces.push_back(tri);
+			}
+		}
+		return true;
+	}
+
+	bool readOBJLine(const char* begin, const char* end, OBJChunk& chunk)
+	{
+		// the second character picks the v record and is skipped for all
+		const char second = end - begin > 1 ? begin[1] : '\0';
+		TextScanner in(std::min(begin + 2, end), end);
+		OBJFile& obj = chunk.obj;
+		OBJVertex vert;
+		OBJUV uv;
+
+		switch (*begin)
+		{
+		case 'v':
+			if (second == 't')
+			{
+				if (!in.read(uv))
+					return false;
+				obj.uvs.push_back(uv);
+			}
+			else if (second == 'n')
+			{
+				if (!in.read(vert))
+					return false;
+				obj.normals.push_back(vert);
+			}
+			else if (second != 'p')
+			{
+				if (!in.read(vert))
+					return false;
+				obj.vertices.push_back(vert);
+			}
+			break;
+		case 'f':
+			in = TextScanner(begin, end);
+			return readOBJFace(in, chunk);
+		case 'l':
+			obj.lines = true;
+			break;
+		case 'p':
+			obj.points = true;
+			break;
+		case 'o':
+			in = TextScanner(begin + 1, end);
+			obj.objects.emplace_back();
+			in.read(obj.objects.back().name);
+			break;
+		}
+		return true;
+	}
+
+	void readOBJChunk(const char* begin, const char* end, OBJChunk& chunk)
+	{
+		chunk.obj.clear();
+		chunk.obj.objects.emplace_back();
+		chunk.lines = chunk.errorLine = 0;
+
+		for (const char* pos = begin; pos < end; )
+		{
+			const char* lineEnd = static_cast<const char*>(std::memchr(pos, '\n', static_cast<size_t>(end - pos)));
+			if (!lineEnd)
+				lineEnd = end;
+
+			++chunk.lines;
+			if (pos != lineEnd && !readOBJLine(pos, lineEnd, chunk))
+			{
+				chunk.errorLine = chunk.lines;
+				return;
+			}
+			pos = lineEnd + 1;
+		}
+	}
+
+	// Adds the records of the chunks before to the relative indices, false if one ends up before the first
+	bool resolveRelative(OBJChunk& chunk)
+	{
+		for (const OBJRelativeFace& relative: chunk.relative)
+		{
+			OBJTri& face = chunk.obj.objects[relative.object].faces[relative.face];
+
+			for (unsigned i = 0; i < 3; ++i)
+			{
+				// tri holds negative values wrapped around
+				long long values[3] = {static_cast<int>(face.tri[i]), face.uvs[i], face.nrm[i]};
+
+				for (unsigned part = 0; part < 3; ++part)
+				{
+					if (relative.mask & (1u << (i * 3 + part)))
+					{
+						values[part] += static_cast<long long>(chunk.bases[part]);
+						if (values[part] < 1 || values[part] > std::numeric_limits<int>::max())
+							return false;
+					}
+				}
+				face.tri[i] = static_cast<GLuint>(values[0]);
+				face.uvs[i] = static_cast<int>(values[1]);
+				face.nrm[i] = static_cast<int>(values[2]);
+			}
+		}
+		return true;
+	}
+
+	bool indexInRange(int index, size_t count)
+	{
+		return index < 1 || static_cast<size_t>(index) <= count;
+	}
+
+	// Once relative indices are resolved, against the records of all chunks
+	bool facesInRange(const OBJFile& obj, const size_t counts[3])
+	{
+		for (const OBJObject& object: obj.objects)
+		{
+			for (const OBJTri& face: object.faces)
+			{
+				for (size_t i = 0; i < 3; ++i)
+				{
+					if (face.tri[i] < 1 || face.tri[i] > counts[0]
+						|| !indexInRange(face.uvs[i], counts[1]) || !indexInRange(face.nrm[i], counts[2]))
+					{
+						return false;
+					}
+				}
+			}
+		}
+		return true;
+	}
+}
+
+bool readOBJ(const char* data, size_t size, OBJFile& obj, unsigned chunks)
+{
+	const char* end = data + size;
+
+	obj.clear();
+	if (!chunks)
+		chunks = static_cast<unsigned>(std::min<size_t>(parallelThreads(), std::max<size_t>(1, size / OBJ_PARALLEL_MIN_CHUNK)));
+
+	// split at line starts, chunks may come out empty
+	std::vector<const char*> starts(chunks + 1, end);
+	starts[0] = data;
+	for (unsigned i = 1; i < chunks; ++i)
+	{
+		const char* pos = std::max(starts[i - 1], data + size / chunks * i);
+		if (pos != data && pos != end && pos[-1] != '\n')
+		{
+			pos = static_cast<const char*>(std::memchr(pos, '\n', static_cast<size_t>(end - pos)));
+			pos = pos ? pos + 1 : end;
+		}
+		starts[i] = pos;
+	}
+
+	std::vector<OBJChunk> parsed(chunks);
+	parallelFor(0, chunks, 1, [&](size_t first, size_t last)
+	{
+		for (size_t i = first; i < last; ++i)
+			readOBJChunk(starts[i], starts[i + 1], parsed[i]);
+	});
+
+	// the first malformed line, whatever the chunks
+	unsigned line = 0;
+	for (const OBJChunk& chunk: parsed)
+	{
+		if (chunk.errorLine)
+		{
+			std::cerr << "readOBJ - Error reading line " << line + chunk.errorLine;
+			return false;
+		}
+		line += chunk.lines;
+	}
+
+	// where the records of each chunk go, after those of the chunks before
+	size_t totals[3] = {0, 0, 0};
+	std::vector<size_t> faceCounts(1, 0);
+
+	for (OBJChunk& chunk: parsed)
+	{
+		const size_t counts[3] = {chunk.obj.vertices.size(), chunk.obj.uvs.size(), chunk.obj.normals.size()};
+
+		for (unsigned part = 0; part < 3; ++part)
+		{
+			chunk.bases[part] = totals[part];
+			totals[part] += counts[part];
+		}
+		chunk.firstObject = faceCounts.size() - 1;
+		chunk.firstFace = faceCounts.back();
+		faceCounts.back() += chunk.obj.objects.front().faces.size();
+		for (size_t i = 1; i < chunk.obj.objects.size(); ++i)
+			faceCounts.push_back(chunk.obj.objects[i].faces.size());
+	}
+
+	std::vector<char> valid(chunks);
+
+	if (chunks == 1)
+	{
+		valid[0] = resolveRelative(parsed[0]) && facesInRange(parsed[0].obj, totals);
+		obj = std::move(parsed[0].obj);
+	}
+	else
+	{
+		obj.vertices.resize(totals[0]);
+		obj.uvs.resize(totals[1]);
+		obj.normals.resize(totals[2]);
+		obj.objects.resize(faceCounts.size());
+		for (size_t i = 0; i < faceCounts.size(); ++i)
+			obj.objects[i].faces.resize(faceCounts[i]);
+
+		for (OBJChunk& chunk: parsed)
+		{
+			for (size_t i = 1; i < chunk.obj.objects.size(); ++i)
+				obj.objects[chunk.firstObject + i].name.swap(chunk.obj.objects[i].name);
+			obj.lines = obj.lines || chunk.obj.lines;
+			obj.points = obj.points || chunk.obj.points;
+		}
+
+		// each chunk copies into its own ranges
+		parallelFor(0, chunks, 1, [&](size_t first, size_t last)
+		{
+			for (size_t i = first; i < last; ++i)
+			{
+				OBJChunk& chunk = parsed[i];
+
+				valid[i] = resolveRelative(chunk) && facesInRange(chunk.obj, totals);
+				std::copy(chunk.obj.vertices.begin(), chunk.obj.vertices.end(), obj.vertices.begin() + chunk.bases[0]);
+				std::copy(chunk.obj.uvs.begin(), chunk.obj.uvs.end(), obj.uvs.begin() + chunk.bases[1]);
+				std::copy(chunk.obj.normals.begin(), chunk.obj.normals.end(), obj.normals.begin() + chunk.bases[2]);
+				for (size_t k = 0; k < chunk.obj.objects.size(); ++k)
+				{
+					const std::vector<OBJTri>& faces = chunk.obj.objects[k].faces;
+					std::copy(faces.begin(), faces.end(),
+						  obj.objects[chunk.firstObject + k].faces.begin() + (k ? 0 : chunk.firstFace));
+				}
+			}
+		});
+	}
+
+	if (std::find(valid.begin(), valid.end(), 0) != valid.end())
+	{
+		std::cerr << "readOBJ - Face index out of range";
+		return false;
+	}
+	return true;
+}
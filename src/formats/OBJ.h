@@ -21,13 +21,15 @@
 #define OBJ_HPP
 
 #include <iostream>
+#include <string>
 #include <vector>
-#include <set>
+#include <limits>
 
 #include <GL/glew.h>
 
 #include "VectorTypes.h"
 #include "Polygon.h"
+#include "VertexWelder.h"
 
 typedef Vertex<GLfloat> OBJVertex;
 typedef UV<GLclampf> OBJUV;
@@ -36,9 +38,9 @@ struct OBJTri
 {
 	IndexedTri tri;
 
-	// signed short: -1 means not specified
-	Vector<short, 3> nrm;
-	Vector<short, 3> uvs;
+	// -1 means not specified
+	Vector<int, 3> nrm;
+	Vector<int, 3> uvs;
 
 	bool operator == (const OBJTri& rhs)
 	{
@@ -57,42 +59,112 @@ struct OBJTri
 		return tri < rhs.tri;
 	}
 };
-inline void writeOBJVertex(const OBJVertex& vert, std::ostream& out)
+// An "o" line and the faces up to the next one
+struct OBJObject
+{
+	std::string name; // empty if the line had none
+	std::vector<OBJTri> faces;
+};
+
+/*
+ * The records of an OBJ file. The first object holds the faces before any "o" line.
+ * Faces are split into triangle fans and relative indices are made absolute,
+ * all indices stay 1 based.
+ */
+struct OBJFile
+{
+	std::vector<OBJVertex> vertices, normals;
+	std::vector<OBJUV> uvs;
+	std::vector<OBJObject> objects;
+	bool lines, points; // unsupported records seen
+
+	void clear();
+};
+
+/*
+ * Parses the v, vt, vn, f and o records of an OBJ file in memory, without allocating
+ * per line. Fails on malformed coordinates and on indices out of range.
+ *
+ * The file is split at line starts into chunks parsed on parallel threads, one per
+ * thread for big files when chunks is 0. Any chunk count gives the same result.
+ */
+bool readOBJ(const char* data, size_t size, OBJFile& obj, unsigned chunks = 0);
+
+inline void writeOBJVertex(const OBJVertex& vert, TextWriter& out)
 {
 	out << "v " << vert.x() << ' '
 			<< vert.y()  << ' '
 			<< vert.z() << '\n';
 }
 
-inline void writeOBJUV(const OBJUV& uv, std::ostream& out)
+inline void writeOBJUV(const OBJUV& uv, TextWriter& out)
 {
 	out << "vt " << uv.u() << ' '
 			<< uv.v() << '\n';
 }
 
-inline void writeOBJNormal(const OBJVertex& norm, std::ostream& out)
+inline void writeOBJNormal(const OBJVertex& norm, TextWriter& out)
 {
 	out << "vn " << norm.x() << ' '
 			<< norm.y()  << ' '
 			<< norm.z() << '\n';
 }
 
-/* Ugh, those wretched template parameters have a way of fuglying things up
- * so I'm burrying them here so that hopefuly no-one sees them...
- * these are function parameters, currently assumed to be valid pointers,
- * these are treated like references.
+/*
+ * Shared v/vt/vn pools of an OBJ export,
+ * attributes within epsilon of a pooled one reuse its index.
  */
-struct Mesh_exportToOBJ_InOutParams
+struct OBJExportPools
+{
+	OBJExportPools(): m_vertHash(std::numeric_limits<GLfloat>::epsilon()),
+		m_uvHash(std::numeric_limits<GLfloat>::epsilon()),
+		m_normHash(std::numeric_limits<GLfloat>::epsilon()) {}
+
+	unsigned addVertex(const OBJVertex& vert)
+	{
+		return add(vert, vert, vertices, m_vertHash);
+	}
+
+	unsigned addUV(const OBJUV& uv)
+	{
+		return add(uv, OBJVertex(uv.u(), uv.v(), 0.f), uvs, m_uvHash);
+	}
+
+	unsigned addNormal(const OBJVertex& norm)
+	{
+		return add(norm, norm, normals, m_normHash);
+	}
+
+	std::vector<OBJVertex> vertices;
+	std::vector<OBJUV> uvs;
+	std::vector<OBJVertex> normals;
+
+private:
+	template <typename T>
+	static unsigned add(const T& val, const OBJVertex& key, std::vector<T>& pool, PointHash& hash)
+	{
+		const typename T::equal_wEps equals;
+		unsigned index = 0;
+
+		if (!hash.find(key, [&](unsigned candidate)
+			{
+				return equals(pool[candidate], val);
+			}, index))
+		{
+			index = static_cast<unsigned>(pool.size());
+			hash.insert(key, index);
+			pool.push_back(val);
+		}
+		return index;
+	}
+
+	PointHash m_vertHash, m_uvHash, m_normHash;
+};
+
+// 0 based pool indices of a mesh point
+struct OBJPointRef
 {
-	std::vector<OBJVertex>* vertices;
-	std::set<OBJVertex, OBJVertex::less_wEps>* vertSet;
-	std::vector<unsigned>* vertMapping;
-	std::vector<OBJUV>* uvs;
-	std::set<OBJUV, OBJUV::less_wEps>* uvSet;
-	std::vector<unsigned>* uvMapping;
-	std::vector<OBJVertex>* normals;
-	std::set<OBJVertex, OBJVertex::less_wEps>* normSet;
-	std::vector<unsigned>* normMapping;
+	unsigned v, vt, vn;
 };
 
 #endif // OBJ_HPP
@@ -23,18 +23,17 @@
 #include <fstream>
 
 #include "Pie.h"
+#include "MappedFile.h"
+#include "VectorTypesIO.h"
 
-int pieVersion(std::istream& in)
+int pieVersion(const char* data, size_t size)
 {
-	std::string pie;
+	TextScanner in(data, data + size);
 	unsigned version;
-	std::streampos start = in.tellg();
 
-	// PIE %u
-	in >> pie >> version;
-	if (in.good() && pie.compare(PIE_MODEL_SIGNATURE) == 0)
+	// PIE %u, not at the very end
+	if (in.skipWord(PIE_MODEL_SIGNATURE) && in.read(version) && in.position() != in.end())
 	{
-		in.seekg(start);
 		if (version >= 2 || version <= 3)
 		{
 			return version;
@@ -43,26 +42,6 @@ int pieVersion(std::istream& in)
 	return -1;
 }
 
-bool tryToReadDirective(std::istream &in, const char* directive, const bool isOptional, std::function<bool(std::istream&)> dirLoaderFunc)
-{
-	std::string str;
-	std::streampos entrypoint = in.tellg();
-
-	in >> str;
-	if (in.fail() || (str.compare(directive) != 0))
-	{
-		// Not a failure if some other directive found and this is optional, just rewind
-		if (isOptional)
-		{
-			in.clear();
-			in.seekg(entrypoint);
-		}
-		return isOptional;
-	}
-
-	return dirLoaderFunc(in);
-}
-
 
 /**********************************************
   Pie version 2
@@ -381,29 +360,22 @@ unsigned Pie3Model::textureWidth() const
 	return 0;
 }
 
-bool ApieAnimFrame::read(std::istream &in)
+bool ApieAnimFrame::read(TextScanner &in)
 {
-	in >> num;
-	if ( in.fail())
-		return false;
-
-	in >> pos >> rot >> scale;
-	return !in.fail();
+	return in.read(num) && in.read(pos) && in.read(rot) && in.read(scale);
 }
 
-void ApieAnimFrame::write(std::ostream &out) const
+void ApieAnimFrame::write(TextWriter &out) const
 {
 	out << num  << ' ' << pos  << ' ' << rot  << ' ' << scale;
 }
 
-bool ApieAnimObject::read(std::istream &in)
+bool ApieAnimObject::read(TextScanner &in)
 {
 	clear();
 
 	// time cycles frames
-	in >> time >> cycles >> numframes;
-
-	if ( in.fail())
+	if (!in.read(time) || !in.read(cycles) || !in.read(numframes))
 	{
 		return false;
 	}
@@ -421,7 +393,7 @@ bool ApieAnimObject::read(std::istream &in)
 	return true;
 }
 
-void ApieAnimObject::write(std::ostream &out) const
+void ApieAnimObject::write(TextWriter &out) const
 {
 	out << ' ' << time << ' ' << cycles << ' ' << numframes;
 	for (size_t i = 0; i < static_cast<size_t>(numframes); ++i)
@@ -434,21 +406,15 @@ void ApieAnimObject::write(std::ostream &out) const
 
 bool ApieAnimObject::readStandaloneAniFile(const char *file)
 {
-	std::ifstream fin;
+	MappedFile mapped;
 
 	clear();
 
-	fin.open(file, std::ios::in | std::ios::binary);
-
-	if (!fin.is_open())
+	if (!mapped.open(file))
 		return false;
 
-	return tryToReadDirective(fin, PIE_MODEL_DIRECTIVE_ANIMOBJECT, false,
-		[this](std::istream& inn)
-		{
-			return read(inn);
-		}
-	);
+	TextScanner in(mapped.data(), mapped.data() + mapped.size());
+	return in.skipWord(PIE_MODEL_DIRECTIVE_ANIMOBJECT) && read(in);
 }
 
 const char *getPieDirectiveName(PIE_OPT_DIRECTIVES dir)
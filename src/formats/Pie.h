@@ -28,6 +28,8 @@
 #include <GL/glew.h>
 #include "VectorTypes.h"
 #include "Polygon.h"
+#include "TextScanner.h"
+#include "TextWriter.h"
 
 #include "WZM.h" // for friends
 
@@ -127,9 +129,6 @@ enum class PIE_OPT_DIRECTIVES
 const char* getPieDirectiveName(PIE_OPT_DIRECTIVES dir);
 const char* getPieDirectiveDescription(PIE_OPT_DIRECTIVES dir);
 
-bool tryToReadDirective(std::istream &in, const char* directive, const bool isOptional,
-			std::function<bool(std::istream&)> dirLoaderFunc);
-
 template<>
 struct EnumTraits<PIE_OPT_DIRECTIVES>
 {
@@ -149,8 +148,8 @@ public:
 	Vertex<int> pos, rot;
 	Vertex<float> scale;
 
-	bool read(std::istream& in);
-	void write(std::ostream& out) const;
+	bool read(TextScanner& in);
+	void write(TextWriter& out) const;
 };
 
 class ApieAnimObject
@@ -162,8 +161,8 @@ public:
 	bool isValid() const {return !frames.empty();}
 	void clear() {frames.clear();}
 
-	bool read(std::istream& in);
-	void write(std::ostream& out) const;
+	bool read(TextScanner& in);
+	void write(TextWriter& out) const;
 
 	bool readStandaloneAniFile(const char* file);
 };
@@ -172,14 +171,19 @@ template<typename V, typename P, typename C>
 class APieLevel
 {
 	typedef Vertex<GLfloat> PieNormal;
-	friend Mesh::operator Pie3Level() const;
-	friend Mesh::Mesh(const Pie3Level& p3);
+	friend class MeshTransformView;
+	friend Mesh::Mesh(const Pie3Level& p3, const WeldTolerances& tolerances);
 public:
 	APieLevel();
 	virtual ~APieLevel() {}
 
-	virtual bool read(std::istream& in, PieCaps& caps);
-	virtual void write(std::ostream& out, const PieCaps& caps) const;
+	APieLevel(const APieLevel& rhs) = default;
+	APieLevel(APieLevel&& rhs) = default;
+	APieLevel& operator=(const APieLevel& rhs) = default;
+	APieLevel& operator=(APieLevel&& rhs) = default;
+
+	bool read(TextScanner& in, PieCaps& caps);
+	virtual void write(TextWriter& out, const PieCaps& caps) const;
 
 	size_t points() const;
 	size_t normals() const;
@@ -190,7 +194,7 @@ public:
 
 protected:
 	void clearAll();
-	bool readAnimObjectDirective(std::istream &in, PieCaps& caps);
+	bool readAnimObjectDirective(TextScanner& in, PieCaps& caps);
 
 	std::vector<V> m_points;
 	std::vector<PieNormal> m_normals;
@@ -209,11 +213,21 @@ public:
 	APieModel(const PieCaps& def_caps);
 	virtual ~APieModel();
 
+	// no assignment, m_def_caps is const
+	APieModel(const APieModel& rhs) = default;
+	APieModel(APieModel&& rhs) = default;
+
 	virtual unsigned version() const =0;
 
 	virtual bool read(std::istream& in);
+	// Big files with several levels are parsed in parallel
+	bool read(const char* data, size_t size);
 	virtual void write(std::ostream& out, const PieCaps* piecaps = nullptr) const;
 
+	// The pieces of write, for streaming levels that aren't held in m_levels
+	void writeHeader(TextWriter& out, size_t levels, const PieCaps& caps) const;
+	static void writeLevel(TextWriter& out, unsigned number, const L& level, const PieCaps& caps);
+
 	size_t levels() const;
 	virtual unsigned getType() const;
 
@@ -229,18 +243,16 @@ protected:
 	virtual unsigned textureHeight() const =0;
 	virtual unsigned textureWidth() const =0;
 
-	virtual bool readHeaderBlock(std::istream& in);
-
-	virtual bool readTexturesBlock(std::istream& in);
-	bool readTextureDirective(std::istream& in);
-	bool readNormalmapDirective(std::istream& in);
-	bool readSpecmapDirective(std::istream& in);
-
-	virtual bool readLevelsBlock(std::istream& in);
-	bool readEventsDirective(std::istream& in);
-	int readLevelsDirective(std::istream& in);
-	bool readLevels(int levels, std::istream& in);
-	bool readAnimObjectDirective(std::istream &in);
+	bool readHeaderBlock(TextScanner& in);
+	bool readTexturesBlock(TextScanner& in);
+	bool readTextureDirective(TextScanner& in);
+	bool readNormalmapDirective(TextScanner& in);
+	bool readSpecmapDirective(TextScanner& in);
+	bool readLevelsBlock(TextScanner& in);
+	bool readEventsDirective(TextScanner& in);
+	int readLevelsDirective(TextScanner& in);
+	bool readLevels(int levels, TextScanner& in);
+	bool readLevelsInParallel(int levels, TextScanner& in);
 
 	std::string m_texture;
 	std::string m_texture_normalmap;
@@ -259,19 +271,18 @@ template <typename V>
 struct PieConnector
 {
 	virtual ~PieConnector(){}
-	bool read(std::istream& in);
-	void write(std::ostream& out) const;
+	bool read(TextScanner& in);
+	void write(TextWriter& out) const;
 	V pos;
 };
 
 
 /** Returns the Pie version
   *
-  *	@param	in	istream to a Pie file, the stream's position will be
-  *		returned to where it was (on success).
-  *	@return	int Version of the pie version.
+  *	@param	data, size	a Pie file in memory.
+  *	@return	int Version of the pie version, -1 if it is no Pie.
   */
-int pieVersion(std::istream& in);
+int pieVersion(const char* data, size_t size);
 
 /**********************************************
   Pie version 2
@@ -294,6 +305,11 @@ class Pie2Level : public APieLevel<Pie2Vertex, Pie2Polygon, Pie2Connector>
 public:
 	Pie2Level(){}
 	virtual ~Pie2Level(){}
+
+	Pie2Level(const Pie2Level& rhs) = default;
+	Pie2Level(Pie2Level&& rhs) = default;
+	Pie2Level& operator=(const Pie2Level& rhs) = default;
+	Pie2Level& operator=(Pie2Level&& rhs) = default;
 };
 
 class Pie2Model : public APieModel<Pie2Level>
@@ -303,6 +319,9 @@ public:
 	Pie2Model();
 	virtual ~Pie2Model();
 
+	Pie2Model(const Pie2Model& rhs) = default;
+	Pie2Model(Pie2Model&& rhs) = default;
+
 	unsigned version() const;
 
 	unsigned textureHeight() const;
@@ -362,12 +381,18 @@ private:
 class Pie3Level : public APieLevel<Pie3Vertex, Pie3Polygon, Pie3Connector>
 {
     friend WZM::WZM(const Pie3Model &p3);
-    friend WZM::operator Pie3Model() const;
+    friend WZM::WZM(Pie3Model&& p3);
+    friend Pie3Level WZM::pieLevel(int index, const WZMMatrix4& transform, int mesh) const;
 public:
 	Pie3Level();
 	Pie3Level(const Pie2Level& p2);
 	virtual ~Pie3Level();
 
+	Pie3Level(const Pie3Level& rhs) = default;
+	Pie3Level(Pie3Level&& rhs) = default;
+	Pie3Level& operator=(const Pie3Level& rhs) = default;
+	Pie3Level& operator=(Pie3Level&& rhs) = default;
+
 	static Pie3Level upConvert(const Pie2Level& p2);
 	static Pie2Level backConvert(const Pie3Level& p3);
 	operator Pie2Level() const;
@@ -376,12 +401,17 @@ public:
 class Pie3Model : public APieModel<Pie3Level>
 {
 	friend WZM::WZM(const Pie3Model &p3);
-	friend WZM::operator Pie3Model() const;
+	friend WZM::WZM(Pie3Model&& p3);
+	friend Pie3Model WZM::toPie3Model(const WZMMatrix4& transform, int mesh) const;
+	friend Pie3Model WZM::pieHeader() const;
 public:
 	Pie3Model();
 	Pie3Model(const Pie2Model& pie2);
 	virtual ~Pie3Model();
 
+	Pie3Model(const Pie3Model& rhs) = default;
+	Pie3Model(Pie3Model&& rhs) = default;
+
 	unsigned version() const;
 
 	operator Pie2Model() const;
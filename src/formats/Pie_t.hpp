@@ -20,6 +20,7 @@
 
 #include "Generic.h"
 #include "Util.h"
+#include "Parallel.h"
 
 #include "Pie.h" // Hack for autocomplete
 
@@ -37,163 +38,123 @@ APieLevel< V, P, C>::APieLevel(): m_material(true)
 
 // Optional directive
 template<typename V, typename P, typename C>
-bool APieLevel< V, P, C>::readAnimObjectDirective(std::istream& in, PieCaps& caps)
+bool APieLevel< V, P, C>::readAnimObjectDirective(TextScanner& in, PieCaps& caps)
 {
-	return tryToReadDirective(in, PIE_MODEL_DIRECTIVE_ANIMOBJECT, true,
-		[this, &caps](std::istream& inn)
-		{
-			caps.set(PIE_OPT_DIRECTIVES::podANIMOBJECT);
-			return m_animobj.read(inn);
-		}
-	);
+	if (!in.skipWord(PIE_MODEL_DIRECTIVE_ANIMOBJECT))
+		return true;
+
+	caps.set(PIE_OPT_DIRECTIVES::podANIMOBJECT);
+	return m_animobj.read(in);
 }
 
-// TODO: Write error messages to std::cerr
+// Optional directives are looked for on a copy of the scanner
 template<typename V, typename P, typename C>
-bool APieLevel< V, P, C>::read(std::istream& in, PieCaps& caps)
+bool APieLevel< V, P, C>::read(TextScanner& in, PieCaps& caps)
 {
-	std::string str;
 	unsigned uint;
-	std::streampos mark;
 
 	clearAll();
 
-	#define streamfail() do { clearAll();return false; } while(0)
+	#define scanfail() do { clearAll();return false; } while(0)
 
 	// LEVEL %u
-	in >> str >> uint;
-	if ( in.fail() || str.compare("LEVEL") != 0)
+	if (!in.skipWord("LEVEL") || !in.read(uint))
 	{
-		streamfail();
+		scanfail();
 	}
 
-	// POINTS %u || MATERIALS %u
-	in >> str;
-	if ( str.compare(PIE_MODEL_DIRECTIVE_MATERIALS) == 0)
+	// Optional: MATERIALS
+	if (in.skipWord(PIE_MODEL_DIRECTIVE_MATERIALS))
 	{
-		in >> m_material;
-		if (in.fail())
-			streamfail();
+		if (!readMaterial(in, m_material))
+			scanfail();
 		caps.set(PIE_OPT_DIRECTIVES::podMATERIALS);
-		in >> str;
 	}
 
-	// Optional: shaders
-	if (str.compare(PIE_MODEL_DIRECTIVE_SHADERS) == 0)
+	// Optional: shaders, the count is not checked
+	if (in.skipWord(PIE_MODEL_DIRECTIVE_SHADERS))
 	{
-		in >> str >> m_shader_vert >> m_shader_frag;
-		if (in.fail())
-			streamfail();
+		const char* count;
+		size_t size;
+		if (!in.word(count, size) || !in.read(m_shader_vert) || !in.read(m_shader_frag))
+			scanfail();
 		caps.set(PIE_OPT_DIRECTIVES::podSHADERS);
-		in >> str;
 	}
 
-	if (in.fail() || str.compare("POINTS") != 0)
-	{
-		streamfail();
-	}
-	else
+	// POINTS %u
+	if (!in.skipWord("POINTS") || !in.read(uint))
 	{
-		in >> uint;
+		scanfail();
 	}
 
 	m_points.reserve(uint);
 	for (; uint > 0; --uint)
 	{
 		V point;
-		in >> point.x() >> point.y() >> point.z();
+		if (!in.read(point))
+			scanfail();
 		m_points.emplace_back(point);
 	}
 
-	if (in.fail())
-	{
-		streamfail();
-	}
-
 	// Optional: NORMALS %u
-	mark = in.tellg();
-	in >> str >> uint;
-	if ( !in.fail() && str.compare("NORMALS") == 0)
+	TextScanner ahead(in);
+	if (ahead.skipWord("NORMALS") && ahead.read(uint))
 	{
+		in = ahead;
 		uint *= 3;
 		if (uint > 0)
 			caps.set(PIE_OPT_DIRECTIVES::podNORMALS);
+		m_normals.reserve(uint);
 		for (; uint > 0; --uint)
 		{
 			PieNormal normal;
-			in >> normal.x() >> normal.y() >> normal.z();
-			if (in.fail())
-			{
-				/* Normals are optional, but if they're bad
-				 * we return failure.
-				 */
-				streamfail();
-			}
+			if (!in.read(normal))
+				scanfail();
 			m_normals.emplace_back(normal);
 		}
 	}
-	else
-	{
-		// no normals or eof
-		in.clear();
-		in.seekg(mark);
-	}
 
 	// POLYGONS %u
-	in >> str >> uint;
-	if ( in.fail() || str.compare("POLYGONS") != 0)
+	if (!in.skipWord("POLYGONS") || !in.read(uint))
 	{
-		streamfail();
+		scanfail();
 	}
 
 	m_polygons.reserve(uint);
 	for (; uint > 0; --uint)
 	{
-		P poly;
-		if (!poly.read(in))
+		m_polygons.emplace_back();
+		if (!m_polygons.back().read(in))
 		{
-			streamfail();
+			scanfail();
 		}
-		m_polygons.emplace_back(poly);
 	}
 
-	mark = in.tellg();
-
 	// Optional: CONNECTORS %u
-	in >> str >> uint;
-	if ( !in.fail() && str.compare("CONNECTORS") == 0)
+	ahead = in;
+	if (ahead.skipWord("CONNECTORS") && ahead.read(uint))
 	{
+		in = ahead;
 		if (uint > 0)
 			caps.set(PIE_OPT_DIRECTIVES::podCONNECTORS);
 		for (; uint > 0; --uint)
 		{
 			C cnctr;
 			if (!cnctr.read(in))
-			{
-				/* Connectors are optional, but if they're bad
-				 * we return failure.
-				 */
-				streamfail();
-			}
+				scanfail();
 			m_connectors.emplace_back(cnctr);
 		}
 	}
-	else
-	{
-		// no connectors or eof
-		in.clear();
-		in.seekg(mark);
-	}
 
-	if (!in.eof() && !readAnimObjectDirective(in, caps))
-		streamfail();
+	if (!in.atEnd() && !readAnimObjectDirective(in, caps))
+		scanfail();
 
 	return true;
-#undef streamfail
+#undef scanfail
 }
 
 template<typename V, typename P, typename C>
-void APieLevel< V, P, C>::write(std::ostream &out, const PieCaps &caps) const
+void APieLevel< V, P, C>::write(TextWriter &out, const PieCaps &caps) const
 {
 	typename std::vector<V>::const_iterator ptIt;
 	typename std::vector<P>::const_iterator polyIt;
@@ -219,7 +180,7 @@ void APieLevel< V, P, C>::write(std::ostream &out, const PieCaps &caps) const
 		size_t nCnt = 0;
 
 		out << "NORMALS " << static_cast<int>(normals() / 3);
-		out << std::fixed;
+		out.setFixedNotation(true);
 		for (auto nIt = m_normals.begin(); nIt != m_normals.end(); ++nIt)
 		{
 			if (nCnt++ % 3 == 0)
@@ -228,7 +189,7 @@ void APieLevel< V, P, C>::write(std::ostream &out, const PieCaps &caps) const
 			if (nCnt % 3 != 0)
 				out << ' ';
 		}
-		out.unsetf(std::ios::floatfield);
+		out.setFixedNotation(false);
 		out << '\n';
 	}
 
@@ -313,14 +274,14 @@ bool APieLevel<V, P, C>::isValid() const
 }
 
 template <typename V>
-bool PieConnector<V>::read(std::istream& in)
+bool PieConnector<V>::read(TextScanner& in)
 {
-	in >> pos.x() >> pos.y() >> pos.z();
-	return in.good() || in.eof();
+	// a cut off last connector passes, as with streams
+	return in.read(pos) || in.atEnd();
 }
 
 template <typename V>
-void PieConnector<V>::write(std::ostream& out) const
+void PieConnector<V>::write(TextWriter& out) const
 {
 	out << pos.x() << ' ' << pos.y() << ' ' << pos.z() << '\n';
 }
@@ -374,17 +335,21 @@ inline bool APieModel<L>::isFeatureSet(unsigned feature) const
 	return (m_read_type & feature);
 }
 
-#define streamfail() do {\
-	clearAll();	\
-	in.clear();	\
-	in.seekg(start);	\
-	return false; } while(0)
-
-// TODO: Write error messages to std::cerr
+// The whole stream is read into memory and parsed like a mapped file
 template <typename L>
 bool APieModel<L>::read(std::istream& in)
 {
-	std::streampos start = in.tellg();
+	const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	return read(data.data(), data.size());
+}
+
+// Levels of files at least this big are parsed in parallel
+static const size_t PIE_PARALLEL_LEVELS_MIN_BYTES = 256 * 1024;
+
+template <typename L>
+bool APieModel<L>::read(const char* data, size_t size)
+{
+	TextScanner in(data, data + size);
 
 	clearAll();
 
@@ -393,50 +358,35 @@ bool APieModel<L>::read(std::istream& in)
 		return true;
 	}
 
-	// do error macro
-	streamfail();
+	clearAll();
+	return false;
 }
 
-#undef streamfail
-
 template <typename L>
-bool APieModel<L>::readHeaderBlock(std::istream& in)
+bool APieModel<L>::readHeaderBlock(TextScanner& in)
 {
-	std::string str;
 	unsigned uint;
 
 	// PIE %u
-	in >> str >> uint;
-	if ( in.fail() || str.compare(PIE_MODEL_SIGNATURE) != 0)
-	{
-		return false;
-	}
-
 	// TYPE %x
-	in >> str >> std::hex >> m_read_type >> std::dec;
-	if ( in.fail() || str.compare(PIE_MODEL_DIRECTIVE_TYPE) != 0)
-	{
-		return false;
-	}
-
-	return true;
+	return in.skipWord(PIE_MODEL_SIGNATURE) && in.read(uint)
+		&& in.skipWord(PIE_MODEL_DIRECTIVE_TYPE) && in.readHex(m_read_type);
 }
 
 template <typename L>
-bool APieModel<L>::readTexturesBlock(std::istream& in)
+bool APieModel<L>::readTexturesBlock(TextScanner& in)
 {
-    return readTextureDirective(in) && readNormalmapDirective(in) && readSpecmapDirective(in);
+	return readTextureDirective(in) && readNormalmapDirective(in) && readSpecmapDirective(in);
 }
 
 template <typename L>
-bool APieModel<L>::readTextureDirective(std::istream& in)
+bool APieModel<L>::readTextureDirective(TextScanner& in)
 {
-	std::string str;
 	unsigned uint;
 
 	// TEXTURE 0 %s %u %u
-	in >> str >> uint >> m_texture >> uint >> uint;
-	if ( in.fail() || str.compare(PIE_MODEL_DIRECTIVE_TEXTURE) != 0)
+	if (!in.skipWord(PIE_MODEL_DIRECTIVE_TEXTURE) || !in.read(uint) || !in.read(m_texture)
+		|| !in.read(uint) || !in.read(uint))
 	{
 		return false;
 	}
@@ -454,30 +404,28 @@ bool APieModel<L>::readTextureDirective(std::istream& in)
 	return true;
 }
 
-// Optional directive
+// Optional directive, like the stream version it fails when the next 3 words can't be one
 template <typename L>
-bool APieModel<L>::readNormalmapDirective(std::istream& in)
+bool APieModel<L>::readNormalmapDirective(TextScanner& in)
 {
-	std::string str;
+	TextScanner ahead(in);
+	const char* str;
+	size_t size;
 	unsigned uint;
-	std::streampos entrypoint = in.tellg();
 
 	// NORMALMAP 0 %s
-	in >> str >> uint >> m_texture_normalmap;
-	if ( in.fail())
+	if (!ahead.word(str, size) || !ahead.read(uint) || !ahead.read(m_texture_normalmap))
 	{
 		return false;
 	}
 
-	if (str.compare(PIE_MODEL_DIRECTIVE_NORMALMAP) != 0)
+	if (!in.skipWord(PIE_MODEL_DIRECTIVE_NORMALMAP))
 	{
 		m_texture_normalmap.clear();
-		in.seekg(entrypoint);
 		return true;
 	}
 
-	// no constraits for normalmap name afaik
-
+	in = ahead;
 	m_caps.set(PIE_OPT_DIRECTIVES::podNORMALMAP);
 
 	return true;
@@ -485,59 +433,46 @@ bool APieModel<L>::readNormalmapDirective(std::istream& in)
 
 // Optional directive
 template <typename L>
-bool APieModel<L>::readSpecmapDirective(std::istream& in)
+bool APieModel<L>::readSpecmapDirective(TextScanner& in)
 {
-	std::string str;
+	TextScanner ahead(in);
+	const char* str;
+	size_t size;
 	unsigned uint;
-	std::streampos entrypoint = in.tellg();
 
 	// <TYPE> 0 %s
-	in >> str >> uint >> m_texture_specmap;
-	if ( in.fail())
+	if (!ahead.word(str, size) || !ahead.read(uint) || !ahead.read(m_texture_specmap))
 	{
 		return false;
 	}
 
-	if (str.compare(PIE_MODEL_DIRECTIVE_SPECULARMAP) != 0)
+	if (!in.skipWord(PIE_MODEL_DIRECTIVE_SPECULARMAP))
 	{
 		m_texture_specmap.clear();
-		in.seekg(entrypoint);
 		return true;
 	}
 
-	// no constraits for name afaik
-
+	in = ahead;
 	m_caps.set(PIE_OPT_DIRECTIVES::podSPECULARMAP);
 
 	return true;
 }
 
-// Optional directive
+// Optional directive, false once there are no more
 template <typename L>
-bool APieModel<L>::readEventsDirective(std::istream& in)
+bool APieModel<L>::readEventsDirective(TextScanner& in)
 {
-	std::string str;
-	std::streampos entrypoint = in.tellg();
-
 	// EVENT type filename.pie
-	in >> str;
-	if (in.fail())
+	if (!in.skipWord(PIE_MODEL_DIRECTIVE_EVENT))
 	{
-		in.seekg(entrypoint);
-		return false;
-	}
-
-	if (str.compare(PIE_MODEL_DIRECTIVE_EVENT) != 0)
-	{
-		in.seekg(entrypoint);
-		// not really a fail, but will work for a "while"
 		return false;
 	}
 
 	int type;
+	std::string str;
 
-	in >> type >> str;
-	if (in.fail())
+	// a broken event leaves in failed, failing LEVELS next
+	if (!in.read(type) || !in.read(str))
 		return false;
 
 	m_events.emplace(type, str);
@@ -546,7 +481,7 @@ bool APieModel<L>::readEventsDirective(std::istream& in)
 }
 
 template <typename L>
-bool APieModel<L>::readLevelsBlock(std::istream& in)
+bool APieModel<L>::readLevelsBlock(TextScanner& in)
 {
 	// Optional sequence of event directives
 	while (readEventsDirective(in)) {}
@@ -556,36 +491,112 @@ bool APieModel<L>::readLevelsBlock(std::istream& in)
 	if (levels < 0)
 		return false;
 
-	if (!readLevels(levels, in))
-		return false;
+	if (levels > 1 && static_cast<size_t>(in.end() - in.position()) >= PIE_PARALLEL_LEVELS_MIN_BYTES
+		&& parallelThreads() > 1 && readLevelsInParallel(levels, in))
+	{
+		return true;
+	}
 
-	return true;
+	return readLevels(levels, in);
 }
 
 template <typename L>
-bool APieModel<L>::readLevels(int levels, std::istream& in)
+bool APieModel<L>::readLevels(int levels, TextScanner& in)
 {
+	m_levels.reserve(static_cast<size_t>(levels));
 	for (; levels > 0; --levels)
 	{
-		L lvl;
-		if (!lvl.read(in, m_caps))
+		m_levels.emplace_back();
+		if (!m_levels.back().read(in, m_caps))
 		{
 			return false;
 		}
-		m_levels.push_back(lvl);
 	}
 	return true;
 }
 
+/*
+  Finds where each LEVEL starts by looking at line starts only, then parses
+  the levels on several threads. Each one runs to the end of the buffer like
+  a sequential read would, and has to stop right where the next one was found.
+  Otherwise, e.g. for a LEVEL in the middle of a line, nothing is kept and
+  false sends the caller to the sequential read.
+  */
 template <typename L>
-int APieModel<L>::readLevelsDirective(std::istream& in)
+bool APieModel<L>::readLevelsInParallel(int levels, TextScanner& in)
+{
+	std::vector<const char*> starts;
+
+	starts.reserve(static_cast<size_t>(levels));
+	for (const char* line = in.position(); line; )
+	{
+		const char* word = line;
+		while (word != in.end() && (*word == ' ' || *word == '\t'))
+			++word;
+
+		if (in.end() - word >= 5 && std::memcmp(word, "LEVEL", 5) == 0
+			&& (in.end() - word == 5 || TextScanner::isSpace(word[5])))
+		{
+			if (starts.size() == static_cast<size_t>(levels))
+				return false;
+			starts.push_back(word);
+		}
+
+		line = static_cast<const char*>(std::memchr(word, '\n', static_cast<size_t>(in.end() - word)));
+		if (line)
+			++line;
+	}
+
+	TextScanner first(in);
+	if (starts.size() != static_cast<size_t>(levels) || first.atEnd() || first.position() != starts.front())
+		return false;
+
+	std::vector<L> parsed(starts.size());
+	std::vector<PieCaps> caps(parsed.size(), m_caps);
+	std::vector<char> ok(parsed.size(), 0);
+	TextScanner last(in);
+
+	parallelFor(0, parsed.size(), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			TextScanner level(starts[i], in.end());
+			ok[i] = parsed[i].read(level, caps[i]);
+
+			if (i + 1 == parsed.size())
+				last = level;
+			else if (level.atEnd() || level.position() != starts[i + 1])
+				ok[i] = false;
+		}
+	});
+
+	for (size_t i = 0; i < parsed.size(); ++i)
+	{
+		if (!ok[i])
+			return false;
+	}
+
+	for (size_t i = 0; i < parsed.size(); ++i)
+	{
+		for (int cap = 0; cap < static_cast<int>(PIE_OPT_DIRECTIVES::pod_MAXVAL); ++cap)
+		{
+			if (caps[i].test(static_cast<PIE_OPT_DIRECTIVES>(cap)))
+				m_caps.set(static_cast<PIE_OPT_DIRECTIVES>(cap));
+		}
+	}
+
+	m_levels = std::move(parsed);
+	in = last;
+	return true;
+}
+
+template <typename L>
+int APieModel<L>::readLevelsDirective(TextScanner& in)
 {
-	std::string str;
 	unsigned uint;
 
 	// LEVELS %u
-	in >> str >> uint;
-	if ( in.fail() || str.compare(PIE_MODEL_DIRECTIVE_LEVELS) != 0)
+	if (!in.skipWord(PIE_MODEL_DIRECTIVE_LEVELS) || !in.read(uint))
 	{
 		return -1;
 	}
@@ -600,10 +611,23 @@ void APieModel<L>::write(std::ostream& out, const PieCaps *piecaps) const
 	unsigned i = 1;
 
 	const PieCaps& caps(piecaps ? *piecaps : m_def_caps);
+	TextWriter writer(out);
+
+	writeHeader(writer, levels(), caps);
 
+	for (it = m_levels.begin(); it != m_levels.end(); ++it, ++i)
+	{
+		writeLevel(writer, i, *it, caps);
+	}
+}
+
+template <typename L>
+void APieModel<L>::writeHeader(TextWriter& out, size_t levels, const PieCaps& caps) const
+{
 	out << PIE_MODEL_SIGNATURE << " " << version() << '\n';
 
-	out << PIE_MODEL_DIRECTIVE_TYPE << " " << std::hex << getType() << std::dec << '\n';
+	out << PIE_MODEL_DIRECTIVE_TYPE << " ";
+	out.writeHex(getType()) << '\n';
 
 	out << PIE_MODEL_DIRECTIVE_TEXTURE << " 0 " << m_texture << ' '
 			<< textureWidth() << ' '
@@ -627,13 +651,14 @@ void APieModel<L>::write(std::ostream& out, const PieCaps *piecaps) const
 		}
 	}
 
-	out << PIE_MODEL_DIRECTIVE_LEVELS << " " << levels() << '\n';
+	out << PIE_MODEL_DIRECTIVE_LEVELS << " " << levels << '\n';
+}
 
-	for (it = m_levels.begin(); it != m_levels.end(); ++it, ++i)
-	{
-		out << "LEVEL " << i << '\n';
-		it->write(out, caps);
-	}
+template <typename L>
+void APieModel<L>::writeLevel(TextWriter& out, unsigned number, const L& level, const PieCaps& caps)
+{
+	out << "LEVEL " << number << '\n';
+	level.write(out, caps);
 }
 
 template <typename L>
@@ -0,0 +1,340 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "VertexCodec.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+	const double PI = 3.14159265358979323846;
+
+	inline GLfloat fromSnorm16(int value)
+	{
+		return std::max(-1.f, static_cast<GLfloat>(value) / 32767.f);
+	}
+
+	inline GLfloat signNotZero(GLfloat value)
+	{
+		return value < 0.f ? -1.f : 1.f;
+	}
+
+	// Cosine between a unit direction and an encoded one, in double as neighbours differ by less than a float ulp
+	double octCosine(const GLshort code[2], const double dir[3])
+	{
+		double x = std::max(-1., code[0] / 32767.), y = std::max(-1., code[1] / 32767.);
+		const double z = 1. - std::fabs(x) - std::fabs(y);
+
+		if (z < 0.)
+		{
+			const double unfoldedX = (1. - std::fabs(y)) * (x < 0. ? -1. : 1.);
+			y = (1. - std::fabs(x)) * (y < 0. ? -1. : 1.);
+			x = unfoldedX;
+		}
+
+		return (x * dir[0] + y * dir[1] + z * dir[2]) / std::sqrt(x * x + y * y + z * z);
+	}
+
+	// Angle between two directions, 0 if the first one has no length
+	double angleDeg(const GLfloat a[3], const GLfloat b[3])
+	{
+		const double lenA = std::sqrt(double(a[0]) * a[0] + double(a[1]) * a[1] + double(a[2]) * a[2]);
+		const double lenB = std::sqrt(double(b[0]) * b[0] + double(b[1]) * b[1] + double(b[2]) * b[2]);
+
+		if (lenA == 0. || lenB == 0.)
+			return 0.;
+
+		double cosine = (double(a[0]) * b[0] + double(a[1]) * b[1] + double(a[2]) * b[2]) / (lenA * lenB);
+		cosine = std::max(-1., std::min(1., cosine));
+		return std::acos(cosine) * 180. / PI;
+	}
+}
+
+GLushort floatToHalf(GLfloat value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	const GLushort sign = static_cast<GLushort>((bits >> 16) & 0x8000);
+	const uint32_t absBits = bits & 0x7FFFFFFF;
+
+	// inf and nan
+	if (absBits >= 0x7F800000)
+		return sign | 0x7C00 | (absBits > 0x7F800000 ? 0x200 : 0);
+
+	// 65520 and up round past the largest half
+	if (absBits >= 0x477FF000)
+		return sign | 0x7C00;
+
+	// below 2^-14, denormals
+	if (absBits < 0x38800000)
+		return sign | static_cast<GLushort>(std::lrint(std::fabs(value) * 16777216.f));
+
+	// rebias the exponent and round to nearest even
+	uint32_t half = (absBits - 0x38000000) >> 13;
+	const uint32_t rest = absBits & 0x1FFF;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+		++half;
+
+	return sign | static_cast<GLushort>(half);
+}
+
+GLfloat halfToFloat(GLushort value)
+{
+	const uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+	const uint32_t exponent = (value >> 10) & 0x1F;
+	const uint32_t mantissa = value & 0x3FF;
+	uint32_t bits;
+
+	if (exponent == 0)
+	{
+		const GLfloat result = std::ldexp(static_cast<GLfloat>(mantissa), -24);
+		return sign ? -result : result;
+	}
+
+	if (exponent == 31)
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	else
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+	GLfloat result;
+	std::memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+// yStep 2 keeps the lowest bit of out[1] clear
+static void octEncodeStep(const GLfloat dir[3], GLshort out[2], int yStep)
+{
+	const GLfloat length = std::fabs(dir[0]) + std::fabs(dir[1]) + std::fabs(dir[2]);
+
+	if (!(length > 0.f))
+	{
+		out[0] = out[1] = 0;
+		return;
+	}
+
+	GLfloat x = dir[0] / length, y = dir[1] / length;
+
+	// fold the lower hemisphere over the diagonals
+	if (dir[2] < 0.f)
+	{
+		const GLfloat foldedX = (1.f - std::fabs(y)) * signNotZero(x);
+		y = (1.f - std::fabs(x)) * signNotZero(y);
+		x = foldedX;
+	}
+
+	// nearest in oct space isn't always nearest on the sphere, try the 4 neighbours
+	const GLfloat scaledX = std::floor(std::max(-1.f, std::min(1.f, x)) * 32767.f);
+	const GLfloat scaledY = std::floor(std::max(-1.f, std::min(1.f, y)) * 32767.f / yStep) * yStep;
+	const GLfloat maxY = static_cast<GLfloat>(32768 - yStep);
+	const double norm = std::sqrt(double(dir[0]) * dir[0] + double(dir[1]) * dir[1] + double(dir[2]) * dir[2]);
+	const double unitDir[3] = {dir[0] / norm, dir[1] / norm, dir[2] / norm};
+	double best = -2.;
+
+	for (int k = 0; k < 4; ++k)
+	{
+		const GLshort candidate[2] = {
+			static_cast<GLshort>(std::min(32767.f, scaledX + (k & 1))),
+			static_cast<GLshort>(std::min(maxY, scaledY + (k >> 1) * yStep))
+		};
+		const double cosine = octCosine(candidate, unitDir);
+		if (cosine > best)
+		{
+			best = cosine;
+			out[0] = candidate[0];
+			out[1] = candidate[1];
+		}
+	}
+}
+
+void octEncode(const GLfloat dir[3], GLshort out[2])
+{
+	octEncodeStep(dir, out, 1);
+}
+
+void octDecode(const GLshort in[2], GLfloat dir[3])
+{
+	GLfloat x = fromSnorm16(in[0]), y = fromSnorm16(in[1]);
+	const GLfloat z = 1.f - std::fabs(x) - std::fabs(y);
+
+	if (z < 0.f)
+	{
+		const GLfloat unfoldedX = (1.f - std::fabs(y)) * signNotZero(x);
+		y = (1.f - std::fabs(x)) * signNotZero(y);
+		x = unfoldedX;
+	}
+
+	const GLfloat length = std::sqrt(x * x + y * y + z * z);
+	dir[0] = x / length;
+	dir[1] = y / length;
+	dir[2] = z / length;
+}
+
+CompactVertexArray::CompactVertexArray(): m_uvEncoding(WZM_UV_UNORM16)
+{
+}
+
+void CompactVertexArray::encode(const std::vector<WZMPackedVertex>& vertices)
+{
+	size_t i;
+
+	m_uvEncoding = WZM_UV_UNORM16;
+	for (i = 0; i < vertices.size(); ++i)
+	{
+		const GLfloat* uv = vertices[i].uv;
+
+		// also catches nan
+		if (!(uv[0] >= 0.f && uv[0] <= 1.f && uv[1] >= 0.f && uv[1] <= 1.f))
+		{
+			m_uvEncoding = WZM_UV_HALF;
+			break;
+		}
+	}
+
+	m_vertices.resize(vertices.size());
+	for (i = 0; i < vertices.size(); ++i)
+	{
+		const WZMPackedVertex& src = vertices[i];
+		WZMCompactVertex& dst = m_vertices[i];
+
+		std::copy(src.pos, src.pos + 3, dst.pos);
+
+		for (int k = 0; k < 2; ++k)
+		{
+			if (m_uvEncoding == WZM_UV_UNORM16)
+				dst.uv[k] = static_cast<GLushort>(std::lround(src.uv[k] * 65535.f));
+			else
+				dst.uv[k] = floatToHalf(src.uv[k]);
+		}
+
+		octEncode(src.normal, dst.normal);
+		// the lowest tangent bit holds the handedness
+		octEncodeStep(src.tangent, dst.tangent, 2);
+		dst.tangent[1] = static_cast<GLshort>(dst.tangent[1] | (src.tangent[3] < 0.f ? 1 : 0));
+	}
+}
+
+void CompactVertexArray::decode(std::vector<WZMPackedVertex>& vertices) const
+{
+	vertices.resize(m_vertices.size());
+	for (size_t i = 0; i < m_vertices.size(); ++i)
+	{
+		const WZMCompactVertex& src = m_vertices[i];
+		WZMPackedVertex& dst = vertices[i];
+
+		std::copy(src.pos, src.pos + 3, dst.pos);
+
+		for (int k = 0; k < 2; ++k)
+		{
+			if (m_uvEncoding == WZM_UV_UNORM16)
+				dst.uv[k] = static_cast<GLfloat>(src.uv[k]) / 65535.f;
+			else
+				dst.uv[k] = halfToFloat(src.uv[k]);
+		}
+
+		octDecode(src.normal, dst.normal);
+
+		const GLshort tangent[2] = {src.tangent[0], static_cast<GLshort>(src.tangent[1] & ~1)};
+		octDecode(tangent, dst.tangent);
+		dst.tangent[3] = (src.tangent[1] & 1) ? -1.f : 1.f;
+	}
+}
+
+void CompactVertexArray::assign(const std::vector<WZMCompactVertex>& vertices, WZMUVEncoding uvEncoding)
+{
+	m_vertices = vertices;
+	m_uvEncoding = uvEncoding;
+}
+
+void CompactVertexArray::assign(std::vector<WZMCompactVertex>&& vertices, WZMUVEncoding uvEncoding)
+{
+	m_vertices = std::move(vertices);
+	m_uvEncoding = uvEncoding;
+}
+
+bool CompactErrorStats::withinBounds() const
+{
+	const double uvBound = halfUVs ? WMIT_COMPACT_MAX_UV_ERROR_HALF : WMIT_COMPACT_MAX_UV_ERROR_UNORM16;
+
+	return position == 0. && uv <= uvBound && handedness == 0
+		&& normal <= WMIT_COMPACT_MAX_NORMAL_ERROR_DEG
+		&& tangent <= WMIT_COMPACT_MAX_TANGENT_ERROR_DEG;
+}
+
+CompactErrorStats& CompactErrorStats::operator += (const CompactErrorStats& rhs)
+{
+	vertices += rhs.vertices;
+	position = std::max(position, rhs.position);
+	uv = std::max(uv, rhs.uv);
+	normal = std::max(normal, rhs.normal);
+	tangent = std::max(tangent, rhs.tangent);
+	handedness += rhs.handedness;
+	halfUVs = halfUVs || rhs.halfUVs;
+	return *this;
+}
+
+CompactErrorStats measureCompactError(const std::vector<WZMPackedVertex>& vertices)
+{
+	CompactVertexArray compact;
+	std::vector<WZMPackedVertex> decoded;
+
+	compact.encode(vertices);
+	compact.decode(decoded);
+
+	return compareCompactError(vertices, decoded, compact.uvEncoding() == WZM_UV_HALF);
+}
+
+CompactErrorStats compareCompactError(const std::vector<WZMPackedVertex>& original,
+				      const std::vector<WZMPackedVertex>& decoded, bool halfUVs)
+{
+	CompactErrorStats stats;
+
+	stats.vertices = original.size();
+	stats.halfUVs = halfUVs;
+
+	for (size_t i = 0; i < original.size(); ++i)
+	{
+		const WZMPackedVertex& orig = original[i];
+		const WZMPackedVertex& dec = decoded[i];
+		int k;
+
+		for (k = 0; k < 3; ++k)
+			stats.position = std::max(stats.position, std::fabs(double(orig.pos[k]) - dec.pos[k]));
+
+		for (k = 0; k < 2; ++k)
+		{
+			double error = std::fabs(double(orig.uv[k]) - dec.uv[k]);
+			if (stats.halfUVs)
+				error /= std::max(1., std::fabs(double(orig.uv[k])));
+			stats.uv = std::max(stats.uv, error);
+		}
+
+		stats.normal = std::max(stats.normal, angleDeg(orig.normal, dec.normal));
+		stats.tangent = std::max(stats.tangent, angleDeg(orig.tangent, dec.tangent));
+
+		if ((orig.tangent[3] < 0.f) != (dec.tangent[3] < 0.f))
+			++stats.handedness;
+	}
+
+	return stats;
+}
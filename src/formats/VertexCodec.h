@@ -0,0 +1,117 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VERTEXCODEC_HPP
+#define VERTEXCODEC_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include <GL/glew.h>
+#include "VectorTypes.h"
+
+// Worst errors the compact encoding may introduce, checked by CompactErrorStats
+#define WMIT_COMPACT_MAX_NORMAL_ERROR_DEG 0.003 // oct encoded, 16 bits per axis
+#define WMIT_COMPACT_MAX_TANGENT_ERROR_DEG 0.005 // one bit less, it holds the handedness
+#define WMIT_COMPACT_MAX_UV_ERROR_UNORM16 (0.5 / 65535. + 1e-7)
+#define WMIT_COMPACT_MAX_UV_ERROR_HALF (1. / 2048.) // relative to max(1, |uv|)
+
+/*
+ * One vertex of the interleaved stream, everything a draw call reads in a single
+ * 48 byte block. The bitangent is left out, it follows from normal, tangent and w.
+ */
+struct alignas(16) WZMPackedVertex
+{
+	GLfloat pos[3];
+	GLfloat uv[2];
+	GLfloat normal[3];
+	GLfloat tangent[4];
+};
+static_assert(sizeof(WZMPackedVertex) == sizeof(GLfloat) * 12, "WZMPackedVertex has become fat.");
+
+enum WZMUVEncoding
+{
+	WZM_UV_UNORM16, // all uvs within [0, 1]
+	WZM_UV_HALF
+};
+
+/*
+ * 24 byte vertex: float position, 16-bit uvs and octahedral snorm16 normal and tangent.
+ * The tangent's w sign lives in the lowest bit of tangent[1].
+ */
+struct WZMCompactVertex
+{
+	GLfloat pos[3];
+	GLushort uv[2];
+	GLshort normal[2];
+	GLshort tangent[2];
+};
+static_assert(sizeof(WZMCompactVertex) == 24, "WZMCompactVertex has become fat.");
+
+GLushort floatToHalf(GLfloat value);
+GLfloat halfToFloat(GLushort value);
+
+/// Unit direction to octahedral snorm16, zero vectors give +z
+void octEncode(const GLfloat dir[3], GLshort out[2]);
+void octDecode(const GLshort in[2], GLfloat dir[3]);
+
+class CompactVertexArray
+{
+public:
+	CompactVertexArray();
+
+	void encode(const std::vector<WZMPackedVertex>& vertices);
+	void decode(std::vector<WZMPackedVertex>& vertices) const;
+
+	void assign(const std::vector<WZMCompactVertex>& vertices, WZMUVEncoding uvEncoding);
+	void assign(std::vector<WZMCompactVertex>&& vertices, WZMUVEncoding uvEncoding);
+
+	size_t size() const {return m_vertices.size();}
+	WZMUVEncoding uvEncoding() const {return m_uvEncoding;}
+	const std::vector<WZMCompactVertex>& vertices() const {return m_vertices;}
+
+private:
+	std::vector<WZMCompactVertex> m_vertices;
+	WZMUVEncoding m_uvEncoding;
+};
+
+struct CompactErrorStats
+{
+	CompactErrorStats(): vertices(0), position(0), uv(0), normal(0), tangent(0), handedness(0), halfUVs(false) {}
+
+	size_t vertices;
+	double position; // largest absolute error
+	double uv;
+	double normal, tangent; // largest angle in degrees
+	size_t handedness; // tangent w sign changes
+	bool halfUVs; // uv errors are relative then
+
+	bool withinBounds() const;
+
+	CompactErrorStats& operator += (const CompactErrorStats& rhs);
+};
+
+/// Round trips the vertices through the compact encoding and compares to the originals
+CompactErrorStats measureCompactError(const std::vector<WZMPackedVertex>& vertices);
+
+/// Compares decoded vertices to the originals they were encoded from, same count only
+CompactErrorStats compareCompactError(const std::vector<WZMPackedVertex>& original,
+				      const std::vector<WZMPackedVertex>& decoded, bool halfUVs);
+
+#endif // VERTEXCODEC_HPP
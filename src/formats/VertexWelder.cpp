@@ -0,0 +1,121 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "VertexWelder.h"
+
+#include <cmath>
+#include <limits>
+
+PointHash::PointHash(GLfloat eps)
+{
+	// same lower bound as Vector::equal_wEps
+	if (eps <= std::numeric_limits<GLfloat>::epsilon())
+		eps = std::numeric_limits<GLfloat>::epsilon();
+	m_invCellSize = 1. / (2. * eps);
+}
+
+void PointHash::clear()
+{
+	m_cells.clear();
+	m_entries.clear();
+}
+
+void PointHash::reserve(size_t size)
+{
+	m_cells.reserve(size);
+	m_entries.reserve(size);
+}
+
+int64_t PointHash::cellCoord(GLfloat val, int& nearSide) const
+{
+	double scaled = val * m_invCellSize;
+
+	// keep huge (or NaN) values representable, they just share the outer cells
+	if (!(std::abs(scaled) < 1e18))
+		scaled = scaled < 0 ? -1e18 : 1e18;
+
+	const double cell = std::floor(scaled);
+
+	// neighbour on the side of the closer cell border
+	nearSide = (scaled - cell) < 0.5 ? -1 : 1;
+	return static_cast<int64_t>(cell);
+}
+
+void PointHash::insert(const Vertex<GLfloat>& pos, unsigned index)
+{
+	int side;
+	const Cell cell = {cellCoord(pos.x(), side), cellCoord(pos.y(), side), cellCoord(pos.z(), side)};
+
+	Entry entry = {index, NO_ENTRY};
+	auto inResult = m_cells.insert(std::make_pair(cell, static_cast<unsigned>(m_entries.size())));
+	if (!inResult.second)
+	{
+		entry.next = inResult.first->second;
+		inResult.first->second = static_cast<unsigned>(m_entries.size());
+	}
+	m_entries.push_back(entry);
+}
+
+VertexWelder::VertexWelder(const WeldTolerances& tolerances):
+	m_hash(tolerances.position),
+	m_posEq(tolerances.position),
+	m_uvEq(tolerances.uv),
+	m_nrmEq(tolerances.normal)
+{
+}
+
+void VertexWelder::clear()
+{
+	m_hash.clear();
+	m_positions.clear();
+	m_uvs.clear();
+	m_normals.clear();
+}
+
+void VertexWelder::reserve(size_t size)
+{
+	m_hash.reserve(size);
+	m_positions.reserve(size);
+	m_uvs.reserve(size);
+	m_normals.reserve(size);
+}
+
+unsigned VertexWelder::weld(const Vertex<GLfloat>& pos, const UV<GLclampf>& uv, const Vertex<GLfloat>& nrm,
+			    bool& inserted)
+{
+	unsigned index = 0;
+
+	inserted = !m_hash.find(pos, [&](unsigned candidate)
+		{
+			return m_posEq(m_positions[candidate], pos) &&
+				m_uvEq(m_uvs[candidate], uv) &&
+				m_nrmEq(m_normals[candidate], nrm);
+		}, index);
+
+	if (inserted)
+	{
+		index = static_cast<unsigned>(m_positions.size());
+		m_hash.insert(pos, index);
+		m_positions.push_back(pos);
+		m_uvs.push_back(uv);
+		m_normals.push_back(nrm);
+	}
+
+	return index;
+}
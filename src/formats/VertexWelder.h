@@ -0,0 +1,156 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VERTEXWELDER_HPP
+#define VERTEXWELDER_HPP
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+#include <GL/glew.h>
+#include "VectorTypes.h"
+
+#define WMIT_WELD_DEFAULT_EPS 0.0001f
+
+struct WeldTolerances
+{
+	WeldTolerances(GLfloat posEps = WMIT_WELD_DEFAULT_EPS,
+		       GLfloat uvEps = WMIT_WELD_DEFAULT_EPS,
+		       GLfloat nrmEps = WMIT_WELD_DEFAULT_EPS):
+		position(posEps), uv(uvEps), normal(nrmEps) {}
+
+	GLfloat position, uv, normal;
+};
+
+/*
+ * Buckets point indices on a uniform grid with a cell size of twice the
+ * tolerance, so that any point within tolerance of a query (per component)
+ * lives in one of the 8 cells closest to it.
+ * Matching is left to the caller, which gets to see all candidates.
+ */
+class PointHash
+{
+public:
+	PointHash(GLfloat eps = WMIT_WELD_DEFAULT_EPS);
+
+	void clear();
+	void reserve(size_t size);
+
+	void insert(const Vertex<GLfloat>& pos, unsigned index);
+
+	/// Returns the lowest index accepted by isSame among the candidates near pos
+	template <typename F>
+	bool find(const Vertex<GLfloat>& pos, F isSame, unsigned& index) const;
+
+private:
+	struct Cell
+	{
+		int64_t x, y, z;
+		bool operator == (const Cell& rhs) const
+		{
+			return x == rhs.x && y == rhs.y && z == rhs.z;
+		}
+	};
+
+	struct CellHash
+	{
+		size_t operator() (const Cell& cell) const
+		{
+			uint64_t h = static_cast<uint64_t>(cell.x) * 0x9E3779B97F4A7C15ULL;
+			h ^= static_cast<uint64_t>(cell.y) * 0xC2B2AE3D27D4EB4FULL;
+			h ^= static_cast<uint64_t>(cell.z) * 0x165667B19E3779F9ULL;
+			return static_cast<size_t>(h ^ (h >> 29));
+		}
+	};
+
+	struct Entry
+	{
+		unsigned index;
+		unsigned next;
+	};
+
+	static const unsigned NO_ENTRY = ~0u;
+
+	int64_t cellCoord(GLfloat val, int& nearSide) const;
+
+	std::unordered_map<Cell, unsigned, CellHash> m_cells;
+	std::vector<Entry> m_entries;
+	double m_invCellSize;
+};
+
+/*
+ * Epsilon aware welder for (position, uv, normal) triplets,
+ * the expected O(1) replacement for a std::set with an epsilon comparator.
+ */
+class VertexWelder
+{
+public:
+	VertexWelder(const WeldTolerances& tolerances = WeldTolerances());
+
+	void clear();
+	void reserve(size_t size);
+	size_t points() const {return m_positions.size();}
+
+	/// Returns the index of an equivalent point, or adds a new one at index points()
+	unsigned weld(const Vertex<GLfloat>& pos, const UV<GLclampf>& uv, const Vertex<GLfloat>& nrm,
+		      bool& inserted);
+
+private:
+	PointHash m_hash;
+	Vertex<GLfloat>::equal_wEps m_posEq;
+	UV<GLclampf>::equal_wEps m_uvEq;
+	Vertex<GLfloat>::equal_wEps m_nrmEq;
+
+	std::vector<Vertex<GLfloat> > m_positions;
+	std::vector<UV<GLclampf> > m_uvs;
+	std::vector<Vertex<GLfloat> > m_normals;
+};
+
+template <typename F>
+bool PointHash::find(const Vertex<GLfloat>& pos, F isSame, unsigned& index) const
+{
+	int side[3];
+	const Cell base = {cellCoord(pos.x(), side[0]), cellCoord(pos.y(), side[1]), cellCoord(pos.z(), side[2])};
+	bool found = false;
+
+	for (int i = 0; i < 8; ++i)
+	{
+		const Cell cell = {base.x + ((i & 1) ? side[0] : 0),
+				   base.y + ((i & 2) ? side[1] : 0),
+				   base.z + ((i & 4) ? side[2] : 0)};
+
+		auto it = m_cells.find(cell);
+		if (it == m_cells.end())
+			continue;
+
+		for (unsigned e = it->second; e != NO_ENTRY; e = m_entries[e].next)
+		{
+			const unsigned candidate = m_entries[e].index;
+			if ((!found || candidate < index) && isSame(candidate))
+			{
+				index = candidate;
+				found = true;
+			}
+		}
+	}
+	return found;
+}
+
+#endif // VERTEXWELDER_HPP
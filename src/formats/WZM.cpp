@@ -24,15 +24,21 @@
 #include <map>
 #include <set>
 #include <list>
+#include <utility>
 
 #include <cmath>
+#include <cstring>
 
 #include <sstream>
 
 #include "Generic.h"
+#include "GLTF.h"
+#include "Parallel.h"
 #include "Util.h"
 #include "Pie.h"
+#include "TextScanner.h"
 #include "Vector.h"
+#include "VectorTypesIO.h"
 
 #include "OBJ.h"
 
@@ -56,16 +62,15 @@ bool WZMaterial::isDefault() const
 	return false;
 }
 
-std::istream& operator>> (std::istream& in, WZMaterial& mat)
+bool readMaterial(TextScanner& in, WZMaterial& mat)
 {
-    if (!mat.m_skipemissive)
-        in >> mat.vals[WZM_MAT_EMISSIVE];
-    in >> mat.vals[WZM_MAT_AMBIENT] >> mat.vals[WZM_MAT_DIFFUSE] >> mat.vals[WZM_MAT_SPECULAR];
-	in >> mat.shininess;
-	return in;
+	if (!mat.m_skipemissive && !in.read(mat.vals[WZM_MAT_EMISSIVE]))
+		return false;
+	return in.read(mat.vals[WZM_MAT_AMBIENT]) && in.read(mat.vals[WZM_MAT_DIFFUSE])
+		&& in.read(mat.vals[WZM_MAT_SPECULAR]) && in.read(mat.shininess);
 }
 
-std::ostream& operator<< (std::ostream& out, const WZMaterial& mat)
+TextWriter& operator<< (TextWriter& out, const WZMaterial& mat)
 {
     if (!mat.m_skipemissive)
         out << mat.vals[WZM_MAT_EMISSIVE];
@@ -81,7 +86,6 @@ WZM::WZM()
 WZM::WZM(const Pie3Model &p3)
 {
 	std::vector<Pie3Level>::const_iterator it;
-	std::stringstream ss;
 
 	setTextureName(WZM_TEX_DIFFUSE, p3.m_texture);
 	setTextureName(WZM_TEX_NORMALMAP, p3.m_texture_normalmap);
@@ -93,21 +97,66 @@ WZM::WZM(const Pie3Model &p3)
 
 	m_events = p3.m_events;
 
+	m_meshes.reserve(p3.levels());
 	for (it = p3.m_levels.begin(); it != p3.m_levels.end(); ++it)
 	{
-		m_meshes.push_back(*it);
+		m_meshes.emplace_back(*it);
+		setupPieMesh();
+	}
+}
+
+WZM::WZM(Pie3Model&& p3)
+{
+	setTextureName(WZM_TEX_DIFFUSE, p3.m_texture);
+	setTextureName(WZM_TEX_NORMALMAP, p3.m_texture_normalmap);
+	setTextureName(WZM_TEX_TCMASK, p3.m_texture_tcmask);
+	setTextureName(WZM_TEX_SPECULAR, p3.m_texture_specmap);
+
+	if (p3.levels() > 0)
+		m_material = p3.m_levels.begin()->m_material;
 
-		// name
-		ss << m_meshes.size();
-		m_meshes.back().setName(ss.str());
-		ss.str(std::string());
+	m_events = std::move(p3.m_events);
 
-		// per-mesh team colors
-		m_meshes.back().setTeamColours(isTextureSet(WZM_TEX_TCMASK));
+	// peak memory is one level, not the whole pie, above the finished meshes
+	m_meshes.reserve(p3.levels());
+	for (Pie3Level& level: p3.m_levels)
+	{
+		m_meshes.emplace_back(level);
+		setupPieMesh();
+		level = Pie3Level();
 	}
+	p3.m_levels.clear();
+}
+
+void WZM::setupPieMesh()
+{
+	std::stringstream ss;
+
+	// name
+	ss << m_meshes.size();
+	m_meshes.back().setName(ss.str());
+
+	// per-mesh team colors
+	m_meshes.back().setTeamColours(isTextureSet(WZM_TEX_TCMASK));
 }
 
 WZM::operator Pie3Model() const
+{
+	return toPie3Model(WZMMatrix4(), -1);
+}
+
+Pie3Model WZM::toPie3Model(const WZMMatrix4& transform, int mesh) const
+{
+	Pie3Model p3 = pieHeader();
+
+	p3.m_levels.reserve(m_meshes.size());
+	for (size_t i = 0; i < m_meshes.size(); ++i)
+		p3.m_levels.push_back(pieLevel(static_cast<int>(i), transform, mesh));
+
+	return p3;
+}
+
+Pie3Model WZM::pieHeader() const
 {
 	Pie3Model p3;
 
@@ -118,127 +167,122 @@ WZM::operator Pie3Model() const
 
 	p3.m_events = m_events;
 
-	std::transform(m_meshes.begin(), m_meshes.end(),
-				   back_inserter(p3.m_levels), Mesh::backConvert);
+	return p3;
+}
 
-	for (auto iter = p3.m_levels.begin(); iter != p3.m_levels.end(); iter++)
-		iter->m_material = m_material;
+Pie3Level WZM::pieLevel(int index, const WZMMatrix4& transform, int mesh) const
+{
+	const Mesh& source = m_meshes[static_cast<size_t>(index)];
+	Pie3Level level = MeshTransformView(source, mesh < 0 || mesh == index ? transform : WZMMatrix4());
 
-	return p3;
+	level.m_material = m_material;
+	return level;
 }
 
+// The whole stream is read into memory and parsed like a mapped file
 bool WZM::read(std::istream& in)
 {
+	const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	return read(data.data(), data.size());
+}
+
+bool WZM::read(const char* data, size_t size)
+{
+	TextScanner in(data, data + size);
 	std::string str;
-	int i,meshes;
+	int i, meshes, fileVersion;
 
 	clear();
-	in >> str;
-	if (in.fail() || str.compare(WZM_MODEL_SIGNATURE) != 0)
+	if (!in.read(str) || str.compare(WZM_MODEL_SIGNATURE) != 0)
 	{
 		std::cerr << "WZM::read - Missing header";
 		return false;
 	}
 
-	in >> i;
-	if (in.fail())
+	if (!in.read(fileVersion))
 	{
 		std::cerr << "WZM::read - Error reading WZM version";
 		return false;
 	}
-	else if(i != WZM_MODEL_VERSION_FD)
+	else if(fileVersion != WZM_MODEL_VERSION_FD && fileVersion != WZM_MODEL_VERSION_COMPACT)
 	{
-		std::cerr << "WZM::read - Unsupported WZM version " << i;
+		std::cerr << "WZM::read - Unsupported WZM version " << fileVersion;
 		return false;
 	}
 
 	// TEXTURE %s
-	in >> str;
+	in.read(str);
 	if (str.compare(WZM_MODEL_DIRECTIVE_TEXTURE) != 0)
 	{
 		std::cerr << "WZM::read - Expected " << WZM_MODEL_DIRECTIVE_TEXTURE << " directive but got" << str;
 		return false;
 	}
-	in >> m_textures[WZM_TEX_DIFFUSE];
-	if (in.fail())
+	if (!in.read(m_textures[WZM_TEX_DIFFUSE]))
 	{
 		std::cerr << "WZM::read - Error reading texture name";
 		return false;
 	}
 
 	// read next token
-	in >> str;
+	in.read(str);
 
 	// optional: team color mask
 	if (!str.compare(WZM_MODEL_DIRECTIVE_TCMASK))
 	{
-		in >> m_textures[WZM_TEX_TCMASK];
-		if (in.fail())
+		if (!in.read(m_textures[WZM_TEX_TCMASK]))
 		{
 			std::cerr << "WZM::read - Error reading TCMask name";
 			return false;
 		}
-
-		// pre read next token
-		in >> str;
+		in.read(str);
 	}
 
 	// optional: normalmap
 	if (!str.compare(WZM_MODEL_DIRECTIVE_NORMALMAP))
 	{
-		in >> m_textures[WZM_TEX_NORMALMAP];
-		if (in.fail())
+		if (!in.read(m_textures[WZM_TEX_NORMALMAP]))
 		{
 			std::cerr << "WZM::read - Error reading NORMALMAP name";
 			return false;
 		}
-
-		// pre read next token
-		in >> str;
+		in.read(str);
 	}
 
 	// optional: specularmap
 	if (!str.compare(WZM_MODEL_DIRECTIVE_SPECULARMAP))
 	{
-		in >> m_textures[WZM_TEX_SPECULAR];
-		if (in.fail())
+		if (!in.read(m_textures[WZM_TEX_SPECULAR]))
 		{
 			std::cerr << "WZM::read - Error reading SPECULARMAP name";
 			return false;
 		}
-
-		// pre read next token
-		in >> str;
+		in.read(str);
 	}
 
 	// optional: material
 	if (!str.compare(WZM_MODEL_DIRECTIVE_MATERIAL))
 	{
-		in >> m_material;
-		if (in.fail())
+		if (!readMaterial(in, m_material))
 		{
 			std::cerr << "WZM::read - Error reading material values";
 			return false;
 		}
-
-		// pre read next token
-		in >> str;
+		in.read(str);
 	}
 
 	// token was pre read here
 	// MESHES %u
-	in >> meshes;
-	if (in.fail() || str.compare("MESHES") != 0)
+	if (!in.read(meshes) || str.compare("MESHES") != 0)
 	{
 		std::cerr << "WZM::read - Expected MESHES directive but got " << str;
 		return false;
 	}
 
-	m_meshes.resize(static_cast<size_t>(meshes));
-	for(size_t i = 0; i < static_cast<size_t>(meshes); ++i)
+	// grown one mesh at a time, a made up count fails at the first missing mesh
+	for (i = 0; i < meshes; ++i)
 	{
-		Mesh& mesh = m_meshes[i];
-		if (!mesh.read(in))
+		m_meshes.emplace_back();
+		if (!m_meshes.back().read(in, fileVersion == WZM_MODEL_VERSION_COMPACT))
 		{
 			std::cerr << "WZM::read - Error reading mesh " << meshes + 1;
 			return false;
@@ -247,11 +291,17 @@ bool WZM::read(std::istream& in)
 	return true;
 }
 
-void WZM::write(std::ostream& out) const
+void WZM::write(std::ostream& out, bool compactVertices) const
 {
-	std::vector<Mesh>::const_iterator it;
+	write(out, compactVertices, WZMMatrix4(), -1);
+}
+
+void WZM::write(std::ostream& stream, bool compactVertices, const WZMMatrix4& transform, int mesh) const
+{
+	TextWriter out(stream);
 
-	out << "WZM " << version() << '\n';
+	// version 3 readers don't know compact vertices
+	out << "WZM " << (compactVertices ? WZM_MODEL_VERSION_COMPACT : version()) << '\n';
 
 	// TEXTURE
 	if (isTextureSet(WZM_TEX_DIFFUSE))
@@ -290,294 +340,722 @@ void WZM::write(std::ostream& out) const
 
 	// MESHES
 	out << WZM_MODEL_DIRECTIVE_MESHES << " " << meshes() << '\n';
-	for (it = m_meshes.begin(); it != m_meshes.end(); ++it)
+	for (int i = 0; i < meshes(); ++i)
 	{
-		it->write(out);
+		const Mesh& source = m_meshes[static_cast<size_t>(i)];
+
+		// bounds and compact encoding need the moved vertices, only one copy lives at a time
+		if ((mesh < 0 || mesh == i) && !transform.isIdentity())
+		{
+			Mesh moved(source);
+			moved.applyAffine(transform);
+			moved.write(out, compactVertices);
+		}
+		else
+		{
+			source.write(out, compactVertices);
+		}
 	}
 }
 
+static_assert(WZM_TEX__LAST == WZMB_TEXTURES, "WZMBHeader holds a name per texture type.");
+
+bool WZM::readBinary(const char* data, size_t size)
+{
+	const WZMBReader file(data, size);
+	WZMBHeader header;
+	WZMBTrailer trailer;
+
+	clear();
+	if (!isWZMB(data, size) || size < sizeof(WZMBHeader) + sizeof(WZMBTrailer))
+	{
+		std::cerr << "WZM::readBinary - Missing header";
+		return false;
+	}
+
+	std::memcpy(&header, data, sizeof(header));
+	std::memcpy(&trailer, data + size - sizeof(trailer), sizeof(trailer));
+
+	if (header.version != WZMB_VERSION || header.flags != 0)
+	{
+		std::cerr << "WZM::readBinary - Unsupported WZMB version " << header.version;
+		return false;
+	}
+
+	if (!wzmbHostSupported())
+	{
+		std::cerr << "WZM::readBinary - WZMB files are little endian only";
+		return false;
+	}
+
+	for (int type = WZM_TEX__FIRST; type < WZM_TEX__LAST; ++type)
+	{
+		const char* name = file.block(header.textures[type]);
+		if (!name)
+		{
+			std::cerr << "WZM::readBinary - Error reading texture name";
+			return false;
+		}
+		if (header.textures[type].size)
+			m_textures[static_cast<wzm_texture_type_t>(type)].assign(name, header.textures[type].size);
+	}
+
+	if (header.hasMaterial)
+	{
+		for (int i = WZM_MAT__FIRST; i < WZM_MAT__LAST; ++i)
+			m_material.vals[i] = WZMVertex(header.material[i * 3], header.material[i * 3 + 1], header.material[i * 3 + 2]);
+		m_material.shininess = header.material[12];
+	}
+
+	const char* table = file.block(trailer.table, static_cast<uint64_t>(trailer.meshes) * sizeof(WZMBMesh));
+	if (!table || std::memcmp(trailer.signature, WZMB_SIGNATURE, 4) != 0)
+	{
+		std::cerr << "WZM::readBinary - Error reading mesh table";
+		return false;
+	}
+
+	m_meshes.resize(trailer.meshes);
+	for (size_t i = 0; i < m_meshes.size(); ++i)
+	{
+		WZMBMesh entry;
+		std::memcpy(&entry, table + i * sizeof(entry), sizeof(entry));
+		if (!m_meshes[i].readBinary(file, entry))
+		{
+			std::cerr << "WZM::readBinary - Error reading mesh " << i + 1;
+			m_meshes.clear();
+			return false;
+		}
+	}
+	return true;
+}
+
+void WZM::writeBinary(std::ostream& out, WZMBEncoding encoding) const
+{
+	writeBinary(out, encoding, WZMMatrix4(), -1);
+}
+
+void WZM::writeBinary(std::ostream& out, WZMBEncoding encoding, const WZMMatrix4& transform, int mesh) const
+{
+	WZMBWriter writer(out);
+	WZMBHeader header;
+	WZMBTrailer trailer;
+	std::vector<std::string> textures(WZM_TEX__LAST);
+	std::vector<WZMBMesh> table;
+
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.signature, WZMB_SIGNATURE, 4);
+	header.version = WZMB_VERSION;
+
+	// the diffuse texture is always there, as in text files
+	for (int type = WZM_TEX__FIRST; type < WZM_TEX__LAST; ++type)
+		textures[type] = getTextureName(static_cast<wzm_texture_type_t>(type));
+	if (textures[WZM_TEX_DIFFUSE].empty())
+		textures[WZM_TEX_DIFFUSE] = "notexture.set";
+
+	header.hasMaterial = !m_material.isDefault();
+	for (int i = WZM_MAT__FIRST; i < WZM_MAT__LAST; ++i)
+	{
+		for (size_t k = 0; k < 3; ++k)
+			header.material[i * 3 + k] = m_material.vals[i][k];
+	}
+	header.material[12] = m_material.shininess;
+
+	// names follow the header, where the writer will put them
+	uint64_t offset = sizeof(header);
+	for (int type = WZM_TEX__FIRST; type < WZM_TEX__LAST; ++type)
+	{
+		offset = WZMBWriter::align(offset);
+		header.textures[type].offset = offset;
+		header.textures[type].size = textures[type].size();
+		offset += textures[type].size();
+	}
+
+	writer.writeRaw(&header, sizeof(header));
+	for (int type = WZM_TEX__FIRST; type < WZM_TEX__LAST; ++type)
+		writer.write(textures[type].data(), textures[type].size());
+
+	table.reserve(m_meshes.size());
+	for (int i = 0; i < meshes(); ++i)
+	{
+		const Mesh& source = m_meshes[static_cast<size_t>(i)];
+
+		if ((mesh < 0 || mesh == i) && !transform.isIdentity())
+		{
+			Mesh moved(source);
+			moved.applyAffine(transform);
+			table.push_back(moved.writeBinary(writer, encoding));
+		}
+		else
+		{
+			table.push_back(source.writeBinary(writer, encoding));
+		}
+	}
+
+	std::memset(&trailer, 0, sizeof(trailer));
+	trailer.table = writer.write(table.data(), table.size() * sizeof(WZMBMesh));
+	trailer.meshes = static_cast<uint32_t>(table.size());
+	std::memcpy(trailer.signature, WZMB_SIGNATURE, 4);
+	writer.writeRaw(&trailer, sizeof(trailer));
+}
+
 /*
  * This function does the parsing,
  * we'll let class Mesh do the WZM'izing
  */
-bool WZM::importFromOBJ(std::istream& in, bool welder)
+bool WZM::importFromOBJ(std::istream& in, bool welder, const WeldTolerances& tolerances)
 {
-	const bool invertV = true;
-	std::vector<OBJVertex> vertArray, normArray;
-	std::vector<OBJUV> uvArray;
-	std::vector<OBJTri> groupedFaces;
-
-	std::string name("Default"); //Default name of default obj group is default
-	std::vector<std::string> vertices, indices;
-	std::vector<std::string>::iterator itVStr;
-	std::string str;
-	std::stringstream ss;
+	const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
 
-	// Only give warnings once
-	bool warnLine = false, warnPoint = false;
-
-	// More temporaries
-	OBJTri tri;
-	OBJVertex vert;
-	OBJUV uv;
+	return importFromOBJ(data.data(), data.size(), welder, tolerances);
+}
 
-	unsigned i, pos;
+bool WZM::importFromOBJ(const char* data, size_t size, bool welder, const WeldTolerances& tolerances)
+{
+	const bool invertV = true;
+	OBJFile obj;
+	std::string name("Default"); //Default name of default obj group is default
 
 	clear();
 
-	/*	Build "global" vertex and
-	 *	texture coordinate arrays.
-	 *	Also figure out the mesh/group boundaries
-	 */
-
 	/* Note: This program tolerates imperfect .obj files
 	 * because it accepts any whitespace as a space.
 	 */
+	if (!readOBJ(data, size, obj))
+	{
+		return false;
+	}
 
-	while (!(in.eof()|| in.fail()))
+	// Only give warnings once
+	if (obj.lines)
+	{
+		std::cout << "WZM::importFromOBJ - Warning! Lines are not supported and will be ignored!";
+	}
+	if (obj.points)
 	{
-		std::getline(in, str);
-		ss.str(str);
-		ss.seekg(0);
-		ss.clear();
+		std::cout << "Model::importFromOBJ - Warning! Points are not supported and will be ignored!";
+	}
 
-		if (str.empty() || ss.fail())
+	if (invertV)
+	{
+		for (OBJUV& uv: obj.uvs)
 		{
-			continue;
+			uv.v() = 1 - uv.v();
 		}
+	}
+
+	// Names first, those made up count the meshes before
+	std::vector<const OBJObject*> groups;
+	std::vector<std::string> names;
 
-		switch(ss.get())
+	for (std::vector<OBJObject>::const_iterator it = obj.objects.begin(); it != obj.objects.end(); ++it)
+	{
+		// an o line without a name keeps the previous one
+		if (it != obj.objects.begin())
 		{
-		case '#':
-			// ignore comments
-			continue;
-		case 'v':
-			switch(ss.get())
+			if (!it->name.empty())
 			{
-			case 't':
-				ss >> uv.u() >> uv.v();
-				if (ss.fail())
-				{
-					return false;
-				}
-				else if (invertV)
-				{
-					uv.v() = 1 - uv.v();
-				}
-				uvArray.push_back(uv);
-				break;
-			case 'n':	// normals
-				ss >> vert.x() >> vert.y() >> vert.z();
-				if (ss.fail())
-				{
-					return false;
-				}
-				normArray.push_back(vert);
-				break;
-			case 'p':	// and parameter vertices
-				break;
-			default:
-				ss >> vert.x() >> vert.y() >> vert.z();
-				if (ss.fail())
-				{
-					return false;
-				}
-				vertArray.push_back(vert);
+				name = it->name;
 			}
-			break;
-		case 'f':
-			vertices = split(str);
-			if (vertices.size() < 2 + 1)
+			if (!isValidWzName(name))
 			{
-				 /* Should never happen, faces will have >= 3+1 tokens
-				  * ( more than 3 vertices + the "f" directive)
-				  */
-				break;
+				name = std::to_string(groups.size());
 			}
+		}
 
-			itVStr = vertices.begin();
-			++itVStr; // Advance to first vertex
+		if (!it->faces.empty())
+		{
+			groups.push_back(&*it);
+			names.push_back(name);
+		}
+	}
 
-			for (i = 0; itVStr != vertices.end(); ++itVStr, ++i)
-			{
-				if (i <= 2)
-				{
-					pos = i;
-				}
-				else
-				{
-					tri.uvs.operator [](1) = tri.uvs.operator [](2);
-					tri.tri.operator [](1) = tri.tri.operator [](2);
-					pos = 2;
-				}
+	// then the meshes concurrently, in file order
+	m_meshes.resize(groups.size());
+	parallelForEach(0, groups.size(), [&](size_t i)
+	{
+		Mesh& mesh = m_meshes[i];
+		mesh.importFromOBJ(groups[i]->faces, obj.vertices, obj.uvs, obj.normals, welder, tolerances);
+		mesh.mirrorFromPoint(WZMVertex(), 0);
+		mesh.reverseWinding();
+		mesh.setTeamColours(false);
+		mesh.setName(names[i]);
+	});
+	return true;
+}
 
-				indices = split(*itVStr, '/');
+void WZM::exportToOBJ(std::ostream &out) const
+{
+	exportToOBJ(out, WZMMatrix4(), -1);
+}
 
-				ss.str(indices[0]), ss.clear(), ss.seekg(0);
+void WZM::exportToOBJ(std::ostream& stream, const WZMMatrix4& transform, int mesh) const
+{
+	TextWriter out(stream);
+	OBJExportPools pools;
+	std::vector<std::vector<OBJPointRef> > meshRefs(m_meshes.size());
 
-				ss >> tri.tri.operator [](pos);
+	std::vector<OBJVertex>::const_iterator itVert;
+	std::vector<OBJUV>::const_iterator itUV;
+	std::vector<OBJVertex>::const_iterator itNorm;
+	size_t i;
 
-				if (indices.size() >= 2 && !indices[1].empty())
-				{
-					ss.str(indices[1]), ss.clear(), ss.seekg(0);
-					ss >> tri.uvs.operator [](pos);
-				}
-				else
-				{
-					tri.uvs.operator [](pos) = -1;
-					tri.nrm.operator [](pos) = -1;
-				}
+	if (!getTextureName(WZM_TEX_DIFFUSE).empty())
+	{
+		out << "mtllib " << getTextureName(WZM_TEX_DIFFUSE) << ".mtl\nusemtl " << getTextureName(WZM_TEX_DIFFUSE) << "\n\n";
+	}
 
-				if (indices.size() == 3 && !indices[2].empty())
-				{
-					ss.str(indices[2]), ss.clear(), ss.seekg(0);
-					ss >> tri.nrm.operator [](pos);
-				}
-				else
-				{
-					tri.nrm.operator [](pos) = -1;
-				}
+	// The shared pools are written first, faces are streamed afterwards
+	for (i = 0; i < m_meshes.size(); ++i)
+	{
+		const bool moved = mesh < 0 || static_cast<size_t>(mesh) == i;
+		MeshTransformView(m_meshes[i], moved ? transform : WZMMatrix4()).addToOBJPools(pools, meshRefs[i]);
+	}
+
+	out << "# " << pools.vertices.size() << " vertices\n";
+	for (itVert = pools.vertices.begin(); itVert != pools.vertices.end(); ++itVert)
+	{
+		writeOBJVertex(*itVert, out);
+	}
 
-				if (i >= 2)
+	out << '\n';
+
+	out << "# " << pools.uvs.size() << " texture coords\n";
+	for (itUV = pools.uvs.begin(); itUV != pools.uvs.end(); ++itUV)
+	{
+		writeOBJUV(*itUV, out);
+	}
+
+	out << '\n';
+
+	out << "# " << pools.normals.size() << " vertex normals\n";
+	for (itNorm = pools.normals.begin(); itNorm != pools.normals.end(); ++itNorm)
+	{
+		writeOBJNormal(*itNorm, out);
+	}
+
+	for (i = 0; i < m_meshes.size(); ++i)
+	{
+		const bool moved = mesh < 0 || static_cast<size_t>(mesh) == i;
+		out << "\n";
+		MeshTransformView(m_meshes[i], moved ? transform : WZMMatrix4()).writeOBJFaces(out, meshRefs[i]);
+	}
+}
+
+namespace
+{
+	// A primitive to convert and how to get it into WZM space
+	struct GLTFPrimitiveJob
+	{
+		const JsonValue* primitive;
+		const JsonValue* extras; // of the node
+		WZMMatrix4 transform;
+		std::string name;
+		GLTFNodeAnimation animation; // no frames if not animated
+	};
+
+	// Depth first in file order, each mesh node baking the transforms above it
+	void collectGLTFNodes(const GLBFile& file, size_t index, const WZMMatrix4& parent, std::vector<bool>& visited,
+			      std::vector<GLTFPrimitiveJob>& jobs, bool& skipped)
+	{
+		static const WZMMatrix4 mirror = WZMMatrix4::scaling(-1.f, 1.f, 1.f);
+		const JsonValue& nodes = file.json()["nodes"];
+		const JsonValue& node = nodes[index];
+		const WZMMatrix4 world = parent * gltfNodeMatrix(node);
+		const JsonValue& children = node["children"];
+		size_t meshIndex;
+
+		if (visited[index])
+			return;
+		visited[index] = true;
+
+		if (gltfIndex(node["mesh"], meshIndex, file.json()["meshes"].size()))
+		{
+			const JsonValue& mesh = file.json()["meshes"][meshIndex];
+			const JsonValue& primitives = mesh["primitives"];
+			GLTFPrimitiveJob job;
+
+			// animated nodes get their own transform from the frames
+			job.extras = &node["extras"];
+			job.name = node.has("name") ? node["name"].string() : mesh["name"].string();
+			job.transform = file.nodeAnimation(index, job.animation) ? mirror * parent : mirror * world;
+
+			for (size_t i = 0; i < primitives.size(); ++i)
+			{
+				if (primitives[i]["mode"].number(GLTF_TRIANGLES) != GLTF_TRIANGLES)
 				{
-					groupedFaces.push_back(tri);
+					skipped = true;
+					continue;
 				}
+				job.primitive = &primitives[i];
+				jobs.push_back(job);
 			}
-			break;
-		case 'l':
-			// Ignore lines and give one warning to the user
-			if (!warnLine)
-			{
-				std::cout << "WZM::importFromOBJ - Warning! Lines are not supported and will be ignored!";
-				warnLine = true;
-			}
-			break;
-		case 'p':
-			// Ignore points and give one warning to the user
-			if (!warnPoint)
-			{
-				std::cout << "Model::importFromOBJ - Warning! Points are not supported and will be ignored!";
-				warnPoint = true;
-			}
-			break;
-		case 'o':
-			if (!groupedFaces.empty())
-			{
-				m_meshes.push_back(Mesh());
-				Mesh& mesh = m_meshes.back();
-				mesh.importFromOBJ(groupedFaces, vertArray, uvArray, normArray, welder);
-				mesh.mirrorFromPoint(WZMVertex(), 0);
-				mesh.reverseWinding();
-				mesh.setTeamColours(false);
-				mesh.setName(name);
-				groupedFaces.clear();
-			}
-			ss >> name;
-			if (!isValidWzName(name))
-			{
-				ss.str(std::string()), ss.clear(), ss.seekg(0);
-				ss << m_meshes.size();
-				ss >> name;
-			}
-			break;
+		}
+
+		for (size_t i = 0; i < children.size(); ++i)
+		{
+			size_t child;
+			if (gltfIndex(children[i], child, nodes.size()))
+				collectGLTFNodes(file, child, world, visited, jobs, skipped);
 		}
 	}
-	if (!groupedFaces.empty())
+
+	// Name of the image a material's texture info points to
+	std::string gltfTextureName(const JsonValue& json, const JsonValue& textureInfo)
 	{
-		m_meshes.push_back(Mesh());
-		Mesh& mesh = m_meshes.back();
-		mesh.importFromOBJ(groupedFaces, vertArray, uvArray, normArray, welder);
-		mesh.mirrorFromPoint(WZMVertex(), 0);
-		mesh.reverseWinding();
-		mesh.setTeamColours(false);
-		mesh.setName(name);
+		size_t texture, image;
+
+		if (!gltfIndex(textureInfo["index"], texture, json["textures"].size())
+			|| !gltfIndex(json["textures"][texture]["source"], image, json["images"].size()))
+		{
+			return std::string();
+		}
+		const JsonValue& source = json["images"][image];
+		return source.has("uri") ? source["uri"].string() : source["name"].string();
 	}
-	return true;
 }
 
-void WZM::exportToOBJ(std::ostream &out) const
+bool WZM::importFromGLTF(const char* data, size_t size)
 {
-	std::list<std::stringstream*> objectBuffers;
+	GLBFile file;
+	std::vector<GLTFPrimitiveJob> jobs;
+	bool skipped = false;
 
-	Mesh_exportToOBJ_InOutParams params;
-
-	OBJVertex::less_wEps vertCompare;
-	std::set<OBJVertex, OBJVertex::less_wEps> vertSet(vertCompare);
-	std::vector<OBJVertex> vertices;
-	std::vector<unsigned> vertMapping;
-
-	params.vertices = &vertices;
-	params.vertSet = &vertSet;
-	params.vertMapping = &vertMapping;
+	clear();
 
-	OBJUV::less_wEps uvCompare;
-	std::set<OBJUV, OBJUV::less_wEps> uvSet(uvCompare);
-	std::vector<OBJUV> uvs;
-	std::vector<unsigned> uvMapping;
+	if (!file.read(data, size))
+	{
+		return false;
+	}
 
-	params.uvs = &uvs;
-	params.uvSet = &uvSet;
-	params.uvMapping = &uvMapping;
+	const JsonValue& json = file.json();
+	if (json["extensionsRequired"].size())
+	{
+		std::cerr << "WZM::importFromGLTF - Unsupported extension " << json["extensionsRequired"][0].string();
+		return false;
+	}
 
-	OBJVertex::less_wEps normCompare;
-	std::set<OBJVertex, OBJVertex::less_wEps> normSet(normCompare);
-	std::vector<OBJVertex> normals;
-	std::vector<unsigned> normMapping;
+	// the default scene, or the first
+	size_t sceneIndex = 0;
+	const JsonValue& nodes = json["nodes"];
+	std::vector<bool> visited(nodes.size());
 
-	params.normals = &normals;
-	params.normSet = &normSet;
-	params.normMapping = &normMapping;
+	gltfIndex(json["scene"], sceneIndex, json["scenes"].size());
+	const JsonValue& roots = json["scenes"][sceneIndex]["nodes"];
+	for (size_t i = 0; i < roots.size(); ++i)
+	{
+		size_t root;
+		if (gltfIndex(roots[i], root, nodes.size()))
+			collectGLTFNodes(file, root, WZMMatrix4(), visited, jobs, skipped);
+	}
 
-	std::vector<Mesh>::const_iterator itM;
-	std::vector<OBJVertex>::iterator itVert;
-	std::vector<OBJUV>::iterator	itUV;
-	std::vector<OBJVertex>::iterator itNorm;
-	std::stringstream* pSSS;
+	if (skipped)
+	{
+		std::cout << "WZM::importFromGLTF - Warning! Lines and points are not supported and will be ignored!";
+	}
 
-	if (!getTextureName(WZM_TEX_DIFFUSE).empty())
+	for (size_t i = 0; i < jobs.size(); ++i)
 	{
-		out << "mtllib " << getTextureName(WZM_TEX_DIFFUSE) << ".mtl\nusemtl " << getTextureName(WZM_TEX_DIFFUSE) << "\n\n";
+		if (jobs[i].name.empty() || !isValidWzName(jobs[i].name))
+		{
+			jobs[i].name = std::to_string(i);
+		}
 	}
 
-	for (itM = m_meshes.begin(); itM != m_meshes.end(); ++itM)
+	// Textures of the first material, specular and tcmask are no glTF maps
+	for (const GLTFPrimitiveJob& job: jobs)
 	{
-		Mesh expMesh(*itM);
-		expMesh.mirrorFromPoint(WZMVertex(), 0);
-		expMesh.reverseWinding();
+		size_t materialIndex;
+		if (!gltfIndex((*job.primitive)["material"], materialIndex, json["materials"].size()))
+			continue;
 
-		objectBuffers.push_back(expMesh.exportToOBJ(params));
+		const JsonValue& material = json["materials"][materialIndex];
+		const std::string diffuse = gltfTextureName(json, material["pbrMetallicRoughness"]["baseColorTexture"]);
+		const std::string normalmap = gltfTextureName(json, material["normalTexture"]);
+
+		if (!diffuse.empty())
+			setTextureName(WZM_TEX_DIFFUSE, diffuse);
+		if (!normalmap.empty())
+			setTextureName(WZM_TEX_NORMALMAP, normalmap);
+		if (material["extras"]["tcmask"].isString())
+			setTextureName(WZM_TEX_TCMASK, material["extras"]["tcmask"].string());
+		if (material["extras"]["specular"].isString())
+			setTextureName(WZM_TEX_SPECULAR, material["extras"]["specular"].string());
+		break;
 	}
 
-	out << "# " << vertices.size() << " vertices\n";
-	for (itVert = vertices.begin(); itVert != vertices.end(); ++itVert)
+	// then the meshes concurrently, in file order
+	std::vector<char> read(jobs.size());
+	m_meshes.resize(jobs.size());
+	parallelForEach(0, jobs.size(), [&](size_t i)
 	{
-		writeOBJVertex(*itVert, out);
+		const GLTFPrimitiveJob& job = jobs[i];
+		const JsonValue& extras = *job.extras;
+		const JsonValue& connectors = extras["connectors"];
+		Mesh& mesh = m_meshes[i];
+
+		read[i] = mesh.importFromGLTF(file, *job.primitive);
+		if (!read[i])
+			return;
+
+		for (size_t k = 0; k < connectors.size(); ++k)
+		{
+			const JsonValue& pos = connectors[k];
+			mesh.addConnector(WZMConnector(pos[0].number(), pos[1].number(), pos[2].number()));
+		}
+
+		// mirrors into WZM space, which reverses the winding
+		mesh.applyAffine(job.transform);
+
+		if (!job.animation.frames.empty())
+		{
+			const WZMMatrix4 inverse = affineInverse(job.transform);
+			std::vector<Frame> frames;
+
+			frames.reserve(job.animation.frames.size());
+			for (const WZMMatrix4& frame: job.animation.frames)
+				frames.push_back(matrixFrame(job.transform * frame * inverse));
+			mesh.setFrames(frames, job.animation.frameTime, static_cast<int>(extras["frameCycles"].number()));
+		}
+
+		mesh.setTeamColours(extras["teamColours"].boolean(false));
+		mesh.setName(job.name);
+	});
+
+	for (size_t i = 0; i < jobs.size(); ++i)
+	{
+		if (!read[i])
+		{
+			std::cerr << "WZM::importFromGLTF - Error reading mesh " << i + 1;
+			m_meshes.clear();
+			return false;
+		}
 	}
+	return true;
+}
 
-	out << '\n';
+void WZM::exportToGLTF(std::ostream& out) const
+{
+	exportToGLTF(out, WZMMatrix4(), -1);
+}
 
-	out << "# " << uvs.size() << " texture coords\n";
-	for (itUV = uvs.begin(); itUV != uvs.end(); ++itUV)
+void WZM::exportToGLTF(std::ostream& out, const WZMMatrix4& transform, int mesh) const
+{
+	const WZMMatrix4 mirror = WZMMatrix4::scaling(-1.f, 1.f, 1.f);
+	GLBWriter writer;
+	JsonValue& json = writer.json();
+	JsonValue nodes = JsonValue::array(), gltfMeshes = JsonValue::array(), roots = JsonValue::array();
+	JsonValue channels = JsonValue::array(), samplers = JsonValue::array();
+
+	// One material with the textures set, as images next to the model
+	JsonValue material = JsonValue::object(), materialExtras = JsonValue::object();
+	JsonValue images = JsonValue::array(), textures = JsonValue::array();
+	auto addTexture = [&](wzm_texture_type_t type)
 	{
-		writeOBJUV(*itUV, out);
+		JsonValue image = JsonValue::object(), texture = JsonValue::object(), info = JsonValue::object();
+		image.set("uri", getTextureName(type));
+		texture.set("source", images.size());
+		info.set("index", textures.size());
+		images.append(image);
+		textures.append(texture);
+		return info;
+	};
+
+	if (isTextureSet(WZM_TEX_DIFFUSE))
+	{
+		JsonValue& pbr = material.member("pbrMetallicRoughness", JsonValue::object());
+		pbr.set("baseColorTexture", addTexture(WZM_TEX_DIFFUSE));
+		pbr.set("metallicFactor", 0);
 	}
+	if (isTextureSet(WZM_TEX_NORMALMAP))
+		material.set("normalTexture", addTexture(WZM_TEX_NORMALMAP));
+	if (isTextureSet(WZM_TEX_TCMASK))
+		materialExtras.set("tcmask", getTextureName(WZM_TEX_TCMASK));
+	if (isTextureSet(WZM_TEX_SPECULAR))
+		materialExtras.set("specular", getTextureName(WZM_TEX_SPECULAR));
+	if (materialExtras.size())
+		material.set("extras", materialExtras);
 
-	out << '\n';
+	for (int i = 0; i < meshes(); ++i)
+	{
+		const Mesh& source = m_meshes[static_cast<size_t>(i)];
+		const WZMMatrix4 moved = mesh < 0 || mesh == i ? transform : WZMMatrix4();
+		const WZMMatrix4 toGLTF = mirror * moved;
+		const MeshTransformView view(source, toGLTF);
+
+		// glTF has no empty accessors
+		if (!view.vertices() || !view.triangles())
+			continue;
+
+		std::vector<WZMVertex> positions(view.vertices()), normals(view.vertices());
+		std::vector<WZMVertex4> tangents(view.vertices());
+		std::vector<WZMUV> uvs(view.vertices());
+		WZMVertex low, high;
+		IndexArray indices;
+
+		for (size_t v = 0; v < view.vertices(); ++v)
+		{
+			positions[v] = view.position(v);
+			normals[v] = view.normal(v);
+			tangents[v] = view.tangent(v);
+			uvs[v] = view.uv(v);
+		}
+
+		low = high = positions[0];
+		for (const WZMVertex& pos: positions)
+		{
+			for (size_t k = 0; k < 3; ++k)
+			{
+				low[k] = std::min(low[k], pos[k]);
+				high[k] = std::max(high[k], pos[k]);
+			}
+		}
+
+		// reversed, as the mirror reflects
+		indices.reserve(view.triangles());
+		for (size_t t = 0; t < view.triangles(); ++t)
+			indices.push_back(view.triangle(t));
+
+		JsonValue min = JsonValue::array(), max = JsonValue::array();
+		for (size_t k = 0; k < 3; ++k)
+		{
+			min.append(low[k]);
+			max.append(high[k]);
+		}
+
+		JsonValue attributes = JsonValue::object(), primitive = JsonValue::object(), gltfMesh = JsonValue::object();
+		attributes.set("POSITION", writer.addAccessor(positions.data(), positions.size(), GLTF_FLOAT, "VEC3",
+							     GLTF_ARRAY_BUFFER, min, max));
+		attributes.set("NORMAL", writer.addAccessor(normals.data(), normals.size(), GLTF_FLOAT, "VEC3", GLTF_ARRAY_BUFFER));
+		attributes.set("TANGENT", writer.addAccessor(tangents.data(), tangents.size(), GLTF_FLOAT, "VEC4", GLTF_ARRAY_BUFFER));
+		attributes.set("TEXCOORD_0", writer.addAccessor(uvs.data(), uvs.size(), GLTF_FLOAT, "VEC2", GLTF_ARRAY_BUFFER));
+		primitive.set("attributes", attributes);
+		primitive.set("indices", writer.addAccessor(indices.data(), indices.size() * 3,
+							    indices.isWide() ? GLTF_UNSIGNED_INT : GLTF_UNSIGNED_SHORT, "SCALAR",
+							    GLTF_ELEMENT_ARRAY_BUFFER));
+		primitive.set("mode", GLTF_TRIANGLES);
+		if (material.size())
+			primitive.set("material", 0);
+		gltfMesh.set("name", source.getName());
+		gltfMesh.member("primitives").append(primitive);
+
+		// What glTF has no place for goes to the node's extras
+		JsonValue node = JsonValue::object(), extras = JsonValue::object();
+		node.set("name", source.getName());
+		node.set("mesh", gltfMeshes.size());
+		if (source.teamColours())
+			extras.set("teamColours", JsonValue::fromBool(true));
+		if (source.connectors())
+		{
+			JsonValue& connectors = extras.member("connectors", JsonValue::array());
+			for (size_t c = 0; c < source.connectors(); ++c)
+			{
+				const WZMVertex pos = toGLTF.transformPoint(source.getConnector(static_cast<int>(c)).getPos());
+				JsonValue& connector = connectors.append(JsonValue::array());
+				for (size_t k = 0; k < 3; ++k)
+					connector.append(pos[k]);
+			}
+		}
+
+		// Frames as the node's transform, held until the next one. They move as applyAffine moves them
+		if (source.frames())
+		{
+			const std::vector<Frame>& frames = source.getFrames();
+			const int frameTime = std::max(source.frameTime(), 1);
+			std::vector<GLfloat> times(frames.size()), trs[3];
+
+			trs[0].resize(frames.size() * 3);
+			trs[1].resize(frames.size() * 4);
+			trs[2].resize(frames.size() * 3);
+			for (size_t f = 0; f < frames.size(); ++f)
+			{
+				Frame frame = frames[f];
+				frame.trans = moved.transformDirection(frame.trans);
+				times[f] = static_cast<GLfloat>(f * frameTime / 1000.);
+				gltfDecompose(mirror * frameMatrix(frame) * mirror, &trs[0][f * 3], &trs[1][f * 4], &trs[2][f * 3]);
+			}
 
-	out << "# " << normals.size() << " vertex normals\n";
-	for (itNorm = normals.begin(); itNorm != normals.end(); ++itNorm)
+			JsonValue timeMin = JsonValue::array(), timeMax = JsonValue::array();
+			timeMin.append(times.front());
+			timeMax.append(times.back());
+			const size_t input = writer.addAccessor(times.data(), times.size(), GLTF_FLOAT, "SCALAR", 0, timeMin, timeMax);
+
+			static const char* const paths[3] = {"translation", "rotation", "scale"};
+			for (size_t p = 0; p < 3; ++p)
+			{
+				JsonValue sampler = JsonValue::object(), channel = JsonValue::object(), target = JsonValue::object();
+				sampler.set("input", input);
+				sampler.set("output", writer.addAccessor(trs[p].data(), frames.size(), GLTF_FLOAT, p == 1 ? "VEC4" : "VEC3"));
+				sampler.set("interpolation", "STEP");
+				target.set("node", nodes.size());
+				target.set("path", paths[p]);
+				channel.set("sampler", samplers.size());
+				channel.set("target", target);
+				samplers.append(sampler);
+				channels.append(channel);
+			}
+			extras.set("frameCycles", source.frameCycles());
+		}
+
+		if (extras.size())
+			node.set("extras", extras);
+		roots.append(nodes.size());
+		nodes.append(node);
+		gltfMeshes.append(gltfMesh);
+	}
+
+	JsonValue scene = JsonValue::object();
+	scene.set("nodes", roots);
+	json.set("scene", 0);
+	json.member("scenes", JsonValue::array()).append(scene);
+	json.set("nodes", nodes);
+	json.set("meshes", gltfMeshes);
+	if (material.size())
 	{
-		writeOBJNormal(*itNorm, out);
+		json.member("materials", JsonValue::array()).append(material);
+		if (textures.size())
+		{
+			json.set("textures", textures);
+			json.set("images", images);
+		}
+	}
+	if (channels.size())
+	{
+		JsonValue animation = JsonValue::object();
+		animation.set("channels", channels);
+		animation.set("samplers", samplers);
+		json.member("animations", JsonValue::array()).append(animation);
 	}
 
-	while (!objectBuffers.empty())
+	writer.write(out);
+}
+
+void WZM::exportToPIE(std::ostream& out, int pieVersion, const PieCaps* piecaps) const
+{
+	exportToPIE(out, pieVersion, piecaps, WZMMatrix4(), -1);
+}
+
+void WZM::exportToPIE(std::ostream& stream, int pieVersion, const PieCaps* piecaps, const WZMMatrix4& transform, int mesh) const
+{
+	TextWriter out(stream);
+	const Pie3Model header = pieHeader();
+
+	// Levels are converted and written one at a time, no model copy is built
+	if (pieVersion == 2)
 	{
-		pSSS = objectBuffers.front();
-		objectBuffers.pop_front();
+		const PieCaps& caps = piecaps ? *piecaps : PIE2_CAPS;
+		const Pie2Model p2Header = header;
 
-		out << "\n" << pSSS->str();
+		p2Header.writeHeader(out, m_meshes.size(), caps);
+		for (int i = 0; i < meshes(); ++i)
+			Pie2Model::writeLevel(out, i + 1, pieLevel(i, transform, mesh), caps);
+	}
+	else
+	{
+		const PieCaps& caps = piecaps ? *piecaps : PIE3_CAPS;
 
-		delete pSSS;
+		header.writeHeader(out, m_meshes.size(), caps);
+		for (int i = 0; i < meshes(); ++i)
+			Pie3Model::writeLevel(out, i + 1, pieLevel(i, transform, mesh), caps);
 	}
 }
 
@@ -717,6 +1195,7 @@ void WZM::clear()
 	m_textures.clear();
 	m_material.setDefaults();
 	m_events.clear();
+	m_lods.clear();
 }
 
 void WZM::scale(GLfloat x, GLfloat y, GLfloat z, int mesh)
@@ -822,6 +1301,21 @@ void WZM::flipNormals(int mesh)
 	}
 }
 
+void WZM::applyAffine(const WZMMatrix4& transform, int mesh)
+{
+	// All or a single mesh
+	if (mesh < 0)
+	{
+		for (auto it = m_meshes.begin(); it != m_meshes.end(); ++it)
+			it->applyAffine(transform);
+	}
+	else
+	{
+		if (m_meshes.size() > static_cast<size_t>(mesh))
+			m_meshes[static_cast<size_t>(mesh)].applyAffine(transform);
+	}
+}
+
 void WZM::center(int mesh, int axis)
 {
 	// All or a single mesh
@@ -867,6 +1361,148 @@ void WZM::recalculateTB(int mesh)
 	}
 }
 
+VertexCacheStats WZM::vertexCacheStats(int mesh) const
+{
+	VertexCacheStats stats;
+
+	// All or a single mesh
+	if (mesh < 0)
+	{
+		for (const auto& curMesh: m_meshes)
+			stats += curMesh.vertexCacheStats();
+	}
+	else
+	{
+		if (m_meshes.size() > static_cast<size_t>(mesh))
+			stats = m_meshes[static_cast<size_t>(mesh)].vertexCacheStats();
+	}
+	return stats;
+}
+
+void WZM::optimizeVertexCache(int mesh)
+{
+	// All or a single mesh
+	if (mesh < 0)
+	{
+		for (auto& curMesh: m_meshes)
+			curMesh.optimizeVertexCache();
+	}
+	else
+	{
+		if (m_meshes.size() > static_cast<size_t>(mesh))
+			m_meshes[static_cast<size_t>(mesh)].optimizeVertexCache();
+	}
+}
+
+OverdrawStats WZM::overdrawStats(int mesh) const
+{
+	OverdrawStats stats;
+
+	// All or a single mesh
+	if (mesh < 0)
+	{
+		for (const auto& curMesh: m_meshes)
+			stats += curMesh.overdrawStats();
+	}
+	else
+	{
+		if (m_meshes.size() > static_cast<size_t>(mesh))
+			stats = m_meshes[static_cast<size_t>(mesh)].overdrawStats();
+	}
+	return stats;
+}
+
+void WZM::optimizeOverdraw(float threshold, int mesh)
+{
+	// All or a single mesh
+	if (mesh < 0)
+	{
+		for (auto& curMesh: m_meshes)
+			curMesh.optimizeOverdraw(threshold);
+	}
+	else
+	{
+		if (m_meshes.size() > static_cast<size_t>(mesh))
+			m_meshes[static_cast<size_t>(mesh)].optimizeOverdraw(threshold);
+	}
+}
+
+void WZM::optimizeVertexFetch(int mesh)
+{
+	// All or a single mesh
+	if (mesh < 0)
+	{
+		for (auto& curMesh: m_meshes)
+			curMesh.optimizeVertexFetch();
+	}
+	else
+	{
+		if (m_meshes.size() > static_cast<size_t>(mesh))
+			m_meshes[static_cast<size_t>(mesh)].optimizeVertexFetch();
+	}
+}
+
+CompactErrorStats WZM::compactErrorStats(int mesh) const
+{
+	CompactErrorStats stats;
+
+	// All or a single mesh
+	if (mesh < 0)
+	{
+		for (const auto& curMesh: m_meshes)
+			stats += curMesh.compactErrorStats();
+	}
+	else
+	{
+		if (m_meshes.size() > static_cast<size_t>(mesh))
+			stats = m_meshes[static_cast<size_t>(mesh)].compactErrorStats();
+	}
+	return stats;
+}
+
+void WZM::buildLODs(const std::vector<float>& ratios, const LODOptimizations& optimizations)
+{
+	m_lods.clear();
+	m_lods.reserve(ratios.size());
+
+	for (float ratio: ratios)
+	{
+		m_lods.push_back(simplifiedModel(ratio));
+		WZM& lod = m_lods.back();
+
+		// clusters are cut from the cache optimized order, the fetch order follows the final one
+		if (optimizations.vertexCache)
+			lod.optimizeVertexCache();
+		if (optimizations.overdraw)
+			lod.optimizeOverdraw(optimizations.overdrawThreshold);
+		if (optimizations.vertexFetch)
+			lod.optimizeVertexFetch();
+	}
+}
+
+WZM WZM::simplifiedModel(float ratio) const
+{
+	WZM model;
+
+	model.m_meshes.reserve(m_meshes.size());
+	for (const Mesh& mesh: m_meshes)
+		model.m_meshes.push_back(mesh.simplified(ratio));
+
+	model.m_textures = m_textures;
+	model.m_material = m_material;
+	model.m_events = m_events;
+	return model;
+}
+
+size_t WZM::triangles() const
+{
+	size_t count = 0;
+
+	for (const Mesh& mesh: m_meshes)
+		count += mesh.indices();
+	return count;
+}
+
 WZMVertex WZM::calculateCenterPoint() const
 {
 	WZMVertex center, meshcenter;
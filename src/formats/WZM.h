@@ -28,6 +28,7 @@
 
 #define WZM_MODEL_SIGNATURE "WZM"
 #define WZM_MODEL_VERSION_FD 3 // First draft version
+#define WZM_MODEL_VERSION_COMPACT 4 // meshes may have a COMPACTVERTEXARRAY instead
 
 #define WZM_MODEL_DIRECTIVE_TEXTURE "TEXTURE"
 #define WZM_MODEL_DIRECTIVE_TCMASK "TCMASK"
@@ -38,6 +39,11 @@
 #define WZM_MODEL_DIRECTIVE_MESHES "MESHES"
 
 class Pie3Model;
+class Pie3Level;
+class TextScanner;
+enum class PIE_OPT_DIRECTIVES;
+template <typename T> class EnumClassBitset;
+typedef EnumClassBitset<PIE_OPT_DIRECTIVES> PieCaps;
 
 enum wzm_texture_type_t {WZM_TEX_DIFFUSE = 0, WZM_TEX_TCMASK, WZM_TEX_NORMALMAP, WZM_TEX_SPECULAR,
 			 WZM_TEX__LAST, WZM_TEX__FIRST = WZM_TEX_DIFFUSE};
@@ -58,6 +64,8 @@ struct WZMaterial
         setDefaults();
     }
 
+    WZMaterial(const WZMaterial& rhs) = default;
+
     const WZMaterial& operator=(const WZMaterial& rhs)
     {
         for (int i = WZM_MAT__FIRST; i < WZM_MAT__LAST; ++i)
@@ -68,8 +76,8 @@ struct WZMaterial
 	void setDefaults();
 	bool isDefault() const;
 };
-std::istream& operator>> (std::istream& in, WZMaterial& mat);
-std::ostream& operator<< (std::ostream& out, const WZMaterial& mat);
+bool readMaterial(TextScanner& in, WZMaterial& mat);
+TextWriter& operator<< (TextWriter& out, const WZMaterial& mat);
 
 const static size_t MAX_CONNECTOR_COLORS = 10;
 const static WZMVertex CONNECTOR_COLORS[MAX_CONNECTOR_COLORS] = {
@@ -85,20 +93,61 @@ const static WZMVertex CONNECTOR_COLORS[MAX_CONNECTOR_COLORS] = {
 	WZMVertex(1.f, 0.1f, 1.f),
 };
 
+// What WZM::buildLODs runs on every level, in the order the command line runs it on the model
+struct LODOptimizations
+{
+	LODOptimizations(): vertexCache(false), overdraw(false), vertexFetch(false),
+		overdrawThreshold(WMIT_OVERDRAW_DEFAULT_THRESHOLD) {}
+
+	bool vertexCache, overdraw, vertexFetch;
+	float overdrawThreshold;
+};
+
 class WZM
 {
 public:
 	WZM();
 	WZM(const Pie3Model& p3);
+	WZM(Pie3Model&& p3); // releases each level once its mesh is built
 	virtual ~WZM() {clear();}
 
+	WZM(const WZM& rhs) = default;
+	WZM(WZM&& rhs) = default;
+	WZM& operator=(const WZM& rhs) = default;
+	WZM& operator=(WZM&& rhs) = default;
+
 	virtual operator Pie3Model() const;
 
 	virtual bool read(std::istream& in);
-	virtual void write(std::ostream& out) const;
-
-	virtual bool importFromOBJ(std::istream& in, bool welder);
+	// The stream overload reads it all into memory and calls this
+	bool read(const char* data, size_t size);
+	virtual void write(std::ostream& out, bool compactVertices = false) const;
+
+	// Binary .wzmb, see WZMBinary.h
+	bool readBinary(const char* data, size_t size);
+	virtual void writeBinary(std::ostream& out, WZMBEncoding encoding = WZMB_ENCODING_FLOATS) const;
+
+	virtual bool importFromOBJ(std::istream& in, bool welder,
+				   const WeldTolerances& tolerances = WeldTolerances());
+	bool importFromOBJ(const char* data, size_t size, bool welder,
+			   const WeldTolerances& tolerances = WeldTolerances());
 	virtual void exportToOBJ(std::ostream& out) const;
+	// glTF binary (.glb), see GLTF.h
+	bool importFromGLTF(const char* data, size_t size);
+	virtual void exportToGLTF(std::ostream& out) const;
+	virtual void exportToPIE(std::ostream& out, int pieVersion = 3, const PieCaps* piecaps = nullptr) const;
+
+	// Exports with transform applied on the fly to all meshes or a single one,
+	// WZM output copies one mesh at a time, the others copy nothing
+	void write(std::ostream& out, bool compactVertices, const WZMMatrix4& transform, int mesh) const;
+	void writeBinary(std::ostream& out, WZMBEncoding encoding, const WZMMatrix4& transform, int mesh) const;
+	void exportToOBJ(std::ostream& out, const WZMMatrix4& transform, int mesh) const;
+	void exportToGLTF(std::ostream& out, const WZMMatrix4& transform, int mesh) const;
+	void exportToPIE(std::ostream& out, int pieVersion, const PieCaps* piecaps, const WZMMatrix4& transform, int mesh) const;
+
+	Pie3Model toPie3Model(const WZMMatrix4& transform, int mesh) const;
+	Pie3Model pieHeader() const; // textures and events, no levels
+	Pie3Level pieLevel(int index, const WZMMatrix4& transform, int mesh) const;
 
 	virtual int version() const;
 	virtual int meshes() const;
@@ -126,16 +175,38 @@ public:
 	virtual void reverseWinding(int mesh = -1);
 	virtual void flipNormals(int mesh = -1);
 	virtual void center(int mesh, int axis);
+	virtual void applyAffine(const WZMMatrix4& transform, int mesh = -1);
 	virtual void recalculateTB(int mesh = -1);
 
+	virtual VertexCacheStats vertexCacheStats(int mesh = -1) const;
+	virtual void optimizeVertexCache(int mesh = -1);
+	virtual void optimizeVertexFetch(int mesh = -1);
+
+	virtual OverdrawStats overdrawStats(int mesh = -1) const;
+	virtual void optimizeOverdraw(float threshold = WMIT_OVERDRAW_DEFAULT_THRESHOLD, int mesh = -1);
+
+	virtual CompactErrorStats compactErrorStats(int mesh = -1) const;
+
+	// Levels of detail are not meshes of the model. buildLODs simplifies and optimizes one level
+	// per ratio and keeps them until the next build, later edits of the model don't reach them.
+	// saveModel writes each level as a model of its own (the game draws every pie level)
+	virtual void buildLODs(const std::vector<float>& ratios,
+			       const LODOptimizations& optimizations = LODOptimizations());
+	const std::vector<WZM>& lods() const {return m_lods;}
+	// Every mesh simplified to about ratio of its triangles, seams may keep it above that
+	WZM simplifiedModel(float ratio) const;
+	size_t triangles() const;
+
 	virtual WZMVertex calculateCenterPoint() const;
 protected:
 	virtual void clear();
+	void setupPieMesh(); // names the last mesh converted from a pie level
 
 	std::vector<Mesh> m_meshes;
 	std::map<wzm_texture_type_t, std::string> m_textures;
 	WZMaterial m_material;
 	std::map<int, std::string> m_events;
+	std::vector<WZM> m_lods;
 };
 
 #endif // WZM_HPP
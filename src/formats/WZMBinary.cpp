@@ -0,0 +1,63 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "WZMBinary.h"
+
+#include <cstring>
+
+bool wzmbHostSupported()
+{
+	const uint32_t one = 1;
+	unsigned char first;
+	std::memcpy(&first, &one, 1);
+	return first == 1;
+}
+
+bool isWZMB(const char* data, size_t size)
+{
+	return size >= sizeof(WZMBHeader) && std::memcmp(data, WZMB_SIGNATURE, 4) == 0;
+}
+
+void WZMBWriter::writeRaw(const void* data, size_t size)
+{
+	m_out.write(static_cast<const char*>(data), size);
+	m_offset += size;
+}
+
+WZMBBlock WZMBWriter::write(const void* data, size_t size)
+{
+	static const char padding[WZMB_ALIGNMENT] = {};
+	WZMBBlock block;
+
+	block.offset = align(m_offset);
+	writeRaw(padding, block.offset - m_offset);
+	block.size = size;
+	writeRaw(data, size);
+	return block;
+}
+
+const char* WZMBReader::block(const WZMBBlock& block, uint64_t size) const
+{
+	if (block.size != size || block.offset > m_size || block.size > m_size - block.offset
+		|| block.offset % WZMB_ALIGNMENT != 0)
+	{
+		return nullptr;
+	}
+	return m_data + block.offset;
+}
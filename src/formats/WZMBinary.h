@@ -0,0 +1,152 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WZMBINARY_HPP
+#define WZMBINARY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+#include <GL/glew.h>
+
+/*
+ * Binary WZM (.wzmb): the text format's contents as little endian arrays a
+ * loader copies straight into Mesh, or hands to GL from the memory map.
+ *
+ *   WZMBHeader
+ *   blocks, each starting at a multiple of WZMB_ALIGNMENT
+ *   WZMBMesh table, one entry per mesh
+ *   WZMBTrailer, locating the table
+ *
+ * The table follows the blocks so files are written in one pass.
+ *
+ * Packed meshes trade the mapping for size, see GeometryCodec.h. For
+ * packaging the application may deflate whole files on top, those
+ * start with WZMB_DEFLATED_SIGNATURE instead.
+ */
+
+#define WZMB_SIGNATURE "WZMB"
+#define WZMB_VERSION 1
+#define WZMB_ALIGNMENT 16
+#define WZMB_TEXTURES 4 // WZM_TEX__LAST
+#define WZMB_DEFLATED_SIGNATURE "WZMZ"
+
+/// Byte range of a block in the file, empty blocks have size 0
+struct WZMBBlock
+{
+	uint64_t offset, size;
+};
+
+struct WZMBHeader
+{
+	char signature[4];
+	uint32_t version;
+	uint32_t flags; // none defined yet, must be 0
+	uint32_t hasMaterial;
+	GLfloat material[13]; // emissive, ambient, diffuse and specular rgb, shininess
+	uint32_t reserved;
+	WZMBBlock textures[WZMB_TEXTURES]; // names by wzm_texture_type_t, empty if unset
+};
+static_assert(sizeof(WZMBHeader) == 136, "WZMBHeader layout changed.");
+
+enum WZMBVertexLayout
+{
+	WZMB_VERTICES_ARRAYS = 0, // positions, uvs, normals and tangents blocks of floats
+	WZMB_VERTICES_COMPACT_UNORM16, // one block of WZMCompactVertex
+	WZMB_VERTICES_COMPACT_HALF,
+	WZMB_VERTICES_PACKED // packed vertices in the compact block, packed triangles in the indices one
+};
+
+/// How meshes get written, the layout follows from it
+enum WZMBEncoding
+{
+	WZMB_ENCODING_FLOATS = 0,
+	WZMB_ENCODING_COMPACT, // the vertices wzm --compact writes
+	WZMB_ENCODING_PACKED
+};
+
+struct WZMBMesh
+{
+	WZMBBlock name;
+	uint32_t vertices, triangles;
+	uint32_t vertexLayout; // WZMBVertexLayout
+	uint32_t indexSize; // 2 or 4 bytes
+	uint32_t connectors, frames;
+	int32_t frameTime, frameCycles;
+	uint32_t teamColours;
+	GLfloat aabbMin[3], aabbMax[3], tspCenter[3];
+	WZMBBlock positions, uvs, normals, tangents; // 3, 2, 3 and 4 floats per vertex
+	WZMBBlock compact;
+	WZMBBlock indices; // 3 per triangle, of indexSize unless packed
+	WZMBBlock connectorArray; // 3 floats each
+	WZMBBlock frameArray; // translation, rotation and scale, 9 floats each
+};
+static_assert(sizeof(WZMBMesh) == 216, "WZMBMesh layout changed.");
+
+struct WZMBTrailer
+{
+	WZMBBlock table;
+	uint32_t meshes;
+	char signature[4];
+};
+static_assert(sizeof(WZMBTrailer) == 24, "WZMBTrailer layout changed.");
+
+/// The format is little endian, other hosts can't map it
+bool wzmbHostSupported();
+
+/// True if data starts like a .wzmb file
+bool isWZMB(const char* data, size_t size);
+
+// Writes blocks at aligned offsets and tells where they went
+class WZMBWriter
+{
+public:
+	explicit WZMBWriter(std::ostream& out): m_out(out), m_offset(0) {}
+
+	/// Writes size bytes unaligned, for the header, table and trailer
+	void writeRaw(const void* data, size_t size);
+	/// Pads to the next alignment and writes a block there
+	WZMBBlock write(const void* data, size_t size);
+
+	/// Where a block written at offset starts
+	static uint64_t align(uint64_t offset) {return (offset + WZMB_ALIGNMENT - 1) / WZMB_ALIGNMENT * WZMB_ALIGNMENT;}
+
+private:
+	std::ostream& m_out;
+	uint64_t m_offset;
+};
+
+// Checks blocks against the file they point into
+class WZMBReader
+{
+public:
+	WZMBReader(const char* data, size_t size): m_data(data), m_size(size) {}
+
+	/// Start of an aligned block inside the file of exactly size bytes, nullptr otherwise
+	const char* block(const WZMBBlock& block, uint64_t size) const;
+	/// Any size, for names
+	const char* block(const WZMBBlock& block) const {return this->block(block, block.size);}
+
+private:
+	const char* m_data;
+	size_t m_size;
+};
+
+#endif // WZMBINARY_HPP
@@ -23,10 +23,16 @@
 #include <QSettings>
 
 #include <fstream>
+#include <vector>
 
 #include "MainWindow.h"
+#include "Benchmarks.h"
 #include "WZM.h"
 #include "Pie.h"
+#include "MeshKernels.h"
+#include "AllocStats.h"
+#include "Parallel.h"
+#include "Util.h"
 #include "wmit.h"
 
 #if defined(Q_OS_WIN) && defined(QT_STATICPLUGIN)
@@ -34,6 +40,12 @@
 Q_IMPORT_PLUGIN(QWindowsIntegrationPlugin);
 #endif
 
+static void printAllocStats(const char* phase, const AllocStats& stats)
+{
+	printf("Allocations (%s): %zu allocations, %zu frees, %zu bytes\n", phase, stats.allocations, stats.frees,
+	       stats.bytes);
+}
+
 int main(int argc, char *argv[])
 {
     //QTextCodec::setCodecForCStrings(QTextCodec::codecForLocale());
@@ -44,19 +56,284 @@ int main(int argc, char *argv[])
 		printf("  WMIT (opens application)\n");
 		printf("  WMIT --help (shows this message)\n");
 		printf("  WMIT [filename] (opens a file)\n");
-		printf("  WMIT [input] [output] (converts between formats wzm, pie and obj)\n");
+		printf("  WMIT [input] [output] (converts between formats wzm, wzmb, pie, obj and glb)\n");
+		printf("  WMIT [options] [input] [output] (converts with processing options)\n");
+		printf("  WMIT --benchmark-kernels[=vertices] (times the bulk mesh kernels per instruction set,\n"
+		       "      on 1000000 vertices by default)\n");
+		printf("  WMIT --benchmark-compact[=vertices] (writes random vertices as a compact wzm, times reading\n"
+		       "      it back and fails if the errors exceed the bounds, 100000 vertices by default)\n");
+		printf("  WMIT --benchmark-pie [filename] (times reading a pie file copied from a stream\n"
+		       "      and memory mapped)\n");
+		printf("  WMIT --benchmark-wzm [filename] (times reading a wzm file copied from a stream,\n"
+		       "      memory mapped and as wzmb)\n");
+		printf("  WMIT --benchmark-stream [filename] (times uploading and drawing a wzm file from separate\n"
+		       "      vertex arrays and from the interleaved stream)\n");
+		printf("  WMIT --benchmark-weld [filename] (times welding the triangle corners of a wzm file with the\n"
+		       "      old epsilon set and with the hash welder, the old weld is quadratic)\n");
+		printf("  WMIT --benchmark-packing [filename...] (sizes and read times of wzm files as text, wzmb\n"
+		       "      and wzmb with packed meshes, plain and deflated)\n");
+		printf("\nOptions:\n");
+		printf("  --optimize-vcache (reorders triangles for the post-transform vertex cache)\n");
+		printf("  --optimize-overdraw[=threshold] (sorts triangle clusters front to back, allowing\n"
+		       "      the vertex cache ACMR to grow by threshold, %.2f by default)\n", WMIT_OVERDRAW_DEFAULT_THRESHOLD);
+		printf("  --optimize-vfetch (lays out vertices in the order triangles use them)\n");
+		printf("  --analyze-overdraw (reports overdraw from the 6 axis directions)\n");
+		printf("  --lods=ratio[,ratio...] (writes simplified models keeping about ratio of the triangles\n"
+		       "      next to the output as name_lod1.ext and on, seams limit how far flat shaded or\n"
+		       "      uv split models go; not pie levels, as the game draws every level of a pie)\n");
+		printf("  --compact (writes wzm and wzmb vertices with octahedral normals and tangents and 16-bit uvs,\n"
+		       "      wzm files become version 4)\n");
+		printf("  --compress (writes wzmb meshes packed, with 16-bit positions and delta coded vertices\n"
+		       "      and triangles, and deflates the file)\n");
+		printf("  --verify-compact (round trips the vertices through the compact encoding and\n"
+		       "      fails if the errors exceed the bounds)\n");
+		printf("  --alloc-stats (reports heap allocations while loading, processing and saving,\n"
+		       "      needs a build with WMIT_ALLOC_STATS)\n");
 		exit(0);
 	}
 
-	if (argc > 2)
+	if (argc == 2 && strncmp("--benchmark-kernels", argv[1], 19) == 0)
+	{
+		const size_t vertices = argv[1][19] == '=' ? strtoul(argv[1] + 20, NULL, 10) : 1000000;
+		const std::vector<KernelTiming> timings = benchmarkKernels(vertices);
+
+		bool identical = true;
+
+		printf("Kernels on %zu vertices, best of 5 runs (in use: %s)\n", vertices, kernelInstructionSet());
+		for (const KernelTiming& timing: timings)
+		{
+			printf("  %-14s %-8s %9.3f ms%s\n", timing.kernel.c_str(), timing.instructionSet.c_str(),
+			       timing.milliseconds, timing.identical ? "" : " (differs from scalar)");
+			identical = identical && timing.identical;
+		}
+		printf("Results %s\n", identical ? "identical" : "differ");
+		return identical ? 0 : 1;
+	}
+
+	if (argc == 2 && strncmp("--benchmark-compact", argv[1], 19) == 0)
+	{
+		const size_t vertices = argv[1][19] == '=' ? strtoul(argv[1] + 20, NULL, 10) : 100000;
+		const CompactRoundTrip result = benchmarkCompactRoundTrip(vertices);
+
+		if (!result.read)
+		{
+			fprintf(stderr, "The compact model didn't read back\n");
+			return 1;
+		}
+
+		const CompactErrorStats& errors = result.errors;
+		const bool passed = errors.withinBounds() && result.versionChecked;
+
+		printf("Compact round trip of %zu random vertices, best of 5 runs\n", result.vertices);
+		printf("  version 3 %9.2f MB %9.3f ms\n", result.megabytes, result.readMilliseconds);
+		printf("  compact   %9.2f MB %9.3f ms\n", result.compactMegabytes, result.compactReadMilliseconds);
+		printf("  errors: position %g, uv %g, normal %g deg, tangent %g deg, %zu handedness flips\n",
+		       errors.position, errors.uv, errors.normal, errors.tangent, errors.handedness);
+		printf("  compact vertices in a version 3 file %s\n", result.versionChecked ? "refused" : "accepted");
+		printf("Round trip %s\n", passed ? "within bounds" : "exceeds bounds");
+		return passed ? 0 : 1;
+	}
+
+	if (argc == 3 && strcmp("--benchmark-pie", argv[1]) == 0)
+	{
+		const PieReadTiming timing = benchmarkPieRead(argv[2]);
+
+		if (timing.version < 0)
+		{
+			printf("Could not read %s as a pie file\n", argv[2]);
+			return 1;
+		}
+
+		printf("PIE %d read, best of 5 runs (%u threads)\n", timing.version, parallelThreads());
+		printf("  %-10s %9.3f ms, std::ifstream copied into memory, then scanned\n", "copy+scan",
+		       timing.copyMilliseconds);
+		printf("  %-10s %9.3f ms\n", "mapped", timing.mappedMilliseconds);
+		printf("Results %s\n", timing.identical ? "identical" : "differ");
+		return timing.identical ? 0 : 1;
+	}
+
+	if (argc == 3 && strcmp("--benchmark-wzm", argv[1]) == 0)
+	{
+		const WZMReadTiming timing = benchmarkWZMRead(argv[2]);
+
+		if (!timing.read)
+		{
+			printf("Could not read %s as a wzm file\n", argv[2]);
+			return 1;
+		}
+
+		printf("WZM read of %.2f MB, best of 5 runs\n", timing.megabytes);
+		printf("  %-10s %9.3f ms %8.1f MB/s, std::ifstream copied into memory, then scanned\n", "copy+scan",
+		       timing.copyMilliseconds, timing.megabytes * 1000. / timing.copyMilliseconds);
+		printf("  %-10s %9.3f ms %8.1f MB/s\n", "mapped", timing.mappedMilliseconds,
+		       timing.megabytes * 1000. / timing.mappedMilliseconds);
+		printf("  %-10s %9.3f ms %8.1f MB/s, %.2f MB as wzmb, read from memory\n", "binary",
+		       timing.binaryMilliseconds, timing.binaryMegabytes * 1000. / timing.binaryMilliseconds,
+		       timing.binaryMegabytes);
+		printf("Results %s\n", timing.identical ? "identical" : "differ");
+		return timing.identical ? 0 : 1;
+	}
+
+	if (argc == 3 && strcmp("--benchmark-stream", argv[1]) == 0)
+	{
+		const WZMStreamTiming timing = benchmarkVertexStream(argv[2]);
+
+		if (!timing.read)
+		{
+			printf("Could not read %s as a wzm file\n", argv[2]);
+			return 1;
+		}
+
+		printf("Vertex layouts of %zu vertices and %zu triangles, best of 5 runs\n", timing.vertices, timing.triangles);
+		printf("  %-16s %9.3f ms\n", "build stream", timing.buildMilliseconds);
+		printf("  %-16s %9.3f ms (separate) %9.3f ms (stream)\n", "upload", timing.splitUploadMilliseconds,
+		       timing.streamUploadMilliseconds);
+		printf("  %-16s %9.3f ms (separate) %9.3f ms (stream)\n", "draw", timing.splitDrawMilliseconds,
+		       timing.streamDrawMilliseconds);
+		printf("  %-16s %9.3f ms (separate) %9.3f ms (stream)\n", "draw shuffled", timing.splitShuffledMilliseconds,
+		       timing.streamShuffledMilliseconds);
+		printf("Results %s\n", timing.identical ? "identical" : "differ");
+		return timing.identical ? 0 : 1;
+	}
+
+	if (argc == 3 && strcmp("--benchmark-weld", argv[1]) == 0)
+	{
+		const WZMWeldTiming timing = benchmarkWeld(argv[2]);
+
+		if (!timing.read)
+		{
+			printf("Could not read %s as a wzm file\n", argv[2]);
+			return 1;
+		}
+
+		printf("Weld of %zu triangle corners, best of 3 runs\n", timing.corners);
+		printf("  %-8s %9.3f ms %9zu points\n", "set", timing.setMilliseconds, timing.setPoints);
+		printf("  %-8s %9.3f ms %9zu points (%.1fx)\n", "hash", timing.hashMilliseconds, timing.hashPoints,
+		       timing.setMilliseconds / timing.hashMilliseconds);
+		return 0;
+	}
+
+	if (argc >= 3 && strcmp("--benchmark-packing", argv[1]) == 0)
+	{
+		bool allPacked = true;
+
+		printf("Packed wzmb, reads best of 5 runs, text memory mapped and wzmb from memory\n");
+		for (int i = 2; i < argc; ++i)
+		{
+			const WZMPackTiming timing = benchmarkWZMPacking(argv[i]);
+
+			if (!timing.read)
+			{
+				printf("Could not read %s as a wzm file\n", argv[i]);
+				allPacked = false;
+				continue;
+			}
+
+			const QByteArray deflated = deflateWZMB(timing.packed);
+			const double deflatedMegabytes = deflated.size() / (1024. * 1024.);
+			const double deflatedMilliseconds = bestMilliseconds(5, [&deflated]()
+			{
+				const QByteArray inflated = inflateWZMB(deflated.constData(), deflated.size());
+				WZM model;
+				model.readBinary(inflated.constData(), inflated.size());
+			});
+
+			// size, ratio to the text, read time, input read per second and speedup over the text
+			auto row = [&timing](const char* name, double megabytes, double milliseconds)
+			{
+				printf("  %-8s %8.2f MB %6.1fx %9.3f ms %8.1f MB/s (%.1fx)\n", name, megabytes,
+				       timing.megabytes / megabytes, milliseconds, megabytes * 1000. / milliseconds,
+				       timing.mappedMilliseconds / milliseconds);
+			};
+
+			printf("%s\n", argv[i]);
+			row("text", timing.megabytes, timing.mappedMilliseconds);
+			row("wzmb", timing.binaryMegabytes, timing.binaryMilliseconds);
+			row("packed", timing.packedMegabytes, timing.packedMilliseconds);
+			row("deflated", deflatedMegabytes, deflatedMilliseconds);
+			printf("  Triangles %s, largest position error %g\n", timing.trianglesIdentical ? "identical" : "differ",
+			       timing.positionError);
+			allPacked = allPacked && timing.trianglesIdentical;
+		}
+		return allPacked ? 0 : 1;
+	}
+
+	// Split processing options from file names
+	bool optimizeVCache = false;
+	bool optimizeVFetch = false;
+	bool optimizeOverdraw = false;
+	bool analyzeOverdraw = false;
+	float overdrawThreshold = WMIT_OVERDRAW_DEFAULT_THRESHOLD;
+	std::vector<float> lodRatios;
+	bool compactVertices = false;
+	bool compressBinary = false;
+	bool verifyCompact = false;
+	bool reportAllocs = false;
+	std::vector<const char*> files;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp("--optimize-vcache", argv[i]) == 0)
+			optimizeVCache = true;
+		else if (strcmp("--optimize-vfetch", argv[i]) == 0)
+			optimizeVFetch = true;
+		else if (strcmp("--optimize-overdraw", argv[i]) == 0)
+			optimizeOverdraw = true;
+		else if (strncmp("--optimize-overdraw=", argv[i], 20) == 0)
+		{
+			optimizeOverdraw = true;
+			overdrawThreshold = static_cast<float>(atof(argv[i] + 20));
+		}
+		else if (strcmp("--analyze-overdraw", argv[i]) == 0)
+			analyzeOverdraw = true;
+		else if (strcmp("--compact", argv[i]) == 0)
+			compactVertices = true;
+		else if (strcmp("--compress", argv[i]) == 0)
+			compressBinary = true;
+		else if (strcmp("--verify-compact", argv[i]) == 0)
+			verifyCompact = true;
+		else if (strcmp("--alloc-stats", argv[i]) == 0)
+			reportAllocs = true;
+		else if (strncmp("--lods=", argv[i], 7) == 0)
+		{
+			const char* ratios = argv[i] + 7;
+			char* end;
+
+			for (float ratio = strtof(ratios, &end); end != ratios; ratio = strtof(ratios, &end))
+			{
+				if (ratio > 0.f && ratio < 1.f)
+					lodRatios.push_back(ratio);
+				ratios = *end == ',' ? end + 1 : end;
+			}
+		}
+		else
+			files.push_back(argv[i]);
+	}
+
+	if (files.size() > 1)
 	{
 		// command line conversion mode
-		QString inname = argv[1];
+		if (reportAllocs && !allocStatsEnabled())
+		{
+			printf("Allocation counting is not compiled in, rebuild with WMIT_ALLOC_STATS\n");
+			reportAllocs = false;
+		}
+
+		AllocStats phaseStart = allocStats();
+		QString inname = files[0];
 
 		ModelInfo info;
 		WZM model;
 
-		info.m_saveAsFile = argv[2];
+		info.m_saveAsFile = files[1];
+		info.m_compactVertices = compactVertices;
+		info.m_compressBinary = compressBinary;
+
+		if (!MainWindow::guessModelTypeFromFilename(info.m_saveAsFile, info.m_save_type))
+		{
+			printf("Could not guess model type from output filename\n");
+			return 1;
+		}
 
 		if (!MainWindow::loadModel(inname, model, info, true))
 		{
@@ -66,11 +343,103 @@ int main(int argc, char *argv[])
 
 		info.defaultPieCapsIfNeeded();
 
+		if (reportAllocs)
+		{
+			printAllocStats("load", allocStats() - phaseStart);
+			phaseStart = allocStats();
+		}
+
+		// simplified from the model as loaded, with the optimizations below
+		if (!lodRatios.empty())
+		{
+			LODOptimizations optimizations;
+			optimizations.vertexCache = optimizeVCache;
+			optimizations.overdraw = optimizeOverdraw;
+			optimizations.overdrawThreshold = overdrawThreshold;
+			optimizations.vertexFetch = optimizeVFetch;
+			model.buildLODs(lodRatios, optimizations);
+		}
+
+		for (size_t lod = 0; lod < model.lods().size(); ++lod)
+		{
+			const size_t triangles = model.triangles(), reached = model.lods()[lod].triangles();
+			printf("LOD %zu: %zu of %zu triangles, ratio %.2f reached for %g\n", lod + 1, reached, triangles,
+			       triangles ? double(reached) / triangles : 0., lodRatios[lod]);
+		}
+
+		if (optimizeVCache)
+		{
+			const VertexCacheStats before = model.vertexCacheStats();
+			model.optimizeVertexCache();
+			const VertexCacheStats after = model.vertexCacheStats();
+
+			printf("Vertex cache (FIFO %d): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", WMIT_VCACHE_FIFO_SIZE,
+			       before.acmr(), after.acmr(), before.atvr(), after.atvr());
+		}
+
+		if (analyzeOverdraw)
+		{
+			printf("Overdraw: %.3f\n", model.overdrawStats().overdraw());
+		}
+
+		// clusters are cut from the cache optimized order
+		if (optimizeOverdraw)
+		{
+			const VertexCacheStats cacheBefore = model.vertexCacheStats();
+			const OverdrawStats before = model.overdrawStats();
+			model.optimizeOverdraw(overdrawThreshold);
+			const VertexCacheStats cacheAfter = model.vertexCacheStats();
+			const OverdrawStats after = model.overdrawStats();
+
+			printf("Overdraw: %.3f -> %.3f, ACMR %.3f -> %.3f\n", before.overdraw(), after.overdraw(),
+			       cacheBefore.acmr(), cacheAfter.acmr());
+		}
+
+		// after triangle reordering, as it follows the final index order
+		if (optimizeVFetch)
+		{
+			model.optimizeVertexFetch();
+		}
+
+		if (verifyCompact)
+		{
+			CompactErrorStats stats = model.compactErrorStats();
+			for (const WZM& lod: model.lods())
+				stats += lod.compactErrorStats();
+
+			printf("Compact vertices: %zu bytes -> %zu bytes\n", stats.vertices * sizeof(WZMPackedVertex),
+			       stats.vertices * sizeof(WZMCompactVertex));
+			printf("  position error %g, uv error %g%s (bound %g)\n", stats.position, stats.uv,
+			       stats.halfUVs ? " relative" : "",
+			       stats.halfUVs ? WMIT_COMPACT_MAX_UV_ERROR_HALF : WMIT_COMPACT_MAX_UV_ERROR_UNORM16);
+			printf("  normal error %.5f deg (bound %g), tangent error %.5f deg (bound %g), handedness changes %zu\n",
+			       stats.normal, WMIT_COMPACT_MAX_NORMAL_ERROR_DEG, stats.tangent, WMIT_COMPACT_MAX_TANGENT_ERROR_DEG,
+			       stats.handedness);
+
+			if (!stats.withinBounds())
+			{
+				printf("Compact encoding exceeds its error bounds\n");
+				return 1;
+			}
+		}
+
+		if (reportAllocs)
+		{
+			printAllocStats("processing", allocStats() - phaseStart);
+			phaseStart = allocStats();
+		}
+
+		// the levels are saved with the model
 		if(!MainWindow::saveModel(model, info))
 		{
 			printf("Could not save model\n");
 			return 1;
 		}
+
+		if (reportAllocs)
+		{
+			printAllocStats("save", allocStats() - phaseStart);
+		}
 	}
 	else
 	{
@@ -84,9 +453,9 @@ int main(int argc, char *argv[])
 		MainWindow w(model);
 		w.show();
 
-		if (argc == 2)
+		if (files.size() == 1)
 		{
-			QString inname = argv[1];
+			QString inname = files[0];
 			w.openFile(inname);
 		}
 
@@ -29,6 +29,8 @@
 #include "LightColorDock.h"
 
 #include <fstream>
+#include <sstream>
+#include <utility>
 
 #include <QFileInfo>
 #include <QFileDialog>
@@ -42,6 +44,8 @@
 #include <QVariant>
 
 #include "Pie.h"
+#include "MappedFile.h"
+#include "Util.h"
 #include "WZLight.h"
 
 QString MainWindow::buildAppTitle()
@@ -137,6 +141,7 @@ MainWindow::MainWindow(QWZM &model, QWidget *parent) : QMainWindow(parent),
 	connect(m_ui->actionAppendModel, SIGNAL(triggered()), this, SLOT(actionAppendModel()));
 	connect(m_ui->actionImport_Animation, SIGNAL(triggered()), this, SLOT(actionImport_Animation()));
 	connect(m_ui->actionImport_Connectors, SIGNAL(triggered()), this, SLOT(actionImport_Connectors()));
+	connect(m_ui->actionGenerateLODs, SIGNAL(triggered()), this, SLOT(actionGenerateLODs()));
 	connect(m_ui->actionShowAxes, SIGNAL(toggled(bool)), m_ui->centralWidget, SLOT(setAxisIsDrawn(bool)));
 	connect(m_ui->actionShowGrid, SIGNAL(toggled(bool)), m_ui->centralWidget, SLOT(setGridIsDrawn(bool)));
 	connect(m_ui->actionShowLightSource, SIGNAL(toggled(bool)), m_ui->centralWidget, SLOT(setDrawLightSource(bool)));
@@ -212,6 +217,7 @@ void MainWindow::doAfterModelWasLoaded(const bool success)
 	m_ui->actionSetupTextures->setEnabled(success);
 	m_ui->actionAppendModel->setEnabled(success);
 	m_ui->actionImport_Animation->setEnabled(success);
+	m_ui->actionGenerateLODs->setEnabled(success);
 
 	// Disallow mirroring as it will mess-up animation
 	m_transformDock->setMirrorState(success && !hasAnim);
@@ -235,7 +241,7 @@ bool MainWindow::openFile(const QString &filePath)
 
 		m_modelinfo = tmpinfo;
 		m_modelinfo.m_currentFile = modelFileNfo.absoluteFilePath();
-		*m_model = tmpmodel;
+		*m_model = std::move(tmpmodel);
 
 		setWindowTitle(buildAppTitle());
 
@@ -261,10 +267,18 @@ bool MainWindow::guessModelTypeFromFilename(const QString& fname, wmit_filetype_
 	{
 		type = WMIT_FT_WZM;
 	}
+	else if (ext.compare(QString("wzmb"), Qt::CaseInsensitive) == 0)
+	{
+		type = WMIT_FT_WZMB;
+	}
 	else if (ext.compare(QString("obj"), Qt::CaseInsensitive) == 0)
 	{
 		type = WMIT_FT_OBJ;
 	}
+	else if (ext.compare(QString("glb"), Qt::CaseInsensitive) == 0)
+	{
+		type = WMIT_FT_GLB;
+	}
 	else if (ext.compare(QString("pie"), Qt::CaseInsensitive) == 0)
 	{
 		type = WMIT_FT_PIE;
@@ -280,35 +294,59 @@ bool MainWindow::guessModelTypeFromFilename(const QString& fname, wmit_filetype_
 bool MainWindow::saveModel(const WZM &model, const ModelInfo &info)
 {
 	std::ofstream out;
-	out.open(info.m_saveAsFile.toLocal8Bit().constData());
+	out.open(info.m_saveAsFile.toLocal8Bit().constData(),
+		 info.m_save_type == WMIT_FT_WZMB || info.m_save_type == WMIT_FT_GLB ? std::ios::out | std::ios::binary : std::ios::out);
 
 	switch (info.m_save_type)
 	{
 	case WMIT_FT_WZM:
-		model.write(out);
+		model.write(out, info.m_compactVertices);
 		break;
-	case WMIT_FT_OBJ:
-		model.exportToOBJ(out);
-		break;
-	default:
-		Pie3Model p3 = model;
-
-		if (info.m_save_type == WMIT_FT_PIE2)
+	case WMIT_FT_WZMB:
+		if (info.m_compressBinary)
 		{
-			Pie2Model p2 = p3;
-			p2.write(out, &info.m_pieCaps);
+			std::ostringstream packed;
+			model.writeBinary(packed, WZMB_ENCODING_PACKED);
+			const QByteArray deflated = deflateWZMB(packed.str());
+			out.write(deflated.constData(), deflated.size());
 		}
 		else
 		{
-			p3.write(out, &info.m_pieCaps);
+			model.writeBinary(out, info.m_compactVertices ? WZMB_ENCODING_COMPACT : WZMB_ENCODING_FLOATS);
 		}
+		break;
+	case WMIT_FT_OBJ:
+		model.exportToOBJ(out);
+		break;
+	case WMIT_FT_GLB:
+		model.exportToGLTF(out);
+		break;
+	default:
+		model.exportToPIE(out, info.m_save_type == WMIT_FT_PIE2 ? 2 : 3, &info.m_pieCaps);
 	}
 
 	out.close();
 
+	// Levels of detail go to files of their own, the levels have none
+	for (size_t lod = 0; lod < model.lods().size(); ++lod)
+	{
+		ModelInfo lodInfo(info);
+		lodInfo.m_saveAsFile = lodFileName(info.m_saveAsFile, lod + 1);
+		if (!saveModel(model.lods()[lod], lodInfo))
+			return false;
+	}
+
 	return true;
 }
 
+QString MainWindow::lodFileName(const QString &file, size_t level)
+{
+	const int dot = file.lastIndexOf('.');
+	const QString suffix = dot > file.lastIndexOf('/') && dot > file.lastIndexOf('\\') ? file.mid(dot) : QString();
+
+	return file.left(file.size() - suffix.size()) + QString("_lod%1").arg(level) + suffix;
+}
+
 void MainWindow::changeEvent(QEvent *event)
 {
 	QMainWindow::changeEvent(event);
@@ -355,23 +393,37 @@ bool MainWindow::loadModel(const QString& file, WZM& model, ModelInfo &info, boo
 
 	if (!guessModelTypeFromFilename(file, type))
 	{
-		printf("Could not guess model type from filename. Only formats PIE, WZM, and OBJ are supported.\n");
+		printf("Could not guess model type from filename. Only formats PIE, WZM, WZMB, OBJ and GLB are supported.\n");
 		return false;
 	}
 
 	info.m_read_type = type;
 
 	bool read_success = false;
-	std::ifstream f;
+	MappedFile mapped;
 	ImportDialog* importDialog = nullptr;
 	QSettings* settings = nullptr;
 
-	f.open(file.toLocal8Bit(), std::ios::in | std::ios::binary);
+	if (!mapped.open(file.toLocal8Bit()))
+	{
+		return false;
+	}
 
 	switch (type)
 	{
 	case WMIT_FT_WZM:
-		read_success = model.read(f);
+		read_success = model.read(mapped.data(), mapped.size());
+		break;
+	case WMIT_FT_WZMB:
+		if (isDeflatedWZMB(mapped.data(), mapped.size()))
+		{
+			const QByteArray inflated = inflateWZMB(mapped.data(), mapped.size());
+			read_success = model.readBinary(inflated.constData(), inflated.size());
+		}
+		else
+		{
+			read_success = model.readBinary(mapped.data(), mapped.size());
+		}
 		break;
 	case WMIT_FT_OBJ:
 		if (!nogui)
@@ -389,36 +441,38 @@ bool MainWindow::loadModel(const QString& file, WZM& model, ModelInfo &info, boo
 
 		settings = new QSettings();
 
-		read_success = model.importFromOBJ(f, settings->value(WMIT_SETTINGS_IMPORT_WELDER, true).toBool());
+		read_success = model.importFromOBJ(mapped.data(), mapped.size(),
+						   settings->value(WMIT_SETTINGS_IMPORT_WELDER, true).toBool());
+		break;
+	case WMIT_FT_GLB:
+		read_success = model.importFromGLTF(mapped.data(), mapped.size());
 		break;
 	case WMIT_FT_PIE:
 	case WMIT_FT_PIE2:
-		int pieversion = pieVersion(f);
+		int pieversion = pieVersion(mapped.data(), mapped.size());
 		if (pieversion <= 2)
 		{
 			Pie2Model p2;
-			read_success = p2.read(f);
+			read_success = p2.read(mapped.data(), mapped.size());
 			if (read_success)
 			{
 				Pie3Model p3(p2);
 				info.m_pieCaps = p3.getCaps();
-				model = WZM(p3);
+				model = WZM(std::move(p3));
 			}
 		}
 		else // 3 or higher
 		{
 			Pie3Model p3;
-			read_success = p3.read(f);
+			read_success = p3.read(mapped.data(), mapped.size());
 			if (read_success)
 			{
 				info.m_pieCaps = p3.getCaps();
-				model = WZM(p3);
+				model = WZM(std::move(p3));
 			}
 		}
 	}
 
-	f.close();
-
 	if (importDialog)
 		delete importDialog;
 	if (settings)
@@ -466,10 +520,12 @@ void MainWindow::actionOpen()
 	QFileDialog* fileDialog = new QFileDialog(this,
 						  tr("Select File to open"),
 						  m_pathImport,
-						  tr("All Compatible (*.wzm *.pie *.obj);;"
+						  tr("All Compatible (*.wzm *.wzmb *.pie *.obj *.glb);;"
 						     "WZM models (*.wzm);;"
+						     "Binary WZM models (*.wzmb);;"
 						     "PIE models (*.pie);;"
-						     "OBJ files (*.obj)"));
+						     "OBJ files (*.obj);;"
+						     "glTF binary files (*.glb)"));
 	fileDialog->setFileMode(QFileDialog::ExistingFile);
 	fileDialog->exec();
 
@@ -555,10 +611,11 @@ void MainWindow::actionSaveAs()
 	ModelInfo tmpModelinfo(m_modelinfo);
 
 	QStringList filters;
-	filters << "PIE3 models (*.pie)" << "PIE2 models (*.pie)" << "WZM models (*.wzm)" << "OBJ files (*.obj)";
+	filters << "PIE3 models (*.pie)" << "PIE2 models (*.pie)" << "WZM models (*.wzm)" << "OBJ files (*.obj)"
+		<< "Binary WZM models (*.wzmb)" << "glTF binary files (*.glb)";
 
 	QList<wmit_filetype_t> types;
-	types << WMIT_FT_PIE << WMIT_FT_PIE2 << WMIT_FT_WZM << WMIT_FT_OBJ;
+	types << WMIT_FT_PIE << WMIT_FT_PIE2 << WMIT_FT_WZM << WMIT_FT_OBJ << WMIT_FT_WZMB << WMIT_FT_GLB;
 
 	QFileDialog* fDialog = new QFileDialog();
 
@@ -612,6 +669,14 @@ void MainWindow::actionSaveAs()
 		if (finfo.suffix().toLower() != "wzm")
 			tmpModelinfo.m_saveAsFile += ".wzm";
 		break;
+	case WMIT_FT_WZMB:
+		if (finfo.suffix().toLower() != "wzmb")
+			tmpModelinfo.m_saveAsFile += ".wzmb";
+		break;
+	case WMIT_FT_GLB:
+		if (finfo.suffix().toLower() != "glb")
+			tmpModelinfo.m_saveAsFile += ".glb";
+		break;
 	}
 
 	if (dlg && dlg->result() != QDialog::Accepted)
@@ -965,10 +1030,12 @@ void MainWindow::actionAppendModel()
 	QFileDialog* fileDialog = new QFileDialog(this,
 						  tr("Select file to append"),
 						  m_pathImport,
-						  tr("All Compatible (*.wzm *.pie *.obj);;"
+						  tr("All Compatible (*.wzm *.wzmb *.pie *.obj *.glb);;"
 						     "WZM models (*.wzm);;"
+						     "Binary WZM models (*.wzmb);;"
 						     "PIE models (*.pie);;"
-						     "OBJ files (*.obj)"));
+						     "OBJ files (*.obj);;"
+						     "glTF binary files (*.glb)"));
 	fileDialog->setFileMode(QFileDialog::ExistingFile);
 	fileDialog->exec();
 
@@ -1105,6 +1172,62 @@ void MainWindow::actionImport_Connectors()
 	m_modelinfo.m_pieCaps.set(PIE_OPT_DIRECTIVES::podCONNECTORS);
 }
 
+void MainWindow::actionGenerateLODs()
+{
+	if (m_model->meshes() == 0)
+		return;
+
+	bool ok;
+	QString text = QInputDialog::getText(this, tr("Generate LOD levels"),
+					     tr("Triangle ratio of each new level, separated by commas:"),
+					     QLineEdit::Normal, "0.5,0.25", &ok);
+	if (!ok)
+		return;
+
+	std::vector<float> ratios;
+	for (const QString& part: text.split(','))
+	{
+		if (part.trimmed().isEmpty())
+			continue;
+
+		bool isNumber;
+		float ratio = part.trimmed().toFloat(&isNumber);
+
+		if (!isNumber || ratio <= 0.f || ratio >= 1.f)
+		{
+			QMessageBox::warning(this, tr("Generate LOD levels"),
+					     tr("\"%1\" is not a ratio between 0 and 1.").arg(part.trimmed()));
+			return;
+		}
+		ratios.push_back(ratio);
+	}
+
+	if (ratios.empty())
+		return;
+
+	// Freshly simplified triangles come in no useful order, the lossless reorderings fix that
+	LODOptimizations optimizations;
+	optimizations.vertexCache = true;
+	optimizations.vertexFetch = true;
+	m_model->buildLODs(ratios, optimizations);
+
+	// The simplifier keeps seams and borders, so report the ratio it actually reaches
+	const size_t triangles = m_model->triangles();
+	QString report;
+	for (size_t lod = 0; lod < m_model->lods().size(); ++lod)
+	{
+		const size_t reached = m_model->lods()[lod].triangles();
+		report += tr("Level %1: %2 of %3 triangles, ratio %4 reached for %5\n")
+			  .arg(lod + 1).arg(reached).arg(triangles)
+			  .arg(triangles ? double(reached) / triangles : 0., 0, 'f', 2).arg(ratios[lod]);
+	}
+
+	QMessageBox::information(this, tr("Generate LOD levels"), report +
+				 tr("\nThe levels are saved next to the model with _lod1, _lod2 and so on after the file name. "
+				    "They are not added as pie levels, the game draws every level of a pie. "
+				    "Later edits of the model don't reach them, generate them again after editing."));
+}
+
 void MainWindow::actionLocateUserShaders()
 {
     QString vert_path = QFileDialog::getOpenFileName(this, "Locate vertex shader",
@@ -59,10 +59,14 @@ struct ModelInfo
 	wmit_filetype_t m_read_type;
 	QString m_currentFile;
 	QString m_saveAsFile;
+	bool m_compactVertices; // wzm and wzmb only
+	bool m_compressBinary; // wzmb only, packed meshes in a deflated file
 
 	void clear()
 	{
 		m_save_type = m_read_type = WMIT_FT_WZM;
+		m_compactVertices = false;
+		m_compressBinary = false;
 		m_pieCaps.reset();
 		m_currentFile.clear();
 		m_saveAsFile.clear();
@@ -98,6 +102,7 @@ public:
 	static bool loadModel(const QString& file, WZM& model, ModelInfo &info, bool nogui = false);
 	static bool guessModelTypeFromFilename(const QString &fname, wmit_filetype_t &type);
 	static bool saveModel(const WZM& model, const ModelInfo &info);
+	static QString lodFileName(const QString &file, size_t level); // model_lod1.pie for level 1 of model.pie
 
 	void PrependFileToRecentList(const QString &filename);
 
@@ -121,6 +126,7 @@ private slots:
 	void actionEnableUserShaders(bool checked);
 	void actionImport_Animation();
 	void actionImport_Connectors();
+	void actionGenerateLODs();
 
 	void updateRecentFilesMenu();
 	void updateModelRender();
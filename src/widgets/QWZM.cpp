@@ -23,6 +23,8 @@
 #include "QtGLView.h"
 #include "WZLight.h"
 
+#include <utility>
+
 static const char vertexAtributeName[] = "vertex";
 static const char vertexNormalAtributeName[] = "vertexNormal";
 static const char vertexTexCoordAtributeName[] = "vertexTexCoord";
@@ -120,6 +122,8 @@ void QWZM::render(const float* mtxModelView, const float* mtxProj, const float*
 	for (size_t i = 0; i < m_meshes.size(); ++i)
 	{
 		const Mesh& msh = m_meshes.at(i);
+		const std::vector<WZMPackedVertex>& stream = msh.vertexStream();
+		const int stride = static_cast<int>(sizeof(WZMPackedVertex));
 
 		glColor3f(1.f, 1.f, 1.f);
 
@@ -176,10 +180,10 @@ void QWZM::render(const float* mtxModelView, const float* mtxProj, const float*
 					shader->enableAttributeArray(vertexTexCoordAtributeName);
 					shader->enableAttributeArray(vertexTangentAtributeName);
 
-					shader->setAttributeArray(vertexAtributeName, msh.m_vertexArray[0], 3);
-					shader->setAttributeArray(vertexTexCoordAtributeName, msh.m_textureArray[0], 2);
-					shader->setAttributeArray(vertexNormalAtributeName, msh.m_normalArray[0], 3);
-					shader->setAttributeArray(vertexTangentAtributeName, msh.m_tangentArray[0], 4);
+					shader->setAttributeArray(vertexAtributeName, stream[0].pos, 3, stride);
+					shader->setAttributeArray(vertexTexCoordAtributeName, stream[0].uv, 2, stride);
+					shader->setAttributeArray(vertexNormalAtributeName, stream[0].normal, 3, stride);
+					shader->setAttributeArray(vertexTangentAtributeName, stream[0].tangent, 4, stride);
 				}
 			}
 		}
@@ -190,16 +194,11 @@ void QWZM::render(const float* mtxModelView, const float* mtxProj, const float*
 		glMaterialfv(GL_FRONT, GL_SPECULAR, m_material.vals[WZM_MAT_SPECULAR]);
 		glMaterialf(GL_FRONT, GL_SHININESS, m_material.shininess);
 
-		static_assert(sizeof(WZMUV) == sizeof(GLfloat)*2, "WZMUV has become fat.");
-		glTexCoordPointer(2, GL_FLOAT, 0, &msh.m_textureArray[0]);
-
-		glNormalPointer(GL_FLOAT, 0, &msh.m_normalArray[0]);
-
-		static_assert(sizeof(WZMVertex) == sizeof(GLfloat)*3, "WZMVertex has become fat.");
-		glVertexPointer(3, GL_FLOAT, 0, &msh.m_vertexArray[0]);
+		glTexCoordPointer(2, GL_FLOAT, stride, stream[0].uv);
+		glNormalPointer(GL_FLOAT, stride, stream[0].normal);
+		glVertexPointer(3, GL_FLOAT, stride, stream[0].pos);
 
-		static_assert(sizeof(IndexedTri) == sizeof(GLushort)*3, "IndexedTri has become fat.");
-		glDrawElements(GL_TRIANGLES, static_cast<int>(msh.m_indexArray.size()) * 3, GL_UNSIGNED_SHORT, &msh.m_indexArray[0]);
+		glDrawElements(GL_TRIANGLES, static_cast<int>(msh.m_indexArray.size()) * 3, msh.m_indexArray.glType(), msh.m_indexArray.data());
 
 		if (!isFixedPipelineRenderer())
 		{
@@ -320,6 +319,7 @@ void QWZM::drawNormals(size_t mesh_idx, bool draw_tb)
 	qglviewer::Vec from, to;
 
 	const Mesh& msh = m_meshes.at(mesh_idx);
+	msh.ensureTangents();
 	for (size_t j = 0; j < msh.m_vertexArray.size(); ++j)
 	{
 		nrm = msh.m_normalArray[j].normalize() * 2. / scale_all;
@@ -339,7 +339,7 @@ void QWZM::drawNormals(size_t mesh_idx, bool draw_tb)
 			to = qglviewer::Vec(from + qglviewer::Vec(tb.x(), tb.y(), tb.z()));
 			QGLViewer::drawArrow(from, to);
 
-			tb = msh.m_bitangentArray[j].normalize() * 2. / scale_all;
+			tb = msh.getBitangent(j).normalize() * 2. / scale_all;
 
 			glColor3f(0.7f, 0.7f, 1.0f);
 			to = qglviewer::Vec(from + qglviewer::Vec(tb.x(), tb.y(), tb.z()));
@@ -840,7 +840,7 @@ void QWZM::applyTransformations()
 	if (!m_pending_changes)
 		return;
 
-	scale(scale_all * scale_xyz[0], scale_all * scale_xyz[1], scale_all * scale_xyz[2], m_active_mesh);
+	applyAffine(pendingTransform(), m_active_mesh);
 
 	// reset values
 	resetAllPendingChanges();
@@ -851,12 +851,9 @@ void QWZM::setActiveMesh(int mesh)
 	m_active_mesh = mesh;
 }
 
-void QWZM::applyPendingChangesToModel(WZM &model) const
+WZMMatrix4 QWZM::pendingTransform() const
 {
-	if (m_pending_changes)
-	{
-		model.scale(scale_all * scale_xyz[0], scale_all * scale_xyz[1], scale_all * scale_xyz[2], m_active_mesh);
-	}
+	return WZMMatrix4::scaling(scale_all * scale_xyz[0], scale_all * scale_xyz[1], scale_all * scale_xyz[2]);
 }
 
 void QWZM::resetAllPendingChanges()
@@ -894,6 +891,13 @@ void QWZM::operator=(const WZM& wzm)
 	meshCountChanged(meshes(), getMeshNames());
 }
 
+void QWZM::operator=(WZM&& wzm)
+{
+	clear();
+	WZM::operator=(std::move(wzm));
+	meshCountChanged(meshes(), getMeshNames());
+}
+
 void QWZM::addMesh(const Mesh& mesh)
 {
 	WZM::addMesh(mesh);
@@ -916,9 +920,9 @@ void QWZM::slotRemoveActiveMesh()
 	meshCountChanged(meshes(), getMeshNames());
 }
 
-bool QWZM::importFromOBJ(std::istream& in, bool welder)
+bool QWZM::importFromOBJ(std::istream& in, bool welder, const WeldTolerances& tolerances)
 {
-	if (WZM::importFromOBJ(in, welder))
+	if (WZM::importFromOBJ(in, welder, tolerances))
 	{
 		meshCountChanged(meshes(), getMeshNames());
 		return true;
@@ -928,44 +932,68 @@ bool QWZM::importFromOBJ(std::istream& in, bool welder)
 	return false;
 }
 
-// apply any pending transformations to temp object on export
+// pending transformations are applied on the fly while exporting
 
 QWZM::operator Pie3Model() const
 {
 	if (m_pending_changes)
-	{
-		WZM res = *this;
-		applyPendingChangesToModel(res);
-		return Pie3Model(res);
-	}
+		return toPie3Model(pendingTransform(), m_active_mesh);
 
 	return WZM::operator Pie3Model();
 }
 
-void QWZM::write(std::ostream& out) const
+void QWZM::write(std::ostream& out, bool compactVertices) const
 {
 	if (m_pending_changes)
-	{
-		WZM res = *this;
-		applyPendingChangesToModel(res);
-		res.write(out);
-	}
+		WZM::write(out, compactVertices, pendingTransform(), m_active_mesh);
 	else
-	{
-		WZM::write(out);
-	}
+		WZM::write(out, compactVertices);
+}
+
+void QWZM::writeBinary(std::ostream& out, WZMBEncoding encoding) const
+{
+	if (m_pending_changes)
+		WZM::writeBinary(out, encoding, pendingTransform(), m_active_mesh);
+	else
+		WZM::writeBinary(out, encoding);
 }
 
 void QWZM::exportToOBJ(std::ostream& out) const
 {
 	if (m_pending_changes)
-	{
-		WZM res = *this;
-		applyPendingChangesToModel(res);
-		res.exportToOBJ(out);
-	}
+		WZM::exportToOBJ(out, pendingTransform(), m_active_mesh);
 	else
-	{
 		WZM::exportToOBJ(out);
+}
+
+void QWZM::exportToGLTF(std::ostream& out) const
+{
+	if (m_pending_changes)
+		WZM::exportToGLTF(out, pendingTransform(), m_active_mesh);
+	else
+		WZM::exportToGLTF(out);
+}
+
+void QWZM::buildLODs(const std::vector<float>& ratios, const LODOptimizations& optimizations)
+{
+	if (!m_pending_changes)
+	{
+		WZM::buildLODs(ratios, optimizations);
+		return;
 	}
+
+	// Pending transformations go into the levels like into the model on export
+	m_lods.clear();
+	WZM transformed(*this);
+	transformed.applyAffine(pendingTransform(), m_active_mesh);
+	transformed.buildLODs(ratios, optimizations);
+	m_lods = transformed.lods();
+}
+
+void QWZM::exportToPIE(std::ostream& out, int pieVersion, const PieCaps* piecaps) const
+{
+	if (m_pending_changes)
+		WZM::exportToPIE(out, pieVersion, piecaps, pendingTransform(), m_active_mesh);
+	else
+		WZM::exportToPIE(out, pieVersion, piecaps);
 }
@@ -62,6 +62,7 @@ public:
 	virtual ~QWZM();
 
 	void operator=(const WZM& wzm);
+	void operator=(WZM&& wzm);
 
 	void clear();
 	QStringList getMeshNames() const;
@@ -121,10 +122,16 @@ public:
 
 	/// WZM
 	virtual operator Pie3Model() const;
-	void write(std::ostream& out) const;
+	void write(std::ostream& out, bool compactVertices = false) const;
+	void writeBinary(std::ostream& out, WZMBEncoding encoding = WZMB_ENCODING_FLOATS) const;
 
-	bool importFromOBJ(std::istream& in, bool welder);
+	bool importFromOBJ(std::istream& in, bool welder,
+			   const WeldTolerances& tolerances = WeldTolerances());
 	void exportToOBJ(std::ostream& out) const;
+	void exportToGLTF(std::ostream& out) const;
+	void exportToPIE(std::ostream& out, int pieVersion = 3, const PieCaps* piecaps = nullptr) const;
+	void buildLODs(const std::vector<float>& ratios,
+		       const LODOptimizations& optimizations = LODOptimizations());
 
 	void addMesh (const Mesh& mesh);
 
@@ -141,7 +148,7 @@ private:
 	bool setupTextureUnits(int type);
 	void clearTextureUnits(int type);
 
-	void applyPendingChangesToModel(WZM& model) const;
+	WZMMatrix4 pendingTransform() const; // all pending edits composed
 	void resetAllPendingChanges();
 
 	std::map<wzm_texture_type_t, GLuint> m_gl_textures;
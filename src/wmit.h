@@ -23,4 +23,4 @@
 
 #define WMIT_IMAGES_NOTEXTURE ":/data/images/notex.png"
 
-enum wmit_filetype_t { WMIT_FT_PIE = 0, WMIT_FT_PIE2, WMIT_FT_WZM, WMIT_FT_OBJ };
+enum wmit_filetype_t { WMIT_FT_PIE = 0, WMIT_FT_PIE2, WMIT_FT_WZM, WMIT_FT_OBJ, WMIT_FT_WZMB, WMIT_FT_GLB };
@@ -5,9 +5,9 @@ QT = core gui opengl xml
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
-CONFIG += c++11
+CONFIG += c++11 thread
 
-INCLUDEPATH += src src/basic src/formats src/ui src/widgets 3rdparty/GLEW/include
+INCLUDEPATH += src src/basic src/bench src/formats src/ui src/widgets 3rdparty/GLEW/include
 
 HEADERS += \
     3rdparty/GLEW/include/GL/glew.h \
@@ -24,21 +24,39 @@ HEADERS += \
     src/ui/TexConfigDialog.h \
     src/ui/TransformDock.h \
     src/ui/UVEditor.h \
+    src/formats/GeometryCodec.h \
+    src/formats/GLTF.h \
     src/formats/Mesh.h \
+    src/formats/MeshKernels.h \
+    src/formats/MeshOptimizer.h \
+    src/formats/MeshSimplifier.h \
     src/formats/OBJ.h \
     src/formats/Pie.h \
     src/formats/Pie_t.hpp \
+    src/formats/VertexCodec.h \
+    src/formats/VertexWelder.h \
     src/formats/WZM.h \
+    src/formats/WZMBinary.h \
+    src/basic/AllocStats.h \
     src/basic/GLTexture.h \
     src/basic/IAnimatable.h \
     src/basic/IGLRenderable.h \
     src/basic/IGLTexturedRenderable.h \
     src/basic/IGLTextureManager.h \
+    src/basic/IndexArray.h \
+    src/basic/Json.h \
+    src/basic/MappedFile.h \
+    src/basic/Matrix.h \
+    src/basic/Parallel.h \
     src/basic/Polygon.h \
     src/basic/Polygon_t.hpp \
+    src/basic/TextScanner.h \
+    src/basic/TextWriter.h \
     src/basic/Vector.h \
     src/basic/VectorTypes.h \
+    src/basic/VectorTypesIO.h \
     src/basic/WZLight.h \
+    src/bench/Benchmarks.h \
     src/widgets/QWZM.h \
     src/ui/MaterialDock.h \
     src/ui/LightColorWidget.h \
@@ -48,8 +66,17 @@ HEADERS += \
 SOURCES += \
     3rdparty/GLEW/src/glew.c \
     src/formats/WZM.cpp \
+    src/formats/GeometryCodec.cpp \
+    src/formats/GLTF.cpp \
     src/formats/Pie.cpp \
     src/formats/Mesh.cpp \
+    src/formats/MeshKernels.cpp \
+    src/formats/MeshOptimizer.cpp \
+    src/formats/MeshSimplifier.cpp \
+    src/formats/OBJ.cpp \
+    src/formats/VertexCodec.cpp \
+    src/formats/VertexWelder.cpp \
+    src/formats/WZMBinary.cpp \
     src/ui/UVEditor.cpp \
     src/ui/TransformDock.cpp \
     src/ui/MainWindow.cpp \
@@ -58,8 +85,13 @@ SOURCES += \
     src/Util.cpp \
     src/main.cpp \
     src/Generic.cpp \
+    src/basic/AllocStats.cpp \
     src/basic/GLTexture.cpp \
+    src/basic/Json.cpp \
+    src/basic/MappedFile.cpp \
+    src/basic/TextWriter.cpp \
     src/basic/WZLight.cpp \
+    src/bench/Benchmarks.cpp \
     src/widgets/QWZM.cpp \
     src/widgets/QtGLView.cpp \
     src/ui/TextureDialog.cpp \
@@ -100,6 +132,10 @@ win32 {
 }
 
 DEFINES += GLEW_STATIC
+# Counts heap allocations, reported by --alloc-stats
+#DEFINES += WMIT_ALLOC_STATS
+# Builds the untested NEON mesh kernels on ARM
+#DEFINES += WMIT_NEON_KERNELS
     
 LIBS += -lm
 !win32 {